@@ -1,26 +1,31 @@
 #ifndef COMMSLIB_CLIENT_HPP
 #define COMMSLIB_CLIENT_HPP
 
+#include <Delta.hpp>
 #include <Message.hpp>
+#include <MessageRing.hpp>
+#include <Platform.hpp>
 #include <ReceiveStatus.hpp>
+#include <Reliable.hpp>
+#include <SharedMemory.hpp>
+#include <TimerWheel.hpp>
+#include <Transport.hpp>
+#include <UnixSocket.hpp>
+#include <Wire.hpp>
 
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
 #include <mutex>
-#include <queue>
+#include <string>
 #include <thread>
+#include <unordered_map>
 
-#ifdef _WIN32
+#define MESSAGE_QUEUE_SIZE 131072 //!< Bytes of received messages waiting for getMessage()
 
-	#ifndef WIN32_LEAN_AND_MEAN
-	#define WIN32_LEAN_AND_MEAN
-	#endif
+#define HEARTBEAT_INTERVAL_MS 1000 //!< Time between two heartbeats sent to the server
 
-	#ifndef NOMINMAX
-	#define NOMINMAX
-	#endif
-
-	#include <WinSock2.h>
-
-#endif // _WIN32
+#define CONNECT_RETRY_INTERVAL_MS 100 //!< Time between two connection attempts
 
 namespace cl
 {
@@ -28,15 +33,114 @@ namespace cl
 class Client
 {
 public:
-	Client(uint16_t serverPort, unsigned int id, bool isBlueTeam);
-	// clientPort = serverPort + id + 1
+	/**
+	 * @brief Construct a new Client object and connect to the server
+	 * 
+	 * @param serverPort The port of the server on localhost
+	 * @param id RLBot id of the bot
+	 * @param isBlueTeam Team of the bot
+	 * @param useIoThread Receive messages continuously on a thread owned
+	 *                    by the client instead of in update()
+	 * @param maxDatagramSize Pack the messages sent between two updates
+	 *                        in datagrams of up to this size if the
+	 *                        server supports it. sizeof(Message) sends
+	 *                        every message immediately.
+	 * @param transport Transport::SharedMemory exchanges the datagrams
+	 *                  through memory shared with a server on the same
+	 *                  host started with it, and falls back to UDP if
+	 *                  the server does not offer it.
+	 *                  Transport::UnixDatagram sends them to the Unix
+	 *                  socket of the server, also falling back to UDP.
+	 * @param unixPath Endpoint of the Unix socket of the server, empty
+	 *                 for its default one. @see Server::Server
+	 * @param room Room to join if the server is a RoomHost, 0 for its
+	 *             default room or a plain server. Rooms are only
+	 *             reached through UDP. @see RoomHost
+	 * 
+	 * The client binds to port serverPort + id + 1 if it uses UDP, to
+	 * unixPath followed by "." and the id if it uses a Unix socket. A
+	 * client joining a room binds to a port chosen by the system, ids
+	 * being reused by the other rooms. A client using shared memory
+	 * must be recreated once the server stopped.
+	 */
+	Client(uint16_t serverPort, unsigned int id, bool isBlueTeam, bool useIoThread = false,
+	       uint16_t maxDatagramSize = sizeof(Message), Transport transport = Transport::Udp,
+	       const std::string& unixPath = std::string(), uint32_t room = 0);
 	~Client();
 
 	void close();
 	void update(float dt);
 
+	/**
+	 * @brief Send a message to the server
+	 * 
+	 * @param message The message to send
+	 * @param force Send even if the client is not connected
+	 * @return true The message was sent or buffered
+	 * @return false The message could not be sent
+	 * 
+	 * When messages are coalesced, the message is only buffered and
+	 * sent by flush(), update() or once the datagram is full. Forced
+	 * messages are always sent immediately, after the buffered ones.
+	 * 
+	 * The message is sent with defaultDelivery(message->type), forced
+	 * messages are unreliable.
+	 * 
+	 * MSG_DELTA and MSG_RELIABLE are set by the client and cleared from
+	 * the parameters of the message, except in MSG_CONNECT where the bit
+	 * of MSG_DELTA is MSG_CONNECT_ROOM and is sent as is.
+	 */
 	bool sendMessage(Message* message, bool force = false);
 
+	/**
+	 * @brief Send a message of any payload size to the server
+	 * 
+	 * @see sendMessage(Message*, bool)
+	 * 
+	 * The payload is copied, it must be at most MAX_PAYLOAD_SIZE bytes.
+	 * Servers that don't support the compact format only receive the
+	 * first 60 bytes.
+	 */
+	bool sendMessage(const MessageView& message, bool force = false);
+
+	/**
+	 * @brief Send a message to the server with the given delivery
+	 * 
+	 * @see sendMessage(const MessageView&, bool)
+	 * 
+	 * Reliable messages are sent again by update() until the server
+	 * acknowledges them if it supports MSG_CAP_RELIABLE, and once
+	 * otherwise. Their payload must be at most MAX_RELIABLE_PAYLOAD_SIZE
+	 * bytes. When RELIABLE_WINDOW_SIZE messages of the channel are not
+	 * acknowledged yet, the message is queued until there is room.
+	 * Messages of delta-encoded streams are always unreliable.
+	 */
+	bool sendMessage(const MessageView& message, Delivery delivery);
+
+	/**
+	 * @brief Send the messages buffered by sendMessage()
+	 * 
+	 * @return true Nothing was buffered or the datagram was sent
+	 * @return false The datagram could not be sent
+	 * 
+	 * Called at the end of update().
+	 */
+	bool flush();
+
+	/**
+	 * @brief Send the messages of a type as a stream of snapshots
+	 * 
+	 * @param type The message type, not reserved by COMMS LIB
+	 * @param enabled false to send full messages again
+	 * 
+	 * Each message of the type replaces the previous one, like the
+	 * state of the bot sent every tick. If the server supports
+	 * MSG_CAP_DELTA, only what changed since the last snapshot it
+	 * acknowledged is sent. Payloads must be at most MAX_SNAPSHOT_SIZE
+	 * bytes. The receivers get full messages either way.
+	 */
+	void setDeltaStream(uint8_t type, bool enabled = true);
+
 	/**
 	 * @brief Get all messages of interest to the user
 	 * 
@@ -54,18 +158,175 @@ public:
 	 * 
 	 * This method will not return a message that is used for
 	 * COMMS LIB to work properly like connect, ping, etc.
+	 * 
+	 * Payloads are truncated to 60 bytes, use getMessage(MessageView&)
+	 * to read larger ones.
 	 */
 	bool getMessage(Message& message);
 
+	/**
+	 * @brief Get the next message without copying it
+	 * 
+	 * @param message The view to fill
+	 * @return true A message was read
+	 * @return false There is no message
+	 * 
+	 * The view stays valid until the next call to getMessage() or
+	 * waitForMessage().
+	 */
+	bool getMessage(MessageView& message);
+
+	/**
+	 * @brief Wait until a message is available for getMessage()
+	 * 
+	 * @param timeout Maximum time to wait
+	 * @return true A message is available
+	 * @return false The timeout expired
+	 * 
+	 * Only waits when the client uses an I/O thread. Otherwise,
+	 * messages are only received in update() so it returns
+	 * immediately.
+	 */
+	bool waitForMessage(std::chrono::milliseconds timeout);
+
+	/**
+	 * @brief Whether the server accepted the client
+	 * 
+	 * @return true The client is connected
+	 * @return false The client is connecting, or connecting again
+	 *               after the server disconnected it
+	 */
+	bool isConnected() const;
+
+	/**
+	 * @brief Get the error the server last answered with
+	 * 
+	 * @return uint8_t One of the MSG_ERR_* codes, MSG_ERR_NO_ERR
+	 *                 once the client is connected
+	 * 
+	 * After MSG_ERR_NO_ROOM, the client stops asking to connect: the
+	 * room has to be opened and the client recreated.
+	 */
+	uint8_t lastError() const;
+
 private:
 
+	/**
+	 * @brief Receive messages until the client is closed
+	 * 
+	 * Main loop of the I/O thread.
+	 */
+	void runIoThread();
+
+	/**
+	 * @brief Sleep until the socket or the channel has data or the I/O thread is stopped
+	 * 
+	 * @return true the I/O thread can go on
+	 * @return false there was an error while waiting
+	 */
+	bool waitForData();
+
+	/**
+	 * @brief Stop the I/O thread and wait for it to finish
+	 */
+	void stopIoThread();
+
+	/**
+	 * @brief Remove the message returned by getMessage(MessageView&)
+	 */
+	void releaseMessageView();
+
 	bool receiveMessages();
 
-	ReceiveStatus receive(Message& message);
+	/**
+	 * @brief Queue or handle a message received from the server
+	 */
+	void processMessage(MessageView message);
+
+	/**
+	 * @brief Handle a message received on a reliable channel
+	 * 
+	 * The message is processed, then the ones it was holding back.
+	 */
+	void processReliableMessage(const MessageView& message);
+
+	/**
+	 * @brief Hand out the next message of the last datagram received
+	 */
+	ReceiveStatus receive(MessageView& message);
+
+	/**
+	 * @brief Read the next datagram and start reading its messages
+	 */
+	ReceiveStatus receiveDatagram();
+
+	/**
+	 * @brief Read the next datagram of m_channel in place
+	 * 
+	 * @return ReceiveStatus ConnReset once if the server closed the channel
+	 */
+	ReceiveStatus receiveChannelDatagram();
+
+	bool sendMessage(const MessageView& message, Delivery delivery, bool force);
+
+	/**
+	 * @brief Add an encoded message to the next datagram
+	 * 
+	 * The buffered messages are sent first if the message does not fit.
+	 */
+	bool appendMessage(const MessageView& message, bool compact);
+
+	/**
+	 * @brief Send the buffered messages without adding acknowledgements
+	 */
+	bool sendBuffered();
+
+	/**
+	 * @brief Send the reliable messages not acknowledged in time and the queued ones
+	 * 
+	 * @return false The server stopped acknowledging them
+	 */
+	bool retransmit();
+
+	bool sendDatagram(const void* data, std::size_t size);
+
+	/**
+	 * @brief Make receiveDatagram() report that the Unix socket of the server is gone
+	 */
+	void reportUnixServerGone();
+
+	bool handleMessage(const MessageView& message);
+
+	/**
+	 * @brief Send a ping of the server back immediately
+	 * 
+	 * Bypasses the messages waiting for flush() so the server measures
+	 * the round-trip time without the time between two updates. Safe
+	 * to call from the I/O thread.
+	 */
+	bool answerPing(const MessageView& ping);
 
-	bool handleMessage(const Message& message);
+	/**
+	 * @brief Replace a delta-encoded message by the snapshot it contains
+	 * 
+	 * @param message The message received, with MSG_DELTA
+	 * @return true The snapshot was decoded in m_deltaSnapshot
+	 * @return false The baseline of the message was not received
+	 */
+	bool decodeSnapshot(MessageView& message);
+
+	/**
+	 * @brief Acknowledge the snapshots received since the last update
+	 */
+	bool sendDeltaAcks();
+
+	/**
+	 * @brief Forget the snapshots sent and received, keeping the sequence numbers
+	 */
+	void resetDeltaStreams();
 
 	bool init(uint16_t clientPort);
+	bool initUnix(const std::string& serverPath, unsigned int id);
 
 	void generateRandomData(uint8_t* buffer) const;
 
@@ -77,14 +338,74 @@ private:
 	SOCKET      m_socket;
 	sockaddr_in m_serverAddress;
 
-	uint8_t m_idAndTeam;
-	uint8_t m_key;
+	std::string       m_unixPath;              // endpoint m_socket is bound to with Transport::UnixDatagram, empty with UDP
+	sockaddr_un       m_unixServerAddress;     // endpoint of the server m_socket is connected to
+	socklen_t         m_unixServerAddressSize;
+	std::atomic<bool> m_unixServerGone;        // a send found no server, reported by receiveDatagram() like an ICMP error
+
+	uint8_t  m_idAndTeam;
+	uint32_t m_room;      // room asked for in MSG_CONNECT, 0 for none
+
+	std::atomic<uint8_t> m_key;                // written by the I/O thread if there is one
+	std::atomic<bool>    m_isConnected;        // written by the I/O thread if there is one
+	std::atomic<uint8_t> m_serverCapabilities; // MSG_CAP_* flags accepted by the server
+	std::atomic<uint8_t> m_lastError;          // MSG_ERR_* code of the last error received, written by the I/O thread if there is one
+
+	uint16_t       m_maxDatagramSize;               // size limit of coalesced datagrams
+	uint8_t        m_sendBuffer[MAX_DATAGRAM_SIZE]; // messages waiting for flush()
+	DatagramWriter m_sendWriter;
+
+	uint8_t        m_receiveBuffer[MAX_DATAGRAM_SIZE]; // last datagram received
+	DatagramReader m_receiveReader;
 
-	bool    m_isConnected;
+	ShmChannel        m_channel;        // used instead of m_socket with Transport::SharedMemory
+	std::mutex        m_channelMutex;   // the I/O thread answers pings while the application sends
+	bool              m_channelReading; // m_receiveReader reads the front of m_channel
+	bool              m_channelHungUp;  // the connection of m_channel hung up, the server went away
+	std::atomic<bool> m_channelClosed;  // the end of m_channel was reported by receiveDatagram()
 
-	std::queue<Message> m_messageQueue;
+	MessageRing m_messageQueue;
+	bool        m_messageViewPending; // the front of m_messageQueue was returned by getMessage()
+
+	// delta-encoded streams sent, by type
+	struct SendStream
+	{
+		bool            enabled       = false;
+		SnapshotHistory history;
+		uint16_t        nextSequence  = 0;
+		bool            acked         = false; // the server acknowledged a snapshot
+		uint16_t        ackedSequence = 0;
+	};
+
+	// delta-encoded streams received, by source id and team (high byte) and type
+	struct ReceiveStream
+	{
+		SnapshotHistory history;
+		uint16_t        latestSequence = 0;
+		bool            ackPending     = false; // latestSequence is acknowledged by the next update
+	};
+
+	std::unordered_map<uint8_t, SendStream>     m_sendStreams;
+	std::unordered_map<uint16_t, ReceiveStream> m_receiveStreams;
+	std::mutex m_deltaMutex;                       // the streams are shared with the I/O thread
+	uint8_t    m_deltaPayload[MAX_PAYLOAD_SIZE];   // snapshot encoded by sendMessage()
+	uint8_t    m_deltaSnapshot[MAX_SNAPSHOT_SIZE]; // snapshot decoded by decodeSnapshot()
+
+	ReliableEndpoint m_reliable;                          // reliable channels with the server
+	std::mutex       m_reliableMutex;                     // m_reliable is shared with the I/O thread
+	uint8_t          m_reliablePayload[MAX_PAYLOAD_SIZE]; // message numbered by sendMessage()
+	uint8_t          m_orderedPayload[MAX_PAYLOAD_SIZE];  // message delivered by processReliableMessage()
+
+	std::atomic<bool>       m_ioThreadRunning;  // false to stop the I/O thread
+	std::thread             m_ioThread;         // receives messages if useIoThread was set
+	std::mutex              m_messageMutex;     // only used to wait for messages
+	std::condition_variable m_messageAvailable; // notified by the I/O thread
+
+#ifndef _WIN32
+	int m_wakeup; // eventfd used to stop the I/O thread
+#endif // _WIN32
 
-	//float m_lastHeartbeatTimer;
+	TimerWheel m_timers; // connection attempts and heartbeats, only used by update()
 };
 
 } // cl
@@ -0,0 +1,179 @@
+#ifndef COMMSLIB_CLIENT_TABLE_HPP
+#define COMMSLIB_CLIENT_TABLE_HPP
+
+#include <Platform.hpp>
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+
+#define MAX_CLIENTS 128 //!< Maximum number of clients connected to a server
+
+namespace cl
+{
+
+/**
+ * @brief A struct containing client information
+ *
+ * All values are set to zero or invalid by default
+ */
+struct ClientInfo
+{
+	uint8_t  idAndTeam    = 0x00;       //!< RLBot id and team of the client
+	uint8_t  key          = 0x00;       //!< Private key for the client
+	uint8_t  capabilities = 0x00;       //!< MSG_CAP_* flags negotiated at connection
+	// INADDR_ANY will stand for an invalid/uninitialized address
+	uint32_t address      = INADDR_ANY; //!< Address of the client
+	uint16_t port         = 0;          //!< Port of the client
+
+	sockaddr_in socketAddress = {};     //!< Address and port ready to be used by send calls
+
+	std::chrono::steady_clock::time_point lastMessageTime = {}; //!< Last time a message was received from the client
+
+	float ping      = -1.0f; //!< Smoothed round-trip time in milliseconds, negative until measured
+	float jitter    = 0.0f;  //!< Smoothed variation between consecutive round-trip times in milliseconds
+	float lastRtt   = 0.0f;  //!< Last round-trip time measured in milliseconds
+	bool  isPinging = false; //!< A ping was sent and not answered yet
+};
+
+/**
+ * @brief Fixed-capacity table of the clients connected to a server
+ *
+ * Clients are stored contiguously so they can be iterated by index,
+ * and can be found in constant time by id and team (direct lookup)
+ * or by address and port (open-addressed hash table). The clients of
+ * each team are also listed to route team messages.
+ *
+ * Clients are removed in two steps: release() makes the client
+ * unreachable (its address becomes INADDR_ANY) without moving any
+ * other client, so indices stay valid while messages are being
+ * dispatched, and compact() removes all released clients by moving
+ * the last clients into their slots.
+ *
+ * The table belongs to the server thread. The shards only read the
+ * socketAddress of the clients they send to while the server thread
+ * waits for them, @see Server::sendParallel.
+ */
+class ClientTable
+{
+public:
+	ClientTable();
+
+	/**
+	 * @brief Get the number of clients, including released ones
+	 */
+	std::size_t size() const;
+
+	/**
+	 * @brief Determine if every client was released
+	 */
+	bool empty() const;
+
+	/**
+	 * @brief Determine if no client can be added anymore
+	 */
+	bool full() const;
+
+	ClientInfo&       operator[](std::size_t index);
+	const ClientInfo& operator[](std::size_t index) const;
+
+	/**
+	 * @brief Find a client by RLBot id and team
+	 *
+	 * @param idAndTeam The id and team of the client
+	 * @return int The index of the client or -1 if it is not connected
+	 */
+	int find(uint8_t idAndTeam) const;
+
+	/**
+	 * @brief Find a client by address and port
+	 *
+	 * @param address The address of the client
+	 * @param port The port of the client
+	 * @return int The index of the client or -1 if it is not connected
+	 */
+	int find(uint32_t address, uint16_t port) const;
+
+	/**
+	 * @brief Add a client to the table
+	 *
+	 * @param client The client to add
+	 * @return int The index of the client or -1 if the table is full
+	 *
+	 * The id and team and the address and port of the client must not
+	 * be used by another client of the table.
+	 */
+	int add(const ClientInfo& client);
+
+	/**
+	 * @brief Make a client unreachable
+	 *
+	 * @param index The index of the client
+	 *
+	 * The client can't be found anymore and its address is set to
+	 * INADDR_ANY, but it stays at the same index until compact().
+	 */
+	void release(std::size_t index);
+
+	/**
+	 * @brief Remove all released clients
+	 *
+	 * @return true Some clients were removed and others moved
+	 * @return false Nothing changed
+	 */
+	bool compact();
+
+	/**
+	 * @brief Get the number of clients of a team
+	 *
+	 * @param team The team bit (idAndTeam & 0x01)
+	 */
+	std::size_t teamSize(uint8_t team) const;
+
+	/**
+	 * @brief Get the index of a client of a team
+	 *
+	 * @param team The team bit (idAndTeam & 0x01)
+	 * @param position A position between 0 and teamSize(team)
+	 * @return std::size_t The index of the client in the table
+	 */
+	std::size_t teamMember(uint8_t team, std::size_t position) const;
+
+private:
+	/**
+	 * @brief Get the address table slot where a client is or would be
+	 */
+	std::size_t addressSlot(uint32_t address, uint16_t port) const;
+
+	/**
+	 * @brief Remove a client from the address table
+	 */
+	void removeAddress(std::size_t index);
+
+	/**
+	 * @brief Remove a client from its team list
+	 */
+	void removeFromTeam(std::size_t index);
+
+	/**
+	 * @brief Move a client to another index, updating all lookups
+	 */
+	void move(std::size_t from, std::size_t to);
+
+	ClientInfo  m_clients[MAX_CLIENTS]; //!< The clients, contiguously
+	std::size_t m_size;                 //!< Number of clients in m_clients
+
+	uint8_t m_indexById[256];                 //!< Index of the client for each id and team
+	uint8_t m_indexByAddress[2 * MAX_CLIENTS]; //!< Open-addressed hash table of client indices
+
+	uint8_t     m_teamMembers[2][MAX_CLIENTS]; //!< Index of the clients of each team
+	std::size_t m_teamSizes[2];                //!< Number of clients of each team
+	uint8_t     m_teamPositions[MAX_CLIENTS];  //!< Position of each client in its team list
+
+	bool    m_released[MAX_CLIENTS]; //!< Clients waiting to be removed by compact()
+	uint8_t m_releasedCount;         //!< Number of released clients
+};
+
+} // cl
+
+#endif // COMMSLIB_CLIENT_TABLE_HPP
@@ -0,0 +1,413 @@
+#ifndef COMMSLIB_CODEC_HPP
+#define COMMSLIB_CODEC_HPP
+
+#include <Message.hpp>
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <type_traits>
+
+// byte order of the host, typed payloads are always little-endian
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+	#define COMMS_BIG_ENDIAN_HOST 1
+#else
+	#define COMMS_BIG_ENDIAN_HOST 0
+#endif
+
+namespace cl
+{
+
+/**
+ * @brief Wire layout of a struct sent as the payload of a message
+ *
+ * @tparam T The struct
+ *
+ * Specialize it for each struct, deriving from WireFields with the type
+ * of the message and the members of the struct in the order they are
+ * sent:
+ *
+ * ~~~
+ * struct Position
+ * {
+ *     float   x, y, z;
+ *     int32_t frame;
+ * };
+ *
+ * namespace cl
+ * {
+ * template <>
+ * struct WireLayout<Position> : WireFields<0x10, &Position::x, &Position::y, &Position::z, &Position::frame> {};
+ * }
+ * ~~~
+ *
+ * The layout is checked at compile time by every function below.
+ * @see WireFields
+ */
+template <typename T>
+struct WireLayout;
+
+/**
+ * @brief Type and members of a wire layout
+ *
+ * @tparam Type Type of the message: user-defined (0-127) or TMCP (128-191)
+ * @tparam Members Pointers to the members of the struct, each listed once
+ *
+ * The members are sent back to back, with no padding, each in little-
+ * endian byte order. They are integers other than bool, floating-point
+ * numbers (IEEE 754), enums, or arrays of those. Every member of the
+ * struct must be listed, so the size of the struct is the size on the
+ * wire: a struct with padding between its members, or a member listed
+ * twice, does not compile. Members of an anonymous union share their
+ * bytes: list only one of them.
+ *
+ * Listed in the order they are declared, the struct is its own wire
+ * format on little-endian hosts and is copied at once.
+ */
+template <uint8_t Type, auto... Members>
+struct WireFields
+{
+	static constexpr uint8_t type = Type;
+};
+
+/**
+ * @brief Get the size of the payload of a struct, in bytes
+ */
+template <typename T>
+constexpr std::size_t wireSize();
+
+/**
+ * @brief Get the message type of a struct
+ */
+template <typename T>
+constexpr uint8_t wireType();
+
+/**
+ * @brief Write a struct in its wire format
+ *
+ * @param output Where to write, at least wireSize<T>() bytes
+ */
+template <typename T>
+void encode(uint8_t* output, const T& value);
+
+/**
+ * @brief Read a struct from its wire format
+ *
+ * @param input The payload, at least wireSize<T>() bytes
+ */
+template <typename T>
+void decode(const uint8_t* input, T& value);
+
+/**
+ * @brief Build a message carrying a struct
+ *
+ * @param parameters Recipients of the message, @see MSG_ALL
+ *
+ * The rest of the data is zeroed. Send MessageView(message, wireSize<T>())
+ * so only the payload of the struct is sent in compact datagrams. The
+ * struct must fit in a fixed Message.
+ */
+template <typename T>
+Message makeMessage(const T& value, uint8_t parameters = MSG_ALL);
+
+/**
+ * @brief Read the struct carried by a message
+ *
+ * @return false The message has another type or too small a payload,
+ *         value is left unchanged
+ */
+template <typename T>
+bool readMessage(const MessageView& message, T& value);
+
+namespace codec
+{
+
+/**
+ * @brief Unsigned integer of a given size, holding the bytes of a scalar
+ */
+template <std::size_t Size>
+struct Bits;
+
+template <> struct Bits<1> { using Type = uint8_t;  };
+template <> struct Bits<2> { using Type = uint16_t; };
+template <> struct Bits<4> { using Type = uint32_t; };
+template <> struct Bits<8> { using Type = uint64_t; };
+
+/**
+ * @brief Determine if a member can be sent: a scalar other than bool, or an array of scalars
+ */
+template <typename F>
+struct IsWireField
+	: std::bool_constant<(std::is_arithmetic<F>::value || std::is_enum<F>::value) && !std::is_same<F, bool>::value
+	                     && (sizeof(F) == 1 || sizeof(F) == 2 || sizeof(F) == 4 || sizeof(F) == 8)>
+{
+};
+
+template <typename F, std::size_t N>
+struct IsWireField<F[N]> : IsWireField<F>
+{
+};
+
+/**
+ * @brief Class and type of a member pointer
+ */
+template <typename P>
+struct Member;
+
+template <typename C, typename F>
+struct Member<F C::*>
+{
+	using Class = C;
+	using Field = F;
+};
+
+template <typename C, auto... Members>
+constexpr bool allMembersOf()
+{
+	return (true && ... && std::is_same<typename Member<decltype(Members)>::Class, C>::value);
+}
+
+/**
+ * @brief Determine if two member pointers designate the same member
+ *
+ * Pointers of different types designate different members, only the
+ * others can be compared in a constant expression.
+ */
+template <auto First, auto Second>
+constexpr bool sameMember()
+{
+	if constexpr (std::is_same<decltype(First), decltype(Second)>::value)
+		return First == Second;
+	else
+		return false;
+}
+
+template <auto First, auto... Others>
+constexpr bool distinctFrom()
+{
+	if constexpr (sizeof...(Others) == 0)
+		return true;
+	else
+		return (true && ... && !sameMember<First, Others>()) && distinctFrom<Others...>();
+}
+
+/**
+ * @brief Determine if each member is listed once
+ *
+ * The members of a struct do not overlap, so distinct members whose
+ * sizes add up to the size of the struct cover every byte of it once.
+ */
+template <auto... Members>
+constexpr bool allDistinct()
+{
+	if constexpr (sizeof...(Members) == 0)
+		return true;
+	else
+		return distinctFrom<Members...>();
+}
+
+template <auto... Members>
+constexpr bool allWireFields()
+{
+	return (true && ... && IsWireField<typename Member<decltype(Members)>::Field>::value);
+}
+
+template <auto... Members>
+constexpr std::size_t fieldsSize()
+{
+	return (std::size_t(0) + ... + sizeof(typename Member<decltype(Members)>::Field));
+}
+
+/**
+ * @brief Convert between the host and the wire (little-endian) byte order
+ */
+template <typename U>
+inline U swap(U bits)
+{
+#if COMMS_BIG_ENDIAN_HOST
+	if constexpr (sizeof(U) == 1)
+		return bits;
+	else if constexpr (sizeof(U) == 2)
+		return __builtin_bswap16(bits);
+	else if constexpr (sizeof(U) == 4)
+		return __builtin_bswap32(bits);
+	else
+		return __builtin_bswap64(bits);
+#else
+	return bits;
+#endif // COMMS_BIG_ENDIAN_HOST
+}
+
+template <typename F>
+inline void encodeField(uint8_t* output, const F& field)
+{
+	if constexpr (std::is_array<F>::value)
+	{
+		// the count is a constant, the loop is unrolled
+		for (std::size_t i = 0; i < std::extent<F>::value; i++)
+			encodeField(output + i * sizeof(field[0]), field[i]);
+	}
+	else
+	{
+		typename Bits<sizeof(F)>::Type bits;
+		std::memcpy(&bits, &field, sizeof(F));
+		bits = swap(bits);
+		std::memcpy(output, &bits, sizeof(F));
+	}
+}
+
+template <typename F>
+inline void decodeField(const uint8_t* input, F& field)
+{
+	if constexpr (std::is_array<F>::value)
+	{
+		for (std::size_t i = 0; i < std::extent<F>::value; i++)
+			decodeField(input + i * sizeof(field[0]), field[i]);
+	}
+	else
+	{
+		typename Bits<sizeof(F)>::Type bits;
+		std::memcpy(&bits, input, sizeof(F));
+		bits = swap(bits);
+		std::memcpy(&field, &bits, sizeof(F));
+	}
+}
+
+/**
+ * @brief Check the layout of a struct and get its size on the wire
+ *
+ * Called with WireLayout<T>, deducing the arguments of its WireFields.
+ */
+template <typename T, uint8_t Type, auto... Members>
+constexpr std::size_t checkLayout(const WireFields<Type, Members...>&)
+{
+	static_assert(std::is_trivially_copyable<T>::value, "A wire struct must be trivially copyable");
+	static_assert(Type < MSG_CONNECT, "Message types 192-255 are reserved for CommsLib");
+	static_assert(!std::is_union<T>::value, "A wire struct cannot be a union, its members overlap");
+	static_assert(allMembersOf<T, Members...>(), "Every field of a wire layout must be a member of its struct");
+	static_assert(allDistinct<Members...>(), "A member is listed more than once in the wire layout");
+	static_assert(allWireFields<Members...>(), "Fields must be integers, floating-point numbers, enums or arrays of those");
+	static_assert(sizeof...(Members) > 0 ? fieldsSize<Members...>() == sizeof(T) : std::is_empty<T>::value,
+	              "The struct has padding or members missing from its wire layout");
+	static_assert(fieldsSize<Members...>() <= MAX_PAYLOAD_SIZE, "The struct is larger than MAX_PAYLOAD_SIZE");
+
+	return fieldsSize<Members...>();
+}
+
+template <typename T, uint8_t Type, auto... Members>
+inline void encodeFields(uint8_t* output, const T& value, const WireFields<Type, Members...>&)
+{
+	std::size_t offset = 0;
+	((encodeField(output + offset, value.*Members), offset += sizeof(value.*Members)), ...);
+	(void)output;
+	(void)value;
+	(void)offset;
+}
+
+template <typename T, uint8_t Type, auto... Members>
+inline void decodeFields(const uint8_t* input, T& value, const WireFields<Type, Members...>&)
+{
+	std::size_t offset = 0;
+	((decodeField(input + offset, value.*Members), offset += sizeof(value.*Members)), ...);
+	(void)input;
+	(void)value;
+	(void)offset;
+}
+
+/**
+ * @brief Determine if the members are listed in the order they are declared
+ *
+ * The offsets are constants: the compiler folds the result, there is no
+ * branch left in encode() and decode().
+ */
+template <typename T, uint8_t Type, auto... Members>
+inline bool isDeclarationOrder(const T& value, const WireFields<Type, Members...>&)
+{
+	const uint8_t* base    = reinterpret_cast<const uint8_t*>(&value);
+	std::size_t    offset  = 0;
+	bool           inOrder  = true;
+	((inOrder = inOrder && reinterpret_cast<const uint8_t*>(&(value.*Members)) == base + offset, offset += sizeof(value.*Members)), ...);
+	(void)base;
+
+	return inOrder;
+}
+
+} // codec
+
+template <typename T>
+constexpr std::size_t wireSize()
+{
+	return codec::checkLayout<T>(WireLayout<T>());
+}
+
+template <typename T>
+constexpr uint8_t wireType()
+{
+	return WireLayout<T>::type;
+}
+
+template <typename T>
+inline void encode(uint8_t* output, const T& value)
+{
+	constexpr std::size_t size = wireSize<T>(); // fails to compile if the layout is invalid
+	if constexpr (size == 0)
+		return;
+
+#if !COMMS_BIG_ENDIAN_HOST
+	if (codec::isDeclarationOrder(value, WireLayout<T>()))
+	{
+		std::memcpy(output, &value, size);
+		return;
+	}
+#endif // COMMS_BIG_ENDIAN_HOST
+
+	codec::encodeFields(output, value, WireLayout<T>());
+}
+
+template <typename T>
+inline void decode(const uint8_t* input, T& value)
+{
+	constexpr std::size_t size = wireSize<T>(); // fails to compile if the layout is invalid
+	if constexpr (size == 0)
+		return;
+
+#if !COMMS_BIG_ENDIAN_HOST
+	if (codec::isDeclarationOrder(value, WireLayout<T>()))
+	{
+		std::memcpy(&value, input, size);
+		return;
+	}
+#endif // COMMS_BIG_ENDIAN_HOST
+
+	codec::decodeFields(input, value, WireLayout<T>());
+}
+
+template <typename T>
+inline Message makeMessage(const T& value, uint8_t parameters)
+{
+	static_assert(wireSize<T>() <= LEGACY_PAYLOAD_SIZE, "The struct does not fit in a fixed Message");
+
+	Message message;
+	message.parameters = parameters;
+	message.type       = wireType<T>();
+
+	encode(message.data, value);
+	std::memset(message.data + wireSize<T>(), 0, LEGACY_PAYLOAD_SIZE - wireSize<T>());
+
+	return message;
+}
+
+template <typename T>
+inline bool readMessage(const MessageView& message, T& value)
+{
+	if (message.type != wireType<T>() || message.size < wireSize<T>())
+		return false;
+
+	decode(message.data, value);
+
+	return true;
+}
+
+} // cl
+
+#endif // COMMSLIB_CODEC_HPP
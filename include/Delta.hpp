@@ -0,0 +1,105 @@
+#ifndef COMMSLIB_DELTA_HPP
+#define COMMSLIB_DELTA_HPP
+
+#include <Message.hpp>
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#define DELTA_HISTORY_SIZE 32 //!< Snapshots kept per stream. Older baselines are never used.
+
+#define DELTA_KEYFRAME_HEADER_SIZE 3 //!< Kind and sequence number
+#define DELTA_ACK_SIZE             4 //!< Source, type and sequence number of an acknowledgement
+
+#define MAX_SNAPSHOT_SIZE (MAX_PAYLOAD_SIZE - DELTA_KEYFRAME_HEADER_SIZE) //!< Largest payload of a delta-encoded message
+
+namespace cl
+{
+
+/**
+ * @brief The last snapshots of a stream, by sequence number
+ * 
+ * Snapshot n is kept until snapshot n + DELTA_HISTORY_SIZE is stored.
+ */
+class SnapshotHistory
+{
+public:
+	void clear();
+
+	/**
+	 * @brief Store a snapshot, replacing the one DELTA_HISTORY_SIZE older
+	 */
+	void store(uint16_t sequence, const uint8_t* data, uint16_t size);
+
+	/**
+	 * @brief Find a snapshot
+	 * 
+	 * @return true The snapshot is in the history, data and size are set
+	 * @return false The snapshot was never stored or was replaced
+	 */
+	bool find(uint16_t sequence, const uint8_t*& data, uint16_t& size) const;
+
+private:
+	struct Slot
+	{
+		uint16_t             sequence = 0;
+		bool                 valid    = false;
+		std::vector<uint8_t> data;
+	};
+
+	Slot m_slots[DELTA_HISTORY_SIZE];
+};
+
+/**
+ * @brief Encode a snapshot for a receiver
+ * 
+ * @param output Where to write, at least DELTA_KEYFRAME_HEADER_SIZE + size bytes
+ * @param sequence Sequence number of the snapshot
+ * @param snapshot The snapshot, at most MAX_SNAPSHOT_SIZE bytes
+ * @param size Size of the snapshot
+ * @param history Snapshots previously sent on the stream
+ * @param hasBaseline The receiver acknowledged a snapshot
+ * @param baselineSequence The last snapshot the receiver acknowledged
+ * @return std::size_t The size of the encoded payload
+ * 
+ * The snapshot is XORed with the baseline and the runs of zeros are
+ * removed. It is sent as is (keyframe) when there is no baseline in
+ * the history or when that is not smaller.
+ */
+std::size_t encodeDelta(uint8_t* output, uint16_t sequence, const uint8_t* snapshot, uint16_t size,
+                        const SnapshotHistory& history, bool hasBaseline, uint16_t baselineSequence);
+
+/**
+ * @brief Decode a payload written by encodeDelta()
+ * 
+ * @param payload The encoded payload
+ * @param payloadSize Its size
+ * @param history Snapshots previously received on the stream
+ * @param snapshot Where to write, at least MAX_SNAPSHOT_SIZE bytes
+ * @param size Set to the size of the snapshot
+ * @param sequence Set to the sequence number of the snapshot
+ * @return true The snapshot was decoded
+ * @return false The payload is malformed or its baseline is not in the history
+ */
+bool decodeDelta(const uint8_t* payload, std::size_t payloadSize, const SnapshotHistory& history,
+                 uint8_t* snapshot, uint16_t& size, uint16_t& sequence);
+
+/**
+ * @brief Write the acknowledgement of a snapshot in a MSG_DELTA_ACK payload
+ * 
+ * @param output Where to write, DELTA_ACK_SIZE bytes
+ * @param source Id and team of the client sending the stream
+ * @param type Message type of the stream
+ * @param sequence Sequence number of the snapshot received
+ */
+void encodeDeltaAck(uint8_t* output, uint8_t source, uint8_t type, uint16_t sequence);
+
+/**
+ * @brief Read an acknowledgement written by encodeDeltaAck()
+ */
+void decodeDeltaAck(const uint8_t* input, uint8_t& source, uint8_t& type, uint16_t& sequence);
+
+} // cl
+
+#endif // COMMSLIB_DELTA_HPP
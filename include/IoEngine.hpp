@@ -0,0 +1,23 @@
+#ifndef COMMSLIB_IO_ENGINE_HPP
+#define COMMSLIB_IO_ENGINE_HPP
+
+#include <cstdint>
+
+namespace cl
+{
+
+/**
+ * @brief How the server thread waits for, receives and sends the datagrams of its UDP socket
+ *
+ * The engines only differ in the system calls they make: the messages
+ * are received, handled and routed the same way.
+ */
+enum class IoEngine : uint8_t
+{
+	Epoll,  //!< epoll_wait(), recvmmsg() and sendmmsg() (select() on Windows)
+	IoUring //!< io_uring with multishot receives and batched sends (Linux only), @see IoUring
+};
+
+} // cl
+
+#endif // COMMSLIB_IO_ENGINE_HPP
@@ -0,0 +1,177 @@
+#ifndef COMMSLIB_IO_URING_HPP
+#define COMMSLIB_IO_URING_HPP
+
+#include <Platform.hpp>
+
+#include <cstddef>
+#include <cstdint>
+
+#ifdef _WIN32
+	struct msghdr;
+#else
+	#include <linux/io_uring.h>
+#endif // _WIN32
+
+namespace cl
+{
+
+/**
+ * @brief A completed request of an IoUring
+ */
+struct IoCompletion
+{
+	uint64_t tag    = 0;     //!< Tag of the request
+	int32_t  result = 0;     //!< Result of the system call, -errno on error
+	bool     more   = false; //!< A multishot request stays armed
+	int      buffer = -1;    //!< Provided buffer holding the data, -1 if none
+};
+
+/**
+ * @brief A datagram received by IoUring::receive() in a provided buffer
+ */
+struct IoDatagram
+{
+	const void*    name      = nullptr; //!< Address of the sender
+	socklen_t      nameSize  = 0;
+	const uint8_t* data      = nullptr;
+	std::size_t    size      = 0;
+	bool           truncated = false;   //!< The datagram did not fit in the buffer
+};
+
+/**
+ * @brief Minimal io_uring instance, made of the raw system calls
+ *
+ * Requests are queued with receive(), poll() and send(), and all of
+ * them are handed to the kernel by a single submit(), which can also
+ * wait for completions. Completions are read from memory shared with
+ * the kernel, without any system call.
+ *
+ * Datagrams are received in buffers provided to the kernel beforehand,
+ * so a receive request stays armed for any number of datagrams. Each
+ * buffer must be given back with recycle() once its datagram is read.
+ *
+ * Only available on Linux. Not thread-safe, owned by the server thread.
+ */
+class IoUring
+{
+public:
+	IoUring();
+	~IoUring();
+
+	IoUring(const IoUring&)            = delete;
+	IoUring& operator=(const IoUring&) = delete;
+
+	/**
+	 * @brief Create the instance and the buffers datagrams are received in
+	 *
+	 * @param entries Most requests queued between two submit()
+	 * @param bufferCount Number of receive buffers, a power of two
+	 * @param bufferSize Bytes of each buffer, with room for the header of
+	 *                   the datagram and the address of its sender
+	 * @return false The kernel does not support every feature needed
+	 */
+	bool open(unsigned int entries, unsigned int bufferCount, std::size_t bufferSize);
+
+	void close();
+
+	bool isOpen() const;
+
+	/**
+	 * @brief Queue a multishot receive into the provided buffers
+	 *
+	 * @param header msg_namelen and msg_controllen set the room for the
+	 *               address and control data in each buffer. Must stay
+	 *               valid while the request is armed.
+	 * @return false The queue is full, submit() first
+	 */
+	bool receive(SOCKET socket, const msghdr* header, uint64_t tag);
+
+	/**
+	 * @brief Queue a multishot poll for input on a file descriptor
+	 */
+	bool poll(int fd, uint64_t tag);
+
+	/**
+	 * @brief Queue a sendmsg()
+	 *
+	 * @param header The datagram, must stay valid until its completion
+	 * @param linked The next request is only started once this one
+	 *               completed, even if this one fails. The chain ends
+	 *               with the submission.
+	 */
+	bool send(SOCKET socket, const msghdr* header, uint64_t tag, bool linked);
+
+	/**
+	 * @brief Get the number of requests queued since the last submit()
+	 */
+	unsigned int queued() const;
+
+	/**
+	 * @brief Hand the queued requests to the kernel
+	 *
+	 * @param waitCount Number of completions to wait for
+	 * @param timeoutMs Longest wait, -1 to wait until they arrive
+	 * @return int The number of requests submitted, -1 on error with
+	 *         errno set (ETIME if the wait timed out)
+	 */
+	int submit(unsigned int waitCount, int timeoutMs);
+
+	/**
+	 * @brief Get the next completion, without any system call
+	 *
+	 * @return false There is none
+	 */
+	bool complete(IoCompletion& completion);
+
+	/**
+	 * @brief Find the datagram of a completion of receive()
+	 *
+	 * @return false The buffer does not hold a valid datagram
+	 */
+	bool datagram(const IoCompletion& completion, const msghdr& header, IoDatagram& datagram) const;
+
+	/**
+	 * @brief Give a buffer back to the kernel once its datagram was read
+	 */
+	void recycle(int buffer);
+
+private:
+#ifndef _WIN32
+	/**
+	 * @brief Get a cleared entry at the end of the submission queue, nullptr if it is full
+	 */
+	io_uring_sqe* nextEntry();
+
+	int m_fd;
+
+	void*       m_rings;     //!< Submission and completion rings, mapped together
+	std::size_t m_ringsSize;
+	void*       m_cqRing;    //!< Completion ring if the kernel maps it separately
+	std::size_t m_cqRingSize;
+
+	io_uring_sqe* m_entries;
+	unsigned int  m_entryCount;
+	uint32_t*     m_sqHead;
+	uint32_t*     m_sqTail;
+	uint32_t      m_sqMask;
+	uint32_t      m_sqLocalTail;  //!< Tail of the requests queued, published by submit()
+	uint32_t      m_sqSubmitted;  //!< Tail at the last submit()
+	io_uring_sqe* m_lastEntry;    //!< Last request queued, its link ends the chain
+
+	io_uring_cqe* m_cqes;
+	uint32_t*     m_cqHead;
+	uint32_t*     m_cqTail;
+	uint32_t      m_cqMask;
+
+	io_uring_buf_ring* m_bufferRing;     //!< Buffers given to the kernel
+	std::size_t        m_bufferRingSize;
+	uint8_t*           m_buffers;
+	std::size_t        m_bufferSize;
+	unsigned int       m_bufferCount;
+	uint16_t           m_bufferTail;     //!< Tail of the buffer ring, published by recycle()
+#endif // _WIN32
+};
+
+} // cl
+
+#endif // COMMSLIB_IO_URING_HPP
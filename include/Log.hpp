@@ -0,0 +1,221 @@
+#ifndef COMMSLIB_LOG_HPP
+#define COMMSLIB_LOG_HPP
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <type_traits>
+
+#define LOG_MESSAGE_SIZE       240  //!< Characters of a log message at most, longer messages are cut
+#define LOG_QUEUE_CAPACITY     1024 //!< Messages waiting for the writer thread before new ones are dropped
+#define LOG_REPEAT_INTERVAL_MS 1000 //!< Time between two messages of a rate-limited log statement
+
+#define LOG_LEVEL_DEBUG   0
+#define LOG_LEVEL_INFO    1
+#define LOG_LEVEL_WARNING 2
+#define LOG_LEVEL_ERROR   3
+#define LOG_LEVEL_OFF     4
+
+// log statements below this level are removed at compile time, debug
+// statements are only compiled in debug builds unless it is defined
+#ifndef COMMSLIB_MIN_LOG_LEVEL
+	#ifdef NDEBUG
+		#define COMMSLIB_MIN_LOG_LEVEL LOG_LEVEL_INFO
+	#else
+		#define COMMSLIB_MIN_LOG_LEVEL LOG_LEVEL_DEBUG
+	#endif // NDEBUG
+#endif // COMMSLIB_MIN_LOG_LEVEL
+
+namespace cl
+{
+
+/**
+ * @brief Severity of a log message
+ */
+enum class LogLevel : uint8_t
+{
+	Debug   = LOG_LEVEL_DEBUG,   //!< Details of the traffic, only compiled in debug builds by default
+	Info    = LOG_LEVEL_INFO,    //!< Connections, disconnections, start and stop
+	Warning = LOG_LEVEL_WARNING, //!< Invalid data received, the library keeps going
+	Error   = LOG_LEVEL_ERROR,   //!< A system call failed
+	Off     = LOG_LEVEL_OFF      //!< Used with Logger::setLevel() only, nothing is logged
+};
+
+/**
+ * @brief Part of the library a log message comes from, written before its level
+ */
+enum class LogSource : uint8_t
+{
+	None,   //!< Only the level is written
+	Server, //!< [COMMS SERVER]
+	Client, //!< [COMMS CLIENT]
+	Stats   //!< [COMMS STATS]
+};
+
+/**
+ * @brief A formatted log message waiting for the writer thread
+ */
+struct LogRecord
+{
+	LogLevel  level  = LogLevel::Info;
+	LogSource source = LogSource::None;
+	uint16_t  size   = 0;           //!< Characters of text
+	char      text[LOG_MESSAGE_SIZE]; //!< Not null-terminated
+};
+
+/**
+ * @brief Asynchronous logger shared by the whole library
+ *
+ * Log statements format their message on the stack and push it to a
+ * lock-free queue. A background thread writes the messages to the
+ * standard output and flushes it once per batch, so the threads of
+ * the library never wait for the console. Messages are dropped when
+ * the queue is full, and the writer reports how many.
+ *
+ * The writer thread starts with the first message. It is stopped at
+ * exit, after which messages are written directly.
+ */
+class Logger
+{
+public:
+	/**
+	 * @brief Set the lowest level written, LogLevel::Info by default
+	 *
+	 * Levels below COMMSLIB_MIN_LOG_LEVEL are removed at compile time
+	 * and can't be enabled. Safe to call from any thread.
+	 */
+	static void setLevel(LogLevel level);
+
+	static LogLevel level();
+
+	/**
+	 * @brief Determine if the messages of a level are written
+	 */
+	static bool enabled(LogLevel level)
+	{
+		return static_cast<int>(level) > COMMSLIB_MIN_LOG_LEVEL - 1
+		    && level >= s_level.load(std::memory_order_relaxed);
+	}
+
+	/**
+	 * @brief Wait until the messages logged so far are written
+	 */
+	static void flush();
+
+	/**
+	 * @brief Queue a message for the writer thread
+	 */
+	static void write(const LogRecord& record);
+
+private:
+	static std::atomic<LogLevel> s_level; //!< @see setLevel
+};
+
+/**
+ * @brief Formats a log message on the stack and queues it when destroyed
+ *
+ * Used through the COMMS_LOG_* macros, which skip the formatting when
+ * the level is not enabled.
+ */
+class LogLine
+{
+public:
+	/**
+	 * @param level The level of the message
+	 * @param source The part of the library logging it
+	 * @param suppressed Number of messages of the same statement skipped
+	 *                   by its rate limit, mentioned at the end
+	 */
+	LogLine(LogLevel level, LogSource source, uint64_t suppressed = 0);
+	~LogLine();
+
+	LogLine(const LogLine&)            = delete;
+	LogLine& operator=(const LogLine&) = delete;
+
+	LogLine& operator<<(const char* text);
+	LogLine& operator<<(const std::string& text);
+	LogLine& operator<<(char character);
+	LogLine& operator<<(double value);
+
+	template <typename T>
+	typename std::enable_if<std::is_integral<T>::value, LogLine&>::type operator<<(T value)
+	{
+		if (std::is_signed<T>::value)
+			appendSigned(static_cast<long long>(value));
+		else
+			appendUnsigned(static_cast<unsigned long long>(value));
+		return *this;
+	}
+
+private:
+	void append(const char* text, std::size_t size);
+	void appendSigned(long long value);
+	void appendUnsigned(unsigned long long value);
+
+	LogRecord m_record;
+	uint64_t  m_suppressed;
+};
+
+/**
+ * @brief Lets a log statement through at most once per interval
+ *
+ * Keeps a message repeated for every datagram from flooding the
+ * output: the statements skipped are counted and mentioned by the next
+ * one let through. Safe to use from any number of threads.
+ */
+class LogRateLimiter
+{
+public:
+	explicit LogRateLimiter(std::chrono::milliseconds interval);
+
+	/**
+	 * @brief Determine if the statement can log now, or count it as skipped
+	 */
+	bool allow();
+
+	/**
+	 * @brief Get the number of statements skipped since the last call
+	 */
+	uint64_t takeSuppressed();
+
+private:
+	std::chrono::steady_clock::duration m_interval;
+	std::atomic<int64_t>                m_next;       //!< Time at which the next statement is let through, in ticks of steady_clock
+	std::atomic<uint64_t>               m_suppressed; //!< Statements skipped
+};
+
+} // cl
+
+/**
+ * @brief Log a message if its level is enabled
+ *
+ * Usage: COMMS_LOG(cl::LogLevel::Info, Server) << "Started on port " << port << ".";
+ * The message is only formatted if it is written. The loop runs at most
+ * once, it is a single statement that can't capture a following else.
+ */
+#define COMMS_LOG(level, source)                                                                      \
+	for (bool commsLogEnabled = cl::Logger::enabled(level); commsLogEnabled; commsLogEnabled = false) \
+		cl::LogLine(level, cl::LogSource::source)
+
+/**
+ * @brief Log a message at most once every LOG_REPEAT_INTERVAL_MS
+ *
+ * For messages that may be triggered by every datagram sent or received,
+ * at any level. Each statement has its own rate limit.
+ */
+#define COMMS_LOG_LIMITED(level, source)                                                                         \
+	for (cl::LogRateLimiter* commsLogLimiter = !cl::Logger::enabled(level) ? nullptr : []() {                    \
+	         static cl::LogRateLimiter limiter(std::chrono::milliseconds(LOG_REPEAT_INTERVAL_MS));                \
+	         return &limiter;                                                                                     \
+	     }();                                                                                                     \
+	     commsLogLimiter != nullptr && commsLogLimiter->allow(); commsLogLimiter = nullptr)                      \
+		cl::LogLine(level, cl::LogSource::source, commsLogLimiter->takeSuppressed())
+
+#define COMMS_LOG_DEBUG(source)   COMMS_LOG(cl::LogLevel::Debug, source)
+#define COMMS_LOG_INFO(source)    COMMS_LOG(cl::LogLevel::Info, source)
+#define COMMS_LOG_WARNING(source) COMMS_LOG(cl::LogLevel::Warning, source)
+#define COMMS_LOG_ERROR(source)   COMMS_LOG(cl::LogLevel::Error, source)
+
+#endif // COMMSLIB_LOG_HPP
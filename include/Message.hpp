@@ -1,11 +1,23 @@
 #ifndef COMMSLIB_MESSAGE_HPP
 #define COMMSLIB_MESSAGE_HPP
 
+#include <cstddef>
 #include <cstdint>
+#include <cstring>
 
 // default values
 #define DEFAULT_KEY 0xF0 //!< Default key for connection packet
 
+// datagram sizes
+#define MAX_DATAGRAM_SIZE         1472 //!< Largest datagram a peer must accept (Ethernet MTU minus IP and UDP headers)
+#define DEFAULT_MAX_DATAGRAM_SIZE 1472 //!< Default size limit when several messages are sent in one datagram
+
+// compact wire format (MSG_CAP_COMPACT)
+#define WIRE_VERSION        0x02 //!< First byte of every compact datagram
+#define FRAME_HEADER_SIZE   6    //!< playerIDAndTeam, key, parameters, type and big-endian payload size
+#define LEGACY_PAYLOAD_SIZE 60   //!< Payload size of a fixed Message
+#define MAX_PAYLOAD_SIZE    (MAX_DATAGRAM_SIZE - FRAME_HEADER_SIZE - 2) //!< Largest payload, leaving room for the version and padding bytes
+
 // to setup TMCP version
 #define MSG_TMCP_VERSION 0x80 //!< Used to setup tmcp version. Only 1.0 is available
 
@@ -24,19 +36,39 @@
 #define MSG_STATE       0xC4 //!< State of all currently connected clients
 #define MSG_SERVER_STOP 0xC5 //!< Signal all clients that server is shutting down
 #define MSG_ERROR       0xC6 //!< Signal an error. The error code is in data
+#define MSG_DELTA_ACK   0xC7 //!< Acknowledge snapshots of delta-encoded streams (MSG_CAP_DELTA)
+#define MSG_ACK         0xC8 //!< Acknowledge messages of the reliable channels (MSG_CAP_RELIABLE)
 #define MSG_INVALID     0xFF //!< Invalid message
 
 // COMMS LIB message param masks
-#define MSG_ORANGE  0b00000001            //!< Message orange team
-#define MSG_BLUE    0b00000010            //!< Message blue team
-#define MSG_PRIVATE 0b00000000            //!< Message server or single client only
-#define MSG_ALL     MSG_ORANGE | MSG_BLUE //!< Message all bots
+#define MSG_ORANGE   0b00000001              //!< Message orange team
+#define MSG_BLUE     0b00000010              //!< Message blue team
+#define MSG_PRIVATE  0b00000000              //!< Message server or single client only (recipient's id and team in data[0])
+#define MSG_ALL      (MSG_ORANGE | MSG_BLUE) //!< Message all bots
+#define MSG_DELTA    0b00000100              //!< The payload is a delta-encoded snapshot (MSG_CAP_DELTA)
+#define MSG_RELIABLE 0b00001000              //!< The payload starts with a reliable channel and sequence number (MSG_CAP_RELIABLE)
+
+// COMMS LIB capabilities, in the parameters of MSG_CONNECT. The client
+// sends the ones it supports, the server answers with the ones it accepts.
+#define MSG_CAP_COALESCE 0b00010000 //!< Datagrams may contain several messages back to back
+#define MSG_CAP_COMPACT  0b00100000 //!< Datagrams may use the compact, variable-length format
+#define MSG_CAP_DELTA    0b01000000 //!< Snapshot streams may be delta-encoded (requires MSG_CAP_COMPACT)
+#define MSG_CAP_RELIABLE 0b10000000 //!< Messages may be sent on reliable channels (requires MSG_CAP_COMPACT)
+#define MSG_CAP_ALL      (MSG_CAP_COALESCE | MSG_CAP_COMPACT | MSG_CAP_DELTA | MSG_CAP_RELIABLE)
+
+// COMMS LIB rooms, in the parameters of MSG_CONNECT. The other bits are
+// taken by the recipients and the capabilities, so it shares the bit of
+// MSG_DELTA, which a connection request never has: check the type before
+// MSG_DELTA wherever a MSG_CONNECT can be seen.
+#define MSG_CONNECT_ROOM 0b00000100 //!< The payload starts with the id of the room to join (4 bytes, big-endian)
 
 // COMMS LIB error codes
 #define MSG_ERR_NO_ERR      0x00 //!< No error
 #define MSG_ERR_TOO_MANY    0x01 //!< Too many clients are already connected
 #define MSG_ERR_ALREADY_CON 0x02 //!< Client is already connected to the server
 #define MSG_ERR_INVALID_CON 0x03 //!< Invalid connection packet
+#define MSG_ERR_NO_ROOM     0x04 //!< The room asked for in the connection packet does not exist
+#define MSG_ERR_NOT_CON     0x05 //!< The sender is not connected to the server, it has to connect again
 
 // COMMS LIB disconnect sources
 #define MSG_DISCONNECT_SRC_CLIENT 0x01 //!< The client sent a disconnect message
@@ -55,7 +87,60 @@ struct Message
 	uint8_t key             = DEFAULT_KEY; //!< Unique client key
 	uint8_t parameters      = 0x00;        //!< Bitset of parameters (who to message, etc.)
 	uint8_t type            = MSG_INVALID; //!< Message type
-	uint8_t data[60];                      //!< Message-specific data
+	uint8_t data[LEGACY_PAYLOAD_SIZE];     //!< Message-specific data
+};
+
+/**
+ * @brief Non-owning view of a message of any payload size
+ * 
+ * Received messages are handed out as views of the receive buffers,
+ * so their payload is never copied. The data pointer is only valid
+ * as long as documented by the function that returned the view.
+ * 
+ * A fixed Message converts to a view of its 60 bytes of data (or
+ * fewer to only send the first ones).
+ */
+struct MessageView
+{
+	uint8_t        playerIDAndTeam = 0x00;        //!< ID and team of the bot sending the message
+	uint8_t        key             = DEFAULT_KEY; //!< Unique client key
+	uint8_t        parameters      = 0x00;        //!< Bitset of parameters (who to message, etc.)
+	uint8_t        type            = MSG_INVALID; //!< Message type
+	uint16_t       size            = 0;           //!< Number of bytes of data, at most MAX_PAYLOAD_SIZE
+	const uint8_t* data            = nullptr;     //!< Message-specific data
+
+	MessageView() = default;
+
+	MessageView(const Message& message, uint16_t payloadSize = LEGACY_PAYLOAD_SIZE)
+	: playerIDAndTeam(message.playerIDAndTeam)
+	, key(message.key)
+	, parameters(message.parameters)
+	, type(message.type)
+	, size(payloadSize < LEGACY_PAYLOAD_SIZE ? payloadSize : LEGACY_PAYLOAD_SIZE)
+	, data(message.data)
+	{
+	}
+
+	/**
+	 * @brief Copy the message to a fixed Message
+	 * 
+	 * The payload is truncated to 60 bytes or padded with zeros.
+	 */
+	Message toMessage() const
+	{
+		Message message;
+		message.playerIDAndTeam = playerIDAndTeam;
+		message.key             = key;
+		message.parameters      = parameters;
+		message.type            = type;
+
+		std::size_t copied = size < LEGACY_PAYLOAD_SIZE ? size : LEGACY_PAYLOAD_SIZE;
+		if (copied > 0)
+			std::memcpy(message.data, data, copied);
+		std::memset(message.data + copied, 0, LEGACY_PAYLOAD_SIZE - copied);
+
+		return message;
+	}
 };
 
 /**
@@ -68,6 +153,64 @@ struct Message
  * * 0-127 ------ User defined
  * * 128-191 ---- TMCP
  * * 192-255 ---- Comms lib specific
+ * 
+ * ~~~~ DATAGRAMS ~~~~
+ * A legacy datagram holds one message, or several messages back to
+ * back when both peers announced MSG_CAP_COALESCE while connecting.
+ * Its size is always a multiple of sizeof(Message).
+ * 
+ * A compact datagram (MSG_CAP_COMPACT) starts with WIRE_VERSION and
+ * holds one or more frames: the 4 header bytes of a Message, the
+ * payload size (2 bytes, big-endian) and the payload itself. A
+ * padding byte is added when its size would otherwise be a multiple
+ * of sizeof(Message), so the format of any datagram is known from
+ * its size alone.
+ * 
+ * Datagrams never exceed MAX_DATAGRAM_SIZE.
+ * 
+ * ~~~~ DELTA STREAMS ~~~~
+ * Messages of the types a client designates as streams of snapshots
+ * are sent with MSG_DELTA once both peers announced MSG_CAP_DELTA.
+ * Each snapshot has a sequence number and is encoded against the
+ * last snapshot the receiver acknowledged with MSG_DELTA_ACK (see
+ * Delta.hpp). The server decodes the snapshots and encodes them again
+ * for each recipient; the others receive full messages.
+ * 
+ * ~~~~ RELIABLE CHANNELS ~~~~
+ * Once both peers announced MSG_CAP_RELIABLE, a message may be sent
+ * with MSG_RELIABLE on one of two channels: its payload starts with
+ * the channel (0: reliable, 1: reliable ordered) and a sequence
+ * number (2 bytes, big-endian). The receiver answers with MSG_ACK,
+ * which is put in the next datagram sent to the peer, and the sender
+ * retransmits what is not acknowledged in time (see Reliable.hpp).
+ * Reliability is hop by hop: the server acknowledges the messages of
+ * a client and sends them again reliably to each recipient.
+ * Delta-encoded snapshots are never reliable.
+ * 
+ * ~~~~ ROOMS ~~~~
+ * A RoomHost runs many isolated servers, its rooms, on one port. A
+ * client joins one with MSG_CONNECT_ROOM, the payload of MSG_CONNECT
+ * starting with the id of the room (4 bytes, big-endian); a request
+ * without it joins room 0. Afterwards the datagrams of the client are
+ * routed to its room by its address and port, so ids, keys and every
+ * other message stay the same as with a single server. A request for
+ * a room that does not exist is answered with MSG_ERR_NO_ROOM.
+ * 
+ * ~~~~ TYPED PAYLOADS ~~~~
+ * The TMCP 1.0 messages carry the structs of Tmcp.hpp, written and
+ * read by the codecs of Codec.hpp, which also serve user-defined
+ * types. Their fields are packed with no padding and, unlike the
+ * headers and payloads of the library, in little-endian byte order,
+ * so a struct is its own payload on common hosts.
+ * 
+ * ~~~~ LIVENESS ~~~~
+ * The server sends MSG_PING to every client periodically, with the
+ * time it was sent (8 bytes, big-endian) as payload. Clients send it
+ * back at once so the server can measure their round-trip time, and
+ * also send MSG_HEARTBEAT every HEARTBEAT_INTERVAL_MS. A client
+ * the server receives nothing from for too long is disconnected and
+ * told so with a private MSG_DISCONNECT. Clients that announced no
+ * MSG_CAP_* capability while connecting do neither and never time out.
  */
 
 #endif // COMMSLIB_MESSAGE_HPP
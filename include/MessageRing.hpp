@@ -0,0 +1,96 @@
+#ifndef COMMSLIB_MESSAGE_RING_HPP
+#define COMMSLIB_MESSAGE_RING_HPP
+
+#include <Message.hpp>
+#include <RingBuffer.hpp>
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+
+namespace cl
+{
+
+/**
+ * @brief Bounded lock-free single-producer single-consumer queue of
+ *        messages of any payload size
+ * 
+ * Messages are stored back to back in a byte buffer, so small
+ * messages take little room. Same threading rules as SpscRing.
+ * 
+ * front() returns a view of the message inside the ring: its payload
+ * is not copied and stays valid until pop().
+ */
+class MessageRing
+{
+public:
+	/**
+	 * @brief Construct a new ring
+	 * 
+	 * @param capacity Size of the buffer in bytes, rounded up to a power of two
+	 */
+	explicit MessageRing(std::size_t capacity);
+
+	MessageRing(const MessageRing&)            = delete;
+	MessageRing& operator=(const MessageRing&) = delete;
+
+	/**
+	 * @brief Copy a message at the end of the ring (producer)
+	 * 
+	 * @return true The message was added
+	 * @return false The ring is full, the message was dropped
+	 */
+	bool push(const MessageView& message);
+
+	/**
+	 * @brief Determine if there is no message to read (consumer)
+	 */
+	bool empty() const;
+
+	/**
+	 * @brief Get a view of the first message (consumer)
+	 * 
+	 * The ring must not be empty. The view is valid until pop().
+	 */
+	MessageView front() const;
+
+	/**
+	 * @brief Remove the first message (consumer)
+	 * 
+	 * The ring must not be empty.
+	 */
+	void pop();
+
+	/**
+	 * @brief Get the number of bytes used (approximate if called concurrently)
+	 */
+	std::size_t size() const;
+
+	std::size_t capacity() const;
+
+	/**
+	 * @brief Get the number of messages dropped because the ring was full
+	 */
+	uint64_t overflowCount() const;
+
+private:
+	/**
+	 * @brief Get the position of the first message, after the unused end of the buffer
+	 */
+	std::size_t frontPosition() const;
+
+	const std::size_t          m_mask;   //!< capacity - 1
+	std::unique_ptr<uint8_t[]> m_buffer; //!< The messages
+
+	alignas(CACHE_LINE_SIZE) std::atomic<std::size_t> m_head; //!< Next byte to read, written by the consumer
+	mutable std::size_t m_cachedTail;                         //!< Consumer's copy of m_tail
+
+	alignas(CACHE_LINE_SIZE) std::atomic<std::size_t> m_tail; //!< Next byte to write, written by the producer
+	std::size_t m_cachedHead;                                 //!< Producer's copy of m_head
+	std::atomic<uint64_t> m_overflowCount;                    //!< Written by the producer
+};
+
+} // cl
+
+#endif // COMMSLIB_MESSAGE_RING_HPP
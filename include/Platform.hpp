@@ -0,0 +1,56 @@
+#ifndef COMMSLIB_PLATFORM_HPP
+#define COMMSLIB_PLATFORM_HPP
+
+/**
+ * @file Platform.hpp
+ *
+ * Socket portability layer. CommsLib was written against WinSock,
+ * so on POSIX systems the WinSock names used throughout the library
+ * (SOCKET, INVALID_SOCKET, WSAGetLastError, WSAE* error codes, ...)
+ * are mapped to their BSD socket/errno equivalents.
+ */
+
+#ifdef _WIN32
+
+	#ifndef WIN32_LEAN_AND_MEAN
+	#define WIN32_LEAN_AND_MEAN
+	#endif
+
+	#ifndef NOMINMAX
+	#define NOMINMAX
+	#endif
+
+	#include <WinSock2.h>
+	#include <WS2tcpip.h>
+
+#else
+
+	#include <arpa/inet.h>
+	#include <errno.h>
+	#include <fcntl.h>
+	#include <netinet/in.h>
+	#include <sys/socket.h>
+	#include <unistd.h>
+
+	#include <cstring>
+
+	typedef int SOCKET;
+
+	#define INVALID_SOCKET (-1)
+	#define SOCKET_ERROR   (-1)
+
+	#define closesocket(s)         ::close(s)
+	#define WSAGetLastError()      (errno)
+	#define WSACleanup()           ((void)0)
+	#define ZeroMemory(dest, size) std::memset((dest), 0, (size))
+
+	#define WSAEWOULDBLOCK EWOULDBLOCK
+	#define WSAEMSGSIZE    EMSGSIZE
+	#define WSAENOBUFS     ENOBUFS
+	// Linux reports an ICMP port unreachable as ECONNREFUSED where
+	// WinSock reports WSAECONNRESET
+	#define WSAECONNRESET  ECONNREFUSED
+
+#endif // _WIN32
+
+#endif // COMMSLIB_PLATFORM_HPP
@@ -0,0 +1,284 @@
+#ifndef COMMSLIB_RELIABLE_HPP
+#define COMMSLIB_RELIABLE_HPP
+
+#include <Message.hpp>
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <vector>
+
+#define RELIABLE_HEADER_SIZE   3   //!< Channel and sequence number before the payload of a reliable message
+#define RELIABLE_ACK_SIZE      7   //!< Channel, latest sequence number and the 32 before it in a MSG_ACK payload
+#define RELIABLE_WINDOW_SIZE   32  //!< Messages of a channel waiting for an acknowledgement at most
+#define RELIABLE_CHANNEL_COUNT 2   //!< Reliable and reliable ordered
+#define RELIABLE_MAX_QUEUED    256 //!< Messages of a channel waiting for room in the window before the peer is considered lost
+
+#define RELIABLE_INITIAL_TIMEOUT_MS 200  //!< Retransmission timeout until the round-trip time is measured
+#define RELIABLE_MIN_TIMEOUT_MS     20   //!< Lower bound of the retransmission timeout
+#define RELIABLE_MAX_TIMEOUT_MS     2000 //!< Upper bound of the retransmission timeout, after backoff
+#define RELIABLE_MAX_RETRIES        10   //!< Retransmissions of a message before the peer is considered lost
+
+#define MAX_RELIABLE_PAYLOAD_SIZE (MAX_PAYLOAD_SIZE - RELIABLE_HEADER_SIZE) //!< Largest payload of a reliable message
+
+namespace cl
+{
+
+/**
+ * @brief Delivery guarantees of a message
+ */
+enum class Delivery : uint8_t
+{
+	Unreliable,     //!< Sent once, may be lost
+	Reliable,       //!< Sent until acknowledged, delivered once in any order
+	ReliableOrdered //!< Sent until acknowledged, delivered once in the order it was sent
+};
+
+/**
+ * @brief Get the delivery of the messages sent without choosing one
+ *
+ * Connections, disconnections and the TMCP messages coordinating a
+ * team are reliable and ordered, everything else is unreliable.
+ */
+Delivery defaultDelivery(uint8_t type);
+
+/**
+ * @brief Get the delivery of a message with MSG_RELIABLE
+ */
+Delivery reliableDelivery(const MessageView& message);
+
+/**
+ * @brief Remove the channel and sequence number of a message with MSG_RELIABLE
+ */
+MessageView stripReliableHeader(const MessageView& message);
+
+/**
+ * @brief Retransmission timeout computed from round-trip time samples
+ *
+ * Smoothed round-trip time and variation as in RFC 6298, the timeout
+ * being the smoothed time plus four times the variation.
+ */
+class RttEstimator
+{
+public:
+	RttEstimator();
+
+	void reset();
+
+	/**
+	 * @brief Add a round-trip time measured on a message sent only once
+	 */
+	void sample(std::chrono::microseconds rtt);
+
+	bool hasSample() const;
+
+	std::chrono::microseconds smoothed() const;
+	std::chrono::microseconds variation() const;
+
+	/**
+	 * @brief Get the time to wait for an acknowledgement before sending again
+	 */
+	std::chrono::microseconds timeout() const;
+
+private:
+	std::chrono::microseconds m_smoothed;
+	std::chrono::microseconds m_variation;
+	std::chrono::microseconds m_timeout;
+	bool                      m_hasSample;
+};
+
+/**
+ * @brief Result of ReliableEndpoint::receive()
+ */
+enum class ReliableStatus
+{
+	Deliver,   //!< The message must be handled now
+	Buffered,  //!< The message was kept until the ones before it arrive
+	Duplicate, //!< The message was already received
+	Malformed  //!< The message has no valid header
+};
+
+/**
+ * @brief State of the reliable channels between two peers
+ *
+ * Each reliable channel numbers the messages sent on it. The sender
+ * keeps them until the receiver acknowledges them, sending them again
+ * when the retransmission timeout expires (doubled after each retry).
+ * The receiver acknowledges the latest sequence number received and
+ * the 32 before it, so a single lost acknowledgement is recovered by
+ * the next one, and drops the duplicates.
+ *
+ * At most RELIABLE_WINDOW_SIZE messages of a channel wait for an
+ * acknowledgement, the next ones are queued until there is room.
+ *
+ * Not thread-safe.
+ */
+class ReliableEndpoint
+{
+public:
+	using Clock = std::chrono::steady_clock;
+
+	ReliableEndpoint();
+
+	/**
+	 * @brief Forget every message sent and received
+	 */
+	void reset();
+
+	/**
+	 * @brief Number a message and keep it until it is acknowledged
+	 *
+	 * @param message The message to send
+	 * @param delivery Reliable or ReliableOrdered
+	 * @param now The current time
+	 * @param payload Where to write the payload with its header, at least
+	 *                RELIABLE_HEADER_SIZE + message.size bytes
+	 * @param reliableMessage Set to the message to send, with MSG_RELIABLE
+	 * @return true The message must be sent now
+	 * @return false The window of the channel is full, the message is
+	 *               queued and returned by retransmit() once there is room
+	 */
+	bool send(const MessageView& message, Delivery delivery, Clock::time_point now,
+	          uint8_t* payload, MessageView& reliableMessage);
+
+	/**
+	 * @brief Get the messages to send now
+	 *
+	 * @param now The current time
+	 * @param messages Array to fill with the messages whose retransmission
+	 *                 timeout expired, then the queued messages the
+	 *                 window has room for
+	 * @param maxCount Size of the array
+	 * @return std::size_t Number of messages written to the array
+	 *
+	 * The views are valid until the next call to send() or receiveAcks().
+	 */
+	std::size_t retransmit(Clock::time_point now, MessageView* messages, std::size_t maxCount);
+
+	/**
+	 * @brief Determine if the peer stopped acknowledging messages
+	 *
+	 * A message was sent RELIABLE_MAX_RETRIES times without being
+	 * acknowledged, or RELIABLE_MAX_QUEUED messages are queued.
+	 */
+	bool lost() const;
+
+	/**
+	 * @brief Get the time of the next retransmission, or Clock::time_point::max()
+	 */
+	Clock::time_point nextRetransmit() const;
+
+	/**
+	 * @brief Release the messages acknowledged by a MSG_ACK payload
+	 */
+	void receiveAcks(const uint8_t* data, std::size_t size, Clock::time_point now);
+
+	/**
+	 * @brief Get the number of messages waiting for an acknowledgement or queued
+	 */
+	std::size_t pendingCount() const;
+
+	/**
+	 * @brief Get the number of messages waiting for room in the window
+	 */
+	std::size_t queuedCount() const;
+
+	/**
+	 * @brief Get the number of messages sent again since the last reset()
+	 */
+	uint64_t retransmissionCount() const;
+
+	const RttEstimator& rtt() const;
+
+	/**
+	 * @brief Record a message received with MSG_RELIABLE
+	 *
+	 * @param message The message, with its header
+	 * @return ReliableStatus What to do with the message
+	 */
+	ReliableStatus receive(const MessageView& message);
+
+	/**
+	 * @brief Get the next buffered message that can be delivered in order
+	 *
+	 * @param message Set to the message, with its header
+	 * @return true A message can be delivered
+	 * @return false The next message in order was not received yet
+	 *
+	 * The view is valid until the next call to receive().
+	 */
+	bool nextOrdered(MessageView& message);
+
+	/**
+	 * @brief Determine if messages were received since the last writeAcks()
+	 */
+	bool ackPending() const;
+
+	/**
+	 * @brief Write the acknowledgements of the channels that received messages
+	 *
+	 * @param output Where to write, RELIABLE_CHANNEL_COUNT * RELIABLE_ACK_SIZE bytes
+	 * @return std::size_t Size of the MSG_ACK payload, 0 if nothing to acknowledge
+	 */
+	std::size_t writeAcks(uint8_t* output);
+
+private:
+	struct StoredMessage
+	{
+		bool                 used     = false;
+		uint16_t             sequence = 0;
+		MessageView          header;  //!< Header of the message, data points to payload
+		std::vector<uint8_t> payload; //!< Payload with its reliable header
+	};
+
+	struct PendingMessage : StoredMessage
+	{
+		Clock::time_point sentTime; //!< First time the message was sent
+		Clock::time_point deadline; //!< Time of the next retransmission
+		unsigned int      retries = 0;
+	};
+
+	struct SendChannel
+	{
+		uint16_t                  nextSequence = 0;
+		PendingMessage            pending[RELIABLE_WINDOW_SIZE];
+		std::deque<StoredMessage> queued; //!< Messages waiting for room in the window, not numbered yet
+	};
+
+	struct ReceiveChannel
+	{
+		bool          received     = false; //!< A message was received
+		uint16_t      latest       = 0;     //!< Newest sequence number received
+		uint32_t      history      = 0;     //!< Bit n: latest - n - 1 was received
+		bool          ackPending   = false;
+		uint16_t      nextDelivery = 0;     //!< Next sequence number delivered in order
+		StoredMessage buffered[RELIABLE_WINDOW_SIZE];
+	};
+
+	/**
+	 * @brief Record a sequence number in the history of a channel
+	 *
+	 * @return true The sequence number was not received before
+	 */
+	static bool record(ReceiveChannel& channel, uint16_t sequence);
+
+	static void store(StoredMessage& stored, uint16_t sequence, const MessageView& message);
+
+	/**
+	 * @brief Number a message stored with its header and keep it until it is acknowledged
+	 */
+	void number(SendChannel& channel, uint8_t channelIndex, StoredMessage& stored, Clock::time_point now);
+
+	SendChannel    m_sendChannels[RELIABLE_CHANNEL_COUNT];
+	ReceiveChannel m_receiveChannels[RELIABLE_CHANNEL_COUNT];
+
+	std::size_t  m_pendingCount;
+	bool         m_lost;
+	uint64_t     m_retransmissionCount;
+	RttEstimator m_rtt;
+};
+
+} // cl
+
+#endif // COMMSLIB_RELIABLE_HPP
@@ -0,0 +1,401 @@
+#ifndef COMMSLIB_RING_BUFFER_HPP
+#define COMMSLIB_RING_BUFFER_HPP
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+
+#define CACHE_LINE_SIZE 64 //!< Used to keep indices written by different threads apart
+
+namespace cl
+{
+
+/**
+ * @brief Round a ring capacity up to a power of two (at least 2)
+ */
+inline std::size_t ringCapacity(std::size_t capacity)
+{
+	std::size_t result = 2;
+	while (result < capacity)
+		result <<= 1;
+
+	return result;
+}
+
+/**
+ * @brief Bounded lock-free single-producer single-consumer queue
+ *
+ * @tparam T The type of the elements, must be default constructible
+ *
+ * push() may only be called by one thread at a time and front(),
+ * pop(), tryPop() and empty() by one (possibly other) thread at a
+ * time. The interface mirrors std::queue so it can replace one.
+ *
+ * Elements are never allocated after construction: push() fails and
+ * increments the overflow counter when the ring is full.
+ */
+template <typename T>
+class SpscRing
+{
+public:
+	/**
+	 * @brief Construct a new ring
+	 *
+	 * @param capacity Number of elements, rounded up to a power of two
+	 */
+	explicit SpscRing(std::size_t capacity);
+
+	SpscRing(const SpscRing&)            = delete;
+	SpscRing& operator=(const SpscRing&) = delete;
+
+	/**
+	 * @brief Add an element at the end of the ring (producer)
+	 *
+	 * @return true The element was added
+	 * @return false The ring is full, the element was dropped
+	 */
+	bool push(const T& value);
+
+	/**
+	 * @brief Determine if there is no element to read (consumer)
+	 */
+	bool empty() const;
+
+	/**
+	 * @brief Access the first element without copying it (consumer)
+	 *
+	 * The ring must not be empty. The reference is valid until pop().
+	 */
+	T& front();
+
+	/**
+	 * @brief Remove the first element (consumer)
+	 *
+	 * The ring must not be empty.
+	 */
+	void pop();
+
+	/**
+	 * @brief Copy and remove the first element if there is one (consumer)
+	 *
+	 * @return true An element was read
+	 * @return false The ring is empty
+	 */
+	bool tryPop(T& value);
+
+	/**
+	 * @brief Get the number of elements (approximate if called concurrently)
+	 */
+	std::size_t size() const;
+
+	std::size_t capacity() const;
+
+	/**
+	 * @brief Get the number of elements dropped because the ring was full
+	 */
+	uint64_t overflowCount() const;
+
+private:
+	const std::size_t    m_mask;   //!< capacity - 1
+	std::unique_ptr<T[]> m_buffer; //!< The elements
+
+	alignas(CACHE_LINE_SIZE) std::atomic<std::size_t> m_head; //!< Next element to read, written by the consumer
+	mutable std::size_t m_cachedTail;                         //!< Consumer's copy of m_tail
+
+	alignas(CACHE_LINE_SIZE) std::atomic<std::size_t> m_tail; //!< Next element to write, written by the producer
+	std::size_t m_cachedHead;                                 //!< Producer's copy of m_head
+	std::atomic<uint64_t> m_overflowCount;                    //!< Written by the producer
+};
+
+/**
+ * @brief Bounded lock-free multiple-producer single-consumer queue
+ *
+ * @tparam T The type of the elements, must be default constructible
+ *
+ * Same interface as SpscRing, but push() may be called by any number
+ * of threads concurrently. Each element has a sequence number telling
+ * the consumer whether it was completely written.
+ */
+template <typename T>
+class MpscRing
+{
+public:
+	/**
+	 * @brief Construct a new ring
+	 *
+	 * @param capacity Number of elements, rounded up to a power of two
+	 */
+	explicit MpscRing(std::size_t capacity);
+
+	MpscRing(const MpscRing&)            = delete;
+	MpscRing& operator=(const MpscRing&) = delete;
+
+	/**
+	 * @brief Add an element at the end of the ring (any producer)
+	 *
+	 * @return true The element was added
+	 * @return false The ring is full, the element was dropped
+	 */
+	bool push(const T& value);
+
+	/**
+	 * @brief Determine if there is no element to read (consumer)
+	 *
+	 * An element being written by a producer is not readable yet.
+	 */
+	bool empty() const;
+
+	/**
+	 * @brief Access the first element without copying it (consumer)
+	 *
+	 * The ring must not be empty. The reference is valid until pop().
+	 */
+	T& front();
+
+	/**
+	 * @brief Remove the first element (consumer)
+	 *
+	 * The ring must not be empty.
+	 */
+	void pop();
+
+	/**
+	 * @brief Copy and remove the first element if there is one (consumer)
+	 *
+	 * @return true An element was read
+	 * @return false The ring is empty
+	 */
+	bool tryPop(T& value);
+
+	/**
+	 * @brief Get the number of elements (approximate if called concurrently)
+	 */
+	std::size_t size() const;
+
+	std::size_t capacity() const;
+
+	/**
+	 * @brief Get the number of elements dropped because the ring was full
+	 */
+	uint64_t overflowCount() const;
+
+private:
+	struct Cell
+	{
+		std::atomic<std::size_t> sequence; //!< position + 1 once written, position + capacity once read
+		T                        value;
+	};
+
+	const std::size_t       m_mask;  //!< capacity - 1
+	std::unique_ptr<Cell[]> m_cells; //!< The elements
+
+	alignas(CACHE_LINE_SIZE) std::atomic<std::size_t> m_head; //!< Next element to read, written by the consumer
+
+	alignas(CACHE_LINE_SIZE) std::atomic<std::size_t> m_tail; //!< Next element to claim, shared by the producers
+	std::atomic<uint64_t> m_overflowCount;                    //!< Shared by the producers
+};
+
+// SpscRing
+
+template <typename T>
+SpscRing<T>::SpscRing(std::size_t capacity)
+: m_mask(ringCapacity(capacity) - 1)
+, m_buffer(new T[m_mask + 1])
+, m_head(0)
+, m_cachedTail(0)
+, m_tail(0)
+, m_cachedHead(0)
+, m_overflowCount(0)
+{
+}
+
+template <typename T>
+bool SpscRing<T>::push(const T& value)
+{
+	std::size_t tail = m_tail.load(std::memory_order_relaxed);
+
+	// only read the consumer's index when the ring looks full
+	if (tail - m_cachedHead > m_mask)
+	{
+		m_cachedHead = m_head.load(std::memory_order_acquire);
+		if (tail - m_cachedHead > m_mask)
+		{
+			m_overflowCount.fetch_add(1, std::memory_order_relaxed);
+			return false;
+		}
+	}
+
+	m_buffer[tail & m_mask] = value;
+	m_tail.store(tail + 1, std::memory_order_release);
+
+	return true;
+}
+
+template <typename T>
+bool SpscRing<T>::empty() const
+{
+	std::size_t head = m_head.load(std::memory_order_relaxed);
+
+	// only read the producer's index when the ring looks empty
+	if (head == m_cachedTail)
+		m_cachedTail = m_tail.load(std::memory_order_acquire);
+
+	return head == m_cachedTail;
+}
+
+template <typename T>
+T& SpscRing<T>::front()
+{
+	return m_buffer[m_head.load(std::memory_order_relaxed) & m_mask];
+}
+
+template <typename T>
+void SpscRing<T>::pop()
+{
+	m_head.store(m_head.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+}
+
+template <typename T>
+bool SpscRing<T>::tryPop(T& value)
+{
+	if (empty())
+		return false;
+
+	value = front();
+	pop();
+
+	return true;
+}
+
+template <typename T>
+std::size_t SpscRing<T>::size() const
+{
+	// read the head first so it can't get past the tail
+	std::size_t head = m_head.load(std::memory_order_acquire);
+	return m_tail.load(std::memory_order_acquire) - head;
+}
+
+template <typename T>
+std::size_t SpscRing<T>::capacity() const
+{
+	return m_mask + 1;
+}
+
+template <typename T>
+uint64_t SpscRing<T>::overflowCount() const
+{
+	return m_overflowCount.load(std::memory_order_relaxed);
+}
+
+// MpscRing
+
+template <typename T>
+MpscRing<T>::MpscRing(std::size_t capacity)
+: m_mask(ringCapacity(capacity) - 1)
+, m_cells(new Cell[m_mask + 1])
+, m_head(0)
+, m_tail(0)
+, m_overflowCount(0)
+{
+	for (std::size_t i = 0; i <= m_mask; i++)
+		m_cells[i].sequence.store(i, std::memory_order_relaxed);
+}
+
+template <typename T>
+bool MpscRing<T>::push(const T& value)
+{
+	std::size_t position = m_tail.load(std::memory_order_relaxed);
+	Cell*       cell;
+
+	// claim a cell: it is free once its sequence number equals the position
+	while (true)
+	{
+		cell = &m_cells[position & m_mask];
+		std::size_t    sequence   = cell->sequence.load(std::memory_order_acquire);
+		std::ptrdiff_t difference = static_cast<std::ptrdiff_t>(sequence - position);
+
+		if (difference == 0)
+		{
+			if (m_tail.compare_exchange_weak(position, position + 1, std::memory_order_relaxed))
+				break;
+		}
+		else if (difference < 0)
+		{
+			// the consumer has not read this cell yet
+			m_overflowCount.fetch_add(1, std::memory_order_relaxed);
+			return false;
+		}
+		else
+		{
+			// another producer claimed the cell
+			position = m_tail.load(std::memory_order_relaxed);
+		}
+	}
+
+	cell->value = value;
+	cell->sequence.store(position + 1, std::memory_order_release);
+
+	return true;
+}
+
+template <typename T>
+bool MpscRing<T>::empty() const
+{
+	std::size_t head = m_head.load(std::memory_order_relaxed);
+	return m_cells[head & m_mask].sequence.load(std::memory_order_acquire) != head + 1;
+}
+
+template <typename T>
+T& MpscRing<T>::front()
+{
+	return m_cells[m_head.load(std::memory_order_relaxed) & m_mask].value;
+}
+
+template <typename T>
+void MpscRing<T>::pop()
+{
+	std::size_t head = m_head.load(std::memory_order_relaxed);
+
+	// hand the cell back to the producers for the next lap
+	m_cells[head & m_mask].sequence.store(head + m_mask + 1, std::memory_order_release);
+	m_head.store(head + 1, std::memory_order_relaxed);
+}
+
+template <typename T>
+bool MpscRing<T>::tryPop(T& value)
+{
+	if (empty())
+		return false;
+
+	value = front();
+	pop();
+
+	return true;
+}
+
+template <typename T>
+std::size_t MpscRing<T>::size() const
+{
+	std::size_t tail = m_tail.load(std::memory_order_acquire);
+	std::size_t head = m_head.load(std::memory_order_acquire);
+
+	// claimed cells may not be written yet
+	return tail > head ? tail - head : 0;
+}
+
+template <typename T>
+std::size_t MpscRing<T>::capacity() const
+{
+	return m_mask + 1;
+}
+
+template <typename T>
+uint64_t MpscRing<T>::overflowCount() const
+{
+	return m_overflowCount.load(std::memory_order_relaxed);
+}
+
+} // cl
+
+#endif // COMMSLIB_RING_BUFFER_HPP
@@ -0,0 +1,275 @@
+#ifndef COMMSLIB_ROOM_HOST_HPP
+#define COMMSLIB_ROOM_HOST_HPP
+
+#include <Message.hpp>
+#include <Platform.hpp>
+#include <RingBuffer.hpp>
+#include <Server.hpp>
+#include <Stats.hpp>
+#include <TimerWheel.hpp>
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#define MAX_ROOMS        4096 //!< Most rooms of a RoomHost
+#define MAX_ROOM_WORKERS 16   //!< Most worker threads of a RoomHost
+
+#define ROOM_BATCH_SIZE 64 //!< Maximum number of datagrams read by a single system call of a RoomHost
+
+#define ROOM_QUEUE_CAPACITY 32 //!< Maximum number of messages waiting to be sent for the application of a room, @see APPLICATION_QUEUE_CAPACITY
+
+namespace cl
+{
+
+/**
+ * @brief Counters of a RoomHost, the rooms have their own, @see Server::stats
+ */
+struct RoomHostStats
+{
+	uint64_t rooms             = 0; //!< Rooms open
+	uint64_t waitCalls         = 0; //!< poll() calls of the receive thread and the workers
+	uint64_t receiveCalls      = 0; //!< recvmmsg() calls
+	uint64_t datagramsReceived = 0; //!< Datagrams read from the socket
+	uint64_t datagramsDropped  = 0; //!< Datagrams of no room, or of a room whose inbox was full
+};
+
+/**
+ * @brief Many isolated servers, the rooms, sharing one UDP port and a few threads
+ *
+ * Each room is a Server with its own clients, ids, keys, timers,
+ * reliable channels and delta streams, and is used by the application
+ * like any other server. Clients choose their room when connecting
+ * (MSG_CONNECT_ROOM); the host then routes their datagrams by their
+ * address and port.
+ *
+ * A single receive thread reads the socket in batches and copies each
+ * datagram to the inbox of its room. It keeps its own cache of the
+ * routes, so the lock of the host is only taken by the batches that
+ * follow a connection, a disconnection or the closing of a room.
+ *
+ * The rooms have no thread: each one is assigned to one of the
+ * workers, which steps it when it has datagrams, messages of the
+ * application or timers due, and sleeps otherwise. An idle room costs
+ * no system call and no wakeup, only the memory of its Server, most of
+ * which is never touched.
+ *
+ * Only available on Linux.
+ */
+class RoomHost
+{
+public:
+	/**
+	 * @brief Construct a new RoomHost object, bind its socket and start its threads
+	 *
+	 * @param port the port on which to bind the socket
+	 * @param workers threads running the rooms, at most MAX_ROOM_WORKERS
+	 * @param tickRate tick rate of the rooms, @see Server::Server
+	 * @param maxDatagramSize largest datagram sent by the rooms, @see Server::Server
+	 */
+	RoomHost(uint16_t port, unsigned int workers = 1, unsigned int tickRate = DEFAULT_TICK_RATE,
+	         uint16_t maxDatagramSize = DEFAULT_MAX_DATAGRAM_SIZE);
+
+	/**
+	 * @brief Destroy the RoomHost object, its rooms, and close the socket
+	 */
+	~RoomHost();
+
+	RoomHost(const RoomHost&)            = delete;
+	RoomHost& operator=(const RoomHost&) = delete;
+
+	/**
+	 * @brief Stop the threads, the rooms stop running
+	 *
+	 * Called by ~RoomHost(). The rooms stay valid until then.
+	 */
+	void stop();
+
+	bool isRunning() const;
+
+	/**
+	 * @brief Open a room the clients can join
+	 *
+	 * @param room Id of the room, sent by the clients in MSG_CONNECT.
+	 *             Clients connecting without an id join room 0.
+	 * @return Server* The room, owned by the host. nullptr if it already
+	 *         exists, MAX_ROOMS are open or the host is not running.
+	 *
+	 * The room is assigned to the worker with the fewest rooms.
+	 */
+	Server* openRoom(uint32_t room);
+
+	/**
+	 * @brief Close a room and destroy it
+	 *
+	 * @return false There is no such room
+	 *
+	 * Waits until its worker let go of it. Its clients are not told, they
+	 * time out like when a server stops without sending MSG_SERVER_STOP.
+	 */
+	bool closeRoom(uint32_t room);
+
+	/**
+	 * @brief Find a room
+	 *
+	 * @return Server* The room, nullptr if it is not open
+	 */
+	Server* room(uint32_t room) const;
+
+	std::size_t roomCount() const;
+
+	RoomHostStats stats() const;
+
+private:
+	friend class Server;
+
+	/**
+	 * @brief A room of the host, its index is the slot of the room
+	 */
+	struct RoomSlot
+	{
+		Server*              room     = nullptr;   //!< Room using the slot, under m_mutex
+		std::atomic<Server*> running  { nullptr }; //!< Room stepped by the worker, nullptr once it let go
+		std::atomic<bool>    signaled { false };   //!< The slot is in the ready queue of the worker
+	};
+
+	/**
+	 * @brief A thread running the rooms of the slots slot % m_workerCount == index
+	 */
+	struct Worker
+	{
+		Worker(unsigned int index, std::size_t capacity);
+
+		unsigned int             index;
+		MpscRing<std::size_t>    ready;     //!< Slots of the rooms to step, each at most once
+		TimerWheel               timers;    //!< Next deadline of each room, by slot / m_workerCount
+		int                      wakeup;    //!< eventfd written by wake() while the worker sleeps
+		std::atomic<bool>        sleeping;  //!< The worker is about to wait or waiting
+		std::vector<std::size_t> freeSlots; //!< Slots of the worker without a room, under m_mutex
+		StatCounter              waitCalls;
+		std::thread              thread;
+	};
+
+	/**
+	 * @brief Read the socket and route the datagrams until stop() is called
+	 */
+	void receive();
+
+	/**
+	 * @brief Route the datagrams of the socket to the rooms, until it is empty
+	 */
+	void receiveDatagrams();
+
+	/**
+	 * @brief Pass the ICMP errors of the error queue to the room of the unreachable clients
+	 */
+	void readErrorQueue();
+
+	/**
+	 * @brief Clear the route cache if the routes changed since it was filled (receive thread)
+	 *
+	 * Tells closeRoom() the rooms closed since are no longer cached.
+	 */
+	void refreshRoutes();
+
+	/**
+	 * @brief Find the room of a client, in the route cache or else under m_mutex (receive thread)
+	 *
+	 * @param lock Locked on a cache miss and left locked, so a batch takes m_mutex at most once
+	 * @return Server* The room, nullptr if none
+	 */
+	Server* findRoute(uint32_t address, uint16_t port, std::unique_lock<std::mutex>& lock);
+
+	/**
+	 * @brief Find the room of a datagram (receive thread)
+	 *
+	 * @param lock @see findRoute
+	 * @param noRoom Set if the datagram is a connection request for a room that is not open
+	 * @return Server* The room, nullptr if none
+	 *
+	 * A connection request goes to the room it asks for, looked up under
+	 * m_mutex. Other datagrams go to the room of their sender.
+	 */
+	Server* findRoom(const sockaddr_in& sender, const uint8_t* datagram, std::size_t size,
+	                 std::unique_lock<std::mutex>& lock, bool& noRoom);
+
+	/**
+	 * @brief Answer a connection request for a room that is not open with MSG_ERR_NO_ROOM
+	 *
+	 * Called without m_mutex, the socket may block.
+	 */
+	void sendNoRoom(const sockaddr_in& recipient, const uint8_t* request);
+
+	/**
+	 * @brief Step the rooms of a worker until stop() is called
+	 */
+	void work(Worker& worker);
+
+	/**
+	 * @brief Step a room and schedule its next deadline, or let go of it if it stopped
+	 */
+	void process(Worker& worker, std::size_t slot);
+
+	/**
+	 * @brief Have the worker of a room step it (any thread)
+	 */
+	void wake(std::size_t slot);
+
+	/**
+	 * @brief Route the datagrams of a client to a room, called by the room when it connects
+	 *
+	 * The route cache of the receive thread is cleared, like by unroute()
+	 * and closeRoom(), so it never keeps a route that changed.
+	 */
+	void route(uint32_t address, uint16_t port, std::size_t slot);
+
+	/**
+	 * @brief Stop routing the datagrams of a client, if they still go to the room
+	 */
+	void unroute(uint32_t address, uint16_t port, std::size_t slot);
+
+	SOCKET m_socket; //!< Socket of every room
+	int    m_wakeup; //!< eventfd waking the receive thread up for stop()
+
+	unsigned int m_tickRate;
+	uint16_t     m_maxDatagramSize;
+
+	mutable std::mutex                        m_mutex;           //!< Guards the rooms and the routes
+	std::condition_variable                   m_released;        //!< Notified when a worker or the receive thread lets go of a room
+	std::unordered_map<uint32_t, std::size_t> m_rooms;           //!< Slot of each room by id
+	std::unordered_map<uint64_t, std::size_t> m_routes;          //!< Slot of the room of each client, by address << 16 | port
+	std::atomic<uint64_t>                     m_routesVersion;   //!< Incremented under m_mutex when the routes change
+	uint64_t                                  m_receiverVersion; //!< Version of the route cache, written under m_mutex, UINT64_MAX while no receive thread runs
+	std::unique_ptr<RoomSlot[]>               m_slots;           //!< MAX_ROOMS slots
+
+	std::unordered_map<uint64_t, Server*> m_routeCache; //!< Room of the clients seen since the routes changed, nullptr if none. Receive thread only.
+
+	unsigned int                         m_workerCount;
+	std::vector<std::unique_ptr<Worker>> m_workers;
+
+#ifndef _WIN32
+	mmsghdr     m_headers[ROOM_BATCH_SIZE];   //!< recvmmsg() headers
+	iovec       m_vectors[ROOM_BATCH_SIZE];   //!< Buffer of each datagram
+	sockaddr_in m_addresses[ROOM_BATCH_SIZE]; //!< Senders of the datagrams
+#endif // _WIN32
+
+	std::unique_ptr<uint8_t[]> m_buffers; //!< Datagrams of the batch
+
+	StatCounter m_waitCalls;
+	StatCounter m_receiveCalls;
+	StatCounter m_datagramsReceived;
+	StatCounter m_datagramsDropped;
+
+	std::atomic<bool> m_continueExecution; //!< Used to safely stop the host
+	std::thread       m_thread;            //!< The receive thread
+};
+
+} // cl
+
+#endif // COMMSLIB_ROOM_HOST_HPP
@@ -1,31 +1,51 @@
 #ifndef COMMSLIB_SERVER_HPP
 #define COMMSLIB_SERVER_HPP
 
+#include <ClientTable.hpp>
+#include <Delta.hpp>
+#include <IoEngine.hpp>
+#include <IoUring.hpp>
 #include <Message.hpp>
+#include <MessageRing.hpp>
+#include <Platform.hpp>
 #include <ReceiveStatus.hpp>
+#include <Reliable.hpp>
+#include <RingBuffer.hpp>
+#include <ServerShard.hpp>
+#include <SharedMemory.hpp>
+#include <Stats.hpp>
+#include <TimerWheel.hpp>
+#include <Transport.hpp>
+#include <UnixSocket.hpp>
+#include <Wire.hpp>
 
+#include <atomic>
+#include <chrono>
+#include <memory>
 #include <mutex>
-#include <queue>
+#include <string>
 #include <thread>
+#include <unordered_map>
 #include <vector>
 
-#ifdef _WIN32
-	
-	#ifndef WIN32_LEAN_AND_MEAN
-	#define WIN32_LEAN_AND_MEAN
-	#endif
+#define DEFAULT_TICK_RATE 120 //!< Default number of server updates per second
 
-	#ifndef NOMINMAX
-	#define NOMINMAX
-	#endif
+#define RECEIVE_BATCH_SIZE 64 //!< Maximum number of datagrams read by a single system call
 
-	#include <WinSock2.h>
+#define MESSAGE_BUFFER_SIZE 262144 //!< Bytes of messages buffered between two dispatches
 
-#endif // _WIN32
+#define APPLICATION_INBOX_SIZE 131072 //!< Bytes of dispatched messages waiting for poll()
+
+#define APPLICATION_QUEUE_CAPACITY 1024 //!< Maximum number of messages waiting to be sent for the application
+
+#define DEFAULT_PING_INTERVAL_MS  1000  //!< Default time between two pings of the clients
+#define DEFAULT_CLIENT_TIMEOUT_MS 10000 //!< Default time without any message before a client is disconnected (legacy clients never are)
 
 namespace cl
 {
 
+class RoomHost;
+
 /**
  * @brief Server class. Handles everything related to the server.
  * 
@@ -39,8 +59,38 @@ public:
 	 * @brief Construct a new Server object and start it
 	 * 
 	 * @param port the port on which to bind the server
+	 * @param tickRate number of times per second buffered messages are
+	 *                 dispatched to the clients. 0 dispatches them as soon
+	 *                 as they are received.
+	 * @param maxDatagramSize largest datagram sent to the clients that
+	 *                        accept several messages per datagram,
+	 *                        clamped between sizeof(Message) and
+	 *                        MAX_DATAGRAM_SIZE
+	 * @param transport Transport::SharedMemory also hands out shared
+	 *                  memory channels to the clients on the same host
+	 *                  asking for one. Transport::UnixDatagram also
+	 *                  receives datagrams on a Unix socket. UDP is
+	 *                  always available.
+	 * @param unixPath Endpoint of the Unix socket: a filesystem path, or
+	 *                 a name in the abstract namespace if it starts with
+	 *                 '@'. Empty for UNIX_SOCKET_PREFIX<port>.dgram.
+	 * @param engine IoEngine::IoUring waits for, receives and sends the
+	 *               datagrams of the UDP socket with io_uring, and falls
+	 *               back to IoEngine::Epoll if the kernel lacks it
+	 * @param threads Threads receiving and sending UDP datagrams, at most
+	 *                MAX_SERVER_THREADS. Besides the server thread, each
+	 *                one is a ServerShard with its own socket on the port
+	 *                (Linux only). Messages are still handled in order by
+	 *                the server thread.
+	 * 
+	 * Between two ticks, the server thread sleeps until data arrives. A
+	 * tick is only awaited while messages are pending: with any tick rate,
+	 * 0 included, an idle server sleeps until a datagram, a message of the
+	 * application or its next timer wakes it up.
 	 */
-	Server(uint16_t port);
+	Server(uint16_t port, unsigned int tickRate = DEFAULT_TICK_RATE, uint16_t maxDatagramSize = DEFAULT_MAX_DATAGRAM_SIZE,
+	       Transport transport = Transport::Udp, const std::string& unixPath = std::string(),
+	       IoEngine engine = IoEngine::Epoll, unsigned int threads = 1);
 
 	/**
 	 * @brief Destroy the Server object and close the socket
@@ -54,7 +104,8 @@ public:
 	/**
 	 * @brief Manually stop the server
 	 * 
-	 * This is the function called by ~Server().
+	 * This is the function called by ~Server(). It wakes up the
+	 * server thread and waits for it to finish.
 	 * 
 	 * @see ~Server
 	 */
@@ -72,40 +123,313 @@ public:
 	 * @brief Display a list of connected clients with relevent data
 	 * 
 	 * Formats a table to display the RLBot id, team, key, address, port,
-	 * ping (if requested), and last heartbeat (if requested)
+	 * time since the last message and, if requested, the smoothed
+	 * round-trip time and jitter. The table is written to the standard
+	 * output whatever the log level, after the messages logged so far.
 	 */
 	void printClients(bool showPing = false) const;
 
 	/**
-	 * @brief Ping all connected clients
+	 * @brief Ping all connected clients during the next dispatch
+	 * 
+	 * The clients are also pinged every ping interval. This method only
+	 * asks the server thread to send a ping request to all clients
+	 * without waiting for the interval, and sets their isPinging member.
 	 * 
-	 * If the delay is superior to 1 second, we remove the client
-	 * from the list of connected clients.
+	 * Safe to call from any thread while the server is running.
 	 * 
-	 * This method only sends a ping request to all clients and
-	 * changes the isPinging member of Client for all of them.
+	 * @see setPingInterval
 	 */
 	void pingClients();
 
+	/**
+	 * @brief Set the time between two pings of the clients
+	 * 
+	 * @param interval The interval, 0 to only ping when pingClients() is
+	 *                 called. DEFAULT_PING_INTERVAL_MS by default.
+	 * 
+	 * Each answer updates the smoothed round-trip time (gain 1/8) and
+	 * jitter (gain 1/16) of the client. Safe to call from any thread.
+	 */
+	void setPingInterval(std::chrono::milliseconds interval);
+
+	/**
+	 * @brief Set the time without any message after which a client is disconnected
+	 * 
+	 * @param timeout The timeout, 0 to never disconnect silent clients.
+	 *                DEFAULT_CLIENT_TIMEOUT_MS by default.
+	 * 
+	 * Answers to pings and heartbeats count as messages, so the timeout
+	 * should be a few ping intervals long. The client and the others
+	 * receive a MSG_DISCONNECT from the server. Safe to call from any thread.
+	 * 
+	 * Only the clients that negotiated at least one MSG_CAP_* capability
+	 * are disconnected: legacy clients answer no ping and send no
+	 * heartbeat, so they could not be told apart from silent ones.
+	 */
+	void setClientTimeout(std::chrono::milliseconds timeout);
+
+	/**
+	 * @brief Read the messages received by the server
+	 * 
+	 * @param messages Array to fill with the oldest messages
+	 * @param maxCount Size of the array
+	 * @return std::size_t Number of messages written to the array
+	 * 
+	 * Every message dispatched by the server (relayed messages,
+	 * private messages for the server, connections and disconnections)
+	 * is made available here, once per dispatch. Never blocks.
+	 * 
+	 * Safe to call while the server is running, but from only one
+	 * thread at a time. Messages are dropped if the application does
+	 * not read them fast enough.
+	 * 
+	 * Payloads are truncated to 60 bytes, use poll(MessageView&) to
+	 * read larger ones.
+	 */
+	std::size_t poll(Message* messages, std::size_t maxCount);
+
+	/**
+	 * @brief Read the next message received by the server without copying it
+	 * 
+	 * @param message The view to fill
+	 * @return true A message was read
+	 * @return false There is no message
+	 * 
+	 * The view stays valid until the next call to poll(). Same rules
+	 * as poll(Message*, std::size_t).
+	 */
+	bool poll(MessageView& message);
+
+	/**
+	 * @brief Send a message to a single client
+	 * 
+	 * @param idAndTeam RLBot id and team of the recipient
+	 * @param message The message. The key is set by the server.
+	 * @return true The message will be sent during the next dispatch
+	 * @return false Too many messages are waiting to be sent
+	 * 
+	 * Safe to call from any number of threads while the server is
+	 * running. Nothing is sent if the client is not connected.
+	 * 
+	 * The message is sent with defaultDelivery(message.type).
+	 */
+	bool sendTo(uint8_t idAndTeam, const Message& message);
+
+	/**
+	 * @brief Send a message of any payload size to a single client
+	 * 
+	 * @see sendTo(uint8_t, const Message&)
+	 * 
+	 * The payload is copied, it must be at most MAX_PAYLOAD_SIZE bytes.
+	 */
+	bool sendTo(uint8_t idAndTeam, const MessageView& message);
+
+	/**
+	 * @brief Send a message to a single client with the given delivery
+	 * 
+	 * @see sendTo(uint8_t, const MessageView&)
+	 * 
+	 * Reliable messages are sent until the client acknowledges them if
+	 * it supports MSG_CAP_RELIABLE, and once otherwise. Their payload
+	 * must be at most MAX_RELIABLE_PAYLOAD_SIZE bytes.
+	 */
+	bool sendTo(uint8_t idAndTeam, const MessageView& message, Delivery delivery);
+
+	/**
+	 * @brief Send a message to the teams in message.parameters
+	 * 
+	 * @param message The message. The key is set by the server.
+	 * @return true The message will be sent during the next dispatch
+	 * @return false Too many messages are waiting to be sent
+	 * 
+	 * Use MSG_ALL to message all clients. Safe to call from any
+	 * number of threads while the server is running.
+	 * 
+	 * The message is sent with defaultDelivery(message.type).
+	 */
+	bool broadcast(const Message& message);
+
+	/**
+	 * @brief Send a message of any payload size to the teams in message.parameters
+	 * 
+	 * @see broadcast(const Message&)
+	 * 
+	 * The payload is copied, it must be at most MAX_PAYLOAD_SIZE bytes.
+	 */
+	bool broadcast(const MessageView& message);
+
+	/**
+	 * @brief Send a message to the teams in message.parameters with the given delivery
+	 * 
+	 * @see broadcast(const MessageView&)
+	 * @see sendTo(uint8_t, const MessageView&, Delivery)
+	 */
+	bool broadcast(const MessageView& message, Delivery delivery);
+
+	/**
+	 * @brief Get the traffic counters of the server and of its clients
+	 * 
+	 * @return ServerStats A snapshot of the counters
+	 * 
+	 * The server thread keeps counting while the snapshot is taken,
+	 * so counters read one after the other may be a few messages
+	 * apart. Safe to call from any thread while the server is running.
+	 */
+	ServerStats stats() const;
+
+	/**
+	 * @brief Get the room of the server
+	 * 
+	 * @return uint32_t The id given to RoomHost::openRoom(), 0 for a
+	 *         server with its own socket
+	 */
+	uint32_t room() const;
+
 private:
+	friend class RoomHost;
+
+	/**
+	 * @brief Construct a room of a RoomHost, with neither a thread nor a socket of its own
+	 * 
+	 * @param host The host, which routes the datagrams of the room to
+	 *             m_inbox and runs the room on one of its workers
+	 * @param room Id of the room
+	 * @param slot Slot of the room in the host
+	 * @param socket Socket of the host, the room sends through it
+	 */
+	Server(RoomHost& host, uint32_t room, std::size_t slot, SOCKET socket, unsigned int tickRate, uint16_t maxDatagramSize);
+
+	/**
+	 * @brief Construct a server, or a room if host is not nullptr
+	 * 
+	 * @see Server::Server
+	 */
+	Server(RoomHost* host, uint32_t room, std::size_t slot, SOCKET socket, uint16_t port, unsigned int tickRate,
+	       uint16_t maxDatagramSize, Transport transport, const std::string& unixPath, IoEngine engine, unsigned int threads);
+
+	/**
+	 * @brief Counters of the server, written by the server thread only
+	 * 
+	 * @see ServerStats
+	 */
+	struct alignas(CACHE_LINE_SIZE) ServerCounters
+	{
+		StatCounter waitCalls;
+		StatCounter receiveCalls;
+		StatCounter datagramsReceived;
+		StatCounter bytesReceived;
+		StatCounter messagesReceived;
+		StatCounter sendCalls;
+		StatCounter datagramsSent;
+		StatCounter bytesSent;
+		StatCounter messagesSent;
+
+		StatCounter undersizedDatagrams;
+		StatCounter oversizedDatagrams;
+		StatCounter sendErrors;
+		StatCounter retransmissions;
+
+		StatCounter routedMessages;
+		StatCounter routedCopies;
+		StatCounter maxFanOut;
+
+		StatCounter messageBufferHighWater;
+		StatCounter inboxHighWater;
+		StatCounter outboxHighWater;
+		StatCounter sendQueueHighWater;
+	};
+
+	/**
+	 * @brief Counters of a client, written by the server thread only
+	 * 
+	 * @see ClientStats
+	 */
+	struct alignas(CACHE_LINE_SIZE) ClientCounters
+	{
+		std::atomic<bool>     connected{false}; //!< Set once the other counters are reset for a new client
+		std::atomic<uint32_t> address{0};
+		std::atomic<uint16_t> port{0};
+
+		StatCounter datagramsReceived;
+		StatCounter bytesReceived;
+		StatCounter messagesReceived;
+		StatCounter datagramsSent;
+		StatCounter bytesSent;
+		StatCounter messagesSent;
+		StatCounter malformedDatagrams;
+		StatCounter sendErrors;
+		StatCounter retransmissions;
+
+		std::atomic<float> ping{-1.0f};
+		std::atomic<float> jitter{0.0f};
+	};
+
+	/**
+	 * @brief A message sent by the application through sendTo() or broadcast()
+	 */
+	struct ApplicationMessage
+	{
+		MessageView message;                 //!< Header and payload size, data is not used
+		uint8_t     data[MAX_PAYLOAD_SIZE];  //!< Copy of the payload
+		bool        isBroadcast = true;      //!< Send to the teams in message.parameters
+		uint8_t     recipient   = 0x00;      //!< Id and team of the recipient if not broadcast
+		Delivery    delivery    = Delivery::Unreliable;
+	};
+
 	/**
-	 * @brief A struct containing client information
+	 * @brief A message encoded for one client by queueClientMessage()
 	 * 
-	 * All values are set to zero by default
+	 * Only the header is specific to the client. The payload is shared
+	 * by the copies of a message, unless it was tailored for the client.
 	 */
-	struct ClientInfo
+	struct SendEntry
 	{
-		uint8_t  idAndTeam = 0x00;       //!< RLBot id and team of the client
-		uint8_t  key       = 0x00;       //!< Private key for the client
-		// INADDR_ANY will stand for an invalid/uninitialized address
-		uint32_t address   = INADDR_ANY; //!< Address of the client
-		uint16_t port      = 0;          //!< Port of the client
-
-		//uint16_t ping            = 0;
-		//bool     isPinging       = false;
-		//float    lastMessageTime = -1.0f;
+		std::size_t  header      = 0; //!< Position of the encoded header in m_sendData
+		std::size_t  headerSize  = 0;
+		std::size_t  payload     = 0; //!< Position of the payload in m_sendPayloads
+		std::size_t  payloadSize = 0; //!< Bytes of the payload sent, at most 60 in a fixed Message
+		std::size_t  size        = 0; //!< Size of the encoded message, with the zeros ending a fixed Message
+		unsigned int recipient   = 0; //!< Index of the client it is sent to
 	};
 
+	/**
+	 * @brief A datagram built by flushSends() from queued messages
+	 */
+	struct SendDatagram
+	{
+		std::size_t  first     = 0;     //!< Position of its first message in m_sendOrder
+		std::size_t  count     = 0;     //!< Number of messages
+		std::size_t  size      = 0;     //!< Number of bytes, with the version and padding bytes
+		unsigned int recipient = 0;     //!< Index of the client it is sent to
+		bool         compact   = false; //!< Starts with WIRE_VERSION
+		bool         padded    = false; //!< Ends with a padding byte
+	};
+
+	/**
+	 * @brief A delta-encoded stream of snapshots relayed by the server
+	 * 
+	 * The snapshots received from the source are kept to decode the
+	 * next ones and to encode them for each recipient against the last
+	 * snapshot it acknowledged.
+	 */
+	struct DeltaStream
+	{
+		SnapshotHistory history;                //!< Snapshots received from the source
+		uint16_t        latestSequence = 0;     //!< Last snapshot received from the source
+		bool            ackPending     = false; //!< latestSequence is acknowledged during the next dispatch
+		bool            acked[256]         = {}; //!< Each client acknowledged a snapshot, by id and team
+		uint16_t        ackedSequence[256] = {}; //!< Last snapshot acknowledged by each client, by id and team
+	};
+
+	/**
+	 * @brief Queue a message sent by the application
+	 * 
+	 * @return true The message will be sent during the next dispatch
+	 * @return false Too many messages are waiting to be sent
+	 */
+	bool pushApplicationMessage(const MessageView& message, bool isBroadcast, uint8_t recipient, Delivery delivery);
+
 	/**
 	 * @brief Initialize the server
 	 * 
@@ -122,28 +446,439 @@ private:
 	/**
 	 * @brief Run the main loop of the server
 	 * 
+	 * Each iteration sleeps until data arrives or the next tick is
+	 * due, reads all available messages and, once per tick,
+	 * dispatches them to the clients.
 	 */
 	void run();
 
 	/**
-	 * @brief Send a message to a client
+	 * @brief Get the time at which step() must run if nothing arrives before
+	 * 
+	 * Applies the changes of the other threads to the timers first.
+	 */
+	std::chrono::steady_clock::time_point nextDeadline();
+
+	/**
+	 * @brief Run an iteration of the main loop once woken up
+	 * 
+	 * @return false there was an error, the server must stop
+	 * 
+	 * Reads all available messages and dispatches them if the tick is
+	 * due, or handles the timers that expired.
+	 */
+	bool step();
+
+	/**
+	 * @brief Sleep until the socket has data or the deadline is reached
+	 * 
+	 * @param deadline Time at which to return if nothing happens
+	 * @return true the server can go on
+	 * @return false there was an error while waiting
+	 * 
+	 * Returns early when stop() is called.
+	 */
+	bool waitForData(std::chrono::steady_clock::time_point deadline);
+
+	/**
+	 * @brief Read and handle all the messages available on the socket
+	 * 
+	 * @return true all available data was read
+	 * @return false there was an error while receiving data
+	 * 
+	 * Handled messages are stored in the message buffer until they
+	 * are dispatched.
+	 */
+	bool receiveMessages();
+
+	/**
+	 * @brief Wake the server thread up if it is waiting for data
+	 * 
+	 * Does nothing on Windows, where the thread wakes up every tick.
+	 */
+	void wakeUp();
+
+	/**
+	 * @brief Send all buffered messages to the clients
+	 * 
+	 * Clients that could not be reached are disconnected and
+	 * removed from the list of clients.
+	 */
+	void dispatchMessages();
+
+	/**
+	 * @brief Queue the messages sent by the application for the clients
+	 */
+	void queueApplicationMessages();
+
+	/**
+	 * @brief Queue a message for all the clients of a team
+	 * 
+	 * @param message The message to send
+	 * @param team The team bit of the recipients (idAndTeam & 0x01)
+	 * @param delivery The delivery of the message
+	 */
+	void queueTeamMessage(const MessageView& message, uint8_t team, Delivery delivery);
+
+	/**
+	 * @brief Queue a message for a single client
+	 * 
+	 * @param message The message to send, with the header of its
+	 *                reliable channel if it has MSG_RELIABLE
+	 * @param clientIndex The index of the recipient in m_clients
+	 * @param delivery The delivery of the message
+	 * 
+	 * The message is encoded in the format the client supports and
+	 * numbered on its reliable channel if the client supports it.
+	 */
+	void queueClientMessage(const MessageView& message, unsigned int clientIndex, Delivery delivery = Delivery::Unreliable);
+
+	/**
+	 * @brief Queue a message tailored for a client as is
+	 * 
+	 * @param message The message, with the key of the client
+	 * @param clientIndex The index of the recipient in m_clients
+	 */
+	void queueClientFrame(const MessageView& message, unsigned int clientIndex);
+
+	/**
+	 * @brief Share the payload of a message between the copies queued for it
+	 * 
+	 * Until countFanOut(), a payload within the one of the message is
+	 * copied to m_sendPayloads for the first recipient only: the others
+	 * point to the same bytes, whatever their format.
+	 */
+	void shareFanOut(const MessageView& message);
+
+	/**
+	 * @brief Copy the payload of a message queued for a client to m_sendPayloads
+	 * 
+	 * @return std::size_t The position of the payload in m_sendPayloads
+	 * @see shareFanOut
+	 */
+	std::size_t storePayload(const uint8_t* data, std::size_t size);
+
+	/**
+	 * @brief Determine if the next tick has something to dispatch
+	 * 
+	 * The server thread sleeps until the next timer otherwise.
+	 */
+	bool dispatchPending() const;
+
+	/**
+	 * @brief Apply the ping requests and settings changed by other threads to the timers
+	 */
+	void updateTimers();
+
+	/**
+	 * @brief Handle the timers that expired at m_dispatchTime
+	 * 
+	 * Pings the clients, disconnects the silent ones and queues the
+	 * reliable messages not acknowledged in time.
+	 */
+	void handleTimers();
+
+	/**
+	 * @brief Handle the timers that expired between two dispatches and send what they queued
+	 */
+	void runTimers();
+
+	/**
+	 * @brief Queue a ping for every client
+	 */
+	void queuePings();
+
+	/**
+	 * @brief Disconnect a client if it sent nothing since the client timeout, or wait again
+	 * 
+	 * @param idAndTeam The id and team of the client
+	 */
+	void checkClientTimeout(uint8_t idAndTeam);
+
+	/**
+	 * @brief Queue the reliable messages of a client not acknowledged in time and the ones waiting for room
+	 * 
+	 * @param idAndTeam The id and team of the client
+	 * 
+	 * The client is disconnected if it stopped acknowledging them.
+	 */
+	void queueRetransmissions(uint8_t idAndTeam);
+
+	/**
+	 * @brief Make the retransmission timer of a client expire with its next retransmission
+	 * 
+	 * @param idAndTeam The id and team of the client
+	 * @param endpoint The reliable channels of the client
+	 */
+	void scheduleRetransmissions(uint8_t idAndTeam, const ReliableEndpoint& endpoint);
+
+	/**
+	 * @brief Acknowledge the reliable messages received since the last dispatch
+	 * 
+	 * The acknowledgements are sent in the same datagrams as the other
+	 * messages queued for the clients.
+	 */
+	void queueReliableAcks();
+
+	/**
+	 * @brief Encode a snapshot buffered by handleDeltaMessage() for a client
+	 * 
+	 * @param snapshot The buffered snapshot
+	 * @param recipient The client
+	 * @return MessageView The delta-encoded message, or the full message
+	 *                     if the client does not support MSG_CAP_DELTA
+	 */
+	MessageView encodeSnapshot(const MessageView& snapshot, const ClientInfo& recipient);
+
+	/**
+	 * @brief Acknowledge the snapshots received since the last dispatch
+	 */
+	void queueDeltaAcks();
+
+	/**
+	 * @brief Send all the messages queued by dispatchMessages()
+	 * 
+	 * The messages of each client are packed in as few datagrams as
+	 * its capabilities allow, keeping their order, and the datagrams
+	 * are sent with as few system calls as possible. Clients whose
+	 * datagram could not be sent are disconnected, unless the socket
+	 * only had no room for it (ServerShard::transientSendError()): the
+	 * rest of the batch is then dropped and the clients stay connected.
+	 */
+	void flushSends();
+
+	/**
+	 * @brief Disconnect a client a message could not be sent to
+	 * 
+	 * @param clientIndex The index of the client
+	 */
+	void handleSendError(unsigned int clientIndex);
+
+	/**
+	 * @brief Disconnect a client that stopped acknowledging reliable messages
+	 * 
+	 * @param clientIndex The index of the client
+	 */
+	void handleReliableTimeout(unsigned int clientIndex);
+
+	/**
+	 * @brief Disconnect a client that sent nothing for longer than the client timeout
+	 * 
+	 * @param clientIndex The index of the client
+	 */
+	void handleClientTimeout(unsigned int clientIndex);
+
+	/**
+	 * @brief Reset the counters of a client that just connected
+	 * 
+	 * @param client The client
+	 */
+	void resetClientCounters(const ClientInfo& client);
+
+	/**
+	 * @brief Get the counters of the sender of the last datagram received
+	 * 
+	 * @return ClientCounters* The counters, nullptr if the sender is not connected
+	 */
+	ClientCounters* senderCounters();
+
+	/**
+	 * @brief Count a message routed to the clients and end its fan-out
 	 * 
-	 * @param message the actual message to be sent
+	 * @param firstEntry Size of m_sendEntries before the message was queued
+	 */
+	void countFanOut(std::size_t firstEntry);
+
+	/**
+	 * @brief Send a datagram to a client
+	 * 
+	 * @param data the message(s) to be sent
+	 * @param size the size of the datagram in bytes
 	 * @param recipient the receiving client
-	 * @return true message was successfully sent
-	 * @return false there was an error and the message was not sent
+	 * @return true datagram was successfully sent
+	 * @return false there was an error and the datagram was not sent
 	 */
-	bool send(Message* message, const ClientInfo& recipient) const;
+	bool send(const void* data, std::size_t size, const ClientInfo& recipient) const;
 
 	/**
 	 * @brief Receive a message from a client
 	 * 
-	 * @param message Reference to an empty message to be filled
+	 * @param message Reference to a view to be filled
 	 * @param ipAddress Reference to an address to be filled
 	 * @param port Reference to a port to be filled
 	 * @return ReceiveStatus The status of the data
+	 * 
+	 * The messages of a datagram are handed out one at a time. The
+	 * view points into the receive buffers and is valid until the
+	 * next call.
+	 */
+	ReceiveStatus receive(MessageView& message, uint32_t& ipAddress, uint16_t& port);
+
+	/**
+	 * @brief Read the next datagram and start reading its messages
+	 * 
+	 * @return ReceiveStatus Success if a complete datagram was read
+	 */
+	ReceiveStatus receiveDatagram();
+
+#ifndef _WIN32
+	/**
+	 * @brief Read up to RECEIVE_BATCH_SIZE datagrams with one system call
+	 * 
+	 * @return ReceiveStatus Success if at least one datagram was read
+	 * 
+	 * receive() hands out the datagrams of the batch one at a time. The
+	 * sockets epoll reported readable are read in turn until they are
+	 * empty.
+	 */
+	ReceiveStatus receiveBatch();
+
+	/**
+	 * @brief Send datagrams of m_sendHeaders with as few system calls as possible
+	 * 
+	 * @param socket m_socket or m_unixSocket, which all the datagrams are sent through
+	 * @param first Index of the first datagram in m_sendDatagrams and m_sendHeaders
+	 * @param end Index after the last one
+	 */
+	void sendBatch(SOCKET socket, std::size_t first, std::size_t end);
+
+	/**
+	 * @brief Setup the io_uring engine
+	 * 
+	 * @return false io_uring is not available, m_socket stays in m_epoll
+	 * 
+	 * A multishot receive is kept armed on m_socket, and a multishot poll
+	 * on m_epoll reports the other descriptors.
+	 */
+	bool openRing();
+
+	/**
+	 * @brief Submit the queued requests of m_ring and wait for completions
+	 * 
+	 * @param timeout Longest wait in milliseconds, -1 for no limit
+	 * @return false There was an error
+	 */
+	bool waitForCompletions(int timeout);
+
+	/**
+	 * @brief Read the completions of m_ring, without any system call
+	 * 
+	 * Receives are kept in m_ringReceived for receiveBatch(), sends are
+	 * counted and their errors handled.
+	 */
+	void reapCompletions();
+
+	/**
+	 * @brief Copy up to RECEIVE_BATCH_SIZE datagrams received by m_ring to the batch
+	 * 
+	 * @return ReceiveStatus Success if at least one datagram was copied,
+	 *         ConnReset if a client is unreachable
+	 */
+	ReceiveStatus receiveRingBatch();
+
+	/**
+	 * @brief Send datagrams of m_sendHeaders through m_ring, as one chain per submission
+	 * 
+	 * Returns once all of them completed, the datagrams point to m_sendData.
+	 */
+	void sendRingBatch(std::size_t first, std::size_t end);
+
+	/**
+	 * @brief Send the UDP datagrams of m_sendHeaders from the server thread and the shards at once
+	 * 
+	 * @param end Index after the last datagram
+	 * 
+	 * Each thread sends a slice of the datagrams, cut between two
+	 * clients so the datagrams of a client leave in order. The client
+	 * table is only read until all of them are sent; the results of the
+	 * shards are counted afterwards, by the server thread.
+	 */
+	void sendParallel(std::size_t end);
+#endif // _WIN32
+
+	/**
+	 * @brief Count a datagram of m_sendDatagrams as sent
+	 */
+	void countSent(const SendDatagram& datagram);
+
+	/**
+	 * @brief Count a datagram that was dropped without disconnecting its client
+	 */
+	void countDropped(unsigned int clientIndex);
+
+	/**
+	 * @brief Get the slot of the sender of a datagram of the Unix socket
+	 * 
+	 * @return int The slot, -1 if all of them belong to connected clients
+	 * 
+	 * The slots of the endpoints without a connected client are freed
+	 * once all of them are used.
+	 */
+	int unixSlot(const sockaddr_un& address, socklen_t size);
+
+	/**
+	 * @brief Get the slot of a client of the Unix socket
+	 * 
+	 * @return int Its slot in m_unixPeers, -1 if the client uses another transport
+	 */
+	int unixSlot(const ClientInfo& client) const;
+
+	/**
+	 * @brief Read the next datagram of the shared memory channels
+	 * 
+	 * @return true A datagram was read, its sender is the client of the channel
+	 * @return false The channels are empty
+	 * 
+	 * The channels take turns, one datagram each. The datagram stays
+	 * in its ring until the next call to receiveDatagram().
+	 */
+	bool receiveShmDatagram();
+
+	/**
+	 * @brief Read the next datagram passed by the shards
+	 * 
+	 * @return ReceiveStatus NoData if the rings of the shards are empty
+	 * 
+	 * The shards take turns, one datagram each. The datagram stays in
+	 * its ring until the next call to receiveDatagram(). ICMP errors are
+	 * handled on the way, like those of the error queue of m_socket.
+	 */
+	ReceiveStatus receiveShardDatagram();
+
+	/**
+	 * @brief Read the next datagram of a ring of records
+	 * 
+	 * @param records The ring of a shard, or m_inbox
+	 * @return ReceiveStatus NoData if the ring is empty
+	 * 
+	 * The datagram stays in the ring until the next call to
+	 * receiveDatagram(). ICMP errors are handled on the way.
+	 */
+	ReceiveStatus receiveRecord(RecordRing& records);
+
+	/**
+	 * @brief Hand out a channel to each client waiting on m_shmListener
+	 */
+	void acceptShmChannels();
+
+	/**
+	 * @brief Close a channel whose client went away and disconnect the client
 	 */
-	ReceiveStatus receive(Message& message, uint32_t& ipAddress, uint16_t& port);
+	void closeShmChannel(unsigned int slot);
+
+	/**
+	 * @brief Get the channel of a client
+	 * 
+	 * @return int The slot of its channel, -1 if the client uses UDP
+	 */
+	int shmSlot(const ClientInfo& client) const;
+
+	/**
+	 * @brief Copy the version byte, messages and padding byte of a datagram
+	 * 
+	 * @return std::size_t The size of the datagram
+	 */
+	std::size_t copyDatagram(const SendDatagram& datagram, uint8_t* output) const;
 
 	/**
 	 * @brief Handle a raw message from a client
@@ -151,14 +886,13 @@ private:
 	 * @param receivedMessage The message received from receive()
 	 * @param senderAddress The address of the sender
 	 * @param senderPort The port of the sender
-	 * @return Message output message to store in buffer
 	 * 
 	 * This function parses the messages, execute an appropriate
 	 * function to handle it more precisely, if required and
-	 * transforms it into a message that can be handled later when
-	 * going through the message queue.
+	 * transforms it into a message that is stored in the buffer to
+	 * be handled later when going through the message queue.
 	 */
-	Message handleMessage(const Message& receivedMessage, const uint32_t& senderAddress, const uint16_t& senderPort);
+	void handleMessage(const MessageView& receivedMessage, const uint32_t& senderAddress, const uint16_t& senderPort);
 
 	/**
 	 * @brief Handle a connection message
@@ -175,9 +909,92 @@ private:
 	 * message will be invalid and no change will be made to the
 	 * list of connected clients.
 	 */
-	Message handleConnectionMessage(const Message& connectionMessage, const uint32_t& senderAddress,
+	Message handleConnectionMessage(const MessageView& connectionMessage, const uint32_t& senderAddress,
 		const uint16_t& senderPort);
 
+	/**
+	 * @brief Disconnect the client bound to an unreachable address
+	 * 
+	 * @param address The address the failed datagram was sent to
+	 * @param port The port the failed datagram was sent to
+	 * 
+	 * Called when the OS reports that a datagram could not be
+	 * delivered (WSAECONNRESET on Windows, ECONNREFUSED on Linux).
+	 * The matching client is disconnected and a disconnect message
+	 * is buffered for the other clients.
+	 */
+	void handleConnectionReset(uint32_t address, uint16_t port);
+
+	/**
+	 * @brief Decode a snapshot of a delta-encoded stream
+	 * 
+	 * @param message The message received, with MSG_DELTA
+	 * @param senderAddress The address of the sender
+	 * @param senderPort The port of the sender
+	 * 
+	 * The snapshot is buffered with MSG_DELTA and its sequence number
+	 * (2 bytes, big-endian) before the payload, so it can be encoded
+	 * for each recipient during the dispatch.
+	 */
+	void handleDeltaMessage(const MessageView& message, const uint32_t& senderAddress, const uint16_t& senderPort);
+
+	/**
+	 * @brief Record the snapshots a client acknowledged
+	 * 
+	 * @param message The MSG_DELTA_ACK message
+	 * @param senderAddress The address of the sender
+	 * @param senderPort The port of the sender
+	 */
+	void handleDeltaAck(const MessageView& message, const uint32_t& senderAddress, const uint16_t& senderPort);
+
+	/**
+	 * @brief Measure the round-trip time of a client from the answer to a ping
+	 * 
+	 * @param message The MSG_PING message, with the timestamp of the ping
+	 * @param senderAddress The address of the sender
+	 * @param senderPort The port of the sender
+	 */
+	void handlePing(const MessageView& message, const uint32_t& senderAddress, const uint16_t& senderPort);
+
+	/**
+	 * @brief Forget the delta streams sent and acknowledged by a client
+	 * 
+	 * @param idAndTeam The id and team of the client
+	 */
+	void resetDeltaStreams(uint8_t idAndTeam);
+
+	/**
+	 * @brief Handle a message received on a reliable channel
+	 * 
+	 * @param message The message received, with MSG_RELIABLE
+	 * @param senderAddress The address of the sender
+	 * @param senderPort The port of the sender
+	 * 
+	 * The message and the ones it was holding back are buffered with
+	 * their reliable header, to be sent on the same channel.
+	 */
+	void handleReliableMessage(const MessageView& message, const uint32_t& senderAddress, const uint16_t& senderPort);
+
+	/**
+	 * @brief Release the reliable messages a client acknowledged
+	 * 
+	 * @param message The MSG_ACK message
+	 * @param senderAddress The address of the sender
+	 * @param senderPort The port of the sender
+	 */
+	void handleAck(const MessageView& message, const uint32_t& senderAddress, const uint16_t& senderPort);
+
+#ifndef _WIN32
+	/**
+	 * @brief Read the socket error queue and handle every pending error
+	 * 
+	 * On Linux, ICMP errors for an unconnected UDP socket are only
+	 * reported through the error queue (IP_RECVERR), which also holds
+	 * the destination of the datagram that caused the error.
+	 */
+	void handleErrorQueue();
+#endif // _WIN32
+
 	/**
 	 * @brief Sends an error message to a client
 	 * 
@@ -191,10 +1008,25 @@ private:
 	 */
 	bool sendErrorMessage(const ClientInfo& recipient, uint8_t errorCode) const;
 
+	/**
+	 * @brief Tells a client that the server disconnected it
+	 * 
+	 * @param recipient Client struct the recipient's info
+	 * @return true Message successfully sent
+	 * @return false Message not successfully sent
+	 * 
+	 * Note: call it before the client is released, the other
+	 * clients are told through a MSG_ALL disconnect message.
+	 */
+	bool sendDisconnectMessage(const ClientInfo& recipient) const;
+
 	/**
 	 * @brief Disconnect a specific client
 	 * 
 	 * @param clientIndex The index of the client that was disconnected
+	 * 
+	 * The client stays at the same index until the end of the next
+	 * dispatch, but can't be found by id or address anymore.
 	 */
 	void disconnectClient(const int& clientIndex);
 
@@ -209,12 +1041,112 @@ private:
 	 */
 	uint8_t generateKey(uint8_t const* messageData) const;
 
-	std::vector<ClientInfo> m_clients; //!< The list of all connected clients
+	ClientTable m_clients; //!< The table of all connected clients
 	
-	std::queue<Message> m_messageBuffer; //!< A buffer for all the messages received in one update
+	MessageRing m_messageBuffer; //!< A buffer for all the messages received in one update
+
+	MessageRing                  m_applicationInbox;  //!< Dispatched messages waiting for poll()
+	bool                         m_inboxViewPending;  //!< The front of m_applicationInbox was returned by poll()
+	MpscRing<ApplicationMessage> m_applicationOutbox; //!< Messages from sendTo() and broadcast()
+
+	std::unordered_map<uint16_t, DeltaStream> m_deltaStreams; //!< Streams by source id and team (high byte) and type
+	uint8_t m_deltaSnapshot[MAX_PAYLOAD_SIZE];                //!< Snapshot decoded by handleDeltaMessage()
+	uint8_t m_deltaPayload[MAX_PAYLOAD_SIZE];                 //!< Snapshot encoded by encodeSnapshot()
+
+	std::unordered_map<uint8_t, ReliableEndpoint> m_reliableEndpoints; //!< Reliable channels by client id and team
+	uint8_t m_reliablePayload[MAX_PAYLOAD_SIZE];                       //!< Message numbered by queueClientMessage()
+	std::chrono::steady_clock::time_point m_dispatchTime;              //!< Start of the current dispatch
+
+	std::atomic<std::chrono::milliseconds> m_pingInterval;  //!< @see setPingInterval
+	std::atomic<std::chrono::milliseconds> m_clientTimeout; //!< @see setClientTimeout
+	std::atomic<bool>                      m_pingRequested; //!< pingClients() was called since the last ping
+	std::atomic<bool>                      m_timersChanged; //!< The ping interval or the client timeout changed
+	std::chrono::steady_clock::time_point  m_lastPingTime;  //!< Last time the clients were pinged
+
+	TimerWheel m_timers;          //!< Client timeouts, retransmissions and pings, @see handleTimers
+	bool       m_dispatchPending; //!< Messages were received since the last dispatch
+
+	std::vector<uint8_t>      m_sendData;       //!< Headers of the messages to send during the current dispatch, encoded
+	std::vector<uint8_t>      m_sendPayloads;   //!< Payloads of the messages, once per message routed
+	std::vector<SendEntry>    m_sendEntries;    //!< The messages of m_sendData
+	std::vector<std::size_t>  m_sendOrder;      //!< Indices of m_sendEntries grouped by client
+	std::vector<SendDatagram> m_sendDatagrams;  //!< Datagrams built from m_sendOrder
+	MessageView               m_fanOut;         //!< Message whose payload is shared, @see shareFanOut
+	std::size_t               m_fanOutPayload;  //!< Position of the payload of m_fanOut in m_sendPayloads, SIZE_MAX until stored
+
+	uint16_t m_maxDatagramSize; //!< Size limit of the datagrams sent to clients with MSG_CAP_COALESCE
+
+#ifndef _WIN32
+	std::vector<mmsghdr> m_sendHeaders; //!< sendmmsg() headers, one per datagram
+	std::vector<iovec>   m_sendVectors; //!< sendmmsg() buffers: the header, payload and zeros of each message
+#endif // _WIN32
+
+	std::unique_ptr<uint8_t[]> m_receiveBuffers; //!< Datagrams read from the socket, MAX_DATAGRAM_SIZE bytes each
+
+#ifndef _WIN32
+	sockaddr_in  m_receiveAddresses[RECEIVE_BATCH_SIZE]; //!< Senders of the datagrams of the batch
+	sockaddr_un  m_unixAddresses[RECEIVE_BATCH_SIZE];    //!< Senders of the datagrams of a batch of m_unixSocket
+	iovec        m_receiveVectors[RECEIVE_BATCH_SIZE];   //!< recvmmsg() buffers
+	mmsghdr      m_receiveHeaders[RECEIVE_BATCH_SIZE];   //!< recvmmsg() headers
+	mmsghdr      m_unixHeaders[RECEIVE_BATCH_SIZE];      //!< recvmmsg() headers of m_unixSocket, same buffers
+	unsigned int m_receiveCount;                         //!< Number of datagrams in the batch
+	unsigned int m_receiveIndex;                         //!< Next datagram of the batch to hand out
+	bool         m_receiveUnix;                          //!< The batch was read from m_unixSocket
+	bool         m_socketReadable;                       //!< epoll reported m_socket readable and it was not emptied yet
+	bool         m_unixSocketReadable;                   //!< Same for m_unixSocket
+#endif // _WIN32
+
+	DatagramReader m_datagramReader; //!< Reads the messages of the last datagram received
+	sockaddr_in    m_datagramSender; //!< Address and port of the last datagram received
+
+	mutable ServerCounters m_counters;            //!< @see stats
+	ClientCounters         m_clientCounters[256]; //!< Counters of each client by id and team, @see stats
+	alignas(CACHE_LINE_SIZE) std::atomic<uint64_t> m_outboxDrops; //!< Written by the threads of the application
 
 	SOCKET m_socket; //!< The server's socket handle
 
+	IoEngine m_engine; //!< Engine asked for, @see Server::Server
+
+#ifndef _WIN32
+	IoUring                   m_ring;              //!< io_uring of IoEngine::IoUring, closed if m_epoll reads m_socket
+	msghdr                    m_ringHeader;        //!< Layout of the datagrams in the buffers of m_ring
+	std::vector<IoCompletion> m_ringReceived;      //!< Receives of m_ring waiting for receiveBatch()
+	std::vector<std::size_t>  m_ringRetries;       //!< Datagrams to send again after an ICMP error was reported
+	unsigned int              m_ringSendsPending;  //!< Sends submitted to m_ring and not completed
+	bool                      m_ringEpollReadable; //!< m_ring reported events of m_epoll, read them without waiting
+#endif // _WIN32
+
+	unsigned int             m_threadCount;  //!< Threads asked for, @see Server::Server
+	std::vector<ServerShard> m_shards;       //!< Threads sharing the port of m_socket, created with the server for stats()
+	std::size_t              m_shardCount;   //!< Shards started by init(), the first ones of m_shards
+	std::size_t              m_shardNext;    //!< Shard read first by the next receiveShardDatagram()
+	std::vector<int>         m_shardErrors;  //!< Errors of the datagrams sent by the shards
+
+	RoomHost*                   m_host;          //!< Host running the server as one of its rooms, nullptr if it has its own thread
+	uint32_t                    m_room;          //!< @see room
+	std::size_t                 m_roomSlot;      //!< Slot of the room in m_host
+	std::unique_ptr<RecordRing> m_inbox;         //!< Datagrams routed to the room by m_host
+	RecordRing*                 m_recordReading; //!< Ring of the datagram read by m_datagramReader, nullptr if none
+
+	Transport          m_transport;                //!< Transport offered besides UDP
+	ShmListener        m_shmListener;              //!< Hands out m_shmChannels
+	mutable ShmChannel m_shmChannels[MAX_CLIENTS]; //!< Channels by slot, their client uses port slot + 1
+	bool               m_shmHangups[MAX_CLIENTS];  //!< The client of the channel went away
+	int                m_shmReading;               //!< Slot of the datagram read by m_datagramReader, -1 if none
+	unsigned int       m_shmNext;                  //!< Slot read first by the next receiveShmDatagram()
+
+	SOCKET        m_unixSocket; //!< Datagram socket of Transport::UnixDatagram
+	std::string   m_unixPath;   //!< Endpoint of m_unixSocket
+	UnixPeerTable m_unixPeers;  //!< Endpoints of the clients of m_unixSocket, their client uses port slot + 1
+
+#ifndef _WIN32
+	int m_epoll;  //!< epoll instance watching the sockets, m_wakeup and the shared memory channels
+	int m_wakeup; //!< eventfd used to wake the server thread up
+#endif // _WIN32
+
+	std::chrono::nanoseconds              m_tickPeriod; //!< Time between two dispatches of the message buffer
+	std::chrono::steady_clock::time_point m_nextTick;   //!< Time of the next dispatch
+
 	std::atomic<bool> m_continueExecution; //!< Used to safely stop the server
 	std::thread       m_thread;            //!< The server's thread
 };
@@ -0,0 +1,258 @@
+#ifndef COMMSLIB_SERVER_SHARD_HPP
+#define COMMSLIB_SERVER_SHARD_HPP
+
+#include <Message.hpp>
+#include <Platform.hpp>
+#include <SharedMemory.hpp>
+#include <Stats.hpp>
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <thread>
+
+#ifdef _WIN32
+	struct mmsghdr;
+#endif // _WIN32
+
+#define MAX_SERVER_THREADS 16 //!< Most threads of a server: the server thread and its shards
+
+#define SHARD_BATCH_SIZE 64 //!< Maximum number of datagrams read by a single system call of a shard
+#define SHARD_RETRY_MS   1  //!< Time a shard waits for the server thread when its ring is full
+
+#define SHARD_UNREACHABLE 0x1 //!< ShardRecord of an ICMP error: the sender is the unreachable client, there is no datagram
+#define SHARD_TRUNCATED   0x2 //!< ShardRecord of a datagram larger than MAX_DATAGRAM_SIZE, its end is missing
+
+namespace cl
+{
+
+/**
+ * @brief Header of a record passed by a ServerShard to the server thread, followed by the datagram
+ */
+struct ShardRecord
+{
+	sockaddr_in sender; //!< Address and port of the client
+	uint32_t    flags;  //!< SHARD_* flags
+};
+
+/**
+ * @brief Ring of ShardRecord followed by their datagram, from one thread to the server thread
+ *
+ * A ShmRing in the memory of the process. Filled by a ServerShard from
+ * its socket, or by a RoomHost with the datagrams of a room.
+ */
+class RecordRing
+{
+public:
+	RecordRing();
+
+	RecordRing(const RecordRing&)            = delete;
+	RecordRing& operator=(const RecordRing&) = delete;
+
+	/**
+	 * @brief Copy a record to the end of the ring (producer)
+	 *
+	 * @param datagram The datagram, nullptr if size is 0
+	 * @return false The ring is full, the record is dropped
+	 */
+	bool push(const sockaddr_in& sender, uint32_t flags, const uint8_t* datagram, std::size_t size);
+
+	/**
+	 * @brief Determine if the server thread must be woken up after push() (producer)
+	 */
+	bool wakeNeeded();
+
+	/**
+	 * @brief Get the first record (server thread)
+	 *
+	 * @param record Set to the header of the record
+	 * @param size Set to the size of the datagram
+	 * @return const uint8_t* The datagram, valid until pop(). nullptr if
+	 *         there is none.
+	 */
+	const uint8_t* front(ShardRecord& record, std::size_t& size) const;
+
+	/**
+	 * @brief Remove the record returned by front() (server thread)
+	 */
+	void pop();
+
+	/**
+	 * @brief Announce that the server thread is about to sleep
+	 *
+	 * @return false Records arrived in the meantime, don't sleep
+	 * @see ShmRing::prepareWait
+	 */
+	bool prepareWait();
+
+	/**
+	 * @brief Withdraw prepareWait() after waking up
+	 */
+	void endWait();
+
+private:
+	std::unique_ptr<ShmRingControl> m_control; //!< Indices of the ring
+	std::unique_ptr<uint8_t[]>      m_data;    //!< Records of the ring
+	ShmRing                         m_writer;  //!< The ring, used by the producer
+	ShmRing                         m_reader;  //!< The ring, used by the server thread
+};
+
+/**
+ * @brief A thread of the server with its own socket on the server's port
+ *
+ * The sockets of the server and its shards share the port (SO_REUSEPORT):
+ * the kernel spreads the clients over them by hashing their address, so
+ * the datagrams of a client always reach the same socket, in order. The
+ * shard reads them in batches and copies them with their sender to a
+ * ring the server thread handles them from, waking it up when it sleeps.
+ *
+ * The shard also sends datagrams queued by the server thread with
+ * send(), so a large fan-out is split over several cores. Those
+ * datagrams point to the client table of the server, which must not
+ * change until waitSent() returns.
+ *
+ * ICMP errors of the clients hashed to the shard are read from the
+ * error queue of its socket and passed as SHARD_UNREACHABLE records.
+ *
+ * Only available on Linux.
+ */
+class ServerShard
+{
+public:
+	ServerShard();
+
+	/**
+	 * @brief Destroy the ServerShard object, stop its thread and close its socket
+	 */
+	~ServerShard();
+
+	ServerShard(const ServerShard&)            = delete;
+	ServerShard& operator=(const ServerShard&) = delete;
+
+	/**
+	 * @brief Bind a socket to the port and start the thread
+	 *
+	 * @param port Port of the server, whose socket has SO_REUSEPORT
+	 * @param doorbell eventfd written when records arrive while the
+	 *                 server thread sleeps
+	 * @return false The socket could not be created
+	 */
+	bool start(uint16_t port, int doorbell);
+
+	void stop();
+
+	/**
+	 * @brief Get the records passed to the server thread
+	 */
+	RecordRing& records();
+
+	/**
+	 * @brief Send datagrams through the socket of the shard, in its thread (server thread)
+	 *
+	 * @param headers The datagrams, valid until waitSent()
+	 * @param errors Set to 0 for each datagram sent, or to the error of
+	 *               the system call that failed to send it
+	 */
+	void send(mmsghdr* headers, std::size_t count, int* errors);
+
+	/**
+	 * @brief Wait until the datagrams of send() are sent (server thread)
+	 */
+	void waitSent();
+
+	/**
+	 * @brief Send datagrams with as few system calls as possible
+	 *
+	 * @param errors Set to 0 for each datagram sent, or to the error of
+	 *               the system call that failed to send it
+	 * @param sendCalls Counts the system calls
+	 *
+	 * A pending ICMP error reported instead of sending is left to the
+	 * error queue, and the datagrams are sent again.
+	 */
+	static void sendDatagrams(SOCKET socket, mmsghdr* headers, std::size_t count, int* errors, StatCounter& sendCalls);
+
+	/**
+	 * @brief Determine if a send failed because the socket had no room for the datagram
+	 *
+	 * The send buffer is full or the kernel is short of memory: the
+	 * datagram is lost, but the client is fine and stays connected.
+	 */
+	static bool transientSendError(int error);
+
+	/**
+	 * @brief Read the error queue of a socket until it is empty
+	 *
+	 * @param unreachable Called with the destination of each datagram
+	 *                    answered by an ICMP port unreachable
+	 *
+	 * On Linux, ICMP errors for an unconnected UDP socket are only
+	 * reported through the error queue (IP_RECVERR).
+	 */
+	static void forEachUnreachable(SOCKET socket, const std::function<void(const sockaddr_in&)>& unreachable);
+
+#ifndef _WIN32
+	/**
+	 * @brief Point recvmmsg() headers at their sender and at consecutive buffers of MAX_DATAGRAM_SIZE bytes
+	 *
+	 * The buffers never move, so it is done once. msg_namelen still has
+	 * to be reset before each call.
+	 */
+	static void setupReceiveHeaders(mmsghdr* headers, iovec* vectors, sockaddr_in* senders, uint8_t* buffers, std::size_t count);
+#endif // _WIN32
+
+	uint64_t waitCalls() const;    //!< poll() calls of the shard
+	uint64_t receiveCalls() const; //!< recvmmsg() calls of the shard
+	uint64_t sendCalls() const;    //!< sendmmsg() calls of the shard
+
+private:
+	/**
+	 * @brief Receive datagrams and send what the server thread asks until stop() is called
+	 */
+	void run();
+
+	/**
+	 * @brief Copy the datagrams of the socket to the ring, until either is empty or full
+	 */
+	void receiveDatagrams();
+
+	/**
+	 * @brief Pass the ICMP errors of the error queue as SHARD_UNREACHABLE records
+	 */
+	void readErrorQueue();
+
+	SOCKET m_socket;   //!< Socket bound to the port of the server
+	int    m_doorbell; //!< eventfd of the server thread
+	int    m_wakeup;   //!< eventfd waking the shard up for send() and stop()
+	int    m_sent;     //!< eventfd written once the datagrams of send() are sent
+
+	RecordRing m_records; //!< Datagrams and ICMP errors passed to the server thread
+
+#ifndef _WIN32
+	mmsghdr     m_headers[SHARD_BATCH_SIZE];   //!< recvmmsg() headers
+	iovec       m_vectors[SHARD_BATCH_SIZE];   //!< Buffer of each datagram
+	sockaddr_in m_addresses[SHARD_BATCH_SIZE]; //!< Senders of the datagrams
+#endif // _WIN32
+
+	std::unique_ptr<uint8_t[]> m_buffers;    //!< Datagrams of the batch
+	unsigned int               m_batchCount; //!< Datagrams in the batch
+	unsigned int               m_batchIndex; //!< Next datagram of the batch to copy to the ring
+
+	mmsghdr*          m_sendHeaders; //!< Datagrams of send()
+	std::size_t       m_sendCount;
+	int*              m_sendErrors;
+	std::atomic<bool> m_sendPending; //!< Set by send(), cleared by the shard once they are sent
+
+	StatCounter m_waitCalls;
+	StatCounter m_receiveCalls;
+	StatCounter m_sendCalls;
+
+	std::atomic<bool> m_continueExecution; //!< Used to safely stop the shard
+	std::thread       m_thread;            //!< The shard's thread
+};
+
+} // cl
+
+#endif // COMMSLIB_SERVER_SHARD_HPP
@@ -0,0 +1,297 @@
+#ifndef COMMSLIB_SHARED_MEMORY_HPP
+#define COMMSLIB_SHARED_MEMORY_HPP
+
+#include <RingBuffer.hpp>
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+#define SHM_RING_SIZE          131072     //!< Bytes of datagrams in each direction of a channel, a power of two
+#define SHM_SOCKET_PREFIX      "commslib." //!< Abstract Unix socket of a server, followed by its port
+#define SHM_CONNECT_TIMEOUT_MS 1000       //!< Time a client waits for the server to hand out a channel
+#define SHM_CLIENT_ADDRESS     0xFFFFFFFF //!< Address of the clients of a channel, no UDP datagram comes from it
+
+namespace cl
+{
+
+/**
+ * @brief Indices of a ring in shared memory
+ */
+struct ShmRingControl
+{
+	alignas(CACHE_LINE_SIZE) std::atomic<uint32_t> head;    //!< Next byte to read, written by the consumer
+	alignas(CACHE_LINE_SIZE) std::atomic<uint32_t> tail;    //!< Next byte to write, written by the producer
+	alignas(CACHE_LINE_SIZE) std::atomic<uint32_t> waiting; //!< The consumer sleeps until the producer rings its doorbell
+};
+
+/**
+ * @brief Memory shared by the server and one client
+ */
+struct ShmSegment
+{
+	uint32_t              magic;    //!< SHM_MAGIC once initialized by the server
+	uint32_t              ringSize; //!< SHM_RING_SIZE of the server
+	std::atomic<uint32_t> closed;   //!< Set by the server when it stops or drops the channel
+
+	ShmRingControl toServer;
+	ShmRingControl toClient;
+
+	alignas(CACHE_LINE_SIZE) uint8_t toServerData[SHM_RING_SIZE];
+	alignas(CACHE_LINE_SIZE) uint8_t toClientData[SHM_RING_SIZE];
+};
+
+/**
+ * @brief Single-producer single-consumer ring of datagrams in shared memory
+ *
+ * Same layout as MessageRing, but the indices live in shared memory
+ * and the records are whole datagrams in their wire format. Each
+ * process keeps its own ShmRing over the segment, with its copies of
+ * the indices of the other side.
+ *
+ * The consumer announces that it goes to sleep with prepareWait(); the
+ * producer only needs to ring the doorbell of the consumer when
+ * wakeNeeded() says so, so no system call is made while both sides
+ * are busy.
+ */
+class ShmRing
+{
+public:
+	ShmRing();
+
+	void attach(ShmRingControl* control, uint8_t* data);
+
+	/**
+	 * @brief Reserve room for a datagram at the end of the ring (producer)
+	 *
+	 * @return uint8_t* Where to write the datagram, nullptr if the ring is full
+	 *
+	 * The datagram is only visible to the consumer after commit().
+	 */
+	uint8_t* reserve(std::size_t size);
+
+	/**
+	 * @brief Publish the datagram written after reserve() (producer)
+	 */
+	void commit();
+
+	/**
+	 * @brief Determine if the consumer must be woken up after commit() (producer)
+	 */
+	bool wakeNeeded();
+
+	/**
+	 * @brief Determine if there is no datagram to read (consumer)
+	 */
+	bool empty() const;
+
+	/**
+	 * @brief Get the first datagram (consumer)
+	 *
+	 * @param size Set to the size of the datagram
+	 * @return const uint8_t* The datagram, valid until pop(). nullptr
+	 *         if the ring is empty or was corrupted by the producer.
+	 */
+	const uint8_t* front(std::size_t& size) const;
+
+	/**
+	 * @brief Remove the datagram returned by front() (consumer)
+	 */
+	void pop();
+
+	/**
+	 * @brief Announce that the consumer is about to sleep (consumer)
+	 *
+	 * @return true The ring is empty, the producer rings the doorbell
+	 *         after its next commit()
+	 * @return false Datagrams arrived in the meantime, don't sleep
+	 */
+	bool prepareWait();
+
+	/**
+	 * @brief Withdraw prepareWait() after waking up (consumer)
+	 */
+	void endWait();
+
+private:
+	/**
+	 * @brief Get the position of the first datagram, after the unused end of the ring
+	 */
+	uint32_t frontPosition() const;
+
+	ShmRingControl* m_control;
+	uint8_t*        m_data;
+
+	mutable uint32_t m_cachedTail; //!< Consumer's copy of the tail
+	uint32_t         m_cachedHead; //!< Producer's copy of the head
+	uint32_t         m_reserved;   //!< End of the datagram reserved by the producer
+};
+
+/**
+ * @brief Two rings shared by the server and one client, and their doorbells
+ *
+ * The server creates a memfd segment for each client connecting to its
+ * abstract Unix socket and passes it with the eventfd doorbells of both
+ * sides over that connection. The connection is kept open: it hangs up
+ * when either side goes away.
+ *
+ * Only available on Linux.
+ */
+class ShmChannel
+{
+public:
+	ShmChannel();
+	~ShmChannel();
+
+	ShmChannel(const ShmChannel&)            = delete;
+	ShmChannel& operator=(const ShmChannel&) = delete;
+
+	/**
+	 * @brief Create the channel of a client accepted by ShmListener (server)
+	 *
+	 * @param connection The accepted connection, owned by the channel
+	 * @param serverDoorbell The doorbell of the server, rung by the client
+	 * @return true The client received the channel
+	 * @return false There was an error, the connection is closed
+	 */
+	bool create(int connection, int serverDoorbell);
+
+	/**
+	 * @brief Get a channel from the server listening on a port (client)
+	 *
+	 * @return true The channel is ready
+	 * @return false The server does not offer shared memory
+	 */
+	bool connect(uint16_t serverPort);
+
+	void close();
+
+	bool isOpen() const;
+
+	/**
+	 * @brief Copy a datagram to the other side and wake it up if it sleeps
+	 *
+	 * @return true The datagram was queued
+	 * @return false The ring is full, the datagram was dropped
+	 */
+	bool send(const void* data, std::size_t size);
+
+	/**
+	 * @brief Reserve room for a datagram to the other side
+	 *
+	 * @see ShmRing::reserve, commit, notify
+	 */
+	uint8_t* reserve(std::size_t size);
+
+	void commit();
+
+	/**
+	 * @brief Ring the doorbell of the other side if datagrams were committed while it sleeps
+	 */
+	void notify();
+
+	/**
+	 * @brief Get the next datagram from the other side
+	 *
+	 * @return const uint8_t* The datagram, valid until release(). nullptr
+	 *         if there is none.
+	 */
+	const uint8_t* receive(std::size_t& size);
+
+	/**
+	 * @brief Release the datagram returned by receive()
+	 */
+	void release();
+
+	/**
+	 * @brief Determine if the other side wrote invalid records, the channel must be closed
+	 */
+	bool isCorrupted() const;
+
+	/** @see ShmRing::prepareWait */
+	bool prepareWait();
+
+	/** @see ShmRing::endWait */
+	void endWait();
+
+	/**
+	 * @brief Tell the client the server closed the channel (server)
+	 */
+	void markClosed();
+
+	/**
+	 * @brief Determine if the server closed the channel (client)
+	 */
+	bool isClosedByServer() const;
+
+	/**
+	 * @brief Get the connection, readable once the other side is gone
+	 */
+	int connection() const;
+
+	/**
+	 * @brief Get the eventfd rung by the server (client), -1 on the server
+	 */
+	int doorbell() const;
+
+private:
+	ShmSegment* m_segment;
+	ShmRing     m_inbound;  //!< Datagrams from the other side
+	ShmRing     m_outbound; //!< Datagrams to the other side
+
+	int  m_connection;    //!< Unix socket connecting both sides
+	int  m_doorbell;      //!< Rung by the server when the client waits, client only
+	int  m_peerDoorbell;  //!< Rung to wake the other side up
+	bool m_notifyPending; //!< Datagrams were committed since the last notify()
+	bool m_corrupted;     //!< @see isCorrupted
+};
+
+/**
+ * @brief Abstract Unix socket handing out channels to the clients of a server
+ *
+ * Named SHM_SOCKET_PREFIX followed by the port of the server, so
+ * clients only need the port. Only available on Linux.
+ */
+class ShmListener
+{
+public:
+	ShmListener();
+	~ShmListener();
+
+	ShmListener(const ShmListener&)            = delete;
+	ShmListener& operator=(const ShmListener&) = delete;
+
+	bool open(uint16_t port);
+	void close();
+	bool isOpen() const;
+
+	/**
+	 * @brief Accept a pending connection
+	 *
+	 * @return int The connection, -1 if there is none
+	 */
+	int accept();
+
+	/**
+	 * @brief Reset the doorbell after waking up
+	 */
+	void clearDoorbell();
+
+	/**
+	 * @brief Get the listening socket, readable when clients are waiting
+	 */
+	int socket() const;
+
+	/**
+	 * @brief Get the eventfd rung by the clients of all channels
+	 */
+	int doorbell() const;
+
+private:
+	int m_socket;
+	int m_doorbell;
+};
+
+} // cl
+
+#endif // COMMSLIB_SHARED_MEMORY_HPP
@@ -0,0 +1,127 @@
+#ifndef COMMSLIB_STATS_HPP
+#define COMMSLIB_STATS_HPP
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace cl
+{
+
+/**
+ * @brief Traffic of a connected client, since its connection
+ */
+struct ClientStats
+{
+	uint8_t  idAndTeam = 0x00; //!< RLBot id and team of the client
+	uint32_t address   = 0;    //!< Address of the client, network byte order
+	uint16_t port      = 0;    //!< Port of the client, network byte order
+
+	uint64_t datagramsReceived  = 0; //!< Datagrams received from the client
+	uint64_t bytesReceived      = 0; //!< Bytes of those datagrams
+	uint64_t messagesReceived   = 0; //!< Messages read from those datagrams
+	uint64_t datagramsSent      = 0; //!< Datagrams sent to the client
+	uint64_t bytesSent          = 0; //!< Bytes of those datagrams
+	uint64_t messagesSent       = 0; //!< Messages packed in those datagrams
+	uint64_t malformedDatagrams = 0; //!< Undersized or oversized datagrams dropped
+	uint64_t sendErrors         = 0; //!< Datagrams that could not be sent
+	uint64_t retransmissions    = 0; //!< Reliable messages sent again
+
+	float ping   = -1.0f; //!< Smoothed round-trip time in milliseconds, negative until measured
+	float jitter = 0.0f;  //!< Smoothed round-trip time variation in milliseconds
+};
+
+/**
+ * @brief Snapshot of the counters of a server, since it started
+ */
+struct ServerStats
+{
+	uint64_t waitCalls         = 0; //!< System calls waiting for data: epoll_wait(), io_uring_enter() or select()
+	uint64_t receiveCalls      = 0; //!< Receive system calls
+	uint64_t datagramsReceived = 0; //!< Datagrams read by those calls
+	uint64_t bytesReceived     = 0; //!< Bytes of those datagrams
+	uint64_t messagesReceived  = 0; //!< Messages read from those datagrams
+	uint64_t sendCalls         = 0; //!< Send system calls
+	uint64_t datagramsSent     = 0; //!< Datagrams written by those calls
+	uint64_t bytesSent         = 0; //!< Bytes of those datagrams
+	uint64_t messagesSent      = 0; //!< Messages packed in those datagrams
+
+	uint64_t undersizedDatagrams = 0; //!< Datagrams dropped because they were too short or malformed
+	uint64_t oversizedDatagrams  = 0; //!< Datagrams dropped because they were truncated
+	uint64_t sendErrors          = 0; //!< Datagrams that could not be sent
+	uint64_t retransmissions     = 0; //!< Reliable messages sent again
+	uint64_t bufferDrops         = 0; //!< Messages dropped because the message buffer was full
+	uint64_t inboxDrops          = 0; //!< Messages dropped because the application did not poll() them
+	uint64_t outboxDrops         = 0; //!< Messages refused by sendTo() and broadcast()
+
+	uint64_t routedMessages = 0; //!< Messages routed to the clients
+	uint64_t routedCopies   = 0; //!< Copies queued for those messages, one per recipient
+	uint64_t maxFanOut      = 0; //!< Most recipients of a single message
+
+	uint64_t messageBufferHighWater = 0; //!< Most bytes waiting in the message buffer for a dispatch
+	uint64_t inboxHighWater         = 0; //!< Most bytes waiting in the application inbox
+	uint64_t outboxHighWater        = 0; //!< Most application messages sent during a dispatch
+	uint64_t sendQueueHighWater     = 0; //!< Most messages queued for the clients during a dispatch
+
+	std::vector<ClientStats> clients; //!< The connected clients
+};
+
+/**
+ * @brief Format a snapshot in the Prometheus text exposition format
+ *
+ * Metric names start with commslib_, the metrics of the clients are
+ * labelled with their id and team.
+ */
+std::string formatPrometheus(const ServerStats& stats);
+
+/**
+ * @brief Counter written by a single thread and read by any
+ *
+ * The writer does not need an atomic read-modify-write since nobody
+ * else writes the counter, readers see the value with a delay at most.
+ * Keep the counters of different writers in different cache lines.
+ */
+class StatCounter
+{
+public:
+	StatCounter() : m_value(0) {}
+
+	/**
+	 * @brief Add to the counter (writer)
+	 */
+	void add(uint64_t amount = 1)
+	{
+		m_value.store(m_value.load(std::memory_order_relaxed) + amount, std::memory_order_relaxed);
+	}
+
+	/**
+	 * @brief Keep the largest value (writer), for high-water marks
+	 */
+	void raise(uint64_t value)
+	{
+		if (value > m_value.load(std::memory_order_relaxed))
+			m_value.store(value, std::memory_order_relaxed);
+	}
+
+	/**
+	 * @brief Replace the value (writer)
+	 */
+	void set(uint64_t value)
+	{
+		m_value.store(value, std::memory_order_relaxed);
+	}
+
+	uint64_t load() const
+	{
+		return m_value.load(std::memory_order_relaxed);
+	}
+
+private:
+	std::atomic<uint64_t> m_value;
+};
+
+} // cl
+
+#endif // COMMSLIB_STATS_HPP
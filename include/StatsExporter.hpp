@@ -0,0 +1,90 @@
+#ifndef COMMSLIB_STATS_EXPORTER_HPP
+#define COMMSLIB_STATS_EXPORTER_HPP
+
+#include <Server.hpp>
+
+#include <atomic>
+#include <string>
+#include <thread>
+
+#define STATS_EXPORTER_BACKLOG    8   //!< Connections waiting to be served
+#define STATS_REQUEST_TIMEOUT_MS  100 //!< Time to wait for the request of a connection, and to write the answer
+
+namespace cl
+{
+
+/**
+ * @brief Serve the stats of a server in the Prometheus text format over a Unix socket
+ *
+ * Every connection receives formatPrometheus(server.stats()) and is
+ * closed. Connections sending an HTTP request get an HTTP answer, so
+ * the socket can be scraped directly (curl --unix-socket) or through
+ * a proxy; others only get the metrics (socat - UNIX-CONNECT:path).
+ *
+ * Only available on POSIX systems.
+ */
+class StatsExporter
+{
+public:
+	/**
+	 * @brief Construct a new StatsExporter object and start serving
+	 *
+	 * @param server The server, which must outlive the exporter
+	 * @param path Path of the socket. A socket left at this path by a
+	 *             previous exporter is replaced.
+	 */
+	StatsExporter(const Server& server, const std::string& path);
+
+	/**
+	 * @brief Destroy the StatsExporter object, stop serving and remove the socket
+	 */
+	~StatsExporter();
+
+	/**
+	 * @brief Manually stop serving
+	 *
+	 * @see ~StatsExporter
+	 */
+	void stop();
+
+	/**
+	 * @brief Determine if the exporter thread is running
+	 */
+	bool isRunning() const;
+
+private:
+	/**
+	 * @brief Create the socket and serve until stop() is called
+	 *
+	 * @return true the exporter stopped normally
+	 * @return false the socket could not be created
+	 *
+	 * This function is launched in a separate thread in the constructor.
+	 */
+	bool init();
+
+	/**
+	 * @brief Accept connections and answer them one at a time
+	 */
+	void run();
+
+	/**
+	 * @brief Read the request of a connection, answer it and close it
+	 *
+	 * @param connection The accepted socket
+	 */
+	void serve(int connection);
+
+	const Server& m_server; //!< The server whose stats are served
+	std::string   m_path;   //!< Path of the socket
+
+	int m_socket; //!< The listening socket
+	int m_wakeup; //!< eventfd used to wake the exporter thread up
+
+	std::atomic<bool> m_continueExecution; //!< Used to safely stop the exporter
+	std::thread       m_thread;            //!< The exporter's thread
+};
+
+} // cl
+
+#endif // COMMSLIB_STATS_EXPORTER_HPP
@@ -0,0 +1,142 @@
+#ifndef COMMSLIB_TIMER_WHEEL_HPP
+#define COMMSLIB_TIMER_WHEEL_HPP
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#define TIMER_WHEEL_LEVELS    4 //!< Number of wheels, each one 64 times coarser than the previous one
+#define TIMER_WHEEL_SLOT_BITS 6 //!< 64 slots per wheel
+
+namespace cl
+{
+
+/**
+ * @brief Hierarchical timer wheel with a fixed number of timers
+ *
+ * Time is divided in ticks of a fixed resolution. The first wheel has
+ * one slot per tick for the next 64 ticks, the second one slot per 64
+ * ticks for the next 4096, and so on; timers further away than the
+ * last wheel wait in its farthest slot. When the first wheel starts a
+ * new turn, the timers of the next slot of the second wheel are spread
+ * over the first one, and likewise for the other wheels.
+ *
+ * Scheduling, rescheduling and cancelling a timer are O(1), and so is
+ * finding the time of the next expiry: each wheel keeps a bitmap of
+ * its non-empty slots.
+ *
+ * Timers are identified by an index chosen by the owner, between 0 and
+ * the capacity. A timer never expires before its deadline, and at most
+ * one resolution after it once advance() is called.
+ *
+ * Not thread-safe.
+ */
+class TimerWheel
+{
+public:
+	using Clock = std::chrono::steady_clock;
+
+	/**
+	 * @brief Construct a new wheel with no timer scheduled
+	 *
+	 * @param capacity Number of timers
+	 * @param resolution Duration of a tick
+	 * @param start Time of the first tick
+	 */
+	TimerWheel(std::size_t capacity, Clock::duration resolution, Clock::time_point start = Clock::now());
+
+	std::size_t capacity() const;
+
+	/**
+	 * @brief Schedule a timer, or move it if it is already scheduled
+	 *
+	 * @param timer The index of the timer
+	 * @param deadline Time at which it expires. Timers scheduled in the
+	 *                 past expire during the next call to advance().
+	 */
+	void schedule(std::size_t timer, Clock::time_point deadline);
+
+	/**
+	 * @brief Unschedule a timer, does nothing if it is not scheduled
+	 */
+	void cancel(std::size_t timer);
+
+	bool scheduled(std::size_t timer) const;
+
+	/**
+	 * @brief Get the deadline a scheduled timer was given
+	 */
+	Clock::time_point deadline(std::size_t timer) const;
+
+	/**
+	 * @brief Get the time until which nothing can expire, or Clock::time_point::max()
+	 *
+	 * Exact when the next timer is in the first wheel. Otherwise, the
+	 * time at which the slot of a coarser wheel holding it is spread,
+	 * which is at most one slot of that wheel early: advance() must be
+	 * called then and nextExpiry() again.
+	 */
+	Clock::time_point nextExpiry() const;
+
+	/**
+	 * @brief Unschedule the timers that expired
+	 *
+	 * @param now The current time
+	 * @param timers Array to fill with the indices of the expired timers
+	 * @param maxCount Size of the array
+	 * @return std::size_t Number of timers written to the array. If it
+	 *                     is maxCount, more timers may have expired.
+	 */
+	std::size_t advance(Clock::time_point now, std::size_t* timers, std::size_t maxCount);
+
+private:
+	struct Timer
+	{
+		Clock::time_point deadline;
+		uint64_t          tick     = 0;      //!< First tick at or after the deadline
+		uint32_t          previous = 0;      //!< Previous timer in the slot
+		uint32_t          next     = 0;      //!< Next timer in the slot
+		uint16_t          slot     = 0xFFFF; //!< Slot of the timer, 0xFFFF if it is not scheduled
+	};
+
+	/**
+	 * @brief Get the tick containing a time, rounded up or down
+	 */
+	uint64_t tickOf(Clock::time_point time, bool roundUp) const;
+
+	/**
+	 * @brief Put a timer in the slot matching its tick
+	 */
+	void insert(uint32_t timer);
+
+	/**
+	 * @brief Take a timer out of its slot
+	 */
+	void remove(uint32_t timer);
+
+	/**
+	 * @brief Spread the slots of the coarser wheels starting at the current tick
+	 */
+	void cascade();
+
+	/**
+	 * @brief Get the tick of the next slot that has timers
+	 *
+	 * @param includeCurrent Consider the slot of the current tick
+	 */
+	uint64_t nextTick(bool includeCurrent) const;
+
+	std::vector<Timer>    m_timers;
+	std::vector<uint32_t> m_slots;                        //!< First timer of each slot, wheel after wheel
+	uint64_t              m_occupied[TIMER_WHEEL_LEVELS]; //!< Bit n: slot n of the wheel has timers
+	std::size_t           m_count;                        //!< Number of scheduled timers
+
+	Clock::duration   m_resolution;
+	Clock::time_point m_start;
+	uint64_t          m_currentTick; //!< Ticks before it were handled, the timers of its slot expire next
+};
+
+} // cl
+
+#endif // COMMSLIB_TIMER_WHEEL_HPP
@@ -0,0 +1,63 @@
+#ifndef COMMSLIB_TMCP_HPP
+#define COMMSLIB_TMCP_HPP
+
+#include <Codec.hpp>
+#include <Message.hpp>
+
+#include <cstdint>
+
+#define TMCP_NO_TIME (-1.0f) //!< Time of a TMCP message when the bot cannot tell
+
+namespace cl
+{
+
+/**
+ * @brief MSG_TMCP1_BALL: the bot is going for the ball
+ */
+struct TmcpBall
+{
+	float time;         //!< Game time at which the bot expects to touch the ball
+	float direction[3]; //!< Direction the bot expects to hit the ball in (x, y, z)
+};
+
+/**
+ * @brief MSG_TMCP1_BOOST: the bot is going for a boost pad
+ */
+struct TmcpBoost
+{
+	int32_t target; //!< Index of the boost pad
+};
+
+/**
+ * @brief MSG_TMCP1_DEMO: the bot is going to demolish an opponent
+ */
+struct TmcpDemo
+{
+	int32_t target; //!< Index of the car of the opponent
+	float   time;   //!< Game time at which the bot expects to hit it
+};
+
+/**
+ * @brief MSG_TMCP1_READY: the bot is available to go for the ball
+ */
+struct TmcpReady
+{
+	float time; //!< Game time at which the bot can reach the ball, TMCP_NO_TIME if unknown
+};
+
+/**
+ * @brief MSG_TMCP1_DEFEND: the bot is in position to defend its goal, no payload
+ */
+struct TmcpDefend
+{
+};
+
+template <> struct WireLayout<TmcpBall>   : WireFields<MSG_TMCP1_BALL,   &TmcpBall::time, &TmcpBall::direction> {};
+template <> struct WireLayout<TmcpBoost>  : WireFields<MSG_TMCP1_BOOST,  &TmcpBoost::target> {};
+template <> struct WireLayout<TmcpDemo>   : WireFields<MSG_TMCP1_DEMO,   &TmcpDemo::target, &TmcpDemo::time> {};
+template <> struct WireLayout<TmcpReady>  : WireFields<MSG_TMCP1_READY,  &TmcpReady::time> {};
+template <> struct WireLayout<TmcpDefend> : WireFields<MSG_TMCP1_DEFEND> {};
+
+} // cl
+
+#endif // COMMSLIB_TMCP_HPP
@@ -0,0 +1,24 @@
+#ifndef COMMSLIB_TRANSPORT_HPP
+#define COMMSLIB_TRANSPORT_HPP
+
+#include <cstdint>
+
+namespace cl
+{
+
+/**
+ * @brief How a client and the server exchange datagrams
+ *
+ * Every transport carries the same datagrams, so messages, keys and
+ * routing behave the same whichever is used.
+ */
+enum class Transport : uint8_t
+{
+	Udp,          //!< Datagrams on the loopback interface
+	SharedMemory, //!< Rings in memory shared with the server, for clients on the same host (Linux only), @see ShmChannel
+	UnixDatagram  //!< Datagrams on a Unix socket, for clients on the same host (POSIX only), @see unixServerPath
+};
+
+} // cl
+
+#endif // COMMSLIB_TRANSPORT_HPP
@@ -0,0 +1,105 @@
+#ifndef COMMSLIB_UNIX_SOCKET_HPP
+#define COMMSLIB_UNIX_SOCKET_HPP
+
+#include <ClientTable.hpp>
+#include <Platform.hpp>
+
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+
+#ifdef _WIN32
+	#include <afunix.h>
+#else
+	#include <sys/un.h>
+#endif // _WIN32
+
+#define UNIX_SOCKET_PREFIX      "@commslib." //!< Default endpoint of a server, followed by its port and ".dgram"
+#define UNIX_CLIENT_ADDRESS     0xFEFFFFFF   //!< Address of the clients of the Unix socket (255.255.255.254), no UDP datagram comes from it
+#define UNIX_CONNECT_TIMEOUT_MS 100          //!< Time a client retries reaching the socket of a server that is starting
+#define UNIX_SEND_TIMEOUT_MS    10           //!< Time a client waits for room in the receive queue of the server
+
+namespace cl
+{
+
+/**
+ * @brief Get the endpoint of a server
+ *
+ * @param path The endpoint chosen by the application, empty for the default one
+ * @param port The port of the server
+ */
+std::string unixServerPath(const std::string& path, uint16_t port);
+
+/**
+ * @brief Get the endpoint a client binds to, next to the one of its server
+ */
+std::string unixClientPath(const std::string& serverPath, unsigned int id);
+
+/**
+ * @brief Fill the address of an endpoint
+ *
+ * @param path A filesystem path, or a name in the abstract namespace
+ *             if it starts with '@'
+ * @return socklen_t The size of the address, 0 if the path is too long
+ */
+socklen_t unixAddress(const std::string& path, sockaddr_un& address);
+
+/**
+ * @brief Create a non-blocking datagram socket bound to an endpoint
+ *
+ * A socket left at a filesystem path by a previous process is replaced,
+ * but nothing else is ever removed.
+ *
+ * @return SOCKET The socket, INVALID_SOCKET if there was an error
+ */
+SOCKET openUnixSocket(const std::string& path);
+
+/**
+ * @brief Close a socket of openUnixSocket() and remove its filesystem path
+ */
+void closeUnixSocket(SOCKET& socket, const std::string& path);
+
+/**
+ * @brief The endpoints of the clients of a Unix socket, by slot
+ *
+ * The server tells its clients apart by address and port. A client of
+ * the Unix socket is given UNIX_CLIENT_ADDRESS and the port slot + 1,
+ * its endpoint is kept here to answer it.
+ */
+class UnixPeerTable
+{
+public:
+	UnixPeerTable();
+
+	/**
+	 * @brief Get the slot of an endpoint, given a free one if it is new
+	 *
+	 * @return int The slot, -1 if there is no free slot
+	 */
+	int find(const sockaddr_un& address, socklen_t size);
+
+	/**
+	 * @brief Free a slot, its endpoint gets a new one if it comes back
+	 */
+	void release(unsigned int slot);
+
+	bool used(unsigned int slot) const;
+
+	const sockaddr_un& address(unsigned int slot) const;
+	socklen_t addressSize(unsigned int slot) const;
+
+private:
+	struct Peer
+	{
+		sockaddr_un address = {};
+		socklen_t   size    = 0; //!< 0 if the slot is free
+	};
+
+	Peer                                          m_peers[MAX_CLIENTS];
+	std::unordered_map<std::string, unsigned int> m_slots; //!< Slots by endpoint, as the raw bytes of the address
+	std::string                                   m_key;   //!< Reused to look endpoints up without allocating
+};
+
+} // cl
+
+#endif // COMMSLIB_UNIX_SOCKET_HPP
@@ -0,0 +1,157 @@
+#ifndef COMMSLIB_WIRE_HPP
+#define COMMSLIB_WIRE_HPP
+
+#include <Message.hpp>
+
+#include <cstddef>
+#include <cstdint>
+
+namespace cl
+{
+
+/**
+ * @brief Determine the format of a datagram from its size
+ * 
+ * @return true The datagram uses the compact format
+ * @return false The datagram holds fixed messages
+ */
+inline bool isCompactDatagram(std::size_t size)
+{
+	return size % sizeof(Message) != 0;
+}
+
+/**
+ * @brief Get the number of bytes a message takes in a datagram
+ * 
+ * @param message The message
+ * @param compact Use the compact format
+ */
+std::size_t encodedSize(const MessageView& message, bool compact);
+
+/**
+ * @brief Write a message as a frame or as a fixed Message
+ * 
+ * @param buffer Where to write, at least encodedSize() bytes
+ * @param message The message
+ * @param compact Use the compact format
+ * @return std::size_t The number of bytes written
+ * 
+ * Fixed messages carry at most 60 bytes of payload: it is truncated
+ * or padded with zeros.
+ */
+std::size_t encodeMessage(uint8_t* buffer, const MessageView& message, bool compact);
+
+/**
+ * @brief Write the header of a message: a frame header or the first 4 bytes of a fixed Message
+ * 
+ * @param buffer Where to write, at least FRAME_HEADER_SIZE bytes
+ * @return std::size_t The number of bytes written
+ * 
+ * encodeMessage() is the header followed by the payload, and by zeros
+ * up to sizeof(Message) in a fixed Message.
+ */
+std::size_t encodeHeader(uint8_t* buffer, const MessageView& message, bool compact);
+
+/**
+ * @brief Get the number of padding bytes a compact datagram needs
+ * 
+ * @param size The size of the datagram without padding
+ */
+inline std::size_t paddingSize(std::size_t size)
+{
+	return size % sizeof(Message) == 0 ? 1 : 0;
+}
+
+/**
+ * @brief Build a datagram from messages in the legacy or compact format
+ */
+class DatagramWriter
+{
+public:
+	/**
+	 * @brief Construct a new writer
+	 * 
+	 * @param buffer Storage of at least MAX_DATAGRAM_SIZE bytes
+	 * @param maxSize Size at which the datagram is full. A single message
+	 *                is always accepted even if it is larger.
+	 */
+	DatagramWriter(uint8_t* buffer, std::size_t maxSize);
+
+	/**
+	 * @brief Start a new datagram
+	 * 
+	 * @param compact Use the compact format
+	 */
+	void reset(bool compact);
+
+	bool empty() const;
+	bool compact() const;
+
+	/**
+	 * @brief Determine if a message can be added without exceeding the limit
+	 */
+	bool fits(const MessageView& message) const;
+
+	/**
+	 * @brief Add a message. It must fit.
+	 */
+	void append(const MessageView& message);
+
+	/**
+	 * @brief Pad the datagram if needed and get its final size
+	 */
+	std::size_t finish();
+
+	const uint8_t* data() const;
+
+private:
+	uint8_t*    m_buffer;
+	std::size_t m_maxSize;
+	std::size_t m_size;
+	std::size_t m_count;   //!< Number of messages
+	bool        m_compact;
+};
+
+/**
+ * @brief Read the messages of a datagram without copying them
+ * 
+ * The views point into the datagram, they are valid as long as it is.
+ */
+class DatagramReader
+{
+public:
+	DatagramReader();
+
+	/**
+	 * @brief Start reading a datagram
+	 * 
+	 * @param data The datagram
+	 * @param size Its size in bytes
+	 */
+	void reset(const uint8_t* data, std::size_t size);
+
+	/**
+	 * @brief Read the next message
+	 * 
+	 * @param message The view to fill
+	 * @return true A message was read
+	 * @return false There is no message left or the datagram is malformed
+	 */
+	bool next(MessageView& message);
+
+	/**
+	 * @brief Determine if the last call to next() failed on invalid data
+	 */
+	bool malformed() const;
+
+private:
+	const uint8_t* m_data;
+	std::size_t    m_size;
+	std::size_t    m_offset;
+	bool           m_compact;
+	bool           m_malformed;
+};
+
+} // cl
+
+#endif // COMMSLIB_WIRE_HPP
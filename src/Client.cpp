@@ -1,6 +1,8 @@
 #include <Client.hpp>
+#include <Log.hpp>
 
-#include <iostream>
+#include <algorithm>
+#include <cstring>
 #include <random>
 
 #define DEFAULT_PORT 12347
@@ -8,22 +10,54 @@
 // 127.0.0.1, but after applying htonl
 #define LOCALHOST_ADDRESS 0x0100007F
 
+// maximum time the I/O thread waits before checking if it should stop (Windows only)
+#define IO_THREAD_TIMEOUT_MS 50
+
+// timers of m_timers
+#define CONNECT_TIMER      0 // the next connection attempt
+#define HEARTBEAT_TIMER    1 // the next heartbeat
+#define CLIENT_TIMER_COUNT 2
+
 #ifdef _WIN32
 
 #include <WS2tcpip.h>
 
 #pragma comment(lib, "Ws2_32.lib")
 
+#else
+
+#include <poll.h>
+#include <sys/eventfd.h>
+
 #endif // _WIN32
 
 namespace cl
 {
 
-Client::Client(uint16_t serverPort, unsigned int id, bool isBlueTeam)
+Client::Client(uint16_t serverPort, unsigned int id, bool isBlueTeam, bool useIoThread, uint16_t maxDatagramSize,
+               Transport transport, const std::string& unixPath, uint32_t room)
 : m_socket(INVALID_SOCKET)
+, m_unixServerAddressSize(0)
+, m_unixServerGone(false)
 , m_idAndTeam(0)
+, m_room(room)
 , m_key(DEFAULT_KEY)
 , m_isConnected(false)
+, m_serverCapabilities(0x00)
+, m_lastError(MSG_ERR_NO_ERR)
+, m_maxDatagramSize(std::min<uint16_t>(std::max<uint16_t>(maxDatagramSize, sizeof(Message)), MAX_DATAGRAM_SIZE))
+, m_sendWriter(m_sendBuffer, m_maxDatagramSize)
+, m_receiveReader()
+, m_channelReading(false)
+, m_channelHungUp(false)
+, m_channelClosed(false)
+, m_messageQueue(MESSAGE_QUEUE_SIZE)
+, m_messageViewPending(false)
+, m_ioThreadRunning(false)
+#ifndef _WIN32
+, m_wakeup(-1)
+#endif // _WIN32
+, m_timers(CLIENT_TIMER_COUNT, std::chrono::milliseconds(1))
 {
 	m_idAndTeam =  (uint8_t)id << 1;
 	m_idAndTeam |= isBlueTeam ? 0x01 : 0x00; // make sure is blue team is only 0x1 and 0x0
@@ -33,9 +67,48 @@ Client::Client(uint16_t serverPort, unsigned int id, bool isBlueTeam)
 	m_serverAddress.sin_port        = htons(serverPort);
 	m_serverAddress.sin_addr.s_addr = LOCALHOST_ADDRESS;
 
-	if (!init(serverPort + static_cast<uint16_t>(id) + 1)) // +1 in case id = 0
+	if (room != 0 && transport != Transport::Udp)
+	{
+		COMMS_LOG_WARNING(Client) << "Rooms are only reached through UDP. Using UDP.";
+		transport = Transport::Udp;
+	}
+
+	if (transport == Transport::SharedMemory)
+	{
+		if (m_channel.connect(serverPort))
+			COMMS_LOG_INFO(Client) << "Using shared memory of the server on port " << serverPort << ".";
+		else
+			COMMS_LOG_ERROR(Client) << "The server on port " << serverPort << " does not offer shared memory. Using UDP.";
+	}
+
+	bool initialized;
+	if (m_channel.isOpen())
+		initialized = attemptConnection();
+	else if (transport == Transport::UnixDatagram && initUnix(unixServerPath(unixPath, serverPort), id))
+		initialized = attemptConnection();
+	else if (room != 0)
+		initialized = init(0); // the clients of the other rooms use the same ids
+	else
+		initialized = init(serverPort + static_cast<uint16_t>(id) + 1); // +1 in case id = 0
+	if (!initialized)
+	{
+		COMMS_LOG_ERROR(Client) << "Failed to intialize client socket.";
+		return;
+	}
+
+	if (useIoThread)
 	{
-		std::cout << "[COMMS CLIENT] Failed to intialize client socket." << std::endl;
+#ifndef _WIN32
+		m_wakeup = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+		if (m_wakeup == -1)
+		{
+			COMMS_LOG_ERROR(Client) << "Could not create wakeup event (" << errno << "). Receiving messages in update().";
+			return;
+		}
+#endif // _WIN32
+
+		m_ioThreadRunning.store(true);
+		m_ioThread = std::thread(&Client::runIoThread, this);
 	}
 }
 
@@ -46,34 +119,50 @@ Client::~Client()
 
 void Client::close()
 {
-	std::cout << "[COMMS CLIENT] Closing..." << std::endl;
+	COMMS_LOG_INFO(Client) << "Closing...";
+
+	stopIoThread();
 
 	disconnect();
 
+	// the server notices the connection of the channel hanging up
+	if (m_channel.isOpen())
+	{
+		m_channel.close();
+		m_channelReading = false;
+		COMMS_LOG_INFO(Client) << "Client successfully stopped.";
+	}
+
+	// the socket file of a filesystem endpoint is removed with it
+	if (m_socket != INVALID_SOCKET && !m_unixPath.empty())
+	{
+		closeUnixSocket(m_socket, m_unixPath);
+		COMMS_LOG_INFO(Client) << "Client successfully stopped.";
+	}
+
 	if (m_socket != INVALID_SOCKET)
 	{
 		int result = closesocket(m_socket);
 		if (result != 0)
 		{
-			std::cout << "Error at closesocket() (" << WSAGetLastError() << "). Could not stop comms client." << std::endl;
+			COMMS_LOG_ERROR(Client) << "Error at closesocket() (" << WSAGetLastError() << "). Could not stop comms client.";
 			WSACleanup();
 			return;
 		}
 		m_socket = INVALID_SOCKET;
-		std::cout << "[COMMS CLIENT] Client successfully stopped." << std::endl;
+		COMMS_LOG_INFO(Client) << "Client successfully stopped.";
 	}
 	WSACleanup();
 }
 
 bool Client::init(uint16_t clientPort)
 {
-#ifdef _WIN32
-
 	// https://pastebin.com/JkGnQyPX
 
-	clientPort = ((clientPort <= 450) ? DEFAULT_PORT : clientPort);
+	// 0 lets the system choose the port
+	clientPort = ((clientPort != 0 && clientPort <= 450) ? DEFAULT_PORT : clientPort);
 
-	std::cout << "[COMMS CLIENT] Binding to localhost on port : " << clientPort << std::endl;
+	COMMS_LOG_INFO(Client) << "Binding to localhost on port : " << clientPort;
 
 	sockaddr_in bindAddress;
 
@@ -84,18 +173,23 @@ bool Client::init(uint16_t clientPort)
 	bindAddress.sin_port        = htons(clientPort);
 	bindAddress.sin_addr.s_addr = INADDR_ANY;
 
+	int result;
+
+#ifdef _WIN32
+
 	// initialize client socket
 	WSADATA wsaData;
-	int     result;
 
 	// Initialize Winsock
 	result = WSAStartup(MAKEWORD(2, 2), &wsaData); // initialize version 2.2
 	if (result != 0)
 	{
-		std::cout << "WSAStartup failed (" << result << "). Could not start comms client." << std::endl;
+		COMMS_LOG_ERROR(Client) << "WSAStartup failed (" << result << "). Could not start comms client.";
 		return false;
 	}
 
+#endif // _WIN32
+
 	// Create a socket for the Client to listen for client connections
 	//m_socket = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
 	m_socket = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
@@ -103,89 +197,614 @@ bool Client::init(uint16_t clientPort)
 	// Check for errors to ensure the socket is valid
 	if (m_socket == INVALID_SOCKET)
 	{
-		std::cout << "Error at socket() (" << WSAGetLastError() << "). Could not start comms client." << std::endl;
+		COMMS_LOG_ERROR(Client) << "Error at socket() (" << WSAGetLastError() << "). Could not start comms client.";
 		WSACleanup();
 		return false;
 	}
 
+#ifdef _WIN32
+
 	// 1 to set non-blocking, 0 to set blocking
 	unsigned long nonBlocking = 1;
 	if (ioctlsocket(m_socket, FIONBIO, &nonBlocking) == SOCKET_ERROR)
 	{
-		std::cout << "Error at ioctlsocket() (" << WSAGetLastError() << "). Could not start comms client." << std::endl;
+		COMMS_LOG_ERROR(Client) << "Error at ioctlsocket() (" << WSAGetLastError() << "). Could not start comms client.";
 		WSACleanup();
 		m_socket = INVALID_SOCKET;
 		return false;
 	}
 
+#else
+
+	int flags = fcntl(m_socket, F_GETFL, 0);
+	if (flags == -1 || fcntl(m_socket, F_SETFL, flags | O_NONBLOCK) == -1)
+	{
+		COMMS_LOG_ERROR(Client) << "Error at fcntl() (" << errno << "). Could not start comms client.";
+		closesocket(m_socket);
+		m_socket = INVALID_SOCKET;
+		return false;
+	}
+
+#endif // _WIN32
+
 	// Setup the UDP socket
 	result = bind(m_socket, reinterpret_cast<sockaddr*>(&bindAddress), sizeof(bindAddress));
 	if (result == SOCKET_ERROR)
 	{
-		std::cout << "Could not bind socket (" << WSAGetLastError() << "). Could not start comms sever." << std::endl;
+		COMMS_LOG_ERROR(Client) << "Could not bind socket (" << WSAGetLastError() << "). Could not start comms sever.";
 		closesocket(m_socket);
 		WSACleanup();
 		m_socket = INVALID_SOCKET;
 		return false;
 	}
 
-	std::cout << "[COMMS CLIENT] Started client on port: " << clientPort << std::endl;
+#ifndef _WIN32
+
+	// Linux only reports an unreachable server (WSAECONNRESET on Windows)
+	// to UDP sockets that are connected to it
+	result = connect(m_socket, reinterpret_cast<sockaddr*>(&m_serverAddress), sizeof(m_serverAddress));
+	if (result == SOCKET_ERROR)
+	{
+		COMMS_LOG_ERROR(Client) << "Could not connect socket (" << errno << "). Could not start comms client.";
+		closesocket(m_socket);
+		m_socket = INVALID_SOCKET;
+		return false;
+	}
 
 #endif // _WIN32
 
+	COMMS_LOG_INFO(Client) << "Started client on port: " << clientPort;
+
 	return attemptConnection();
 }
 
+bool Client::initUnix(const std::string& serverPath, unsigned int id)
+{
+	m_unixServerAddressSize = unixAddress(serverPath, m_unixServerAddress);
+	m_unixPath              = unixClientPath(serverPath, id);
+	m_socket                = openUnixSocket(m_unixPath);
+
+	// like a connected UDP socket, only the datagrams of the server are received.
+	// The server opens its socket on its thread, it may not be there yet.
+	std::chrono::steady_clock::time_point deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(UNIX_CONNECT_TIMEOUT_MS);
+
+	int result = SOCKET_ERROR;
+	while (m_socket != INVALID_SOCKET)
+	{
+		result = connect(m_socket, reinterpret_cast<sockaddr*>(&m_unixServerAddress), m_unixServerAddressSize);
+		if (result != SOCKET_ERROR || (errno != ECONNREFUSED && errno != ENOENT) || std::chrono::steady_clock::now() >= deadline)
+			break;
+
+		std::this_thread::sleep_for(std::chrono::milliseconds(1));
+	}
+
+	if (result == SOCKET_ERROR)
+	{
+		COMMS_LOG_ERROR(Client) << "No Unix socket at " << serverPath << " (" << WSAGetLastError() << "). Using UDP.";
+		closeUnixSocket(m_socket, m_unixPath);
+		m_unixPath.clear();
+		return false;
+	}
+
+	COMMS_LOG_INFO(Client) << "Started client on Unix socket " << m_unixPath << ".";
+	return true;
+}
+
 void Client::update(float dt)
 {
-	receiveMessages();
+	// the timers run on the steady clock, dt is only kept for compatibility
+	(void)dt;
+
+	// the I/O thread receives the messages if there is one
+	if (!m_ioThread.joinable())
+		receiveMessages();
+
+	TimerWheel::Clock::time_point now = TimerWheel::Clock::now();
+
+	std::size_t timers[CLIENT_TIMER_COUNT];
+	std::size_t count        = m_timers.advance(now, timers, CLIENT_TIMER_COUNT);
+	bool        connectDue   = !m_timers.scheduled(CONNECT_TIMER);
+	bool        heartbeatDue = false;
+	for (std::size_t i = 0; i < count; i++)
+	{
+		if (timers[i] == CONNECT_TIMER)   connectDue   = true;
+		if (timers[i] == HEARTBEAT_TIMER) heartbeatDue = true;
+	}
 
 	if (!m_isConnected)
 	{
-		attemptConnection();
+		m_timers.cancel(HEARTBEAT_TIMER);
+
+		// the previous attempt may still be answered. A closed channel
+		// can't reach a new server and a room that does not exist won't
+		// appear by asking again, the client must be recreated.
+		if (connectDue && !m_channelClosed.load() && m_lastError.load() != MSG_ERR_NO_ROOM)
+			attemptConnection();
+	}
+	else
+	{
+		sendDeltaAcks();
+
+		// keeps the client connected even if the pings of the server are lost
+		if (!m_timers.scheduled(HEARTBEAT_TIMER))
+			m_timers.schedule(HEARTBEAT_TIMER, now + std::chrono::milliseconds(HEARTBEAT_INTERVAL_MS));
+
+		if (heartbeatDue)
+		{
+			MessageView heartbeatMessage;
+			heartbeatMessage.playerIDAndTeam = m_idAndTeam;
+			heartbeatMessage.key             = m_key;
+			heartbeatMessage.parameters      = MSG_PRIVATE;
+			heartbeatMessage.type            = MSG_HEARTBEAT;
+			sendMessage(heartbeatMessage, Delivery::Unreliable);
+		}
+
+		if (!retransmit())
+		{
+			COMMS_LOG_ERROR(Client) << "Error: server stopped acknowledging reliable messages.";
+			disconnect(false);
+		}
 	}
+
+	flush();
 }
 
 bool Client::sendMessage(Message* message, bool force)
+{
+	return sendMessage(MessageView(*message), force);
+}
+
+bool Client::sendMessage(const MessageView& message, bool force)
+{
+	return sendMessage(message, force ? Delivery::Unreliable : defaultDelivery(message.type), force);
+}
+
+bool Client::sendMessage(const MessageView& message, Delivery delivery)
+{
+	return sendMessage(message, delivery, false);
+}
+
+bool Client::sendMessage(const MessageView& message, Delivery delivery, bool force)
 {
 	if (!force && !m_isConnected)
 	{
-		std::cout << "[COMMS CLIENT] Client not connected. Will not send message." << std::endl;
+		COMMS_LOG_LIMITED(cl::LogLevel::Warning, Client) << "Client not connected. Will not send message.";
 		return false;
 	}
 
-	if (m_socket == INVALID_SOCKET)
+	if (m_socket == INVALID_SOCKET && !m_channel.isOpen())
 	{
 		return false;
 	}
 
-	int sendResult = sendto(m_socket, reinterpret_cast<char*>(message),
-		static_cast<int>(sizeof(Message)), 0, reinterpret_cast<sockaddr*>(&m_serverAddress),
-		sizeof(m_serverAddress));
+	if (message.size > MAX_PAYLOAD_SIZE)
+	{
+		COMMS_LOG_LIMITED(cl::LogLevel::Warning, Client) << "Payload of " << message.size << " bytes is too large. Will not send message.";
+		return false;
+	}
+
+	uint8_t capabilities = m_serverCapabilities.load();
+	bool    compact      = (capabilities & MSG_CAP_COMPACT) != 0;
+	bool    coalesce     = !force && m_maxDatagramSize > sizeof(Message) && (capabilities & MSG_CAP_COALESCE);
+
+	// the headers of these are added here. In a connection request, the
+	// bit of MSG_DELTA is MSG_CONNECT_ROOM and must be kept: the request
+	// is forced, so it is never taken for a snapshot below.
+	MessageView encodedMessage = message;
+	if (message.type != MSG_CONNECT)
+		encodedMessage.parameters &= ~(MSG_DELTA | MSG_RELIABLE);
+
+	bool isSnapshot = false;
+	if (!force && (capabilities & MSG_CAP_DELTA))
+	{
+		std::lock_guard<std::mutex> lock(m_deltaMutex);
+
+		auto stream = m_sendStreams.find(message.type);
+		if (stream != m_sendStreams.end() && stream->second.enabled)
+		{
+			if (message.size > MAX_SNAPSHOT_SIZE)
+			{
+				COMMS_LOG_LIMITED(cl::LogLevel::Warning, Client) << "Snapshot of " << message.size << " bytes is too large. Will not send message.";
+				return false;
+			}
+
+			SendStream& sendStream = stream->second;
+			uint16_t    sequence   = sendStream.nextSequence++;
+			isSnapshot = true;
+
+			encodedMessage.parameters |= MSG_DELTA;
+			encodedMessage.data        = m_deltaPayload;
+			encodedMessage.size        = static_cast<uint16_t>(encodeDelta(m_deltaPayload, sequence, message.data, message.size,
+				sendStream.history, sendStream.acked, sendStream.ackedSequence));
+			sendStream.history.store(sequence, message.data, message.size);
+		}
+	}
+
+	if (!isSnapshot && delivery != Delivery::Unreliable && (capabilities & MSG_CAP_RELIABLE))
+	{
+		if (message.size > MAX_RELIABLE_PAYLOAD_SIZE)
+		{
+			COMMS_LOG_LIMITED(cl::LogLevel::Warning, Client) << "Payload of " << message.size << " bytes is too large for a reliable message. Will not send message.";
+			return false;
+		}
+
+		// queued messages are sent by update() once the server acknowledges the previous ones
+		std::lock_guard<std::mutex> lock(m_reliableMutex);
+		if (!m_reliable.send(encodedMessage, delivery, ReliableEndpoint::Clock::now(), m_reliablePayload, encodedMessage))
+			return true;
+	}
+
+	if (!appendMessage(encodedMessage, compact))
+		return false;
+
+	return coalesce ? true : flush();
+}
+
+bool Client::appendMessage(const MessageView& message, bool compact)
+{
+	// a datagram has a single format. Buffered messages are sent first to keep the order.
+	if (!m_sendWriter.empty() && (m_sendWriter.compact() != compact || !m_sendWriter.fits(message)) && !sendBuffered())
+		return false;
+
+	if (m_sendWriter.empty())
+		m_sendWriter.reset(compact);
+	m_sendWriter.append(message);
+
+	return true;
+}
+
+bool Client::flush()
+{
+	// acknowledgements go with the messages sent anyway
+	if (m_serverCapabilities.load() & MSG_CAP_RELIABLE)
+	{
+		uint8_t     acks[RELIABLE_CHANNEL_COUNT * RELIABLE_ACK_SIZE];
+		std::size_t size;
+		{
+			std::lock_guard<std::mutex> lock(m_reliableMutex);
+			size = m_reliable.writeAcks(acks);
+		}
+
+		MessageView ackMessage;
+		ackMessage.playerIDAndTeam = m_idAndTeam;
+		ackMessage.key             = m_key;
+		ackMessage.parameters      = MSG_PRIVATE;
+		ackMessage.type            = MSG_ACK;
+		ackMessage.size            = static_cast<uint16_t>(size);
+		ackMessage.data            = acks;
+		if (size > 0 && !appendMessage(ackMessage, true))
+			return false;
+	}
+
+	return sendBuffered();
+}
+
+bool Client::sendBuffered()
+{
+	if (m_sendWriter.empty())
+		return true;
+
+	std::size_t size   = m_sendWriter.finish();
+	bool        result = sendDatagram(m_sendWriter.data(), size);
+	m_sendWriter.reset(m_sendWriter.compact());
+
+	return result;
+}
+
+bool Client::retransmit()
+{
+	std::lock_guard<std::mutex> lock(m_reliableMutex);
+
+	MessageView messages[RELIABLE_CHANNEL_COUNT * RELIABLE_WINDOW_SIZE];
+	std::size_t count = m_reliable.retransmit(ReliableEndpoint::Clock::now(), messages, RELIABLE_CHANNEL_COUNT * RELIABLE_WINDOW_SIZE);
+	for (std::size_t i = 0; i < count; i++)
+	{
+		messages[i].key = m_key;
+		appendMessage(messages[i], true);
+	}
+
+	return !m_reliable.lost();
+}
+
+void Client::setDeltaStream(uint8_t type, bool enabled)
+{
+	std::lock_guard<std::mutex> lock(m_deltaMutex);
+
+	SendStream& stream = m_sendStreams[type];
+	stream.enabled = enabled;
+	stream.acked   = false;
+	stream.history.clear();
+}
+
+bool Client::sendDeltaAcks()
+{
+	uint8_t     acks[MAX_PAYLOAD_SIZE];
+	std::size_t size = 0;
+
+	{
+		std::lock_guard<std::mutex> lock(m_deltaMutex);
+
+		for (auto& entry : m_receiveStreams)
+		{
+			ReceiveStream& stream = entry.second;
+			if (!stream.ackPending || size + DELTA_ACK_SIZE > sizeof(acks))
+				continue;
+
+			encodeDeltaAck(acks + size, static_cast<uint8_t>(entry.first >> 8), static_cast<uint8_t>(entry.first & 0xFF), stream.latestSequence);
+			size += DELTA_ACK_SIZE;
+			stream.ackPending = false;
+		}
+	}
+
+	if (size == 0)
+		return true;
+
+	MessageView ackMessage;
+	ackMessage.playerIDAndTeam = m_idAndTeam;
+	ackMessage.key             = m_key;
+	ackMessage.parameters      = MSG_PRIVATE;
+	ackMessage.type            = MSG_DELTA_ACK;
+	ackMessage.size            = static_cast<uint16_t>(size);
+	ackMessage.data            = acks;
+
+	return sendMessage(ackMessage);
+}
+
+void Client::resetDeltaStreams()
+{
+	std::lock_guard<std::mutex> lock(m_deltaMutex);
+
+	// the sequence numbers go on so acknowledgements sent before can't match
+	for (auto& entry : m_sendStreams)
+	{
+		entry.second.acked = false;
+		entry.second.history.clear();
+	}
+
+	m_receiveStreams.clear();
+}
+
+bool Client::sendDatagram(const void* data, std::size_t size)
+{
+	if (m_channel.isOpen())
+	{
+		std::lock_guard<std::mutex> lock(m_channelMutex);
+		if (!m_channel.send(data, size))
+		{
+			COMMS_LOG_LIMITED(cl::LogLevel::Warning, Client) << "Shared memory of the server is full. Message not sent.";
+			return false;
+		}
+		return true;
+	}
+
+	int sendResult;
+	if (m_unixPath.empty())
+	{
+		sendResult = sendto(m_socket, static_cast<const char*>(data),
+			static_cast<int>(size), 0, reinterpret_cast<sockaddr*>(&m_serverAddress),
+			sizeof(m_serverAddress));
+	}
+	else
+	{
+		sendResult = send(m_socket, static_cast<const char*>(data), static_cast<int>(size), 0);
+
+#ifndef _WIN32
+
+		// unlike UDP, a full receive queue of the server makes the send fail
+		// instead of dropping the datagram: wait a bit for the server to read
+		pollfd descriptor;
+		descriptor.fd     = m_socket;
+		descriptor.events = POLLOUT;
+		if (sendResult < 0 && errno == EAGAIN && ::poll(&descriptor, 1, UNIX_SEND_TIMEOUT_MS) > 0)
+			sendResult = send(m_socket, static_cast<const char*>(data), static_cast<int>(size), 0);
+
+#endif // _WIN32
+
+		// the socket is disconnected once the server is gone, a restarted server has a new one
+		if (sendResult < 0 && (errno == ECONNREFUSED || errno == ENOTCONN))
+		{
+			if (connect(m_socket, reinterpret_cast<sockaddr*>(&m_unixServerAddress), m_unixServerAddressSize) == 0)
+				sendResult = send(m_socket, static_cast<const char*>(data), static_cast<int>(size), 0);
+			else
+				reportUnixServerGone();
+		}
+	}
 
 	if (sendResult < 0)
 	{
-		std::cout << "[COMMS CLIENT] sendto() failed with error: " << WSAGetLastError() << "." << std::endl;
+		COMMS_LOG_ERROR(Client) << "sendto() failed with error: " << WSAGetLastError() << ".";
 		return false;
 	}
 	
 	return true;
 }
 
+void Client::reportUnixServerGone()
+{
+	m_unixServerGone.store(true);
+
+#ifndef _WIN32
+
+	// the I/O thread sleeps until a datagram arrives, none will
+	uint64_t wakeupCount = 1;
+	if (m_wakeup != -1 && write(m_wakeup, &wakeupCount, sizeof(wakeupCount)) < 0)
+		COMMS_LOG_ERROR(Client) << "Error while waking up I/O thread (" << errno << ").";
+
+#endif // _WIN32
+}
+
 bool Client::getMessage(Message& message)
 {
+	MessageView view;
+	if (!getMessage(view))
+		return false;
+
+	message = view.toMessage();
+	return true;
+}
+
+bool Client::getMessage(MessageView& message)
+{
+	releaseMessageView();
+
 	if (m_messageQueue.empty())
 		return false;
 
-	message = m_messageQueue.front();
-	m_messageQueue.pop();
+	message              = m_messageQueue.front();
+	m_messageViewPending = true;
+	return true;
+}
+
+bool Client::waitForMessage(std::chrono::milliseconds timeout)
+{
+	releaseMessageView();
+
+	if (!m_ioThread.joinable())
+		return !m_messageQueue.empty();
+
+	std::unique_lock<std::mutex> lock(m_messageMutex);
+	return m_messageAvailable.wait_for(lock, timeout, [this] { return !m_messageQueue.empty(); });
+}
+
+bool Client::isConnected() const
+{
+	return m_isConnected.load();
+}
+
+uint8_t Client::lastError() const
+{
+	return m_lastError.load();
+}
+
+void Client::runIoThread()
+{
+	while (m_ioThreadRunning.load())
+	{
+		if (!waitForData())
+			break;
+
+		std::size_t queuedMessages = m_messageQueue.size();
+
+		receiveMessages();
+
+		if (m_messageQueue.size() != queuedMessages)
+		{
+			// lock so the notification can't happen between the check and
+			// the wait in waitForMessage()
+			{
+				std::lock_guard<std::mutex> lock(m_messageMutex);
+			}
+			m_messageAvailable.notify_all();
+		}
+	}
+
+	COMMS_LOG_INFO(Client) << "I/O thread stopped.";
+}
+
+bool Client::waitForData()
+{
+#ifdef _WIN32
+
+	timeval timeoutValue;
+	timeoutValue.tv_sec  = 0;
+	timeoutValue.tv_usec = IO_THREAD_TIMEOUT_MS * 1000;
+
+	fd_set readSet;
+	FD_ZERO(&readSet);
+	FD_SET(m_socket, &readSet);
+
+	if (select(0, &readSet, nullptr, nullptr, &timeoutValue) == SOCKET_ERROR)
+	{
+		COMMS_LOG_ERROR(Client) << "Error at select() (" << WSAGetLastError() << ").";
+		return false;
+	}
+
+#else
+
+	// the server only rings the doorbell of the channel once we announced we sleep
+	bool channelOpen = m_channel.isOpen() && !m_channelClosed.load();
+	if (channelOpen && !m_channel.prepareWait())
+		return true;
+
+	// poll() skips the negative descriptors
+	pollfd descriptors[4];
+	descriptors[0].fd      = m_socket;
+	descriptors[0].events  = POLLIN;
+	descriptors[0].revents = 0;
+	descriptors[1].fd      = m_wakeup;
+	descriptors[1].events  = POLLIN;
+	descriptors[1].revents = 0;
+	descriptors[2].fd      = channelOpen ? m_channel.doorbell() : -1;
+	descriptors[2].events  = POLLIN;
+	descriptors[2].revents = 0;
+	descriptors[3].fd      = channelOpen && !m_channelHungUp ? m_channel.connection() : -1;
+	descriptors[3].events  = POLLIN;
+	descriptors[3].revents = 0;
+
+	int result = ::poll(descriptors, 4, -1);
+
+	if (channelOpen)
+		m_channel.endWait();
+
+	if (result < 0 && errno != EINTR)
+	{
+		COMMS_LOG_ERROR(Client) << "Error at poll() (" << errno << ").";
+		return false;
+	}
+
+	if (descriptors[2].revents & POLLIN)
+	{
+		uint64_t wakeupCount;
+		if (read(descriptors[2].fd, &wakeupCount, sizeof(wakeupCount)) < 0 && errno != EAGAIN)
+			COMMS_LOG_ERROR(Client) << "Error while reading shared memory doorbell (" << errno << ").";
+	}
+
+	// the server never writes to the connection, it is readable once the server is gone
+	if (descriptors[3].revents != 0)
+		m_channelHungUp = true;
+
+#endif // _WIN32
 
 	return true;
 }
 
+void Client::stopIoThread()
+{
+	if (!m_ioThread.joinable())
+		return;
+
+	m_ioThreadRunning.store(false);
+
+#ifndef _WIN32
+
+	uint64_t wakeupCount = 1;
+	if (write(m_wakeup, &wakeupCount, sizeof(wakeupCount)) < 0)
+		COMMS_LOG_ERROR(Client) << "Error while waking up I/O thread (" << errno << ").";
+
+#endif // _WIN32
+
+	m_ioThread.join();
+
+#ifndef _WIN32
+
+	::close(m_wakeup);
+	m_wakeup = -1;
+
+#endif // _WIN32
+}
+
+void Client::releaseMessageView()
+{
+	if (!m_messageViewPending)
+		return;
+
+	m_messageQueue.pop();
+	m_messageViewPending = false;
+}
+
 bool Client::receiveMessages()
 {
-	Message       message;
+	MessageView   message;
 	ReceiveStatus receiveStatus;
 
 	// handle message as soon as we receive them
@@ -200,67 +819,154 @@ bool Client::receiveMessages()
 		if (receiveStatus == ReceiveStatus::Undersized) continue;      // skip undersized packet (maybe replace missing data by 0)
 		if (receiveStatus == ReceiveStatus::ConnReset)
 		{
-			std::cout << "[COMMS CLIENT] Error: connection forcibly closed by server." << std::endl;
+			COMMS_LOG_ERROR(Client) << "Error: connection forcibly closed by server.";
 			disconnect(false);
 			return false;
 		}
 
 		if (message.key != m_key && m_isConnected)
 		{
-			std::cout << "[COMMS CLIENT] Received message with invalid key. Ignoring." << std::endl;
+			COMMS_LOG_LIMITED(cl::LogLevel::Warning, Client) << "Received message with invalid key. Ignoring.";
 			continue;
 		}
 
-		if (!(message.type >= 192)) // NOT Comms Lib specific
+		if (message.parameters & MSG_RELIABLE)
+			processReliableMessage(message);
+		else
+			processMessage(message);
+	}
+
+	if (receiveStatus == ReceiveStatus::Error)
+	{
+		COMMS_LOG_ERROR(Client) << "There was an error while receiving messages.";
+		//disconnect();
+		return false;
+	}
+
+	return true;
+}
+
+void Client::processMessage(MessageView message)
+{
+	if ((message.parameters & MSG_DELTA) && m_isConnected && !decodeSnapshot(message))
+	{
+		// the next snapshot will be encoded against one that was received
+		COMMS_LOG_LIMITED(cl::LogLevel::Warning, Client) << "Could not decode delta-encoded message of type: " << (int)message.type << ". Skipping.";
+		return;
+	}
+
+	if (!(message.type >= 192)) // NOT Comms Lib specific
+	{
+		if (m_isConnected)
 		{
-			if (m_isConnected)
-			{
-				m_messageQueue.push(message);
-			}
-			else
-			{
-				std::cout << "[COMMS CLIENT] Warning: non-connected client received a message. Skipping." << std::endl;
-				continue; // we can continue because we know this is not a connection message
-			}
+			m_messageQueue.push(message);
 		}
+		else
+		{
+			COMMS_LOG_LIMITED(cl::LogLevel::Warning, Client) << "Non-connected client received a message. Skipping.";
+			return; // we can return because we know this is not a connection message
+		}
+	}
+
+	if (message.type >= 128)
+	{
+		handleMessage(message);
+	}
+}
 
-		if (message.type >= 128)
+void Client::processReliableMessage(const MessageView& message)
+{
+	ReliableStatus status;
+	{
+		std::lock_guard<std::mutex> lock(m_reliableMutex);
+		status = m_reliable.receive(message);
+	}
+
+	if (status == ReliableStatus::Malformed)
+	{
+		COMMS_LOG_LIMITED(cl::LogLevel::Warning, Client) << "Received reliable message without a valid header. Skipping.";
+		return;
+	}
+
+	if (status == ReliableStatus::Deliver)
+		processMessage(stripReliableHeader(message));
+
+	// processing may reset the channels, so each message is copied out first
+	while (true)
+	{
+		MessageView orderedMessage;
 		{
-			handleMessage(message);
+			std::lock_guard<std::mutex> lock(m_reliableMutex);
+			if (!m_reliable.nextOrdered(orderedMessage))
+				break;
+
+			std::memcpy(m_orderedPayload, orderedMessage.data, orderedMessage.size);
+			orderedMessage.data = m_orderedPayload;
 		}
+
+		processMessage(stripReliableHeader(orderedMessage));
 	}
+}
 
-	if (receiveStatus == ReceiveStatus::Error)
+ReceiveStatus Client::receive(MessageView& message)
+{
+	while (!m_receiveReader.next(message))
 	{
-		std::cout << "[COMMS CLIENT] There was an error while receiving messages." << std::endl;
-		//disconnect();
-		return false;
+		if (m_receiveReader.malformed())
+		{
+			// skip the rest of the datagram
+			m_receiveReader.reset(nullptr, 0);
+			COMMS_LOG_LIMITED(cl::LogLevel::Warning, Client) << "Received undersized datagram.";
+			return ReceiveStatus::Undersized;
+		}
+
+		ReceiveStatus datagramStatus = receiveDatagram();
+		if (datagramStatus == ReceiveStatus::Warning)
+		{
+			// handled as an invalid message
+			message = MessageView();
+		}
+		if (datagramStatus != ReceiveStatus::Success)
+			return datagramStatus;
 	}
 
-	return true;
+	return ReceiveStatus::Success;
 }
 
-ReceiveStatus Client::receive(Message& message)
+ReceiveStatus Client::receiveDatagram()
 {
-#ifdef _WIN32
+	m_receiveReader.reset(nullptr, 0);
+
+	if (m_channel.isOpen())
+		return receiveChannelDatagram();
 
 	if (m_socket == INVALID_SOCKET)
 	{
-		std::cout << "[COMMS CLIENT] Invalid socket. Cannot receive message." << std::endl;
+		COMMS_LOG_ERROR(Client) << "Invalid socket. Cannot receive message.";
 		return ReceiveStatus::Error;
 	}
 
-	std::size_t receivedSize = 0;
-
 	sockaddr_in senderAddress;
 	ZeroMemory(&senderAddress, sizeof(sockaddr_in));
 	senderAddress.sin_addr.s_addr = htonl(INADDR_ANY);
 	senderAddress.sin_family      = AF_INET;
 	senderAddress.sin_port        = 0;
 
-	int addressSize = static_cast<int>(sizeof(sockaddr_in));
-	int sizeReceived = recvfrom(m_socket, reinterpret_cast<char*>(&message),
-		static_cast<int>(sizeof(Message)), 0, reinterpret_cast<sockaddr*>(&senderAddress), &addressSize);
+#ifdef _WIN32
+	int receiveFlags = 0;
+#else
+	int receiveFlags = MSG_TRUNC; // return the real size of oversized datagrams instead of WSAEMSGSIZE
+#endif // _WIN32
+
+	// a connected Unix socket only receives the datagrams of the server, it has no sockaddr_in
+	bool unixSocket = !m_unixPath.empty();
+	if (unixSocket)
+		senderAddress = m_serverAddress;
+
+	socklen_t addressSize = static_cast<socklen_t>(sizeof(sockaddr_in));
+	int sizeReceived = recvfrom(m_socket, reinterpret_cast<char*>(m_receiveBuffer),
+		static_cast<int>(sizeof(m_receiveBuffer)), receiveFlags,
+		unixSocket ? nullptr : reinterpret_cast<sockaddr*>(&senderAddress), unixSocket ? nullptr : &addressSize);
 	
 	if (sizeReceived == 0)
 	{
@@ -269,14 +975,14 @@ ReceiveStatus Client::receive(Message& message)
 	else if (sizeReceived < 0)
 	{
 		int errorCode = WSAGetLastError();
-		if (errorCode == WSAEWOULDBLOCK)
+		if (errorCode == WSAEWOULDBLOCK && !m_unixServerGone.exchange(false))
 		{
 			// no data to be read
 			return ReceiveStatus::NoData;
 		}
-		else if (errorCode == WSAECONNRESET)
+		else if (errorCode == WSAEWOULDBLOCK || errorCode == WSAECONNRESET)
 		{
-			std::cout << "[COMMS CLIENT] Error: could not send message to server. Stopping client..." << std::endl;
+			COMMS_LOG_ERROR(Client) << "Error: could not send message to server. Stopping client...";
 			return ReceiveStatus::ConnReset;
 		}
 		else if (errorCode == WSAEMSGSIZE)
@@ -284,48 +990,90 @@ ReceiveStatus Client::receive(Message& message)
 			if ((senderAddress.sin_addr.s_addr != m_serverAddress.sin_addr.s_addr) ||
 	    		(senderAddress.sin_port        != m_serverAddress.sin_port))
 			{
-				message.playerIDAndTeam = 0x00;
-				message.key             = DEFAULT_KEY;
-				message.parameters      = 0x00;
-				message.type            = MSG_INVALID;
-				std::cout << "[COMMS CLIENT] Warning: Client received message from some other address than server." << std::endl;
+				COMMS_LOG_LIMITED(cl::LogLevel::Warning, Client) << "Client received message from some other address than server.";
 				return ReceiveStatus::Warning;
 			}
 			// too much data. Datagram truncated
-			std::cout << "[COMMS CLIENT] Warning: oversized datagram received. Data truncated or ignored." << std::endl;
+			COMMS_LOG_LIMITED(cl::LogLevel::Warning, Client) << "Oversized datagram received. Data truncated or ignored.";
 			return ReceiveStatus::Oversized;
 		}
-		std::cout << "[COMMS CLIENT] recvfrom() failed with error: " << errorCode << "." << std::endl;
+		COMMS_LOG_ERROR(Client) << "recvfrom() failed with error: " << errorCode << ".";
 		return ReceiveStatus::Error;
 	}
 	else if ((senderAddress.sin_addr.s_addr != m_serverAddress.sin_addr.s_addr) ||
 			 (senderAddress.sin_port        != m_serverAddress.sin_port))
 	{
-		message.playerIDAndTeam = 0x00;
-		message.key             = DEFAULT_KEY;
-		message.parameters      = 0x00;
-		message.type            = MSG_INVALID;
-		std::cout << "[COMMS CLIENT] Warning: Client received message from some other address than server." << std::endl;
+		COMMS_LOG_LIMITED(cl::LogLevel::Warning, Client) << "Client received message from some other address than server.";
 		return ReceiveStatus::Warning;
 	}
-	else if (sizeReceived > static_cast<int>(sizeof(Message)))
+	else if (sizeReceived > static_cast<int>(sizeof(m_receiveBuffer)))
 	{
 		// this should not happen, but it's here just in case
-		std::cout << "[COMMS CLIENT] Received oversized datagram." << std::endl;
+		COMMS_LOG_LIMITED(cl::LogLevel::Warning, Client) << "Received oversized datagram.";
 		return ReceiveStatus::Oversized;
 	}
-	else if (sizeReceived < static_cast<int>(sizeof(Message)))
+
+	// the size tells the format. Invalid compact datagrams are reported by receive()
+	m_receiveReader.reset(m_receiveBuffer, static_cast<std::size_t>(sizeReceived));
+	return ReceiveStatus::Success;
+}
+
+ReceiveStatus Client::receiveChannelDatagram()
+{
+	// the last datagram was read in place, its messages were copied
+	if (m_channelReading)
 	{
-		std::cout << "[COMMS CLIENT] Received undersized datagram." << std::endl;
-		return ReceiveStatus::Undersized;
+		m_channel.release();
+		m_channelReading = false;
 	}
 
-#endif // _WIN32
-	
-	return ReceiveStatus::Success;
+	std::size_t    size;
+	const uint8_t* datagram = m_channel.receive(size);
+	if (datagram != nullptr)
+	{
+		m_channelReading = true;
+		m_receiveReader.reset(datagram, size);
+		return ReceiveStatus::Success;
+	}
+
+	if (m_channel.isCorrupted())
+	{
+		COMMS_LOG_ERROR(Client) << "Invalid data in shared memory.";
+		return ReceiveStatus::Error;
+	}
+
+	// the datagrams sent before were read, like UDP the end is reported once
+	if (!m_channelClosed.load() && (m_channel.isClosedByServer() || m_channelHungUp))
+	{
+		m_channelClosed.store(true);
+		return ReceiveStatus::ConnReset;
+	}
+
+	return ReceiveStatus::NoData;
 }
 
-bool Client::handleMessage(const Message& message)
+bool Client::decodeSnapshot(MessageView& message)
+{
+	std::lock_guard<std::mutex> lock(m_deltaMutex);
+
+	ReceiveStream& stream = m_receiveStreams[static_cast<uint16_t>(message.playerIDAndTeam << 8 | message.type)];
+
+	uint16_t size;
+	uint16_t sequence;
+	if (!decodeDelta(message.data, message.size, stream.history, m_deltaSnapshot, size, sequence))
+		return false;
+
+	stream.history.store(sequence, m_deltaSnapshot, size);
+	stream.latestSequence = sequence;
+	stream.ackPending     = true;
+
+	message.parameters &= ~MSG_DELTA;
+	message.data        = m_deltaSnapshot;
+	message.size        = size;
+	return true;
+}
+
+bool Client::handleMessage(const MessageView& message)
 {
 	if (message.type == MSG_CONNECT)
 	{
@@ -333,12 +1081,15 @@ bool Client::handleMessage(const Message& message)
 		{
 			if (message.playerIDAndTeam == m_idAndTeam)
 			{
-				m_isConnected = true;
-				m_key         = message.key;
+				resetDeltaStreams();
+				m_serverCapabilities = message.parameters & MSG_CAP_ALL;
+				m_key                = message.key;
+				m_lastError          = MSG_ERR_NO_ERR;
+				m_isConnected        = true;
 			}
 			else
 			{
-				std::cout << "[COMMS CLIENT] Warning: non-connected client received a message. Skipping..." << std::endl;
+				COMMS_LOG_LIMITED(cl::LogLevel::Warning, Client) << "Non-connected client received a message. Skipping...";
 				return false;
 			}
 		}
@@ -349,16 +1100,93 @@ bool Client::handleMessage(const Message& message)
 
 		return true;
 	}
+
+	// the connection requests are answered with errors, so they come before the client is connected
+	if (message.type == MSG_ERROR)
+	{
+		if (message.playerIDAndTeam != m_idAndTeam || message.size == 0)
+			return false;
+
+		m_lastError = message.data[0];
+		COMMS_LOG_LIMITED(cl::LogLevel::Warning, Client) << "Received error " << (int)message.data[0] << " from the server.";
+
+		// the server dropped the client and the disconnect message was lost
+		if (message.data[0] == MSG_ERR_NOT_CON && m_isConnected)
+			disconnect(false);
+
+		return true;
+	}
 	
 	if (!m_isConnected)
 	{
-		std::cout << "[COMMS CLIENT] Warning: non-connected client received a message. Skipping..." << std::endl;
+		COMMS_LOG_LIMITED(cl::LogLevel::Warning, Client) << "Non-connected client received a message. Skipping...";
 		return false;
 	}
 
+	if (message.type == MSG_PING)
+	{
+		return answerPing(message);
+	}
+	else if (message.type == MSG_DISCONNECT)
+	{
+		// only a disconnection by the server is sent to the client itself, connect again
+		if (message.playerIDAndTeam == m_idAndTeam && !(message.parameters & MSG_ALL))
+		{
+			COMMS_LOG_INFO(Client) << "Disconnected by the server.";
+			disconnect(false);
+		}
+	}
+	else if (message.type == MSG_ACK)
+	{
+		std::lock_guard<std::mutex> lock(m_reliableMutex);
+		m_reliable.receiveAcks(message.data, message.size, ReliableEndpoint::Clock::now());
+	}
+	else if (message.type == MSG_DELTA_ACK)
+	{
+		std::lock_guard<std::mutex> lock(m_deltaMutex);
+
+		for (std::size_t offset = 0; offset + DELTA_ACK_SIZE <= message.size; offset += DELTA_ACK_SIZE)
+		{
+			uint8_t  source;
+			uint8_t  type;
+			uint16_t sequence;
+			decodeDeltaAck(message.data + offset, source, type, sequence);
+
+			auto stream = m_sendStreams.find(type);
+			if (source != m_idAndTeam || stream == m_sendStreams.end())
+				continue;
+
+			// acknowledgements may arrive out of order
+			SendStream& sendStream = stream->second;
+			if (!sendStream.acked || static_cast<int16_t>(sequence - sendStream.ackedSequence) > 0)
+			{
+				sendStream.acked         = true;
+				sendStream.ackedSequence = sequence;
+			}
+		}
+	}
+
 	return true;
 }
 
+bool Client::answerPing(const MessageView& ping)
+{
+	MessageView pongMessage = ping;
+	pongMessage.playerIDAndTeam = m_idAndTeam;
+	pongMessage.key             = m_key;
+	pongMessage.parameters      = MSG_PRIVATE;
+	if (pongMessage.size > LEGACY_PAYLOAD_SIZE)
+		pongMessage.size = LEGACY_PAYLOAD_SIZE;
+
+	// a datagram of its own, m_sendWriter belongs to the thread calling update()
+	uint8_t        buffer[1 + FRAME_HEADER_SIZE + LEGACY_PAYLOAD_SIZE + 1];
+	DatagramWriter writer(buffer, sizeof(buffer));
+	writer.reset((m_serverCapabilities.load() & MSG_CAP_COMPACT) != 0);
+	writer.append(pongMessage);
+
+	return sendDatagram(writer.data(), writer.finish());
+}
+
 void Client::generateRandomData(uint8_t* buffer) const
 {
 	std::random_device rd;
@@ -374,14 +1202,26 @@ void Client::generateRandomData(uint8_t* buffer) const
 
 bool Client::attemptConnection()
 {
+	m_timers.schedule(CONNECT_TIMER, TimerWheel::Clock::now() + std::chrono::milliseconds(CONNECT_RETRY_INTERVAL_MS));
+
 	Message connectionMessage;
 	connectionMessage.type            = MSG_CONNECT;
 	connectionMessage.playerIDAndTeam = m_idAndTeam;
-	connectionMessage.parameters      = MSG_ALL;
+	connectionMessage.parameters      = MSG_ALL | MSG_CAP_ALL;
 	generateRandomData(connectionMessage.data);
+
+	// the room is part of the data the key is generated from
+	if (m_room != 0)
+	{
+		connectionMessage.parameters |= MSG_CONNECT_ROOM;
+		connectionMessage.data[0]    = static_cast<uint8_t>(m_room >> 24);
+		connectionMessage.data[1]    = static_cast<uint8_t>(m_room >> 16);
+		connectionMessage.data[2]    = static_cast<uint8_t>(m_room >> 8);
+		connectionMessage.data[3]    = static_cast<uint8_t>(m_room);
+	}
 	if (!sendMessage(&connectionMessage, true))
 	{
-		std::cout << "[COMMS CLIENT] Could not send connect message." << std::endl;
+		COMMS_LOG_ERROR(Client) << "Could not send connect message.";
 		return false;
 	}
 
@@ -390,8 +1230,15 @@ bool Client::attemptConnection()
 
 bool Client::disconnect(bool serverAlive)
 {
-	m_isConnected = false;
-	m_key         = DEFAULT_KEY;
+	m_isConnected        = false;
+	m_key                = DEFAULT_KEY;
+	m_serverCapabilities = 0x00;
+	resetDeltaStreams();
+
+	{
+		std::lock_guard<std::mutex> lock(m_reliableMutex);
+		m_reliable.reset();
+	}
 
 	if (serverAlive)
 	{
@@ -402,7 +1249,7 @@ bool Client::disconnect(bool serverAlive)
 		disconnectMessage.parameters      = MSG_ALL;
 		if (!sendMessage(&disconnectMessage, true))
 		{
-			std::cout << "[COMMS CLIENT] Failed to send disconnect message." << std::endl;
+			COMMS_LOG_ERROR(Client) << "Failed to send disconnect message.";
 			return false;
 		}
 	}
@@ -0,0 +1,211 @@
+#include <ClientTable.hpp>
+
+#include <cstring>
+
+// marks an empty entry in the lookup tables
+#define NO_CLIENT 0xFF
+
+#define ADDRESS_TABLE_SIZE (2 * MAX_CLIENTS)
+
+namespace cl
+{
+
+// ideal slot of an address and port in the address table (multiplicative hash)
+static std::size_t addressHash(uint32_t address, uint16_t port)
+{
+	uint32_t hash = (address ^ (static_cast<uint32_t>(port) << 16 | port)) * 2654435761u;
+	return (hash >> 16) & (ADDRESS_TABLE_SIZE - 1);
+}
+
+ClientTable::ClientTable()
+: m_size(0)
+, m_teamSizes{0, 0}
+, m_releasedCount(0)
+{
+	std::memset(m_indexById,      NO_CLIENT, sizeof(m_indexById));
+	std::memset(m_indexByAddress, NO_CLIENT, sizeof(m_indexByAddress));
+	std::memset(m_released,       0,         sizeof(m_released));
+}
+
+std::size_t ClientTable::size() const
+{
+	return m_size;
+}
+
+bool ClientTable::empty() const
+{
+	return m_size == m_releasedCount;
+}
+
+bool ClientTable::full() const
+{
+	return m_size >= MAX_CLIENTS;
+}
+
+ClientInfo& ClientTable::operator[](std::size_t index)
+{
+	return m_clients[index];
+}
+
+const ClientInfo& ClientTable::operator[](std::size_t index) const
+{
+	return m_clients[index];
+}
+
+int ClientTable::find(uint8_t idAndTeam) const
+{
+	uint8_t index = m_indexById[idAndTeam];
+	return index == NO_CLIENT ? -1 : index;
+}
+
+int ClientTable::find(uint32_t address, uint16_t port) const
+{
+	uint8_t index = m_indexByAddress[addressSlot(address, port)];
+	return index == NO_CLIENT ? -1 : index;
+}
+
+int ClientTable::add(const ClientInfo& client)
+{
+	if (full())
+		return -1;
+
+	std::size_t index = m_size++;
+	m_clients[index]  = client;
+	m_released[index] = false;
+
+	m_indexById[client.idAndTeam] = static_cast<uint8_t>(index);
+	m_indexByAddress[addressSlot(client.address, client.port)] = static_cast<uint8_t>(index);
+
+	uint8_t team = client.idAndTeam & 0x01;
+	m_teamPositions[index]                    = static_cast<uint8_t>(m_teamSizes[team]);
+	m_teamMembers[team][m_teamSizes[team]++] = static_cast<uint8_t>(index);
+
+	return static_cast<int>(index);
+}
+
+void ClientTable::release(std::size_t index)
+{
+	if (m_released[index])
+		return;
+
+	if (m_indexById[m_clients[index].idAndTeam] == index)
+		m_indexById[m_clients[index].idAndTeam] = NO_CLIENT;
+	removeAddress(index);
+
+	m_clients[index].address = INADDR_ANY;
+	m_clients[index].port    = 0;
+
+	m_released[index] = true;
+	m_releasedCount++;
+}
+
+bool ClientTable::compact()
+{
+	if (m_releasedCount == 0)
+		return false;
+
+	// go backwards so the last client, which fills the hole, is never a released one
+	for (std::size_t index = m_size; index-- > 0;)
+	{
+		if (!m_released[index])
+			continue;
+
+		removeFromTeam(index);
+		m_released[index] = false;
+
+		std::size_t last = --m_size;
+		if (index != last)
+			move(last, index);
+	}
+
+	m_releasedCount = 0;
+	return true;
+}
+
+std::size_t ClientTable::teamSize(uint8_t team) const
+{
+	return m_teamSizes[team];
+}
+
+std::size_t ClientTable::teamMember(uint8_t team, std::size_t position) const
+{
+	return m_teamMembers[team][position];
+}
+
+std::size_t ClientTable::addressSlot(uint32_t address, uint16_t port) const
+{
+	// linear probing until the client or an empty slot is found
+	std::size_t slot = addressHash(address, port);
+
+	while (m_indexByAddress[slot] != NO_CLIENT)
+	{
+		const ClientInfo& client = m_clients[m_indexByAddress[slot]];
+		if (client.address == address && client.port == port)
+			break;
+
+		slot = (slot + 1) & (ADDRESS_TABLE_SIZE - 1);
+	}
+
+	return slot;
+}
+
+void ClientTable::removeAddress(std::size_t index)
+{
+	std::size_t slot = addressSlot(m_clients[index].address, m_clients[index].port);
+	if (m_indexByAddress[slot] != index)
+		return;
+
+	// backward shift deletion: move the following entries of the probe
+	// sequence up so lookups never stop early at the freed slot
+	std::size_t hole = slot;
+	std::size_t next = (hole + 1) & (ADDRESS_TABLE_SIZE - 1);
+	while (m_indexByAddress[next] != NO_CLIENT)
+	{
+		const ClientInfo& client = m_clients[m_indexByAddress[next]];
+		std::size_t       ideal  = addressHash(client.address, client.port);
+
+		// the entry can fill the hole if its ideal slot is not between the hole and itself
+		if (((next - ideal) & (ADDRESS_TABLE_SIZE - 1)) >= ((next - hole) & (ADDRESS_TABLE_SIZE - 1)))
+		{
+			m_indexByAddress[hole] = m_indexByAddress[next];
+			hole = next;
+		}
+
+		next = (next + 1) & (ADDRESS_TABLE_SIZE - 1);
+	}
+
+	m_indexByAddress[hole] = NO_CLIENT;
+}
+
+void ClientTable::removeFromTeam(std::size_t index)
+{
+	uint8_t     team     = m_clients[index].idAndTeam & 0x01;
+	std::size_t position = m_teamPositions[index];
+	std::size_t last     = --m_teamSizes[team];
+
+	// swap with the last member of the team
+	uint8_t moved = m_teamMembers[team][last];
+	m_teamMembers[team][position] = moved;
+	m_teamPositions[moved]        = static_cast<uint8_t>(position);
+}
+
+void ClientTable::move(std::size_t from, std::size_t to)
+{
+	const ClientInfo& client = m_clients[from];
+
+	if (m_indexById[client.idAndTeam] == from)
+		m_indexById[client.idAndTeam] = static_cast<uint8_t>(to);
+
+	std::size_t slot = addressSlot(client.address, client.port);
+	if (m_indexByAddress[slot] == from)
+		m_indexByAddress[slot] = static_cast<uint8_t>(to);
+
+	uint8_t team = client.idAndTeam & 0x01;
+	m_teamMembers[team][m_teamPositions[from]] = static_cast<uint8_t>(to);
+	m_teamPositions[to]                        = m_teamPositions[from];
+
+	m_clients[to]  = client;
+	m_released[to] = m_released[from];
+}
+
+} // cl
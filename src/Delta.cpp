@@ -0,0 +1,222 @@
+#include <Delta.hpp>
+
+#include <cstring>
+
+// first byte of an encoded payload
+#define DELTA_KEYFRAME 0x00 //!< The snapshot follows as is
+#define DELTA_XOR      0x01 //!< Runs of the snapshot XORed with a baseline follow
+
+// kind, sequence number and baseline sequence number
+#define DELTA_XOR_HEADER_SIZE 5
+
+namespace cl
+{
+
+// LEB128, 7 bits per byte
+static std::size_t writeVarint(uint8_t* output, uint16_t value)
+{
+	std::size_t size = 0;
+	while (value >= 0x80)
+	{
+		output[size++] = static_cast<uint8_t>(value | 0x80);
+		value >>= 7;
+	}
+	output[size++] = static_cast<uint8_t>(value);
+
+	return size;
+}
+
+static bool readVarint(const uint8_t* input, std::size_t inputSize, std::size_t& offset, uint16_t& value)
+{
+	uint32_t result = 0;
+	for (unsigned int shift = 0; shift < 21; shift += 7)
+	{
+		if (offset >= inputSize)
+			return false;
+
+		uint8_t byte = input[offset++];
+		result |= static_cast<uint32_t>(byte & 0x7F) << shift;
+		if (!(byte & 0x80))
+		{
+			value = static_cast<uint16_t>(result);
+			return result <= 0xFFFF;
+		}
+	}
+
+	return false;
+}
+
+static void writeSequence(uint8_t* output, uint16_t sequence)
+{
+	output[0] = static_cast<uint8_t>(sequence >> 8);
+	output[1] = static_cast<uint8_t>(sequence & 0xFF);
+}
+
+static uint16_t readSequence(const uint8_t* input)
+{
+	return static_cast<uint16_t>(input[0] << 8 | input[1]);
+}
+
+// SnapshotHistory
+
+void SnapshotHistory::clear()
+{
+	for (Slot& slot : m_slots)
+		slot.valid = false;
+}
+
+void SnapshotHistory::store(uint16_t sequence, const uint8_t* data, uint16_t size)
+{
+	Slot& slot = m_slots[sequence % DELTA_HISTORY_SIZE];
+	slot.sequence = sequence;
+	slot.valid    = true;
+	slot.data.assign(data, data + size);
+}
+
+bool SnapshotHistory::find(uint16_t sequence, const uint8_t*& data, uint16_t& size) const
+{
+	const Slot& slot = m_slots[sequence % DELTA_HISTORY_SIZE];
+	if (!slot.valid || slot.sequence != sequence)
+		return false;
+
+	data = slot.data.data();
+	size = static_cast<uint16_t>(slot.data.size());
+	return true;
+}
+
+// encoding
+
+std::size_t encodeDelta(uint8_t* output, uint16_t sequence, const uint8_t* snapshot, uint16_t size,
+                        const SnapshotHistory& history, bool hasBaseline, uint16_t baselineSequence)
+{
+	std::size_t keyframeSize = DELTA_KEYFRAME_HEADER_SIZE + size;
+
+	const uint8_t* baseline     = nullptr;
+	uint16_t       baselineSize = 0;
+
+	// the header and size of a delta must leave room for at least one changed byte
+	bool canDelta = keyframeSize > DELTA_XOR_HEADER_SIZE + 3 + 6;
+
+	if (canDelta && hasBaseline && history.find(baselineSequence, baseline, baselineSize))
+	{
+		output[0] = DELTA_XOR;
+		writeSequence(output + 1, sequence);
+		writeSequence(output + 3, baselineSequence);
+
+		std::size_t encodedSize = DELTA_XOR_HEADER_SIZE;
+		encodedSize += writeVarint(output + encodedSize, size);
+
+		// pairs of runs: zeros to skip, then bytes that changed
+		std::size_t position = 0;
+		while (position < size)
+		{
+			std::size_t zeros = position;
+			while (zeros < size && snapshot[zeros] == (zeros < baselineSize ? baseline[zeros] : 0))
+				zeros++;
+
+			// trailing zeros are implied by the size
+			if (zeros == size)
+				break;
+
+			std::size_t literals = zeros;
+			while (literals < size && snapshot[literals] != (literals < baselineSize ? baseline[literals] : 0))
+				literals++;
+
+			// varints take at most 3 bytes each
+			if (encodedSize + 6 + (literals - zeros) >= keyframeSize)
+			{
+				encodedSize = keyframeSize;
+				break;
+			}
+
+			encodedSize += writeVarint(output + encodedSize, static_cast<uint16_t>(zeros - position));
+			encodedSize += writeVarint(output + encodedSize, static_cast<uint16_t>(literals - zeros));
+			for (std::size_t i = zeros; i < literals; i++)
+				output[encodedSize++] = snapshot[i] ^ (i < baselineSize ? baseline[i] : 0);
+
+			position = literals;
+		}
+
+		if (encodedSize < keyframeSize)
+			return encodedSize;
+	}
+
+	output[0] = DELTA_KEYFRAME;
+	writeSequence(output + 1, sequence);
+	if (size > 0)
+		std::memcpy(output + DELTA_KEYFRAME_HEADER_SIZE, snapshot, size);
+
+	return keyframeSize;
+}
+
+bool decodeDelta(const uint8_t* payload, std::size_t payloadSize, const SnapshotHistory& history,
+                 uint8_t* snapshot, uint16_t& size, uint16_t& sequence)
+{
+	if (payloadSize < DELTA_KEYFRAME_HEADER_SIZE)
+		return false;
+
+	sequence = readSequence(payload + 1);
+
+	if (payload[0] == DELTA_KEYFRAME)
+	{
+		if (payloadSize - DELTA_KEYFRAME_HEADER_SIZE > MAX_SNAPSHOT_SIZE)
+			return false;
+
+		size = static_cast<uint16_t>(payloadSize - DELTA_KEYFRAME_HEADER_SIZE);
+		if (size > 0)
+			std::memcpy(snapshot, payload + DELTA_KEYFRAME_HEADER_SIZE, size);
+		return true;
+	}
+
+	if (payload[0] != DELTA_XOR || payloadSize < DELTA_XOR_HEADER_SIZE)
+		return false;
+
+	const uint8_t* baseline     = nullptr;
+	uint16_t       baselineSize = 0;
+	if (!history.find(readSequence(payload + 3), baseline, baselineSize))
+		return false;
+
+	std::size_t offset = DELTA_XOR_HEADER_SIZE;
+	if (!readVarint(payload, payloadSize, offset, size) || size > MAX_SNAPSHOT_SIZE)
+		return false;
+
+	// start from the baseline, truncated or padded with zeros
+	std::size_t copied = baselineSize < size ? baselineSize : size;
+	if (copied > 0)
+		std::memcpy(snapshot, baseline, copied);
+	std::memset(snapshot + copied, 0, size - copied);
+
+	std::size_t position = 0;
+	while (offset < payloadSize)
+	{
+		uint16_t zeros;
+		uint16_t literals;
+		if (!readVarint(payload, payloadSize, offset, zeros) || !readVarint(payload, payloadSize, offset, literals))
+			return false;
+
+		position += zeros;
+		if (position + literals > size || offset + literals > payloadSize)
+			return false;
+
+		for (uint16_t i = 0; i < literals; i++)
+			snapshot[position++] ^= payload[offset++];
+	}
+
+	return true;
+}
+
+void encodeDeltaAck(uint8_t* output, uint8_t source, uint8_t type, uint16_t sequence)
+{
+	output[0] = source;
+	output[1] = type;
+	writeSequence(output + 2, sequence);
+}
+
+void decodeDeltaAck(const uint8_t* input, uint8_t& source, uint8_t& type, uint16_t& sequence)
+{
+	source   = input[0];
+	type     = input[1];
+	sequence = readSequence(input + 2);
+}
+
+} // cl
@@ -0,0 +1,466 @@
+#include <IoUring.hpp>
+#include <Log.hpp>
+
+#include <algorithm>
+#include <cstring>
+
+#ifndef _WIN32
+
+	#include <poll.h>
+	#include <signal.h>
+	#include <sys/mman.h>
+	#include <sys/syscall.h>
+
+#endif // _WIN32
+
+// group of the buffers provided to the kernel, the only one
+#define BUFFER_GROUP 0
+
+// tag of the request cancelling the others when closing
+#define CANCEL_TAG UINT64_MAX
+
+// longest wait for the requests to be cancelled
+#define CANCEL_TIMEOUT_MS 100
+
+namespace cl
+{
+
+#ifndef _WIN32
+
+// the indices of the rings are shared with the kernel
+static uint32_t loadAcquire(const uint32_t* index)
+{
+	return __atomic_load_n(index, __ATOMIC_ACQUIRE);
+}
+
+static void storeRelease(uint32_t* index, uint32_t value)
+{
+	__atomic_store_n(index, value, __ATOMIC_RELEASE);
+}
+
+#endif // _WIN32
+
+IoUring::IoUring()
+#ifndef _WIN32
+: m_fd(-1)
+, m_rings(MAP_FAILED)
+, m_ringsSize(0)
+, m_cqRing(MAP_FAILED)
+, m_cqRingSize(0)
+, m_entries(static_cast<io_uring_sqe*>(MAP_FAILED))
+, m_entryCount(0)
+, m_sqHead(nullptr)
+, m_sqTail(nullptr)
+, m_sqMask(0)
+, m_sqLocalTail(0)
+, m_sqSubmitted(0)
+, m_lastEntry(nullptr)
+, m_cqes(nullptr)
+, m_cqHead(nullptr)
+, m_cqTail(nullptr)
+, m_cqMask(0)
+, m_bufferRing(static_cast<io_uring_buf_ring*>(MAP_FAILED))
+, m_bufferRingSize(0)
+, m_buffers(nullptr)
+, m_bufferSize(0)
+, m_bufferCount(0)
+, m_bufferTail(0)
+#endif // _WIN32
+{
+}
+
+IoUring::~IoUring()
+{
+	close();
+}
+
+bool IoUring::open(unsigned int entries, unsigned int bufferCount, std::size_t bufferSize)
+{
+#ifdef _WIN32
+
+	(void)entries;
+	(void)bufferCount;
+	(void)bufferSize;
+	COMMS_LOG_ERROR(Server) << "io_uring is not supported on this platform.";
+	return false;
+
+#else
+
+	io_uring_params params;
+	ZeroMemory(&params, sizeof(params));
+	params.flags = IORING_SETUP_SUBMIT_ALL;
+
+	m_fd = static_cast<int>(syscall(__NR_io_uring_setup, entries, &params));
+	if (m_fd < 0)
+	{
+		COMMS_LOG_ERROR(Server) << "Error at io_uring_setup() (" << errno << ").";
+		m_fd = -1;
+		return false;
+	}
+
+	// timeouts of submit(), and completions that are never dropped
+	if (!(params.features & IORING_FEAT_EXT_ARG) || !(params.features & IORING_FEAT_NODROP))
+	{
+		COMMS_LOG_ERROR(Server) << "io_uring of this kernel is too old.";
+		close();
+		return false;
+	}
+
+	m_ringsSize  = params.sq_off.array + params.sq_entries * sizeof(uint32_t);
+	m_cqRingSize = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+	if (params.features & IORING_FEAT_SINGLE_MMAP)
+		m_ringsSize = std::max(m_ringsSize, m_cqRingSize);
+
+	m_rings = mmap(nullptr, m_ringsSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, m_fd, IORING_OFF_SQ_RING);
+	if (!(params.features & IORING_FEAT_SINGLE_MMAP) && m_rings != MAP_FAILED)
+		m_cqRing = mmap(nullptr, m_cqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, m_fd, IORING_OFF_CQ_RING);
+
+	m_entryCount = params.sq_entries;
+	m_entries    = static_cast<io_uring_sqe*>(mmap(nullptr, m_entryCount * sizeof(io_uring_sqe), PROT_READ | PROT_WRITE,
+	                                               MAP_SHARED | MAP_POPULATE, m_fd, IORING_OFF_SQES));
+
+	void* cqRing = (params.features & IORING_FEAT_SINGLE_MMAP) ? m_rings : m_cqRing;
+	if (m_rings == MAP_FAILED || cqRing == MAP_FAILED || m_entries == MAP_FAILED)
+	{
+		COMMS_LOG_ERROR(Server) << "Could not map io_uring (" << errno << ").";
+		close();
+		return false;
+	}
+
+	uint8_t* sqRing = static_cast<uint8_t*>(m_rings);
+	m_sqHead        = reinterpret_cast<uint32_t*>(sqRing + params.sq_off.head);
+	m_sqTail        = reinterpret_cast<uint32_t*>(sqRing + params.sq_off.tail);
+	m_sqMask        = *reinterpret_cast<uint32_t*>(sqRing + params.sq_off.ring_mask);
+	m_sqLocalTail   = *m_sqTail;
+	m_sqSubmitted   = m_sqLocalTail;
+
+	// the entries are used in order, the indirection array never changes
+	uint32_t* sqArray = reinterpret_cast<uint32_t*>(sqRing + params.sq_off.array);
+	for (uint32_t i = 0; i < params.sq_entries; i++)
+		sqArray[i] = i;
+
+	uint8_t* cqBytes = static_cast<uint8_t*>(cqRing);
+	m_cqes   = reinterpret_cast<io_uring_cqe*>(cqBytes + params.cq_off.cqes);
+	m_cqHead = reinterpret_cast<uint32_t*>(cqBytes + params.cq_off.head);
+	m_cqTail = reinterpret_cast<uint32_t*>(cqBytes + params.cq_off.tail);
+	m_cqMask = *reinterpret_cast<uint32_t*>(cqBytes + params.cq_off.ring_mask);
+
+	// the buffer ring and the buffers are allocated together, page aligned
+	m_bufferCount    = bufferCount;
+	m_bufferSize     = bufferSize;
+	m_bufferRingSize = bufferCount * sizeof(io_uring_buf);
+
+	void* memory = mmap(nullptr, m_bufferRingSize + bufferCount * bufferSize, PROT_READ | PROT_WRITE,
+	                    MAP_PRIVATE | MAP_ANONYMOUS | MAP_POPULATE, -1, 0);
+	if (memory == MAP_FAILED)
+	{
+		COMMS_LOG_ERROR(Server) << "Could not allocate io_uring buffers (" << errno << ").";
+		close();
+		return false;
+	}
+
+	m_bufferRing = static_cast<io_uring_buf_ring*>(memory);
+	m_buffers    = static_cast<uint8_t*>(memory) + m_bufferRingSize;
+
+	io_uring_buf_reg registration;
+	ZeroMemory(&registration, sizeof(registration));
+	registration.ring_addr    = reinterpret_cast<uint64_t>(m_bufferRing);
+	registration.ring_entries = bufferCount;
+	registration.bgid         = BUFFER_GROUP;
+
+	if (syscall(__NR_io_uring_register, m_fd, IORING_REGISTER_PBUF_RING, &registration, 1) < 0)
+	{
+		COMMS_LOG_ERROR(Server) << "Could not provide io_uring buffers (" << errno << ").";
+		close();
+		return false;
+	}
+
+	m_bufferTail = 0;
+	for (unsigned int i = 0; i < bufferCount; i++)
+		recycle(static_cast<int>(i));
+
+	return true;
+
+#endif // _WIN32
+}
+
+void IoUring::close()
+{
+#ifndef _WIN32
+
+	// closing the instance cancels the requests in the background, with the
+	// sockets they hold still open: end them first so they can be reused
+	if (m_fd != -1)
+	{
+		io_uring_sqe* entry = nextEntry();
+		if (entry != nullptr)
+		{
+			entry->opcode       = IORING_OP_ASYNC_CANCEL;
+			entry->fd           = -1;
+			entry->cancel_flags = IORING_ASYNC_CANCEL_ANY;
+			entry->user_data    = CANCEL_TAG;
+		}
+
+		IoCompletion completion;
+		bool         cancelled = entry == nullptr;
+		while (!cancelled && (submit(1, CANCEL_TIMEOUT_MS) >= 0 || errno == EINTR))
+		{
+			while (complete(completion))
+				cancelled = cancelled || completion.tag == CANCEL_TAG;
+		}
+
+		::close(m_fd);
+	}
+	m_fd = -1;
+
+	if (m_entries != MAP_FAILED)
+		munmap(m_entries, m_entryCount * sizeof(io_uring_sqe));
+	if (m_cqRing != MAP_FAILED)
+		munmap(m_cqRing, m_cqRingSize);
+	if (m_rings != MAP_FAILED)
+		munmap(m_rings, m_ringsSize);
+	if (m_bufferRing != MAP_FAILED)
+		munmap(m_bufferRing, m_bufferRingSize + m_bufferCount * m_bufferSize);
+
+	m_entries    = static_cast<io_uring_sqe*>(MAP_FAILED);
+	m_cqRing     = MAP_FAILED;
+	m_rings      = MAP_FAILED;
+	m_bufferRing = static_cast<io_uring_buf_ring*>(MAP_FAILED);
+	m_lastEntry  = nullptr;
+
+#endif // _WIN32
+}
+
+bool IoUring::isOpen() const
+{
+#ifdef _WIN32
+	return false;
+#else
+	return m_fd != -1;
+#endif // _WIN32
+}
+
+bool IoUring::receive(SOCKET socket, const msghdr* header, uint64_t tag)
+{
+#ifdef _WIN32
+
+	(void)socket;
+	(void)header;
+	(void)tag;
+	return false;
+
+#else
+
+	io_uring_sqe* entry = nextEntry();
+	if (entry == nullptr)
+		return false;
+
+	entry->opcode    = IORING_OP_RECVMSG;
+	entry->fd        = socket;
+	entry->addr      = reinterpret_cast<uint64_t>(header);
+	entry->len       = 1;
+	entry->ioprio    = IORING_RECV_MULTISHOT;
+	entry->flags     = IOSQE_BUFFER_SELECT;
+	entry->buf_group = BUFFER_GROUP;
+	entry->user_data = tag;
+	return true;
+
+#endif // _WIN32
+}
+
+bool IoUring::poll(int fd, uint64_t tag)
+{
+#ifdef _WIN32
+
+	(void)fd;
+	(void)tag;
+	return false;
+
+#else
+
+	io_uring_sqe* entry = nextEntry();
+	if (entry == nullptr)
+		return false;
+
+	entry->opcode        = IORING_OP_POLL_ADD;
+	entry->fd            = fd;
+	entry->poll32_events = POLLIN;
+	entry->len           = IORING_POLL_ADD_MULTI;
+	entry->user_data     = tag;
+	return true;
+
+#endif // _WIN32
+}
+
+bool IoUring::send(SOCKET socket, const msghdr* header, uint64_t tag, bool linked)
+{
+#ifdef _WIN32
+
+	(void)socket;
+	(void)header;
+	(void)tag;
+	(void)linked;
+	return false;
+
+#else
+
+	io_uring_sqe* entry = nextEntry();
+	if (entry == nullptr)
+		return false;
+
+	// a hard link does not cancel the rest of the chain when a send fails
+	entry->opcode    = IORING_OP_SENDMSG;
+	entry->fd        = socket;
+	entry->addr      = reinterpret_cast<uint64_t>(header);
+	entry->len       = 1;
+	entry->flags     = linked ? IOSQE_IO_HARDLINK : 0;
+	entry->user_data = tag;
+	return true;
+
+#endif // _WIN32
+}
+
+unsigned int IoUring::queued() const
+{
+#ifdef _WIN32
+	return 0;
+#else
+	return m_sqLocalTail - m_sqSubmitted;
+#endif // _WIN32
+}
+
+int IoUring::submit(unsigned int waitCount, int timeoutMs)
+{
+#ifdef _WIN32
+
+	(void)waitCount;
+	(void)timeoutMs;
+	return -1;
+
+#else
+
+	// a chain never spans two submissions
+	if (m_lastEntry != nullptr)
+		m_lastEntry->flags &= ~(IOSQE_IO_LINK | IOSQE_IO_HARDLINK);
+	m_lastEntry = nullptr;
+
+	storeRelease(m_sqTail, m_sqLocalTail);
+	unsigned int submitCount = m_sqLocalTail - m_sqSubmitted;
+
+	__kernel_timespec timeout;
+	timeout.tv_sec  = timeoutMs / 1000;
+	timeout.tv_nsec = (timeoutMs % 1000) * 1000000LL;
+
+	io_uring_getevents_arg argument;
+	ZeroMemory(&argument, sizeof(argument));
+	argument.sigmask_sz = _NSIG / 8;
+	argument.ts         = timeoutMs >= 0 ? reinterpret_cast<uint64_t>(&timeout) : 0;
+
+	unsigned int flags = IORING_ENTER_EXT_ARG | (waitCount > 0 ? IORING_ENTER_GETEVENTS : 0);
+	int result = static_cast<int>(syscall(__NR_io_uring_enter, m_fd, submitCount, waitCount, flags, &argument, sizeof(argument)));
+
+	// the requests are consumed even if the wait fails
+	m_sqSubmitted = loadAcquire(m_sqHead);
+
+	return result;
+
+#endif // _WIN32
+}
+
+bool IoUring::complete(IoCompletion& completion)
+{
+#ifdef _WIN32
+
+	(void)completion;
+	return false;
+
+#else
+
+	uint32_t head = *m_cqHead;
+	if (head == loadAcquire(m_cqTail))
+		return false;
+
+	const io_uring_cqe& entry = m_cqes[head & m_cqMask];
+	completion.tag    = entry.user_data;
+	completion.result = entry.res;
+	completion.more   = (entry.flags & IORING_CQE_F_MORE) != 0;
+	completion.buffer = (entry.flags & IORING_CQE_F_BUFFER) ? static_cast<int>(entry.flags >> IORING_CQE_BUFFER_SHIFT) : -1;
+
+	storeRelease(m_cqHead, head + 1);
+	return true;
+
+#endif // _WIN32
+}
+
+bool IoUring::datagram(const IoCompletion& completion, const msghdr& header, IoDatagram& datagram) const
+{
+#ifdef _WIN32
+
+	(void)completion;
+	(void)header;
+	(void)datagram;
+	return false;
+
+#else
+
+	// the buffer starts with the header, then the address and the control data as sized by the request
+	std::size_t headerSize = sizeof(io_uring_recvmsg_out) + header.msg_namelen + header.msg_controllen;
+	if (completion.buffer < 0 || static_cast<unsigned int>(completion.buffer) >= m_bufferCount ||
+	    completion.result < 0 || static_cast<std::size_t>(completion.result) < headerSize)
+	{
+		return false;
+	}
+
+	const uint8_t*              buffer = m_buffers + completion.buffer * m_bufferSize;
+	const io_uring_recvmsg_out* output = reinterpret_cast<const io_uring_recvmsg_out*>(buffer);
+
+	datagram.name      = buffer + sizeof(io_uring_recvmsg_out);
+	datagram.nameSize  = std::min<socklen_t>(output->namelen, header.msg_namelen);
+	datagram.data      = buffer + headerSize;
+	datagram.size      = std::min<std::size_t>(output->payloadlen, completion.result - headerSize);
+	datagram.truncated = (output->flags & MSG_TRUNC) != 0;
+	return true;
+
+#endif // _WIN32
+}
+
+void IoUring::recycle(int buffer)
+{
+#ifdef _WIN32
+
+	(void)buffer;
+
+#else
+
+	if (buffer < 0 || static_cast<unsigned int>(buffer) >= m_bufferCount)
+		return;
+
+	// bufs is a flexible array, which C++ places after an empty struct: index from the start instead
+	io_uring_buf& entry = reinterpret_cast<io_uring_buf*>(m_bufferRing)[m_bufferTail & (m_bufferCount - 1)];
+	entry.addr = reinterpret_cast<uint64_t>(m_buffers + buffer * m_bufferSize);
+	entry.len  = static_cast<uint32_t>(m_bufferSize);
+	entry.bid  = static_cast<uint16_t>(buffer);
+
+	m_bufferTail++;
+	__atomic_store_n(&m_bufferRing->tail, m_bufferTail, __ATOMIC_RELEASE);
+
+#endif // _WIN32
+}
+
+#ifndef _WIN32
+
+io_uring_sqe* IoUring::nextEntry()
+{
+	if (m_sqLocalTail - loadAcquire(m_sqHead) >= m_entryCount)
+		return nullptr;
+
+	io_uring_sqe* entry = &m_entries[m_sqLocalTail & m_sqMask];
+	ZeroMemory(entry, sizeof(io_uring_sqe));
+	m_sqLocalTail++;
+	m_lastEntry = entry;
+	return entry;
+}
+
+#endif // _WIN32
+
+} // cl
@@ -0,0 +1,321 @@
+#include <Log.hpp>
+#include <RingBuffer.hpp>
+
+#include <condition_variable>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <mutex>
+#include <thread>
+
+namespace cl
+{
+
+std::atomic<LogLevel> Logger::s_level(LogLevel::Info);
+
+// prefix written before the messages of each source
+static const char* sourcePrefix(LogSource source)
+{
+	switch (source)
+	{
+	case LogSource::Server: return "[COMMS SERVER] ";
+	case LogSource::Client: return "[COMMS CLIENT] ";
+	case LogSource::Stats:  return "[COMMS STATS] ";
+	default:                return "";
+	}
+}
+
+// tag written after the prefix, so the levels can be told apart in the output
+static const char* levelTag(LogLevel level)
+{
+	switch (level)
+	{
+	case LogLevel::Debug:   return "[DEBUG] ";
+	case LogLevel::Info:    return "[INFO] ";
+	case LogLevel::Warning: return "[WARNING] ";
+	case LogLevel::Error:   return "[ERROR] ";
+	default:                return "";
+	}
+}
+
+static void writeRecord(const LogRecord& record)
+{
+	std::fputs(sourcePrefix(record.source), stdout);
+	std::fputs(levelTag(record.level), stdout);
+	std::fwrite(record.text, 1, record.size, stdout);
+	std::fputc('\n', stdout);
+}
+
+/**
+ * @brief The queue and the writer thread behind Logger
+ *
+ * Never destroyed, so threads of the library logging while static
+ * objects are destroyed still find it. The writer is stopped at exit.
+ */
+class LogWriter
+{
+public:
+	static LogWriter& instance()
+	{
+		static LogWriter* writer = new LogWriter();
+		return *writer;
+	}
+
+	void push(const LogRecord& record)
+	{
+		if (m_synchronous.load(std::memory_order_acquire))
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			writeRecord(record);
+			std::fflush(stdout);
+			return;
+		}
+
+		if (!m_queue.push(record))
+			return;
+
+		m_pushed.fetch_add(1, std::memory_order_release);
+
+		// only take the lock if the writer is waiting for messages
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+		if (m_waiting.exchange(false))
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			m_wakeup.notify_one();
+		}
+	}
+
+	void flush()
+	{
+		if (m_synchronous.load(std::memory_order_acquire))
+			return;
+
+		uint64_t target = m_pushed.load(std::memory_order_acquire);
+
+		std::unique_lock<std::mutex> lock(m_mutex);
+		m_waiting.store(false);
+		m_wakeup.notify_one();
+		m_flushed.wait(lock, [&]() { return m_written >= target || m_synchronous.load(); });
+	}
+
+private:
+	LogWriter()
+	: m_queue(LOG_QUEUE_CAPACITY)
+	, m_pushed(0)
+	, m_written(0)
+	, m_reportedDrops(0)
+	, m_waiting(false)
+	, m_continueExecution(true)
+	, m_synchronous(false)
+	, m_thread(&LogWriter::run, this)
+	{
+		std::atexit([]() { instance().stop(); });
+	}
+
+	void stop()
+	{
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			m_continueExecution.store(false);
+			m_wakeup.notify_one();
+		}
+
+		if (m_thread.joinable()) m_thread.join();
+
+		// the writer drained the queue, later messages are written right away
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_synchronous.store(true, std::memory_order_release);
+		m_flushed.notify_all();
+	}
+
+	void run()
+	{
+		while (true)
+		{
+			uint64_t written = 0;
+			while (!m_queue.empty())
+			{
+				writeRecord(m_queue.front());
+				m_queue.pop();
+				written++;
+			}
+
+			uint64_t drops = m_queue.overflowCount();
+			if (drops != m_reportedDrops)
+			{
+				std::printf("[COMMS LOG] %llu messages dropped.\n", static_cast<unsigned long long>(drops - m_reportedDrops));
+				m_reportedDrops = drops;
+			}
+
+			if (written > 0)
+				std::fflush(stdout);
+
+			std::unique_lock<std::mutex> lock(m_mutex);
+			m_written += written;
+			m_flushed.notify_all();
+
+			if (!m_continueExecution.load())
+			{
+				if (m_queue.empty())
+					break;
+				continue;
+			}
+
+			// a message pushed after the queue was found empty sees m_waiting and wakes us up
+			m_waiting.store(true);
+			std::atomic_thread_fence(std::memory_order_seq_cst);
+			if (!m_queue.empty())
+			{
+				m_waiting.store(false);
+				continue;
+			}
+
+			m_wakeup.wait(lock, [&]() { return !m_waiting.load() || !m_continueExecution.load(); });
+		}
+	}
+
+	MpscRing<LogRecord> m_queue;
+
+	std::atomic<uint64_t> m_pushed;        //!< Messages queued
+	uint64_t              m_written;       //!< Messages written, guarded by m_mutex
+	uint64_t              m_reportedDrops; //!< Value of m_queue.overflowCount() last reported
+
+	std::mutex              m_mutex;
+	std::condition_variable m_wakeup;  //!< Notified when messages are pushed while the writer waits
+	std::condition_variable m_flushed; //!< Notified when the writer wrote a batch
+	std::atomic<bool>       m_waiting; //!< The writer found the queue empty and waits for m_wakeup
+
+	std::atomic<bool> m_continueExecution; //!< Used to stop the writer at exit
+	std::atomic<bool> m_synchronous;       //!< The writer stopped, messages are written by the threads logging them
+	std::thread       m_thread;            //!< The writer thread
+};
+
+void Logger::setLevel(LogLevel level)
+{
+	s_level.store(level, std::memory_order_relaxed);
+}
+
+LogLevel Logger::level()
+{
+	return s_level.load(std::memory_order_relaxed);
+}
+
+void Logger::flush()
+{
+	LogWriter::instance().flush();
+}
+
+void Logger::write(const LogRecord& record)
+{
+	LogWriter::instance().push(record);
+}
+
+LogLine::LogLine(LogLevel level, LogSource source, uint64_t suppressed)
+: m_suppressed(suppressed)
+{
+	m_record.level  = level;
+	m_record.source = source;
+}
+
+LogLine::~LogLine()
+{
+	if (m_suppressed > 0)
+		*this << " (" << m_suppressed << " similar messages suppressed)";
+
+	Logger::write(m_record);
+}
+
+LogLine& LogLine::operator<<(const char* text)
+{
+	append(text, std::strlen(text));
+	return *this;
+}
+
+LogLine& LogLine::operator<<(const std::string& text)
+{
+	append(text.data(), text.size());
+	return *this;
+}
+
+LogLine& LogLine::operator<<(char character)
+{
+	append(&character, 1);
+	return *this;
+}
+
+LogLine& LogLine::operator<<(double value)
+{
+	char buffer[32];
+	int  size = std::snprintf(buffer, sizeof(buffer), "%g", value);
+	if (size > 0)
+		append(buffer, static_cast<std::size_t>(size));
+	return *this;
+}
+
+void LogLine::append(const char* text, std::size_t size)
+{
+	std::size_t room = LOG_MESSAGE_SIZE - m_record.size;
+	if (size > room)
+		size = room;
+
+	std::memcpy(m_record.text + m_record.size, text, size);
+	m_record.size = static_cast<uint16_t>(m_record.size + size);
+}
+
+void LogLine::appendSigned(long long value)
+{
+	if (value < 0)
+	{
+		append("-", 1);
+		appendUnsigned(0ull - static_cast<unsigned long long>(value));
+	}
+	else
+	{
+		appendUnsigned(static_cast<unsigned long long>(value));
+	}
+}
+
+void LogLine::appendUnsigned(unsigned long long value)
+{
+	char  buffer[20];
+	char* end   = buffer + sizeof(buffer);
+	char* start = end;
+
+	do
+	{
+		*--start = static_cast<char>('0' + value % 10);
+		value   /= 10;
+	}
+	while (value != 0);
+
+	append(start, static_cast<std::size_t>(end - start));
+}
+
+LogRateLimiter::LogRateLimiter(std::chrono::milliseconds interval)
+: m_interval(interval)
+, m_next(0)
+, m_suppressed(0)
+{
+}
+
+bool LogRateLimiter::allow()
+{
+	int64_t now  = std::chrono::steady_clock::now().time_since_epoch().count();
+	int64_t next = m_next.load(std::memory_order_relaxed);
+
+	// only one of the threads reaching the end of the interval logs
+	if (now < next || !m_next.compare_exchange_strong(next, now + m_interval.count(), std::memory_order_relaxed))
+	{
+		m_suppressed.fetch_add(1, std::memory_order_relaxed);
+		return false;
+	}
+
+	return true;
+}
+
+uint64_t LogRateLimiter::takeSuppressed()
+{
+	return m_suppressed.exchange(0, std::memory_order_relaxed);
+}
+
+} // cl
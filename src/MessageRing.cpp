@@ -0,0 +1,138 @@
+#include <MessageRing.hpp>
+
+#include <cstring>
+
+// payload size (2 bytes) followed by the 4 header bytes of the message
+#define RECORD_HEADER_SIZE 6
+
+// payload size marking the unused end of the buffer before a wrap
+#define WRAP_MARKER 0xFFFF
+
+namespace cl
+{
+
+MessageRing::MessageRing(std::size_t capacity)
+: m_mask(ringCapacity(capacity) - 1)
+, m_buffer(new uint8_t[m_mask + 1])
+, m_head(0)
+, m_cachedTail(0)
+, m_tail(0)
+, m_cachedHead(0)
+, m_overflowCount(0)
+{
+}
+
+bool MessageRing::push(const MessageView& message)
+{
+	// the payload size must not be mistaken for WRAP_MARKER
+	if (message.size > MAX_PAYLOAD_SIZE)
+		return false;
+
+	std::size_t recordSize = RECORD_HEADER_SIZE + message.size;
+	std::size_t tail       = m_tail.load(std::memory_order_relaxed);
+	std::size_t offset     = tail & m_mask;
+	std::size_t contiguous = m_mask + 1 - offset;
+
+	// records are never split: skip the end of the buffer if it is too short
+	std::size_t skip = contiguous < recordSize ? contiguous : 0;
+	std::size_t end  = tail + skip + recordSize;
+
+	// only read the consumer's index when the ring looks full
+	if (end - m_cachedHead > m_mask + 1)
+	{
+		m_cachedHead = m_head.load(std::memory_order_acquire);
+		if (end - m_cachedHead > m_mask + 1)
+		{
+			m_overflowCount.fetch_add(1, std::memory_order_relaxed);
+			return false;
+		}
+	}
+
+	// the consumer skips ends shorter than a record header by itself
+	if (skip >= RECORD_HEADER_SIZE)
+	{
+		m_buffer[offset]     = WRAP_MARKER >> 8;
+		m_buffer[offset + 1] = WRAP_MARKER & 0xFF;
+	}
+
+	uint8_t* record = &m_buffer[(tail + skip) & m_mask];
+	record[0] = static_cast<uint8_t>(message.size >> 8);
+	record[1] = static_cast<uint8_t>(message.size & 0xFF);
+	record[2] = message.playerIDAndTeam;
+	record[3] = message.key;
+	record[4] = message.parameters;
+	record[5] = message.type;
+	if (message.size > 0)
+		std::memcpy(record + RECORD_HEADER_SIZE, message.data, message.size);
+
+	m_tail.store(end, std::memory_order_release);
+
+	return true;
+}
+
+bool MessageRing::empty() const
+{
+	std::size_t head = m_head.load(std::memory_order_relaxed);
+
+	// only read the producer's index when the ring looks empty
+	if (head == m_cachedTail)
+		m_cachedTail = m_tail.load(std::memory_order_acquire);
+
+	return head == m_cachedTail;
+}
+
+MessageView MessageRing::front() const
+{
+	const uint8_t* record = &m_buffer[frontPosition() & m_mask];
+
+	MessageView message;
+	message.size            = static_cast<uint16_t>(record[0] << 8 | record[1]);
+	message.playerIDAndTeam = record[2];
+	message.key             = record[3];
+	message.parameters      = record[4];
+	message.type            = record[5];
+	message.data            = record + RECORD_HEADER_SIZE;
+
+	return message;
+}
+
+void MessageRing::pop()
+{
+	std::size_t    position = frontPosition();
+	const uint8_t* record   = &m_buffer[position & m_mask];
+	std::size_t    size     = static_cast<std::size_t>(record[0] << 8 | record[1]);
+
+	m_head.store(position + RECORD_HEADER_SIZE + size, std::memory_order_release);
+}
+
+std::size_t MessageRing::size() const
+{
+	// read the head first so it can't get past the tail
+	std::size_t head = m_head.load(std::memory_order_acquire);
+	return m_tail.load(std::memory_order_acquire) - head;
+}
+
+std::size_t MessageRing::capacity() const
+{
+	return m_mask + 1;
+}
+
+uint64_t MessageRing::overflowCount() const
+{
+	return m_overflowCount.load(std::memory_order_relaxed);
+}
+
+std::size_t MessageRing::frontPosition() const
+{
+	std::size_t head       = m_head.load(std::memory_order_relaxed);
+	std::size_t offset     = head & m_mask;
+	std::size_t contiguous = m_mask + 1 - offset;
+
+	if (contiguous < RECORD_HEADER_SIZE)
+		return head + contiguous;
+
+	uint16_t size = static_cast<uint16_t>(m_buffer[offset] << 8 | m_buffer[offset + 1]);
+	return size == WRAP_MARKER ? head + contiguous : head;
+}
+
+} // cl
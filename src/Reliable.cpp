@@ -0,0 +1,438 @@
+#include <Reliable.hpp>
+
+#include <algorithm>
+#include <cstring>
+
+namespace cl
+{
+
+static void writeSequence(uint8_t* output, uint16_t sequence)
+{
+	output[0] = static_cast<uint8_t>(sequence >> 8);
+	output[1] = static_cast<uint8_t>(sequence & 0xFF);
+}
+
+static uint16_t readSequence(const uint8_t* input)
+{
+	return static_cast<uint16_t>(input[0] << 8 | input[1]);
+}
+
+Delivery defaultDelivery(uint8_t type)
+{
+	switch (type)
+	{
+	case MSG_CONNECT:
+	case MSG_DISCONNECT:
+	case MSG_TMCP1_READY:
+	case MSG_TMCP1_DEFEND:
+		return Delivery::ReliableOrdered;
+	default:
+		return Delivery::Unreliable;
+	}
+}
+
+Delivery reliableDelivery(const MessageView& message)
+{
+	return (message.size > 0 && message.data[0] == 1) ? Delivery::ReliableOrdered : Delivery::Reliable;
+}
+
+MessageView stripReliableHeader(const MessageView& message)
+{
+	MessageView stripped = message;
+	stripped.parameters &= ~MSG_RELIABLE;
+	stripped.data       += RELIABLE_HEADER_SIZE;
+	stripped.size       -= RELIABLE_HEADER_SIZE;
+
+	return stripped;
+}
+
+// RttEstimator
+
+RttEstimator::RttEstimator()
+{
+	reset();
+}
+
+void RttEstimator::reset()
+{
+	m_smoothed  = std::chrono::microseconds::zero();
+	m_variation = std::chrono::microseconds::zero();
+	m_timeout   = std::chrono::milliseconds(RELIABLE_INITIAL_TIMEOUT_MS);
+	m_hasSample = false;
+}
+
+void RttEstimator::sample(std::chrono::microseconds rtt)
+{
+	if (!m_hasSample)
+	{
+		m_smoothed  = rtt;
+		m_variation = rtt / 2;
+		m_hasSample = true;
+	}
+	else
+	{
+		std::chrono::microseconds error = m_smoothed > rtt ? m_smoothed - rtt : rtt - m_smoothed;
+		m_variation = (3 * m_variation + error) / 4;
+		m_smoothed  = (7 * m_smoothed + rtt) / 8;
+	}
+
+	m_timeout = std::min<std::chrono::microseconds>(std::max<std::chrono::microseconds>(m_smoothed + 4 * m_variation,
+		std::chrono::milliseconds(RELIABLE_MIN_TIMEOUT_MS)), std::chrono::milliseconds(RELIABLE_MAX_TIMEOUT_MS));
+}
+
+bool RttEstimator::hasSample() const
+{
+	return m_hasSample;
+}
+
+std::chrono::microseconds RttEstimator::smoothed() const
+{
+	return m_smoothed;
+}
+
+std::chrono::microseconds RttEstimator::variation() const
+{
+	return m_variation;
+}
+
+std::chrono::microseconds RttEstimator::timeout() const
+{
+	return m_timeout;
+}
+
+// ReliableEndpoint
+
+ReliableEndpoint::ReliableEndpoint()
+: m_pendingCount(0)
+, m_lost(false)
+, m_retransmissionCount(0)
+{
+}
+
+void ReliableEndpoint::reset()
+{
+	for (SendChannel& channel : m_sendChannels)
+	{
+		channel.nextSequence = 0;
+		for (PendingMessage& pending : channel.pending)
+			pending.used = false;
+		channel.queued.clear();
+	}
+
+	for (ReceiveChannel& channel : m_receiveChannels)
+	{
+		channel.received     = false;
+		channel.latest       = 0;
+		channel.history      = 0;
+		channel.ackPending   = false;
+		channel.nextDelivery = 0;
+		for (StoredMessage& buffered : channel.buffered)
+			buffered.used = false;
+	}
+
+	m_pendingCount        = 0;
+	m_lost                = false;
+	m_retransmissionCount = 0;
+	m_rtt.reset();
+}
+
+bool ReliableEndpoint::send(const MessageView& message, Delivery delivery, Clock::time_point now,
+                            uint8_t* payload, MessageView& reliableMessage)
+{
+	uint8_t      channelIndex = delivery == Delivery::ReliableOrdered ? 1 : 0;
+	SendChannel& channel      = m_sendChannels[channelIndex];
+
+	payload[0] = channelIndex;
+	if (message.size > 0)
+		std::memcpy(payload + RELIABLE_HEADER_SIZE, message.data, message.size);
+
+	reliableMessage            =  message;
+	reliableMessage.parameters |= MSG_RELIABLE;
+	reliableMessage.data       =  payload;
+	reliableMessage.size       =  static_cast<uint16_t>(message.size + RELIABLE_HEADER_SIZE);
+
+	// the slot is still used by the message sent RELIABLE_WINDOW_SIZE messages ago.
+	// Queued messages go first to keep the order.
+	if (!channel.queued.empty() || channel.pending[channel.nextSequence % RELIABLE_WINDOW_SIZE].used)
+	{
+		channel.queued.emplace_back();
+		store(channel.queued.back(), 0, reliableMessage);
+		m_pendingCount++;
+
+		if (channel.queued.size() > RELIABLE_MAX_QUEUED)
+			m_lost = true;
+		return false;
+	}
+
+	writeSequence(payload + 1, channel.nextSequence);
+
+	PendingMessage& pending = channel.pending[channel.nextSequence % RELIABLE_WINDOW_SIZE];
+	store(pending, channel.nextSequence, reliableMessage);
+	number(channel, channelIndex, pending, now);
+	m_pendingCount++;
+
+	return true;
+}
+
+void ReliableEndpoint::number(SendChannel& channel, uint8_t channelIndex, StoredMessage& stored, Clock::time_point now)
+{
+	uint16_t        sequence = channel.nextSequence++;
+	PendingMessage& pending  = channel.pending[sequence % RELIABLE_WINDOW_SIZE];
+
+	if (&pending != &stored)
+	{
+		pending.payload.swap(stored.payload);
+		pending.header      = stored.header;
+		pending.header.data = pending.payload.data();
+	}
+
+	pending.used     = true;
+	pending.sequence = sequence;
+	pending.payload[0] = channelIndex;
+	writeSequence(pending.payload.data() + 1, sequence);
+
+	pending.sentTime = now;
+	pending.deadline = now + m_rtt.timeout();
+	pending.retries  = 0;
+}
+
+std::size_t ReliableEndpoint::retransmit(Clock::time_point now, MessageView* messages, std::size_t maxCount)
+{
+	std::size_t count = 0;
+	if (m_pendingCount == 0)
+		return count;
+
+	for (SendChannel& channel : m_sendChannels)
+	{
+		for (PendingMessage& pending : channel.pending)
+		{
+			if (!pending.used || pending.deadline > now || count >= maxCount)
+				continue;
+
+			if (++pending.retries > RELIABLE_MAX_RETRIES)
+				m_lost = true;
+
+			// exponential backoff, the acknowledgement may only be late
+			std::chrono::microseconds timeout = m_rtt.timeout() * (1u << std::min(pending.retries, 7u));
+			pending.deadline = now + std::min<std::chrono::microseconds>(timeout, std::chrono::milliseconds(RELIABLE_MAX_TIMEOUT_MS));
+
+			messages[count++] = pending.header;
+			m_retransmissionCount++;
+		}
+	}
+
+	for (uint8_t channelIndex = 0; channelIndex < RELIABLE_CHANNEL_COUNT; channelIndex++)
+	{
+		SendChannel& channel = m_sendChannels[channelIndex];
+		while (!channel.queued.empty() && count < maxCount && !channel.pending[channel.nextSequence % RELIABLE_WINDOW_SIZE].used)
+		{
+			PendingMessage& pending = channel.pending[channel.nextSequence % RELIABLE_WINDOW_SIZE];
+			number(channel, channelIndex, channel.queued.front(), now);
+			channel.queued.pop_front();
+
+			messages[count++] = pending.header;
+		}
+	}
+
+	return count;
+}
+
+bool ReliableEndpoint::lost() const
+{
+	return m_lost;
+}
+
+ReliableEndpoint::Clock::time_point ReliableEndpoint::nextRetransmit() const
+{
+	Clock::time_point next = Clock::time_point::max();
+	if (m_pendingCount == 0)
+		return next;
+
+	for (const SendChannel& channel : m_sendChannels)
+		for (const PendingMessage& pending : channel.pending)
+			if (pending.used && pending.deadline < next)
+				next = pending.deadline;
+
+	return next;
+}
+
+void ReliableEndpoint::receiveAcks(const uint8_t* data, std::size_t size, Clock::time_point now)
+{
+	for (std::size_t offset = 0; offset + RELIABLE_ACK_SIZE <= size; offset += RELIABLE_ACK_SIZE)
+	{
+		const uint8_t* ack = data + offset;
+		if (ack[0] >= RELIABLE_CHANNEL_COUNT)
+			continue;
+
+		uint16_t latest  = readSequence(ack + 1);
+		uint32_t history = static_cast<uint32_t>(ack[3]) << 24 | static_cast<uint32_t>(ack[4]) << 16 |
+		                   static_cast<uint32_t>(ack[5]) << 8  | static_cast<uint32_t>(ack[6]);
+
+		for (PendingMessage& pending : m_sendChannels[ack[0]].pending)
+		{
+			if (!pending.used)
+				continue;
+
+			uint16_t distance = static_cast<uint16_t>(latest - pending.sequence);
+			bool     acked    = distance == 0 || (distance <= 32 && (history >> (distance - 1)) & 1);
+			if (!acked)
+				continue;
+
+			// the time of a message sent again can't tell which copy was acknowledged
+			if (pending.retries == 0)
+				m_rtt.sample(std::chrono::duration_cast<std::chrono::microseconds>(now - pending.sentTime));
+
+			pending.used = false;
+			m_pendingCount--;
+		}
+	}
+}
+
+std::size_t ReliableEndpoint::pendingCount() const
+{
+	return m_pendingCount;
+}
+
+std::size_t ReliableEndpoint::queuedCount() const
+{
+	std::size_t count = 0;
+	for (const SendChannel& channel : m_sendChannels)
+		count += channel.queued.size();
+
+	return count;
+}
+
+uint64_t ReliableEndpoint::retransmissionCount() const
+{
+	return m_retransmissionCount;
+}
+
+const RttEstimator& ReliableEndpoint::rtt() const
+{
+	return m_rtt;
+}
+
+ReliableStatus ReliableEndpoint::receive(const MessageView& message)
+{
+	if (message.size < RELIABLE_HEADER_SIZE || message.data[0] >= RELIABLE_CHANNEL_COUNT)
+		return ReliableStatus::Malformed;
+
+	bool            ordered  = message.data[0] == 1;
+	ReceiveChannel& channel  = m_receiveChannels[message.data[0]];
+	uint16_t        sequence = readSequence(message.data + 1);
+
+	// acknowledge duplicates too, the acknowledgement may have been lost
+	channel.ackPending = true;
+
+	if (ordered)
+	{
+		// the sender never gets more than RELIABLE_WINDOW_SIZE messages ahead
+		uint16_t ahead = static_cast<uint16_t>(sequence - channel.nextDelivery);
+		if (ahead >= RELIABLE_WINDOW_SIZE || !record(channel, sequence))
+			return ReliableStatus::Duplicate;
+
+		if (ahead > 0)
+		{
+			store(channel.buffered[sequence % RELIABLE_WINDOW_SIZE], sequence, message);
+			return ReliableStatus::Buffered;
+		}
+
+		channel.nextDelivery++;
+		return ReliableStatus::Deliver;
+	}
+
+	return record(channel, sequence) ? ReliableStatus::Deliver : ReliableStatus::Duplicate;
+}
+
+bool ReliableEndpoint::nextOrdered(MessageView& message)
+{
+	ReceiveChannel& channel  = m_receiveChannels[1];
+	StoredMessage&  buffered = channel.buffered[channel.nextDelivery % RELIABLE_WINDOW_SIZE];
+	if (!buffered.used || buffered.sequence != channel.nextDelivery)
+		return false;
+
+	// the payload stays in place until another message is buffered in the slot
+	buffered.used = false;
+	message       = buffered.header;
+	channel.nextDelivery++;
+
+	return true;
+}
+
+bool ReliableEndpoint::ackPending() const
+{
+	for (const ReceiveChannel& channel : m_receiveChannels)
+		if (channel.ackPending)
+			return true;
+
+	return false;
+}
+
+std::size_t ReliableEndpoint::writeAcks(uint8_t* output)
+{
+	std::size_t size = 0;
+
+	for (uint8_t channelIndex = 0; channelIndex < RELIABLE_CHANNEL_COUNT; channelIndex++)
+	{
+		ReceiveChannel& channel = m_receiveChannels[channelIndex];
+		if (!channel.ackPending)
+			continue;
+
+		uint8_t* ack = output + size;
+		ack[0] = channelIndex;
+		writeSequence(ack + 1, channel.latest);
+		ack[3] = static_cast<uint8_t>(channel.history >> 24);
+		ack[4] = static_cast<uint8_t>(channel.history >> 16);
+		ack[5] = static_cast<uint8_t>(channel.history >> 8);
+		ack[6] = static_cast<uint8_t>(channel.history);
+
+		channel.ackPending = false;
+		size += RELIABLE_ACK_SIZE;
+	}
+
+	return size;
+}
+
+bool ReliableEndpoint::record(ReceiveChannel& channel, uint16_t sequence)
+{
+	if (!channel.received)
+	{
+		channel.received = true;
+		channel.latest   = sequence;
+		channel.history  = 0;
+		return true;
+	}
+
+	int16_t distance = static_cast<int16_t>(sequence - channel.latest);
+	if (distance > 0)
+	{
+		// the previous latest becomes bit distance - 1
+		uint32_t shifted  = distance < 32 ? channel.history << distance : 0;
+		uint32_t previous = distance <= 32 ? 1u << (distance - 1) : 0;
+		channel.history = shifted | previous;
+		channel.latest  = sequence;
+		return true;
+	}
+
+	// older than the history: received long ago, or the sender would not have moved on
+	if (distance == 0 || distance < -32)
+		return false;
+
+	uint32_t bit = 1u << (-distance - 1);
+	if (channel.history & bit)
+		return false;
+
+	channel.history |= bit;
+	return true;
+}
+
+void ReliableEndpoint::store(StoredMessage& stored, uint16_t sequence, const MessageView& message)
+{
+	stored.used     = true;
+	stored.sequence = sequence;
+	stored.payload.assign(message.data, message.data + message.size);
+	stored.header      = message;
+	stored.header.data = stored.payload.data();
+}
+
+} // cl
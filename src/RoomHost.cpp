@@ -0,0 +1,641 @@
+#include <RoomHost.hpp>
+#include <Log.hpp>
+#include <ServerShard.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+
+#ifndef _WIN32
+
+	#include <poll.h>
+	#include <sys/eventfd.h>
+
+#endif // _WIN32
+
+// timers handled per call to TimerWheel::advance() by a worker
+#define ROOM_TIMER_BATCH_SIZE 64
+
+// routes cached by the receive thread before the cache is cleared, bounds
+// the memory taken by the senders of no room
+#define ROOM_ROUTE_CACHE_SIZE 65536
+
+namespace cl
+{
+
+static uint64_t routeKey(uint32_t address, uint16_t port)
+{
+	return static_cast<uint64_t>(address) << 16 | port;
+}
+
+RoomHost::Worker::Worker(unsigned int index, std::size_t capacity)
+: index(index)
+, ready(capacity)
+, timers(capacity, std::chrono::milliseconds(1))
+, wakeup(-1)
+, sleeping(false)
+, freeSlots()
+, waitCalls()
+, thread()
+{
+}
+
+RoomHost::RoomHost(uint16_t port, unsigned int workers, unsigned int tickRate, uint16_t maxDatagramSize)
+: m_socket(INVALID_SOCKET)
+, m_wakeup(-1)
+, m_tickRate(tickRate)
+, m_maxDatagramSize(maxDatagramSize)
+, m_rooms()
+, m_routes()
+, m_routesVersion(0)
+, m_receiverVersion(UINT64_MAX)
+, m_slots(new RoomSlot[MAX_ROOMS])
+, m_routeCache()
+, m_workerCount(std::min<unsigned int>(std::max<unsigned int>(workers, 1), MAX_ROOM_WORKERS))
+, m_workers()
+, m_buffers(new uint8_t[ROOM_BATCH_SIZE * MAX_DATAGRAM_SIZE])
+, m_continueExecution(false)
+{
+#ifdef _WIN32
+
+	(void)port;
+	COMMS_LOG_ERROR(Server) << "Rooms are not supported on this platform.";
+
+#else
+
+	m_socket = ::socket(AF_INET, SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC, IPPROTO_UDP);
+	m_wakeup = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+
+	sockaddr_in bindAddress;
+	ZeroMemory(&bindAddress, sizeof(bindAddress));
+	bindAddress.sin_family      = AF_INET;
+	bindAddress.sin_addr.s_addr = INADDR_ANY;
+	bindAddress.sin_port        = htons(port);
+
+	// unconnected UDP sockets only report unreachable clients through the error queue
+	int enable = 1;
+	if (m_socket == INVALID_SOCKET || m_wakeup == -1
+	 || setsockopt(m_socket, IPPROTO_IP, IP_RECVERR, &enable, sizeof(enable)) == SOCKET_ERROR
+	 || bind(m_socket, reinterpret_cast<sockaddr*>(&bindAddress), sizeof(bindAddress)) == SOCKET_ERROR)
+	{
+		COMMS_LOG_ERROR(Server) << "Could not bind room socket to port " << port << " (" << errno << ").";
+		return;
+	}
+
+	ServerShard::setupReceiveHeaders(m_headers, m_vectors, m_addresses, m_buffers.get(), ROOM_BATCH_SIZE);
+
+	// slot % m_workerCount is the worker of the slot, the last slots are handed out first
+	std::size_t capacity = (MAX_ROOMS + m_workerCount - 1) / m_workerCount;
+	for (unsigned int i = 0; i < m_workerCount; i++)
+	{
+		m_workers.emplace_back(new Worker(i, capacity));
+		m_workers[i]->wakeup = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+		if (m_workers[i]->wakeup == -1)
+		{
+			COMMS_LOG_ERROR(Server) << "Could not create wakeup event of room worker (" << errno << ").";
+			return;
+		}
+
+		for (std::size_t slot = i; slot < MAX_ROOMS; slot += m_workerCount)
+			m_workers[i]->freeSlots.push_back(slot);
+		std::reverse(m_workers[i]->freeSlots.begin(), m_workers[i]->freeSlots.end());
+	}
+
+	COMMS_LOG_INFO(Server) << "Hosting rooms on port " << port << " with " << m_workerCount << " workers.";
+
+	m_continueExecution.store(true);
+	for (std::unique_ptr<Worker>& worker : m_workers)
+		worker->thread = std::thread(&RoomHost::work, this, std::ref(*worker));
+	m_receiverVersion = 0;
+	m_thread          = std::thread(&RoomHost::receive, this);
+
+#endif // _WIN32
+}
+
+RoomHost::~RoomHost()
+{
+	stop();
+
+	for (const std::pair<const uint32_t, std::size_t>& room : m_rooms)
+		delete m_slots[room.second].room;
+	m_rooms.clear();
+
+#ifndef _WIN32
+
+	for (std::unique_ptr<Worker>& worker : m_workers)
+	{
+		if (worker->wakeup != -1)
+			::close(worker->wakeup);
+	}
+
+	if (m_wakeup != -1)
+		::close(m_wakeup);
+
+#endif // _WIN32
+
+	if (m_socket != INVALID_SOCKET)
+		closesocket(m_socket);
+}
+
+void RoomHost::stop()
+{
+	m_continueExecution.store(false);
+
+#ifndef _WIN32
+
+	uint64_t wakeupCount = 1;
+	if (m_thread.joinable() && write(m_wakeup, &wakeupCount, sizeof(wakeupCount)) < 0)
+		COMMS_LOG_ERROR(Server) << "Error while waking up room thread (" << errno << ").";
+
+	for (std::unique_ptr<Worker>& worker : m_workers)
+	{
+		if (worker->thread.joinable() && write(worker->wakeup, &wakeupCount, sizeof(wakeupCount)) < 0)
+			COMMS_LOG_ERROR(Server) << "Error while waking up room worker (" << errno << ").";
+	}
+
+#endif // _WIN32
+
+	if (m_thread.joinable()) m_thread.join();
+	for (std::unique_ptr<Worker>& worker : m_workers)
+	{
+		if (worker->thread.joinable()) worker->thread.join();
+	}
+
+	// nothing steps the rooms anymore, closeRoom() may be waiting for it
+	std::lock_guard<std::mutex> lock(m_mutex);
+	for (const std::pair<const uint32_t, std::size_t>& room : m_rooms)
+		m_slots[room.second].room->m_continueExecution.store(false);
+	for (std::size_t slot = 0; slot < MAX_ROOMS; slot++)
+		m_slots[slot].running.store(nullptr);
+	m_released.notify_all();
+}
+
+bool RoomHost::isRunning() const
+{
+	return m_continueExecution.load();
+}
+
+Server* RoomHost::openRoom(uint32_t room)
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+
+	if (!m_continueExecution.load() || m_rooms.count(room) > 0)
+		return nullptr;
+
+	// the worker with the fewest rooms has the most free slots
+	Worker* worker = nullptr;
+	for (std::unique_ptr<Worker>& candidate : m_workers)
+	{
+		if (worker == nullptr || candidate->freeSlots.size() > worker->freeSlots.size())
+			worker = candidate.get();
+	}
+
+	if (worker->freeSlots.empty())
+	{
+		COMMS_LOG_WARNING(Server) << "Too many rooms already open. Could not open room " << room << ".";
+		return nullptr;
+	}
+
+	std::size_t slot = worker->freeSlots.back();
+	worker->freeSlots.pop_back();
+
+	Server* server = new Server(*this, room, slot, m_socket, m_tickRate, m_maxDatagramSize);
+	m_rooms[room]      = slot;
+	m_slots[slot].room = server;
+	m_slots[slot].running.store(server);
+
+	// the worker schedules the timers of the room
+	wake(slot);
+	return server;
+}
+
+bool RoomHost::closeRoom(uint32_t room)
+{
+	std::unique_lock<std::mutex> lock(m_mutex);
+
+	std::unordered_map<uint32_t, std::size_t>::iterator found = m_rooms.find(room);
+	if (found == m_rooms.end())
+		return false;
+
+	std::size_t slot   = found->second;
+	Server*     server = m_slots[slot].room;
+	m_rooms.erase(found);
+	m_slots[slot].room = nullptr;
+
+	// the datagrams of its clients are dropped from now on
+	for (std::unordered_map<uint64_t, std::size_t>::iterator route = m_routes.begin(); route != m_routes.end();)
+	{
+		if (route->second == slot)
+			route = m_routes.erase(route);
+		else
+			++route;
+	}
+	uint64_t version = m_routesVersion.fetch_add(1) + 1;
+
+#ifndef _WIN32
+
+	// the receive thread may sleep with the room in its route cache
+	uint64_t wakeupCount = 1;
+	if (m_thread.joinable() && write(m_wakeup, &wakeupCount, sizeof(wakeupCount)) < 0)
+		COMMS_LOG_ERROR(Server) << "Error while waking up room thread (" << errno << ").";
+
+#endif // _WIN32
+
+	server->stop();
+	m_released.wait(lock, [this, slot, version]()
+	{
+		return m_slots[slot].running.load() == nullptr && m_receiverVersion >= version;
+	});
+
+	m_workers[slot % m_workerCount]->freeSlots.push_back(slot);
+	lock.unlock();
+
+	delete server;
+	return true;
+}
+
+Server* RoomHost::room(uint32_t room) const
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+
+	std::unordered_map<uint32_t, std::size_t>::const_iterator found = m_rooms.find(room);
+	return found != m_rooms.end() ? m_slots[found->second].room : nullptr;
+}
+
+std::size_t RoomHost::roomCount() const
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	return m_rooms.size();
+}
+
+RoomHostStats RoomHost::stats() const
+{
+	RoomHostStats stats;
+	stats.rooms             = roomCount();
+	stats.waitCalls         = m_waitCalls.load();
+	stats.receiveCalls      = m_receiveCalls.load();
+	stats.datagramsReceived = m_datagramsReceived.load();
+	stats.datagramsDropped  = m_datagramsDropped.load();
+
+	for (const std::unique_ptr<Worker>& worker : m_workers)
+		stats.waitCalls += worker->waitCalls.load();
+
+	return stats;
+}
+
+void RoomHost::receive()
+{
+#ifndef _WIN32
+
+	while (m_continueExecution.load())
+	{
+		pollfd fds[2] = { { m_wakeup, POLLIN, 0 }, { m_socket, POLLIN, 0 } };
+
+		int result = ::poll(fds, 2, -1);
+		m_waitCalls.add();
+
+		if (result < 0 && errno != EINTR)
+		{
+			COMMS_LOG_ERROR(Server) << "Error at poll() (" << errno << "). Stopping room host.";
+			m_continueExecution.store(false);
+			break;
+		}
+
+		uint64_t wakeupCount;
+		if ((fds[0].revents & POLLIN) && read(m_wakeup, &wakeupCount, sizeof(wakeupCount)) < 0 && errno != EAGAIN)
+			COMMS_LOG_ERROR(Server) << "Error while reading wakeup event (" << errno << ").";
+
+		// closeRoom() waits until the closed room leaves the cache
+		refreshRoutes();
+
+		if (fds[1].revents & POLLERR)
+			readErrorQueue();
+
+		if (fds[1].revents & POLLIN)
+			receiveDatagrams();
+	}
+
+	std::lock_guard<std::mutex> lock(m_mutex);
+	m_receiverVersion = UINT64_MAX;
+	m_released.notify_all();
+
+#endif // _WIN32
+}
+
+void RoomHost::receiveDatagrams()
+{
+#ifndef _WIN32
+
+	std::size_t touched[ROOM_BATCH_SIZE]; // rooms to wake up once the batch is routed
+	int         count = ROOM_BATCH_SIZE;
+
+	// a partial batch means the socket was emptied
+	while (count == ROOM_BATCH_SIZE)
+	{
+		for (unsigned int i = 0; i < ROOM_BATCH_SIZE; i++)
+			m_headers[i].msg_hdr.msg_namelen = sizeof(sockaddr_in);
+
+		count = recvmmsg(m_socket, m_headers, ROOM_BATCH_SIZE, MSG_DONTWAIT, nullptr);
+		m_receiveCalls.add();
+
+		if (count < 0)
+		{
+			// the address of the unreachable client is only available in the error queue
+			if (errno == ECONNREFUSED)
+			{
+				readErrorQueue();
+				count = ROOM_BATCH_SIZE;
+				continue;
+			}
+
+			if (errno != EWOULDBLOCK && errno != EINTR)
+				COMMS_LOG_ERROR(Server) << "recvmmsg() failed with error: " << errno << ".";
+			return;
+		}
+
+		m_datagramsReceived.add(count);
+		refreshRoutes();
+
+		// m_mutex is only taken for the datagrams missing from the cache, once per batch
+		std::unique_lock<std::mutex> lock(m_mutex, std::defer_lock);
+		unsigned int                 noRoom[ROOM_BATCH_SIZE]; // connection requests to answer once unlocked
+		std::size_t                  noRoomCount  = 0;
+		std::size_t                  touchedCount = 0;
+
+		for (int i = 0; i < count; i++)
+		{
+			const mmsghdr& header   = m_headers[i];
+			const uint8_t* datagram = static_cast<uint8_t*>(m_vectors[i].iov_base);
+			uint32_t       flags    = (header.msg_hdr.msg_flags & MSG_TRUNC) ? SHARD_TRUNCATED : 0;
+
+			bool    unknownRoom = false;
+			Server* room        = findRoom(m_addresses[i], datagram, header.msg_len, lock, unknownRoom);
+			if (unknownRoom)
+				noRoom[noRoomCount++] = static_cast<unsigned int>(i);
+
+			if (room == nullptr || !room->m_inbox->push(m_addresses[i], flags, datagram, header.msg_len))
+			{
+				m_datagramsDropped.add();
+				continue;
+			}
+
+			if (touchedCount == 0 || touched[touchedCount - 1] != room->m_roomSlot)
+				touched[touchedCount++] = room->m_roomSlot;
+		}
+
+		if (lock.owns_lock())
+			lock.unlock();
+
+		for (std::size_t i = 0; i < noRoomCount; i++)
+			sendNoRoom(m_addresses[noRoom[i]], static_cast<uint8_t*>(m_vectors[noRoom[i]].iov_base));
+
+		// a room already signaled is not queued again
+		for (std::size_t i = 0; i < touchedCount; i++)
+			wake(touched[i]);
+	}
+
+#endif // _WIN32
+}
+
+void RoomHost::readErrorQueue()
+{
+	ServerShard::forEachUnreachable(m_socket, [this](const sockaddr_in& destination)
+	{
+		std::unique_lock<std::mutex> lock(m_mutex, std::defer_lock);
+		Server*                      room = findRoute(destination.sin_addr.s_addr, destination.sin_port, lock);
+		if (lock.owns_lock())
+			lock.unlock();
+
+		// if the inbox is full, the client times out instead
+		if (room != nullptr && room->m_inbox->push(destination, SHARD_UNREACHABLE, nullptr, 0))
+			wake(room->m_roomSlot);
+	});
+}
+
+void RoomHost::refreshRoutes()
+{
+	if (m_routesVersion.load() == m_receiverVersion)
+		return;
+
+	m_routeCache.clear();
+
+	std::lock_guard<std::mutex> lock(m_mutex);
+	m_receiverVersion = m_routesVersion.load();
+	m_released.notify_all();
+}
+
+Server* RoomHost::findRoute(uint32_t address, uint16_t port, std::unique_lock<std::mutex>& lock)
+{
+	uint64_t key = routeKey(address, port);
+
+	std::unordered_map<uint64_t, Server*>::iterator cached = m_routeCache.find(key);
+	if (cached != m_routeCache.end())
+		return cached->second;
+
+	if (!lock.owns_lock())
+		lock.lock();
+
+	// a route changed since the start of the batch
+	if (m_routesVersion.load() != m_receiverVersion)
+	{
+		m_routeCache.clear();
+		m_receiverVersion = m_routesVersion.load();
+		m_released.notify_all();
+	}
+
+	std::unordered_map<uint64_t, std::size_t>::iterator route = m_routes.find(key);
+	Server*                                             room  = route != m_routes.end() ? m_slots[route->second].room : nullptr;
+
+	if (m_routeCache.size() >= ROOM_ROUTE_CACHE_SIZE)
+		m_routeCache.clear();
+	m_routeCache[key] = room;
+
+	return room;
+}
+
+Server* RoomHost::findRoom(const sockaddr_in& sender, const uint8_t* datagram, std::size_t size,
+                           std::unique_lock<std::mutex>& lock, bool& noRoom)
+{
+	// a legacy datagram starting with a connection request
+	if (size >= sizeof(Message) && size % sizeof(Message) == 0 && datagram[3] == MSG_CONNECT)
+	{
+		const Message* request = reinterpret_cast<const Message*>(datagram);
+
+		uint32_t room = 0;
+		if (request->parameters & MSG_CONNECT_ROOM)
+		{
+			room = static_cast<uint32_t>(request->data[0]) << 24 | static_cast<uint32_t>(request->data[1]) << 16
+			     | static_cast<uint32_t>(request->data[2]) << 8  | static_cast<uint32_t>(request->data[3]);
+		}
+
+		if (!lock.owns_lock())
+			lock.lock();
+
+		std::unordered_map<uint32_t, std::size_t>::iterator found = m_rooms.find(room);
+		if (found != m_rooms.end())
+			return m_slots[found->second].room;
+
+		COMMS_LOG_LIMITED(cl::LogLevel::Warning, Server) << "Received connection packet for unknown room " << room << ".";
+		noRoom = true;
+		return nullptr;
+	}
+
+	return findRoute(sender.sin_addr.s_addr, sender.sin_port, lock);
+}
+
+void RoomHost::sendNoRoom(const sockaddr_in& recipient, const uint8_t* request)
+{
+	const Message* requestMessage = reinterpret_cast<const Message*>(request);
+
+	Message errMessage;
+	errMessage.playerIDAndTeam = requestMessage->playerIDAndTeam;
+	errMessage.key             = requestMessage->key;
+	errMessage.parameters      = MSG_PRIVATE;
+	errMessage.type            = MSG_ERROR;
+	errMessage.data[0]         = MSG_ERR_NO_ROOM;
+
+	if (sendto(m_socket, reinterpret_cast<const char*>(&errMessage), sizeof(Message), 0,
+	           reinterpret_cast<const sockaddr*>(&recipient), sizeof(sockaddr_in)) == SOCKET_ERROR)
+		COMMS_LOG_ERROR(Server) << "Error at sendto() (" << WSAGetLastError() << "). Message not sent.";
+}
+
+void RoomHost::work(Worker& worker)
+{
+#ifdef _WIN32
+
+	(void)worker;
+
+#else
+
+	std::size_t expired[ROOM_TIMER_BATCH_SIZE];
+	std::size_t count;
+	std::size_t slot;
+
+	while (m_continueExecution.load())
+	{
+		std::chrono::steady_clock::time_point deadline = worker.timers.nextExpiry();
+
+		int timeout = -1;
+		if (deadline != std::chrono::steady_clock::time_point::max())
+		{
+			// round up so we never wake up right before the deadline and spin
+			std::chrono::steady_clock::duration remaining = deadline - std::chrono::steady_clock::now();
+			timeout = static_cast<int>(std::max<int64_t>(std::chrono::ceil<std::chrono::milliseconds>(remaining).count(), 0));
+		}
+
+		// wake() only writes the eventfd once it saw the worker asleep, after queuing the room
+		worker.sleeping.store(true);
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+
+		if (worker.ready.empty() && timeout != 0)
+		{
+			pollfd fd = { worker.wakeup, POLLIN, 0 };
+
+			int result = ::poll(&fd, 1, timeout);
+			worker.waitCalls.add();
+
+			uint64_t wakeupCount;
+			if (result < 0 && errno != EINTR)
+				COMMS_LOG_ERROR(Server) << "Error at poll() (" << errno << ") in room worker.";
+			else if ((fd.revents & POLLIN) && read(worker.wakeup, &wakeupCount, sizeof(wakeupCount)) < 0 && errno != EAGAIN)
+				COMMS_LOG_ERROR(Server) << "Error while reading wakeup event (" << errno << ").";
+		}
+
+		worker.sleeping.store(false);
+
+		// the rooms whose deadline passed
+		do
+		{
+			count = worker.timers.advance(std::chrono::steady_clock::now(), expired, ROOM_TIMER_BATCH_SIZE);
+			for (std::size_t i = 0; i < count; i++)
+				process(worker, expired[i] * m_workerCount + worker.index);
+		}
+		while (count == ROOM_TIMER_BATCH_SIZE);
+
+		// then the ones that were woken up, signaled again if woken up while being stepped
+		while (worker.ready.tryPop(slot))
+		{
+			m_slots[slot].signaled.store(false);
+			process(worker, slot);
+		}
+	}
+
+#endif // _WIN32
+}
+
+void RoomHost::process(Worker& worker, std::size_t slot)
+{
+	Server*     room  = m_slots[slot].running.load();
+	std::size_t timer = slot / m_workerCount;
+
+	// a slot may be queued again after its room was let go of
+	if (room == nullptr)
+		return;
+
+	if (room->isRunning() && room->step())
+	{
+		std::chrono::steady_clock::time_point deadline = room->nextDeadline();
+		if (deadline == std::chrono::steady_clock::time_point::max())
+			worker.timers.cancel(timer);
+		else
+			worker.timers.schedule(timer, deadline);
+		return;
+	}
+
+	// the room stopped, closeRoom() destroys it once it is let go of
+	room->m_continueExecution.store(false);
+	worker.timers.cancel(timer);
+
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_slots[slot].running.store(nullptr);
+	}
+	m_released.notify_all();
+}
+
+void RoomHost::wake(std::size_t slot)
+{
+	if (m_slots[slot].signaled.exchange(true))
+		return;
+
+	Worker& worker = *m_workers[slot % m_workerCount];
+	worker.ready.push(slot);
+
+	// the worker checks its queue after announcing it sleeps, see work()
+	std::atomic_thread_fence(std::memory_order_seq_cst);
+
+#ifndef _WIN32
+
+	uint64_t wakeupCount = 1;
+	if (worker.sleeping.load() && write(worker.wakeup, &wakeupCount, sizeof(wakeupCount)) < 0)
+		COMMS_LOG_ERROR(Server) << "Error while waking up room worker (" << errno << ").";
+
+#endif // _WIN32
+}
+
+void RoomHost::route(uint32_t address, uint16_t port, std::size_t slot)
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+
+	// the room may be closing, its routes were already removed
+	if (m_slots[slot].room != nullptr)
+	{
+		m_routes[routeKey(address, port)] = slot;
+		m_routesVersion.fetch_add(1);
+	}
+}
+
+void RoomHost::unroute(uint32_t address, uint16_t port, std::size_t slot)
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+
+	// the client may have joined another room since
+	std::unordered_map<uint64_t, std::size_t>::iterator route = m_routes.find(routeKey(address, port));
+	if (route != m_routes.end() && route->second == slot)
+	{
+		m_routes.erase(route);
+		m_routesVersion.fetch_add(1);
+	}
+}
+
+} // cl
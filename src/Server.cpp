@@ -1,15 +1,28 @@
 #include <Server.hpp>
+#include <Log.hpp>
 #include <Message.hpp>
+#include <RoomHost.hpp>
 
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstring>
+#include <functional>
 #include <iomanip>
 #include <iostream>
+#include <sstream>
 #include <string>
 #include <vector>
-#include <queue>
 
 
 #define DEFAULT_PORT 12346
 
+// maximum number of datagrams written by a single system call (UIO_MAXIOV)
+#define SEND_BATCH_SIZE 1024
+
+// events handled per call to epoll_wait(), others are reported by the next call
+#define EPOLL_EVENT_COUNT 16
+
 // used by getStatus
 #define STATUS_READ   0x1
 #define STATUS_WRITE  0x2
@@ -21,15 +34,156 @@
 
 	#pragma comment(lib, "Ws2_32.lib")
 
+	// datagrams are read one at a time
+	#define RECEIVE_BUFFER_COUNT 1
+
+	// nothing can wake the server thread up, it checks the messages of the application this often without ticks
+	#define MAX_WAIT_MS 50
+
+#else
+
+	#define RECEIVE_BUFFER_COUNT RECEIVE_BATCH_SIZE
+
+	// requests of the io_uring between two submissions, and its receive buffers (a power of two)
+	#define RING_ENTRIES      1024
+	#define RING_BUFFER_COUNT 256
+
+	// a receive buffer of the io_uring holds the header of the datagram, its sender and its data
+	#define RING_BUFFER_SIZE (sizeof(io_uring_recvmsg_out) + sizeof(sockaddr_in) + MAX_DATAGRAM_SIZE)
+
+	// tags of the requests of the io_uring, a send is tagged RING_SEND + the index of its datagram
+	#define RING_RECEIVE 0
+	#define RING_POLL    1
+	#define RING_SEND    2
+
+	// fewest datagrams sent by each thread of sendParallel(), fewer aren't worth waking a shard up
+	#define SHARD_SEND_MIN 32
+
+	#include <sys/epoll.h>
+	#include <sys/eventfd.h>
+
 #endif // _WIN32
 
 namespace cl
 {
 
-Server::Server(uint16_t port)
-: m_socket(INVALID_SOCKET)
+// key of a delta stream in m_deltaStreams
+static uint16_t deltaStreamKey(uint8_t source, uint8_t type)
+{
+	return static_cast<uint16_t>(source << 8 | type);
+}
+
+// the snapshot buffered by handleDeltaMessage(), without its sequence number
+static MessageView fullSnapshot(const MessageView& snapshot)
+{
+	MessageView message = snapshot;
+	message.parameters &= ~MSG_DELTA;
+	message.data       += 2;
+	message.size       -= 2;
+
+	return message;
+}
+
+// payload of a ping: the time it was sent in microseconds (8 bytes, big-endian)
+#define PING_PAYLOAD_SIZE 8
+
+// timers of m_timers
+#define TIMEOUT_TIMER(idAndTeam)    (idAndTeam)         // the client may have sent nothing since the client timeout
+#define RETRANSMIT_TIMER(idAndTeam) (256 + (idAndTeam)) // a reliable message of the client may not be acknowledged in time
+#define PING_TIMER                  512                 // the clients are pinged
+#define TIMER_COUNT                 513
+
+#define TIMER_RESOLUTION_MS 1
+#define TIMER_BATCH_SIZE    64 // timers handled per call to TimerWheel::advance()
+
+static void writeTimestamp(uint8_t* output, std::chrono::steady_clock::time_point time)
+{
+	uint64_t microseconds = static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::microseconds>(time.time_since_epoch()).count());
+	for (int i = PING_PAYLOAD_SIZE - 1; i >= 0; i--)
+	{
+		output[i] = static_cast<uint8_t>(microseconds & 0xFF);
+		microseconds >>= 8;
+	}
+}
+
+static std::chrono::steady_clock::time_point readTimestamp(const uint8_t* input)
+{
+	uint64_t microseconds = 0;
+	for (int i = 0; i < PING_PAYLOAD_SIZE; i++)
+		microseconds = microseconds << 8 | input[i];
+
+	return std::chrono::steady_clock::time_point(std::chrono::microseconds(microseconds));
+}
+
+Server::Server(uint16_t port, unsigned int tickRate, uint16_t maxDatagramSize, Transport transport,
+               const std::string& unixPath, IoEngine engine, unsigned int threads)
+: Server(nullptr, 0, 0, INVALID_SOCKET, port, tickRate, maxDatagramSize, transport, unixPath, engine, threads)
+{
+}
+
+Server::Server(RoomHost& host, uint32_t room, std::size_t slot, SOCKET socket, unsigned int tickRate, uint16_t maxDatagramSize)
+: Server(&host, room, slot, socket, 0, tickRate, maxDatagramSize, Transport::Udp, std::string(), IoEngine::Epoll, 1)
+{
+}
+
+Server::Server(RoomHost* host, uint32_t room, std::size_t slot, SOCKET socket, uint16_t port, unsigned int tickRate,
+               uint16_t maxDatagramSize, Transport transport, const std::string& unixPath, IoEngine engine, unsigned int threads)
+: m_messageBuffer(MESSAGE_BUFFER_SIZE)
+, m_applicationInbox(APPLICATION_INBOX_SIZE)
+, m_inboxViewPending(false)
+, m_applicationOutbox(host == nullptr ? APPLICATION_QUEUE_CAPACITY : ROOM_QUEUE_CAPACITY)
+, m_pingInterval(std::chrono::milliseconds(DEFAULT_PING_INTERVAL_MS))
+, m_clientTimeout(std::chrono::milliseconds(DEFAULT_CLIENT_TIMEOUT_MS))
+, m_pingRequested(false)
+, m_timersChanged(true)
+, m_timers(TIMER_COUNT, std::chrono::milliseconds(TIMER_RESOLUTION_MS))
+, m_dispatchPending(false)
+, m_fanOut()
+, m_fanOutPayload(SIZE_MAX)
+, m_maxDatagramSize(std::min<uint16_t>(std::max<uint16_t>(maxDatagramSize, sizeof(Message)), MAX_DATAGRAM_SIZE))
+, m_receiveBuffers(host == nullptr ? new uint8_t[RECEIVE_BUFFER_COUNT * MAX_DATAGRAM_SIZE] : nullptr)
+#ifndef _WIN32
+, m_receiveCount(0)
+, m_receiveIndex(0)
+, m_receiveUnix(false)
+, m_socketReadable(false)
+, m_unixSocketReadable(false)
+#endif // _WIN32
+, m_datagramReader()
+, m_datagramSender()
+, m_counters()
+, m_clientCounters()
+, m_outboxDrops(0)
+, m_socket(socket)
+, m_engine(engine)
+#ifndef _WIN32
+, m_ringSendsPending(0)
+, m_ringEpollReadable(false)
+#endif // _WIN32
+, m_threadCount(std::min<unsigned int>(std::max<unsigned int>(threads, 1), MAX_SERVER_THREADS))
+, m_shards(m_threadCount - 1)
+, m_shardCount(0)
+, m_shardNext(0)
+, m_shardErrors()
+, m_host(host)
+, m_room(room)
+, m_roomSlot(slot)
+, m_inbox(host != nullptr ? new RecordRing() : nullptr)
+, m_recordReading(nullptr)
+, m_transport(transport)
+, m_shmHangups()
+, m_shmReading(-1)
+, m_shmNext(0)
+, m_unixSocket(INVALID_SOCKET)
+, m_unixPath(unixPath)
+#ifndef _WIN32
+, m_epoll(-1)
+, m_wakeup(host == nullptr ? eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC) : -1)
+#endif // _WIN32
+, m_tickPeriod(tickRate > 0 ? std::chrono::nanoseconds(std::chrono::seconds(1)) / tickRate : std::chrono::nanoseconds::zero())
+, m_nextTick(std::chrono::steady_clock::now() + m_tickPeriod)
 , m_continueExecution(true)
-, m_thread(&Server::init, this, port)
+, m_thread(host == nullptr ? std::thread(&Server::init, this, port) : std::thread())
 {
 }
 
@@ -40,28 +194,67 @@ Server::~Server()
 
 void Server::stop()
 {
-	std::cout << "[COMMS SERVER] Stopping..." << std::endl;
+	// a room only stops running, its host owns the socket and detaches the room
+	if (m_host != nullptr)
+	{
+		if (m_continueExecution.exchange(false))
+			wakeUp();
+		return;
+	}
+
+	COMMS_LOG_INFO(Server) << "Stopping...";
 	m_continueExecution.store(false);
-	std::this_thread::sleep_for(std::chrono::milliseconds(2000));
+	wakeUp();
+
+	// on Windows, the thread will notice at most one tick later
 	if (m_thread.joinable()) m_thread.join();
 
-#ifdef _WIN32
+	// the clients of the channels won't get an ICMP error, tell them
+	for (ShmChannel& channel : m_shmChannels)
+	{
+		channel.markClosed();
+		channel.close();
+	}
+	m_shmListener.close();
+	m_shmReading = -1;
+
+	closeUnixSocket(m_unixSocket, m_unixPath);
+
+	// the shards ring m_wakeup, stop them first
+	for (std::size_t i = 0; i < m_shardCount; i++)
+		m_shards[i].stop();
+	m_shardCount    = 0;
+	m_recordReading = nullptr;
+
+#ifndef _WIN32
+
+	if (m_epoll != -1)
+	{
+		::close(m_epoll);
+		m_epoll = -1;
+	}
+
+	if (m_wakeup != -1)
+	{
+		::close(m_wakeup);
+		m_wakeup = -1;
+	}
+
+#endif // _WIN32
 
 	if (m_socket != INVALID_SOCKET)
 	{
 		int result = closesocket(m_socket); // close server; don't shut it down
 		if (result != 0)
 		{
-			std::cout << "[COMMS SERVER] Error at closesocket() (" << WSAGetLastError() << "). Could not stop comms server." << std::endl;
+			COMMS_LOG_ERROR(Server) << "Error at closesocket() (" << WSAGetLastError() << "). Could not stop comms server.";
 			WSACleanup();
 			return;
 		}
 		m_socket = INVALID_SOCKET;
-		std::cout << "[COMMS SERVER] Server successfully stopped." << std::endl;
+		COMMS_LOG_INFO(Server) << "Server successfully stopped.";
 	}
 	WSACleanup();
-
-#endif // _WIN32
 }
 
 bool Server::isRunning() const
@@ -71,43 +264,244 @@ bool Server::isRunning() const
 
 void Server::printClients(bool showPing) const
 {
-	if (m_clients.empty())
+	// the table is printed whatever the log level, after the messages logged so far
+	Logger::flush();
+
+	if (m_clients.size() == 0)
 	{
 		std::cout << "No clients connected." << std::endl;
 		return;
 	}
 
-	std::cout << "Index    RLBot ID      Team     Key            Address       Port    Last Message";
-	if (showPing) std::cout << "     ping";
-	std::cout << std::endl;
+	// written at once, the logger may be writing messages of other threads
+	std::ostringstream table;
+	table << "Index    RLBot ID      Team     Key            Address       Port    Last Message";
+	if (showPing) table << "        Ping      Jitter";
+	table << '\n';
+
+	std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
 
 	for (unsigned int i = 0; i < m_clients.size(); i++)
 	{
-		std::cout << std::setw(5) << i << "    ";
-		std::cout << std::setw(8) << (m_clients[i].idAndTeam >> 1) << "    ";
-		std::cout << ((m_clients[i].idAndTeam & 0x01) ? "Orange" : "  Blue") << "    ";
-		std::cout << "0x" << std::hex << std::setfill('0') << (unsigned int)(m_clients[i].key)
-			      << std::setfill(' ') << std::dec << "    ";
+		table << std::setw(5) << i << "    ";
+		table << std::setw(8) << (m_clients[i].idAndTeam >> 1) << "    ";
+		table << ((m_clients[i].idAndTeam & 0x01) ? "  Blue" : "Orange") << "    ";
+		table << "0x" << std::hex << std::setfill('0') << (unsigned int)(m_clients[i].key)
+			  << std::setfill(' ') << std::dec << "    ";
 		std::string addrString = std::to_string((int)( m_clients[i].address        & 0xFF)) + "."
 							   + std::to_string((int)((m_clients[i].address >> 8)  & 0xFF)) + "."
 							   + std::to_string((int)((m_clients[i].address >> 16) & 0xFF)) + "."
 							   + std::to_string((int)((m_clients[i].address >> 24) & 0xFF));
-		std::cout << std::setw(15) << addrString << "    ";
-		std::cout << std::setw(7)  << ntohs(m_clients[i].port) << "    ";
-		std::cout << std::endl;
+		if (m_clients[i].address == SHM_CLIENT_ADDRESS)
+			addrString = "shared memory";
+		else if (m_clients[i].address == UNIX_CLIENT_ADDRESS)
+			addrString = "unix socket";
+		table << std::setw(15) << addrString << "    ";
+		table << std::setw(7)  << ntohs(m_clients[i].port) << "    ";
+
+		long long lastMessage = std::chrono::duration_cast<std::chrono::milliseconds>(now - m_clients[i].lastMessageTime).count();
+		table << std::setw(9) << lastMessage << " ms";
+
+		if (showPing)
+		{
+			table << std::fixed << std::setprecision(2);
+			if (m_clients[i].ping < 0.0f)
+				table << std::setw(12) << "-" << std::setw(12) << "-";
+			else
+				table << std::setw(9) << m_clients[i].ping << " ms" << std::setw(9) << m_clients[i].jitter << " ms";
+			table << std::defaultfloat;
+		}
+		table << '\n';
 	}
 
+	std::cout << table.str() << std::flush;
 }
 
 void Server::pingClients()
 {
+	m_pingRequested.store(true);
+	wakeUp();
+}
 
+void Server::setPingInterval(std::chrono::milliseconds interval)
+{
+	m_pingInterval.store(interval);
+	m_timersChanged.store(true);
+	wakeUp();
 }
 
-bool Server::init(uint16_t port)
+void Server::setClientTimeout(std::chrono::milliseconds timeout)
 {
-#ifdef _WIN32
+	m_clientTimeout.store(timeout);
+	m_timersChanged.store(true);
+	wakeUp();
+}
+
+std::size_t Server::poll(Message* messages, std::size_t maxCount)
+{
+	std::size_t count = 0;
+	MessageView message;
+	while (count < maxCount && poll(message))
+		messages[count++] = message.toMessage();
+
+	return count;
+}
+
+bool Server::poll(MessageView& message)
+{
+	// the previous view is not used anymore
+	if (m_inboxViewPending)
+	{
+		m_applicationInbox.pop();
+		m_inboxViewPending = false;
+	}
+
+	if (m_applicationInbox.empty())
+		return false;
+
+	message            = m_applicationInbox.front();
+	m_inboxViewPending = true;
+	return true;
+}
+
+bool Server::sendTo(uint8_t idAndTeam, const Message& message)
+{
+	return pushApplicationMessage(message, false, idAndTeam, defaultDelivery(message.type));
+}
+
+bool Server::sendTo(uint8_t idAndTeam, const MessageView& message)
+{
+	return pushApplicationMessage(message, false, idAndTeam, defaultDelivery(message.type));
+}
+
+bool Server::sendTo(uint8_t idAndTeam, const MessageView& message, Delivery delivery)
+{
+	return pushApplicationMessage(message, false, idAndTeam, delivery);
+}
+
+bool Server::broadcast(const Message& message)
+{
+	return pushApplicationMessage(message, true, 0x00, defaultDelivery(message.type));
+}
+
+bool Server::broadcast(const MessageView& message)
+{
+	return pushApplicationMessage(message, true, 0x00, defaultDelivery(message.type));
+}
+
+bool Server::broadcast(const MessageView& message, Delivery delivery)
+{
+	return pushApplicationMessage(message, true, 0x00, delivery);
+}
+
+bool Server::pushApplicationMessage(const MessageView& message, bool isBroadcast, uint8_t recipient, Delivery delivery)
+{
+	std::size_t maxSize = delivery == Delivery::Unreliable ? MAX_PAYLOAD_SIZE : MAX_RELIABLE_PAYLOAD_SIZE;
+	if (message.size > maxSize)
+	{
+		COMMS_LOG_LIMITED(cl::LogLevel::Warning, Server) << "Payload of " << message.size << " bytes is too large. Message not sent.";
+		m_outboxDrops.fetch_add(1, std::memory_order_relaxed);
+		return false;
+	}
+
+	ApplicationMessage applicationMessage;
+	applicationMessage.message     = message;
+	applicationMessage.isBroadcast = isBroadcast;
+	applicationMessage.recipient   = recipient;
+	applicationMessage.delivery    = delivery;
+
+	// the headers of these are added by the server
+	applicationMessage.message.parameters &= ~(MSG_DELTA | MSG_RELIABLE);
+	if (message.size > 0)
+		memcpy(applicationMessage.data, message.data, message.size);
+
+	bool wasEmpty = m_applicationOutbox.empty();
+	if (!m_applicationOutbox.push(applicationMessage))
+	{
+		m_outboxDrops.fetch_add(1, std::memory_order_relaxed);
+		return false;
+	}
+
+	// an idle server sleeps until its next timer, wake it up for the first message
+	if (m_tickPeriod == std::chrono::nanoseconds::zero() || wasEmpty)
+		wakeUp();
+
+	return true;
+}
+
+ServerStats Server::stats() const
+{
+	ServerStats stats;
+	stats.waitCalls         = m_counters.waitCalls.load();
+	stats.receiveCalls      = m_counters.receiveCalls.load();
+	stats.datagramsReceived = m_counters.datagramsReceived.load();
+	stats.bytesReceived     = m_counters.bytesReceived.load();
+	stats.messagesReceived  = m_counters.messagesReceived.load();
+	stats.sendCalls         = m_counters.sendCalls.load();
+	stats.datagramsSent     = m_counters.datagramsSent.load();
+	stats.bytesSent         = m_counters.bytesSent.load();
+	stats.messagesSent      = m_counters.messagesSent.load();
+
+	// created with the server, the shards can be read at any time
+	for (const ServerShard& shard : m_shards)
+	{
+		stats.waitCalls    += shard.waitCalls();
+		stats.receiveCalls += shard.receiveCalls();
+		stats.sendCalls    += shard.sendCalls();
+	}
+
+	stats.undersizedDatagrams = m_counters.undersizedDatagrams.load();
+	stats.oversizedDatagrams  = m_counters.oversizedDatagrams.load();
+	stats.sendErrors          = m_counters.sendErrors.load();
+	stats.retransmissions     = m_counters.retransmissions.load();
+	stats.bufferDrops         = m_messageBuffer.overflowCount();
+	stats.inboxDrops          = m_applicationInbox.overflowCount();
+	stats.outboxDrops         = m_outboxDrops.load(std::memory_order_relaxed);
+
+	stats.routedMessages = m_counters.routedMessages.load();
+	stats.routedCopies   = m_counters.routedCopies.load();
+	stats.maxFanOut      = m_counters.maxFanOut.load();
+
+	stats.messageBufferHighWater = m_counters.messageBufferHighWater.load();
+	stats.inboxHighWater         = m_counters.inboxHighWater.load();
+	stats.outboxHighWater        = m_counters.outboxHighWater.load();
+	stats.sendQueueHighWater     = m_counters.sendQueueHighWater.load();
+
+	// the client table belongs to the server thread, the counters are read instead
+	for (unsigned int idAndTeam = 0; idAndTeam < 256; idAndTeam++)
+	{
+		const ClientCounters& counters = m_clientCounters[idAndTeam];
+		if (!counters.connected.load(std::memory_order_acquire))
+			continue;
+
+		ClientStats client;
+		client.idAndTeam          = static_cast<uint8_t>(idAndTeam);
+		client.address            = counters.address.load(std::memory_order_relaxed);
+		client.port               = counters.port.load(std::memory_order_relaxed);
+		client.datagramsReceived  = counters.datagramsReceived.load();
+		client.bytesReceived      = counters.bytesReceived.load();
+		client.messagesReceived   = counters.messagesReceived.load();
+		client.datagramsSent      = counters.datagramsSent.load();
+		client.bytesSent          = counters.bytesSent.load();
+		client.messagesSent       = counters.messagesSent.load();
+		client.malformedDatagrams = counters.malformedDatagrams.load();
+		client.sendErrors         = counters.sendErrors.load();
+		client.retransmissions    = counters.retransmissions.load();
+		client.ping               = counters.ping.load(std::memory_order_relaxed);
+		client.jitter             = counters.jitter.load(std::memory_order_relaxed);
+		stats.clients.push_back(client);
+	}
+
+	return stats;
+}
+
+uint32_t Server::room() const
+{
+	return m_room;
+}
 
+bool Server::init(uint16_t port)
+{
 	// https://pastebin.com/JkGnQyPX
 	// https://www.sfml-dev.org/tutorials/2.5/network-socket.php
 
@@ -119,50 +513,92 @@ bool Server::init(uint16_t port)
 	bindAddress.sin_addr.s_addr = INADDR_ANY;
 
 	port = (port <= 450) ? DEFAULT_PORT : port;
-	std::cout << "[COMMS SERVER] Setting up on port : " << port << "." << std::endl;
+	COMMS_LOG_INFO(Server) << "Setting up on port : " << port << ".";
 	// big-endian conversion of port 16 bit value
 	bindAddress.sin_port   = htons(port);
 
+	int result;
+
+#ifdef _WIN32
+
 	// initialize server socket
 	WSADATA wsaData;
-	int     result;
 
 	// Initialize Winsock
 	result = WSAStartup(MAKEWORD(2, 2), &wsaData); // initialize version 2.2
 	if (result != 0)
 	{
-		std::cout << "[COMMS SERVER] WSAStartup failed (" << result << "). Could not start comms server." << std::endl;
+		COMMS_LOG_ERROR(Server) << "WSAStartup failed (" << result << "). Could not start comms server.";
 		m_continueExecution.store(false);
 		return false;
 	}
 
+#endif // _WIN32
+
 	// Create a socket for the server to listen for client connections
 	m_socket = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
 
 	// Check for errors to ensure the socket is valid
 	if (m_socket == INVALID_SOCKET)
 	{
-		std::cout << "[COMMS SERVER] Error at socket() (" << WSAGetLastError() << "). Could not start comms server." << std::endl;
+		COMMS_LOG_ERROR(Server) << "Error at socket() (" << WSAGetLastError() << "). Could not start comms server.";
 		WSACleanup();
 		m_continueExecution.store(false);
 		return false;
 	}
 
+#ifdef _WIN32
+
 	// 1 to set non-blocking, 0 to set blocking
 	unsigned long nonBlocking = 1;
 	if (ioctlsocket(m_socket, FIONBIO, &nonBlocking) == SOCKET_ERROR)
 	{
-		std::cout << "[COMMS SERVER] Error at ioctlsocket() (" << WSAGetLastError() << "). Could not start comms server." << std::endl;
+		COMMS_LOG_ERROR(Server) << "Error at ioctlsocket() (" << WSAGetLastError() << "). Could not start comms server.";
 		WSACleanup();
 		m_continueExecution.store(false);
 		return false;
 	}
 
+	if (m_threadCount > 1)
+		COMMS_LOG_WARNING(Server) << "Receive threads are only available on Linux. Using the server thread only.";
+
+#else
+
+	int flags = fcntl(m_socket, F_GETFL, 0);
+	if (flags == -1 || fcntl(m_socket, F_SETFL, flags | O_NONBLOCK) == -1)
+	{
+		COMMS_LOG_ERROR(Server) << "Error at fcntl() (" << errno << "). Could not start comms server.";
+		closesocket(m_socket);
+		m_continueExecution.store(false);
+		m_socket = INVALID_SOCKET;
+		return false;
+	}
+
+	// unconnected UDP sockets only report unreachable clients through the error queue
+	int enable = 1;
+	if (setsockopt(m_socket, IPPROTO_IP, IP_RECVERR, &enable, sizeof(enable)) == SOCKET_ERROR)
+	{
+		COMMS_LOG_ERROR(Server) << "Error at setsockopt() (" << errno << "). Could not start comms server.";
+		closesocket(m_socket);
+		m_continueExecution.store(false);
+		m_socket = INVALID_SOCKET;
+		return false;
+	}
+
+	// the sockets of the shards join the port of this one
+	if (m_threadCount > 1 && setsockopt(m_socket, SOL_SOCKET, SO_REUSEPORT, &enable, sizeof(enable)) == SOCKET_ERROR)
+	{
+		COMMS_LOG_ERROR(Server) << "Error at setsockopt() (" << errno << "). Using the server thread only.";
+		m_threadCount = 1;
+	}
+
+#endif // _WIN32
+
 	// Bind the UDP socket
 	result = bind(m_socket, reinterpret_cast<sockaddr*>(&bindAddress), sizeof(bindAddress));
 	if (result == SOCKET_ERROR)
 	{
-		std::cout << "[COMMS SERVER] Could not bind socket (" << WSAGetLastError() << "). Could not start comms sever." << std::endl;
+		COMMS_LOG_ERROR(Server) << "Could not bind socket (" << WSAGetLastError() << "). Could not start comms sever.";
 		closesocket(m_socket);
 		WSACleanup();
 		m_continueExecution.store(false);
@@ -170,10 +606,120 @@ bool Server::init(uint16_t port)
 		return false;
 	}
 
-	std::cout << "[COMMS SERVER] Started server on port: " << ntohs(bindAddress.sin_port) << "." << std::endl;
+#ifndef _WIN32
+
+	m_epoll = epoll_create1(EPOLL_CLOEXEC);
+	if (m_epoll == -1)
+	{
+		COMMS_LOG_ERROR(Server) << "Error at epoll_create1() (" << errno << "). Could not start comms server.";
+		closesocket(m_socket);
+		m_continueExecution.store(false);
+		m_socket = INVALID_SOCKET;
+		return false;
+	}
+
+	epoll_event socketEvent;
+	socketEvent.events  = EPOLLIN;
+	socketEvent.data.fd = m_socket;
+	if (epoll_ctl(m_epoll, EPOLL_CTL_ADD, m_socket, &socketEvent) == -1)
+	{
+		COMMS_LOG_ERROR(Server) << "Error at epoll_ctl() (" << errno << "). Could not start comms server.";
+		closesocket(m_socket);
+		m_continueExecution.store(false);
+		m_socket = INVALID_SOCKET;
+		return false;
+	}
+
+	epoll_event wakeupEvent;
+	wakeupEvent.events  = EPOLLIN;
+	wakeupEvent.data.fd = m_wakeup;
+	if (m_wakeup == -1 || epoll_ctl(m_epoll, EPOLL_CTL_ADD, m_wakeup, &wakeupEvent) == -1)
+	{
+		COMMS_LOG_ERROR(Server) << "Could not setup wakeup event (" << errno << "). Could not start comms server.";
+		closesocket(m_socket);
+		m_continueExecution.store(false);
+		m_socket = INVALID_SOCKET;
+		return false;
+	}
+
+	// the Unix socket shares the buffers, only its senders differ
+	ServerShard::setupReceiveHeaders(m_receiveHeaders, m_receiveVectors, m_receiveAddresses, m_receiveBuffers.get(), RECEIVE_BATCH_SIZE);
+	for (unsigned int i = 0; i < RECEIVE_BATCH_SIZE; i++)
+	{
+		ZeroMemory(&m_unixHeaders[i], sizeof(mmsghdr));
+		m_unixHeaders[i].msg_hdr.msg_name   = &m_unixAddresses[i];
+		m_unixHeaders[i].msg_hdr.msg_iov    = &m_receiveVectors[i];
+		m_unixHeaders[i].msg_hdr.msg_iovlen = 1;
+	}
+
+	if (m_transport == Transport::UnixDatagram)
+	{
+		m_unixPath   = unixServerPath(m_unixPath, port);
+		m_unixSocket = openUnixSocket(m_unixPath);
+
+		epoll_event unixEvent;
+		unixEvent.events  = EPOLLIN;
+		unixEvent.data.fd = m_unixSocket;
+
+		if (m_unixSocket == INVALID_SOCKET || epoll_ctl(m_epoll, EPOLL_CTL_ADD, m_unixSocket, &unixEvent) == -1)
+		{
+			COMMS_LOG_ERROR(Server) << "Could not open Unix socket " << m_unixPath << " (" << errno << "). Clients must use UDP.";
+			closeUnixSocket(m_unixSocket, m_unixPath);
+		}
+		else
+		{
+			COMMS_LOG_INFO(Server) << "Receiving datagrams on Unix socket " << m_unixPath << ".";
+		}
+	}
+
+	// UDP stays available to the clients that can't share memory with the server
+	if (m_transport == Transport::SharedMemory && m_shmListener.open(port))
+	{
+		epoll_event listenerEvent;
+		listenerEvent.events  = EPOLLIN;
+		listenerEvent.data.fd = m_shmListener.socket();
+
+		epoll_event doorbellEvent;
+		doorbellEvent.events  = EPOLLIN;
+		doorbellEvent.data.fd = m_shmListener.doorbell();
+
+		if (epoll_ctl(m_epoll, EPOLL_CTL_ADD, m_shmListener.socket(), &listenerEvent) == -1
+		 || epoll_ctl(m_epoll, EPOLL_CTL_ADD, m_shmListener.doorbell(), &doorbellEvent) == -1)
+		{
+			COMMS_LOG_ERROR(Server) << "Error at epoll_ctl() (" << errno << "). Clients must use UDP.";
+			m_shmListener.close();
+		}
+		else
+		{
+			COMMS_LOG_INFO(Server) << "Offering shared memory to the clients on this host.";
+		}
+	}
+
+	// started after the bind, the shards can't take the port of another server
+	for (unsigned int i = 1; i < m_threadCount; i++)
+	{
+		if (!m_shards[m_shardCount].start(port, m_wakeup))
+		{
+			COMMS_LOG_ERROR(Server) << "Could not start receive thread " << i << " (" << errno << ").";
+			break;
+		}
+		m_shardCount++;
+	}
+	if (m_shardCount > 0)
+		COMMS_LOG_INFO(Server) << "Receiving and sending UDP datagrams on " << m_shardCount + 1 << " threads.";
+
+	if (m_engine == IoEngine::IoUring)
+	{
+		if (openRing())
+			COMMS_LOG_INFO(Server) << "Using io_uring for the UDP socket.";
+		else
+			COMMS_LOG_ERROR(Server) << "io_uring is not available. Using epoll.";
+	}
 
 #endif // _WIN32
 
+	COMMS_LOG_INFO(Server) << "Started server on port: " << ntohs(bindAddress.sin_port) << ".";
+
 	run();
 
 	return true;
@@ -181,258 +727,1941 @@ bool Server::init(uint16_t port)
 
 void Server::run()
 {
-	Message       receiveMessage;
-	uint32_t      senderAddress;
-	uint16_t      senderPort;
-	ReceiveStatus receiveStatus;
+	m_nextTick = std::chrono::steady_clock::now() + m_tickPeriod;
 
-	Message handledMessage;
-
-	// TODO: Reduce CPU usage. The server doesn't have to run at much more than 120 updates per second...
 	while (m_continueExecution.load())
 	{
-		// loop until there is no more data to be read
-		while ((receiveStatus = receive(receiveMessage, senderAddress, senderPort)) != ReceiveStatus::NoData)
-		{
-			if (receiveStatus == ReceiveStatus::Error)      break;         // handled outside of loop
-			if (receiveStatus == ReceiveStatus::Oversized)  continue;      // skip oversized packet (maybe throw away excess data)
-			if (receiveStatus == ReceiveStatus::Undersized) continue;      // skip undersized packet (maybe replace missing data by 0)
-			if (receiveStatus == ReceiveStatus::ConnReset)
-			{
-				pingClients(); // find which client disconnected
-				continue;
-			}
+		std::chrono::steady_clock::time_point deadline = nextDeadline();
 
-			handledMessage = handleMessage(receiveMessage, senderAddress, senderPort);
-			if (handledMessage.type != MSG_INVALID)
-				m_messageBuffer.push(handledMessage);
-		}
+#ifdef _WIN32
+
+		// nothing can wake the thread up, it has to look for the messages of the application
+		if (m_tickPeriod == std::chrono::nanoseconds::zero())
+			deadline = std::min(deadline, std::chrono::steady_clock::now() + std::chrono::milliseconds(MAX_WAIT_MS));
+		else
+			deadline = std::min(deadline, m_nextTick);
+
+#endif // _WIN32
 
-		// there was an error while calling receive(). Stop the server.
-		if (receiveStatus == ReceiveStatus::Error)
+		if (!waitForData(deadline) || !step())
 		{
-			std::cout << "[COMMS SERVER] Error while receiving data. Stopping server." << std::endl;
 			m_continueExecution.store(false);
 			break;
 		}
+	}
 
-		if (m_messageBuffer.size() > 0)
-		{
-			std::cout << "[COMMS SERVER] Received " << m_messageBuffer.size() * sizeof(Message) << " bytes from clients." << std::endl;
-			while (!m_messageBuffer.empty())
-			{
-				// tailor message for all clients
-				// NOTE: for multi-byte values sent across the network
-				// htonl or htons should be used to convert 4-byte and
-				// 2-byte values respectively.
-				Message currentMessage = m_messageBuffer.front();
-
-				for (unsigned int i = 0; i < m_clients.size(); ++i)
-				{
-					if (m_clients[i].address == INADDR_ANY)
-						continue;
-
-					// check if client should receive the message
-					// and tailor message for client
-					Message clientMessage = currentMessage;
-					clientMessage.key = m_clients[i].key;
-
-					if (!send(&clientMessage, m_clients[i]))
-					{
-						std::cout << "[COMMS SERVER] Client #" << i << " with id: "
-								  << (m_clients[i].idAndTeam >> 1) << " send error." << std::endl;
-
-						m_clients[i].address = INADDR_ANY;
-						m_clients[i].port    = 0;
-
-						Message disconnectMessage;
-						disconnectMessage.parameters = MSG_ALL;
-						disconnectMessage.type       = MSG_DISCONNECT;
-						disconnectMessage.data[0]    = m_clients[i].idAndTeam >> 1;
-						m_messageBuffer.push(disconnectMessage);
-					}
-				}
-
-				m_messageBuffer.pop();
-			}
-		}
+#ifndef _WIN32
 
-		// remove released sockets from list, backwards to avoid skipping some clients
-		if (m_clients.size() > 0)
-		{
-			for (int i = (signed)m_clients.size() - 1; i >= 0; --i)
-			{
-				if (m_clients[i].address == INADDR_ANY)
-					m_clients.erase(m_clients.begin() + i);
-			}
-		}
-	}
+	// the requests of the ring hold m_socket, they are cancelled by the thread that made them
+	m_ring.close();
+
+#endif // _WIN32
 
-	std::cout << "[COMMS SERVER] Server loop stopped successfully." << std::endl;
+	COMMS_LOG_INFO(Server) << "Server loop stopped successfully.";
 }
 
-bool Server::send(Message* message, const ClientInfo& recipient) const
+std::chrono::steady_clock::time_point Server::nextDeadline()
 {
-#ifdef _WIN32
+	updateTimers();
 
-	if (m_socket == INVALID_SOCKET)
+	// sleep until the next tick only if there is something to dispatch
+	std::chrono::steady_clock::time_point deadline = m_timers.nextExpiry();
+	if (dispatchPending())
+		deadline = std::min(deadline, m_nextTick);
+
+	return deadline;
+}
+
+bool Server::step()
+{
+	// there was an error while receiving data. Stop the server.
+	if (!receiveMessages())
 	{
-		std::cout << "[COMMS SERVER] Invalid socket. Cannot send message." << std::endl;
+		COMMS_LOG_ERROR(Server) << "Error while receiving data. Stopping server.";
 		return false;
 	}
 
-	sockaddr_in recipientAddress;
-	ZeroMemory(&recipientAddress, sizeof(recipientAddress)); // initialize to zero
-	recipientAddress.sin_family      = AF_INET;
-	recipientAddress.sin_addr.s_addr = recipient.address;
-	recipientAddress.sin_port        = recipient.port;
+	std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+	if (now >= m_nextTick && dispatchPending())
+		dispatchMessages();
+	else if (m_timers.nextExpiry() <= now)
+		runTimers();
 
-	int sendResult = sendto(m_socket, reinterpret_cast<char*>(message),
-		static_cast<int>(sizeof(Message)), 0, reinterpret_cast<sockaddr*>(&recipientAddress),
-		sizeof(recipientAddress));
-
-	if (sendResult < 0)
+	// skip the ticks that were missed instead of dispatching several times in a row
+	if (now >= m_nextTick)
 	{
-		std::cout << "[COMMS SERVER] Error at sendto() (" << WSAGetLastError() << "). Message not sent." << std::endl;
-		return false;
+		m_nextTick += m_tickPeriod;
+		if (m_nextTick < now)
+			m_nextTick = now + m_tickPeriod;
 	}
 
-#endif // _WIN32
-
 	return true;
 }
 
-ReceiveStatus Server::receive(Message& message, uint32_t& ipAddress, uint16_t& port)
+bool Server::waitForData(std::chrono::steady_clock::time_point deadline)
 {
+	// without any timer, the thread sleeps until it is woken up
+	std::chrono::steady_clock::duration remaining = std::chrono::hours(1);
+	if (deadline != std::chrono::steady_clock::time_point::max())
+		remaining = std::min(deadline - std::chrono::steady_clock::now(), remaining);
+	if (remaining < std::chrono::steady_clock::duration::zero())
+		remaining = std::chrono::steady_clock::duration::zero();
+
 #ifdef _WIN32
 
-	if (m_socket == INVALID_SOCKET)
+	std::chrono::microseconds timeout = std::chrono::ceil<std::chrono::microseconds>(remaining);
+
+	timeval timeoutValue;
+	timeoutValue.tv_sec  = static_cast<long>(timeout.count() / 1000000);
+	timeoutValue.tv_usec = static_cast<long>(timeout.count() % 1000000);
+
+	fd_set readSet;
+	FD_ZERO(&readSet);
+	FD_SET(m_socket, &readSet);
+
+	int result = select(0, &readSet, nullptr, nullptr, &timeoutValue);
+	m_counters.waitCalls.add();
+
+	if (result == SOCKET_ERROR)
 	{
-		std::cout << "[COMMS SERVER] Invalid socket. Cannot receive message." << std::endl;
-		return ReceiveStatus::Error;
+		COMMS_LOG_ERROR(Server) << "Error at select() (" << WSAGetLastError() << "). Stopping server.";
+		return false;
 	}
 
-	std::size_t receivedSize = 0;
-	ipAddress                = INADDR_ANY;
-	port                     = 0;
+#else
 
-	sockaddr_in senderAddress;
-	ZeroMemory(&senderAddress, sizeof(sockaddr_in));
-	senderAddress.sin_addr.s_addr = htonl(INADDR_ANY);
-	senderAddress.sin_family      = AF_INET;
-	senderAddress.sin_port        = 0;
+	// round up so we never wake up right before the deadline and spin
+	int timeout = static_cast<int>(std::chrono::ceil<std::chrono::milliseconds>(remaining).count());
 
-	int addressSize = static_cast<int>(sizeof(sockaddr_in));
-	int sizeReceived = recvfrom(m_socket, reinterpret_cast<char*>(&message),
-		static_cast<int>(sizeof(Message)), 0, reinterpret_cast<sockaddr*>(&senderAddress), &addressSize);
+	// the clients of the channels only ring the doorbell once we announced we sleep
+	for (ShmChannel& channel : m_shmChannels)
+	{
+		if (channel.isOpen() && !channel.prepareWait())
+			timeout = 0;
+	}
+
+	// so do the shards, with m_wakeup
+	for (std::size_t i = 0; i < m_shardCount; i++)
+	{
+		if (!m_shards[i].records().prepareWait())
+			timeout = 0;
+	}
+
+	epoll_event events[EPOLL_EVENT_COUNT];
+	int         eventCount = 0;
+
+	if (m_ring.isOpen())
+	{
+		if (!waitForCompletions(timeout))
+			return false;
+
+		// the other descriptors are only read once the ring reported them
+		if (m_ringEpollReadable)
+		{
+			eventCount = epoll_wait(m_epoll, events, EPOLL_EVENT_COUNT, 0);
+			m_counters.waitCalls.add();
+			m_ringEpollReadable = eventCount < 0 || eventCount == EPOLL_EVENT_COUNT;
+		}
+	}
+	else
+	{
+		eventCount = epoll_wait(m_epoll, events, EPOLL_EVENT_COUNT, timeout);
+		m_counters.waitCalls.add();
+	}
+
+	if (eventCount < 0 && errno != EINTR)
+	{
+		COMMS_LOG_ERROR(Server) << "Error at epoll_wait() (" << errno << "). Stopping server.";
+		return false;
+	}
+
+	for (ShmChannel& channel : m_shmChannels)
+	{
+		if (channel.isOpen())
+			channel.endWait();
+	}
+
+	for (std::size_t i = 0; i < m_shardCount; i++)
+		m_shards[i].records().endWait();
+
+	for (int i = 0; i < eventCount; i++)
+	{
+		if (events[i].data.fd == m_wakeup)
+		{
+			uint64_t wakeupCount;
+			if (read(m_wakeup, &wakeupCount, sizeof(wakeupCount)) < 0 && errno != EAGAIN)
+				COMMS_LOG_ERROR(Server) << "Error while reading wakeup event (" << errno << ").";
+		}
+		else if (events[i].data.fd == m_shmListener.doorbell())
+		{
+			m_shmListener.clearDoorbell();
+		}
+		else if (events[i].data.fd == m_shmListener.socket())
+		{
+			acceptShmChannels();
+		}
+		else if (events[i].data.fd == m_socket)
+		{
+			if (events[i].events & EPOLLIN)
+				m_socketReadable = true;
+			if (events[i].events & EPOLLERR)
+				handleErrorQueue();
+		}
+		else if (events[i].data.fd == m_unixSocket)
+		{
+			m_unixSocketReadable = true;
+		}
+		else
+		{
+			// the clients never write to their connection, it is readable once they are gone
+			for (unsigned int slot = 0; slot < MAX_CLIENTS; slot++)
+			{
+				if (m_shmChannels[slot].connection() == events[i].data.fd)
+					m_shmHangups[slot] = true;
+			}
+		}
+	}
+
+#endif // _WIN32
+
+	return true;
+}
+
+bool Server::receiveMessages()
+{
+	MessageView   receiveMessage;
+	uint32_t      senderAddress;
+	uint16_t      senderPort;
+	ReceiveStatus receiveStatus;
+
+	std::chrono::steady_clock::time_point receiveTime = std::chrono::steady_clock::now();
+
+	// loop until there is no more data to be read
+	while ((receiveStatus = receive(receiveMessage, senderAddress, senderPort)) != ReceiveStatus::NoData)
+	{
+		if (receiveStatus == ReceiveStatus::Error)      return false;
+		if (receiveStatus == ReceiveStatus::Oversized)  continue;      // skip oversized packet (maybe throw away excess data)
+		if (receiveStatus == ReceiveStatus::Undersized) continue;      // skip undersized packet (maybe replace missing data by 0)
+		if (receiveStatus == ReceiveStatus::ConnReset)
+		{
+			pingClients(); // find which client disconnected
+			continue;
+		}
+
+		// any message proves the client is still there, its timeout timer is moved when it expires
+		int clientIndex = m_clients.find(senderAddress, senderPort);
+		if (clientIndex >= 0)
+		{
+			m_clients[clientIndex].lastMessageTime = receiveTime;
+			m_clientCounters[m_clients[clientIndex].idAndTeam].messagesReceived.add();
+		}
+		m_counters.messagesReceived.add();
+
+		handleMessage(receiveMessage, senderAddress, senderPort);
+		m_dispatchPending = true;
+	}
+
+	// the rings are empty, nothing sent by the clients that went away is lost
+	for (unsigned int slot = 0; slot < MAX_CLIENTS; slot++)
+	{
+		if (m_shmHangups[slot])
+			closeShmChannel(slot);
+	}
+
+	m_counters.messageBufferHighWater.raise(m_messageBuffer.size());
+
+	return true;
+}
+
+void Server::wakeUp()
+{
+	// a room has no thread, its worker runs it
+	if (m_host != nullptr)
+	{
+		m_host->wake(m_roomSlot);
+		return;
+	}
+
+#ifndef _WIN32
+
+	uint64_t wakeupCount = 1;
+	if (m_wakeup != -1 && write(m_wakeup, &wakeupCount, sizeof(wakeupCount)) < 0)
+		COMMS_LOG_ERROR(Server) << "Error while waking up server thread (" << errno << ").";
+
+#endif // _WIN32
+}
+
+void Server::dispatchMessages()
+{
+	m_dispatchTime    = std::chrono::steady_clock::now();
+	m_dispatchPending = false;
+
+	queueApplicationMessages();
+	queueDeltaAcks();
+	handleTimers();
+
+	if (m_messageBuffer.size() > 0)
+		COMMS_LOG_DEBUG(Server) << "Received " << m_messageBuffer.size() << " bytes from clients.";
+
+	// sending may fail and buffer disconnect messages, which also have to be dispatched
+	do
+	{
+		while (!m_messageBuffer.empty())
+		{
+			// tailor message for all clients
+			// NOTE: for multi-byte values sent across the network
+			// htonl or htons should be used to convert 4-byte and
+			// 2-byte values respectively.
+			MessageView currentMessage = m_messageBuffer.front();
+			MessageView fullMessage    = currentMessage;
+			Delivery    delivery       = defaultDelivery(currentMessage.type);
+			uint8_t     recipients     = currentMessage.parameters & MSG_ALL;
+
+			// the headers added by the server are removed before routing
+			if (currentMessage.parameters & MSG_DELTA)
+			{
+				fullMessage = fullSnapshot(currentMessage);
+				delivery    = Delivery::Unreliable;
+			}
+			else if (currentMessage.parameters & MSG_RELIABLE)
+			{
+				fullMessage = stripReliableHeader(currentMessage);
+				delivery    = reliableDelivery(currentMessage);
+			}
+
+			std::size_t firstEntry = m_sendEntries.size();
+			shareFanOut(currentMessage);
+
+			if (recipients == MSG_PRIVATE)
+			{
+				// the recipient is identified by the first byte of data. If no
+				// client matches, the message was meant for the server only.
+				int clientIndex = fullMessage.size > 0 ? m_clients.find(fullMessage.data[0]) : -1;
+				if (clientIndex >= 0)
+					queueClientMessage(currentMessage, clientIndex, delivery);
+			}
+			else
+			{
+				if (recipients & MSG_ORANGE) queueTeamMessage(currentMessage, 0x00, delivery);
+				if (recipients & MSG_BLUE)   queueTeamMessage(currentMessage, 0x01, delivery);
+			}
+
+			countFanOut(firstEntry);
+
+			m_applicationInbox.push(fullMessage);
+			m_counters.inboxHighWater.raise(m_applicationInbox.size());
+			m_messageBuffer.pop();
+		}
+
+		queueReliableAcks();
+		flushSends();
+	}
+	while (!m_messageBuffer.empty());
+
+	// remove released sockets from list
+	m_clients.compact();
+}
+
+void Server::queueApplicationMessages()
+{
+	uint64_t count = 0;
+
+	while (!m_applicationOutbox.empty())
+	{
+		const ApplicationMessage& applicationMessage = m_applicationOutbox.front();
+
+		MessageView message    = applicationMessage.message;
+		message.data           = applicationMessage.data;
+		std::size_t firstEntry = m_sendEntries.size();
+		shareFanOut(message);
+
+		if (applicationMessage.isBroadcast)
+		{
+			uint8_t recipients = message.parameters & MSG_ALL;
+			if (recipients & MSG_ORANGE) queueTeamMessage(message, 0x00, applicationMessage.delivery);
+			if (recipients & MSG_BLUE)   queueTeamMessage(message, 0x01, applicationMessage.delivery);
+		}
+		else
+		{
+			int clientIndex = m_clients.find(applicationMessage.recipient);
+			if (clientIndex >= 0)
+				queueClientMessage(message, clientIndex, applicationMessage.delivery);
+		}
+
+		countFanOut(firstEntry);
+		m_applicationOutbox.pop();
+		count++;
+	}
+
+	m_counters.outboxHighWater.raise(count);
+}
+
+void Server::queueTeamMessage(const MessageView& message, uint8_t team, Delivery delivery)
+{
+	for (std::size_t i = 0; i < m_clients.teamSize(team); ++i)
+		queueClientMessage(message, static_cast<unsigned int>(m_clients.teamMember(team, i)), delivery);
+}
+
+void Server::queueClientMessage(const MessageView& message, unsigned int clientIndex, Delivery delivery)
+{
+	const ClientInfo& client = m_clients[clientIndex];
+	if (client.address == INADDR_ANY)
+		return;
+
+	// tailor message for client
+	MessageView tailoredMessage = message;
+	if (message.parameters & MSG_DELTA)
+		tailoredMessage = encodeSnapshot(message, client);
+	else if (message.parameters & MSG_RELIABLE)
+		tailoredMessage = stripReliableHeader(message);
+
+	// the client that connects asks again until it is answered
+	if (message.type == MSG_CONNECT && message.playerIDAndTeam == client.idAndTeam)
+		delivery = Delivery::Unreliable;
+
+	// the sequence number is specific to the client, the message is stored until it is acknowledged
+	if (delivery != Delivery::Unreliable && (client.capabilities & MSG_CAP_RELIABLE) && tailoredMessage.size <= MAX_RELIABLE_PAYLOAD_SIZE)
+	{
+		// queued messages are sent once the client acknowledges the previous ones
+		ReliableEndpoint& endpoint = m_reliableEndpoints[client.idAndTeam];
+		bool              sendNow  = endpoint.send(tailoredMessage, delivery, m_dispatchTime, m_reliablePayload, tailoredMessage);
+
+		// the message expires after the ones already sent, unless they were sent again with a longer timeout
+		std::size_t timer = RETRANSMIT_TIMER(client.idAndTeam);
+		if (!m_timers.scheduled(timer) || m_timers.deadline(timer) > m_dispatchTime + endpoint.rtt().timeout())
+			scheduleRetransmissions(client.idAndTeam, endpoint);
+
+		if (!sendNow)
+			return;
+	}
+
+	tailoredMessage.key = client.key;
+	queueClientFrame(tailoredMessage, clientIndex);
+}
+
+void Server::queueClientFrame(const MessageView& message, unsigned int clientIndex)
+{
+	const ClientInfo& client  = m_clients[clientIndex];
+	bool              compact = (client.capabilities & MSG_CAP_COMPACT) != 0;
+
+	SendEntry entry;
+	entry.header      = m_sendData.size();
+	entry.payloadSize = compact ? message.size : std::min<std::size_t>(message.size, LEGACY_PAYLOAD_SIZE);
+	entry.payload     = storePayload(message.data, entry.payloadSize);
+	entry.size        = encodedSize(message, compact);
+	entry.recipient   = clientIndex;
+
+	// only the header is written for each client
+	m_sendData.resize(entry.header + FRAME_HEADER_SIZE);
+	entry.headerSize = encodeHeader(&m_sendData[entry.header], message, compact);
+	m_sendData.resize(entry.header + entry.headerSize);
+
+	m_sendEntries.push_back(entry);
+}
+
+void Server::shareFanOut(const MessageView& message)
+{
+	m_fanOut        = message;
+	m_fanOutPayload = SIZE_MAX;
+}
+
+std::size_t Server::storePayload(const uint8_t* data, std::size_t size)
+{
+	std::size_t position = m_sendPayloads.size();
+	if (size == 0)
+		return position;
+
+	// a tailored payload is in a buffer of its own, anything within the message of the fan-out is shared
+	std::less_equal<const uint8_t*> notAfter;
+	if (m_fanOut.data != nullptr && notAfter(m_fanOut.data, data) && notAfter(data + size, m_fanOut.data + m_fanOut.size))
+	{
+		if (m_fanOutPayload == SIZE_MAX)
+		{
+			m_fanOutPayload = position;
+			m_sendPayloads.insert(m_sendPayloads.end(), m_fanOut.data, m_fanOut.data + m_fanOut.size);
+		}
+
+		return m_fanOutPayload + (data - m_fanOut.data);
+	}
+
+	m_sendPayloads.insert(m_sendPayloads.end(), data, data + size);
+	return position;
+}
+
+MessageView Server::encodeSnapshot(const MessageView& snapshot, const ClientInfo& recipient)
+{
+	MessageView fullMessage = fullSnapshot(snapshot);
+	if (!(recipient.capabilities & MSG_CAP_DELTA))
+		return fullMessage;
+
+	auto stream = m_deltaStreams.find(deltaStreamKey(snapshot.playerIDAndTeam, snapshot.type));
+	if (stream == m_deltaStreams.end())
+		return fullMessage;
+
+	uint16_t sequence = static_cast<uint16_t>(snapshot.data[0] << 8 | snapshot.data[1]);
+
+	MessageView encodedMessage = snapshot;
+	encodedMessage.data = m_deltaPayload;
+	encodedMessage.size = static_cast<uint16_t>(encodeDelta(m_deltaPayload, sequence, fullMessage.data, fullMessage.size,
+		stream->second.history, stream->second.acked[recipient.idAndTeam], stream->second.ackedSequence[recipient.idAndTeam]));
+
+	return encodedMessage;
+}
+
+void Server::queueDeltaAcks()
+{
+	for (auto& entry : m_deltaStreams)
+	{
+		DeltaStream& stream = entry.second;
+		if (!stream.ackPending)
+			continue;
+
+		stream.ackPending = false;
+
+		uint8_t source      = static_cast<uint8_t>(entry.first >> 8);
+		int     clientIndex = m_clients.find(source);
+		if (clientIndex < 0)
+			continue;
+
+		uint8_t ack[DELTA_ACK_SIZE];
+		encodeDeltaAck(ack, source, static_cast<uint8_t>(entry.first & 0xFF), stream.latestSequence);
+
+		MessageView ackMessage;
+		ackMessage.playerIDAndTeam = source;
+		ackMessage.parameters      = MSG_PRIVATE;
+		ackMessage.type            = MSG_DELTA_ACK;
+		ackMessage.size            = DELTA_ACK_SIZE;
+		ackMessage.data            = ack;
+		queueClientMessage(ackMessage, clientIndex);
+	}
+}
+
+bool Server::dispatchPending() const
+{
+	return m_dispatchPending || !m_messageBuffer.empty() || !m_applicationOutbox.empty();
+}
+
+void Server::updateTimers()
+{
+	if (m_timersChanged.exchange(false))
+	{
+		std::chrono::milliseconds interval = m_pingInterval.load();
+		if (interval > std::chrono::milliseconds::zero())
+			m_timers.schedule(PING_TIMER, m_lastPingTime + interval);
+		else
+			m_timers.cancel(PING_TIMER);
+
+		std::chrono::milliseconds timeout = m_clientTimeout.load();
+		for (unsigned int i = 0; i < m_clients.size(); i++)
+		{
+			if (m_clients[i].address == INADDR_ANY)
+				continue;
+
+			if (timeout > std::chrono::milliseconds::zero() && m_clients[i].capabilities != 0x00)
+				m_timers.schedule(TIMEOUT_TIMER(m_clients[i].idAndTeam), m_clients[i].lastMessageTime + timeout);
+			else
+				m_timers.cancel(TIMEOUT_TIMER(m_clients[i].idAndTeam));
+		}
+	}
+
+	if (m_pingRequested.exchange(false))
+		m_timers.schedule(PING_TIMER, std::chrono::steady_clock::now());
+}
+
+void Server::handleTimers()
+{
+	std::size_t timers[TIMER_BATCH_SIZE];
+	std::size_t count;
+
+	// the timers handled are never scheduled again before m_dispatchTime
+	do
+	{
+		count = m_timers.advance(m_dispatchTime, timers, TIMER_BATCH_SIZE);
+		for (std::size_t i = 0; i < count; i++)
+		{
+			if (timers[i] == PING_TIMER)
+				queuePings();
+			else if (timers[i] >= RETRANSMIT_TIMER(0))
+				queueRetransmissions(static_cast<uint8_t>(timers[i] - RETRANSMIT_TIMER(0)));
+			else
+				checkClientTimeout(static_cast<uint8_t>(timers[i]));
+		}
+	}
+	while (count == TIMER_BATCH_SIZE);
+}
+
+void Server::runTimers()
+{
+	m_dispatchTime = std::chrono::steady_clock::now();
+
+	// disconnections are buffered and dispatched during the next tick
+	handleTimers();
+	flushSends();
+}
+
+void Server::queuePings()
+{
+	m_lastPingTime = m_dispatchTime;
+
+	// without clients the timer is scheduled again by the next connection, an idle server never wakes up
+	std::chrono::milliseconds interval = m_pingInterval.load();
+	if (interval > std::chrono::milliseconds::zero() && !m_clients.empty())
+		m_timers.schedule(PING_TIMER, m_dispatchTime + interval);
+
+	uint8_t timestamp[PING_PAYLOAD_SIZE];
+	writeTimestamp(timestamp, m_dispatchTime);
+
+	for (unsigned int i = 0; i < m_clients.size(); i++)
+	{
+		if (m_clients[i].address == INADDR_ANY)
+			continue;
+
+		// the client sends the payload back as is
+		MessageView pingMessage;
+		pingMessage.playerIDAndTeam = m_clients[i].idAndTeam;
+		pingMessage.key             = m_clients[i].key;
+		pingMessage.parameters      = MSG_PRIVATE;
+		pingMessage.type            = MSG_PING;
+		pingMessage.size            = PING_PAYLOAD_SIZE;
+		pingMessage.data            = timestamp;
+		queueClientFrame(pingMessage, i);
+
+		m_clients[i].isPinging = true;
+	}
+}
+
+void Server::checkClientTimeout(uint8_t idAndTeam)
+{
+	std::chrono::milliseconds timeout = m_clientTimeout.load();
+
+	int clientIndex = m_clients.find(idAndTeam);
+	if (clientIndex < 0 || timeout <= std::chrono::milliseconds::zero())
+		return;
+
+	std::chrono::steady_clock::time_point deadline = m_clients[clientIndex].lastMessageTime + timeout;
+	if (deadline > m_dispatchTime)
+		m_timers.schedule(TIMEOUT_TIMER(idAndTeam), deadline);
+	else
+		handleClientTimeout(clientIndex);
+}
+
+void Server::queueRetransmissions(uint8_t idAndTeam)
+{
+	auto endpoint    = m_reliableEndpoints.find(idAndTeam);
+	int  clientIndex = m_clients.find(idAndTeam);
+	if (endpoint == m_reliableEndpoints.end() || clientIndex < 0)
+		return;
+
+	uint64_t retransmissions = endpoint->second.retransmissionCount();
+
+	MessageView messages[RELIABLE_CHANNEL_COUNT * RELIABLE_WINDOW_SIZE];
+	std::size_t count = endpoint->second.retransmit(m_dispatchTime, messages, RELIABLE_CHANNEL_COUNT * RELIABLE_WINDOW_SIZE);
+	for (std::size_t i = 0; i < count; i++)
+	{
+		messages[i].key = m_clients[clientIndex].key;
+		queueClientFrame(messages[i], clientIndex);
+	}
+
+	// the queued messages sent for the first time are not counted
+	retransmissions = endpoint->second.retransmissionCount() - retransmissions;
+	m_counters.retransmissions.add(retransmissions);
+	m_clientCounters[idAndTeam].retransmissions.add(retransmissions);
+
+	// disconnecting erases the endpoint
+	if (endpoint->second.lost())
+		handleReliableTimeout(clientIndex);
+	else
+		scheduleRetransmissions(idAndTeam, endpoint->second);
+}
+
+void Server::scheduleRetransmissions(uint8_t idAndTeam, const ReliableEndpoint& endpoint)
+{
+	std::chrono::steady_clock::time_point next = endpoint.nextRetransmit();
+
+	// queued messages wait for acknowledgements, which make room in the window
+	if (next == std::chrono::steady_clock::time_point::max())
+		m_timers.cancel(RETRANSMIT_TIMER(idAndTeam));
+	else
+		m_timers.schedule(RETRANSMIT_TIMER(idAndTeam), next);
+}
+
+void Server::queueReliableAcks()
+{
+	uint8_t acks[RELIABLE_CHANNEL_COUNT * RELIABLE_ACK_SIZE];
+
+	for (auto& entry : m_reliableEndpoints)
+	{
+		if (!entry.second.ackPending())
+			continue;
+
+		int clientIndex = m_clients.find(entry.first);
+		if (clientIndex < 0)
+			continue;
+
+		MessageView ackMessage;
+		ackMessage.playerIDAndTeam = entry.first;
+		ackMessage.key             = m_clients[clientIndex].key;
+		ackMessage.parameters      = MSG_PRIVATE;
+		ackMessage.type            = MSG_ACK;
+		ackMessage.size            = static_cast<uint16_t>(entry.second.writeAcks(acks));
+		ackMessage.data            = acks;
+		queueClientFrame(ackMessage, clientIndex);
+	}
+}
+
+void Server::flushSends()
+{
+	std::size_t total = m_sendEntries.size();
+	if (total == 0)
+		return;
+
+	m_counters.sendQueueHighWater.raise(total);
+
+	// group the messages by client, keeping their order (counting sort)
+	std::size_t groupEnds[MAX_CLIENTS] = {};
+	for (const SendEntry& entry : m_sendEntries)
+		groupEnds[entry.recipient]++;
+
+	std::size_t position = 0;
+	for (std::size_t i = 0; i < MAX_CLIENTS; i++)
+	{
+		std::size_t count = groupEnds[i];
+		groupEnds[i] = position;
+		position += count;
+	}
+
+	m_sendOrder.resize(total);
+	for (std::size_t i = 0; i < total; i++)
+		m_sendOrder[groupEnds[m_sendEntries[i].recipient]++] = i;
+
+	// split each group in datagrams the client accepts
+	m_sendDatagrams.clear();
+	for (position = 0; position < total;)
+	{
+		unsigned int      recipient = m_sendEntries[m_sendOrder[position]].recipient;
+		const ClientInfo& client    = m_clients[recipient];
+		bool              coalesce  = (client.capabilities & MSG_CAP_COALESCE) != 0;
+
+		SendDatagram datagram;
+		datagram.first     = position;
+		datagram.recipient = recipient;
+		datagram.compact   = (client.capabilities & MSG_CAP_COMPACT) != 0;
+
+		// the version byte, and room for the padding byte
+		std::size_t overhead = datagram.compact ? 2 : 0;
+		std::size_t size     = 0;
+
+		while (position < groupEnds[recipient])
+		{
+			std::size_t entrySize = m_sendEntries[m_sendOrder[position]].size;
+			if (datagram.count > 0 && (!coalesce || overhead + size + entrySize > m_maxDatagramSize))
+				break;
+
+			size += entrySize;
+			datagram.count++;
+			position++;
+		}
+
+		datagram.padded = datagram.compact && paddingSize(1 + size) > 0;
+		datagram.size   = size + (datagram.compact ? 1 : 0) + (datagram.padded ? 1 : 0);
+		m_sendDatagrams.push_back(datagram);
+	}
+
+	// the datagrams of the clients of a channel are copied to their ring, the others go to the socket
+	std::size_t socketDatagrams = 0;
+	for (const SendDatagram& datagram : m_sendDatagrams)
+	{
+		int slot = shmSlot(m_clients[datagram.recipient]);
+		if (slot < 0)
+		{
+			m_sendDatagrams[socketDatagrams++] = datagram;
+			continue;
+		}
+
+		ShmChannel& channel = m_shmChannels[slot];
+		if (!channel.isOpen())
+		{
+			handleSendError(datagram.recipient);
+			continue;
+		}
+
+		ClientCounters& counters = m_clientCounters[m_clients[datagram.recipient].idAndTeam];
+
+		uint8_t* output = channel.reserve(datagram.size);
+		if (output == nullptr)
+		{
+			// like a full socket buffer, the client is not reading fast enough
+			COMMS_LOG_LIMITED(cl::LogLevel::Warning, Server) << "Shared memory of client #" << datagram.recipient << " is full. Message not sent.";
+			countDropped(datagram.recipient);
+			continue;
+		}
+
+		copyDatagram(datagram, output);
+		channel.commit();
+
+		counters.datagramsSent.add();
+		counters.bytesSent.add(datagram.size);
+		counters.messagesSent.add(datagram.count);
+		m_counters.datagramsSent.add();
+		m_counters.bytesSent.add(datagram.size);
+		m_counters.messagesSent.add(datagram.count);
+	}
+	m_sendDatagrams.resize(socketDatagrams);
+
+	// one wakeup per client however many datagrams it got
+	for (ShmChannel& channel : m_shmChannels)
+	{
+		if (channel.isOpen())
+			channel.notify();
+	}
+
+#ifdef _WIN32
+
+	uint8_t buffer[MAX_DATAGRAM_SIZE];
+
+	for (const SendDatagram& datagram : m_sendDatagrams)
+	{
+		std::size_t size = copyDatagram(datagram, buffer);
+
+		if (!send(buffer, size, m_clients[datagram.recipient]))
+		{
+			if (ServerShard::transientSendError(WSAGetLastError()))
+				countDropped(datagram.recipient);
+			else
+				handleSendError(datagram.recipient);
+			continue;
+		}
+
+		ClientCounters& counters = m_clientCounters[m_clients[datagram.recipient].idAndTeam];
+		counters.datagramsSent.add();
+		counters.bytesSent.add(datagram.size);
+		counters.messagesSent.add(datagram.count);
+		m_counters.messagesSent.add(datagram.count);
+	}
+
+#else
+
+	static const uint8_t datagramVersion = WIRE_VERSION;
+	static const uint8_t datagramPadding = 0x00;
+	static const uint8_t messagePadding[LEGACY_PAYLOAD_SIZE] = {}; // end of a fixed Message with a short payload
+
+	// the datagrams of the clients of the Unix socket go last, each socket sends its datagrams in batches
+	auto unixDatagrams = std::stable_partition(m_sendDatagrams.begin(), m_sendDatagrams.end(),
+		[this](const SendDatagram& datagram) { return unixSlot(m_clients[datagram.recipient]) < 0; });
+
+	// the datagrams point to the queued headers and payloads, nothing is copied
+	std::size_t datagramCount = m_sendDatagrams.size();
+	std::size_t udpCount      = unixDatagrams - m_sendDatagrams.begin();
+	m_sendVectors.resize(3 * total + 2 * datagramCount);
+	m_sendHeaders.resize(datagramCount);
+
+	std::size_t vectorCount = 0;
+	for (std::size_t i = 0; i < datagramCount; i++)
+	{
+		const SendDatagram& datagram = m_sendDatagrams[i];
+		iovec*              vectors  = &m_sendVectors[vectorCount];
+
+		if (datagram.compact)
+		{
+			m_sendVectors[vectorCount].iov_base = const_cast<uint8_t*>(&datagramVersion);
+			m_sendVectors[vectorCount].iov_len  = 1;
+			vectorCount++;
+		}
+
+		for (std::size_t j = 0; j < datagram.count; j++)
+		{
+			const SendEntry& entry   = m_sendEntries[m_sendOrder[datagram.first + j]];
+			std::size_t      padding = entry.size - entry.headerSize - entry.payloadSize;
+
+			m_sendVectors[vectorCount].iov_base = &m_sendData[entry.header];
+			m_sendVectors[vectorCount].iov_len  = entry.headerSize;
+			vectorCount++;
+
+			if (entry.payloadSize > 0)
+			{
+				m_sendVectors[vectorCount].iov_base = &m_sendPayloads[entry.payload];
+				m_sendVectors[vectorCount].iov_len  = entry.payloadSize;
+				vectorCount++;
+			}
+
+			if (padding > 0)
+			{
+				m_sendVectors[vectorCount].iov_base = const_cast<uint8_t*>(messagePadding);
+				m_sendVectors[vectorCount].iov_len  = padding;
+				vectorCount++;
+			}
+		}
+
+		if (datagram.padded)
+		{
+			m_sendVectors[vectorCount].iov_base = const_cast<uint8_t*>(&datagramPadding);
+			m_sendVectors[vectorCount].iov_len  = 1;
+			vectorCount++;
+		}
+
+		ZeroMemory(&m_sendHeaders[i], sizeof(mmsghdr));
+		m_sendHeaders[i].msg_hdr.msg_name    = &m_clients[datagram.recipient].socketAddress;
+		m_sendHeaders[i].msg_hdr.msg_namelen = sizeof(sockaddr_in);
+		m_sendHeaders[i].msg_hdr.msg_iov     = vectors;
+		m_sendHeaders[i].msg_hdr.msg_iovlen  = &m_sendVectors[vectorCount] - vectors;
+
+		if (i >= udpCount)
+		{
+			unsigned int slot = static_cast<unsigned int>(unixSlot(m_clients[datagram.recipient]));
+			m_sendHeaders[i].msg_hdr.msg_name    = const_cast<sockaddr_un*>(&m_unixPeers.address(slot));
+			m_sendHeaders[i].msg_hdr.msg_namelen = m_unixPeers.addressSize(slot);
+		}
+	}
+
+	// a large fan-out is worth waking the shards up
+	if (m_shardCount > 0 && udpCount >= 2 * SHARD_SEND_MIN)
+		sendParallel(udpCount);
+	else if (m_ring.isOpen())
+		sendRingBatch(0, udpCount);
+	else
+		sendBatch(m_socket, 0, udpCount);
+	sendBatch(m_unixSocket, udpCount, datagramCount);
+
+#endif // _WIN32
+
+	m_sendData.clear();
+	m_sendPayloads.clear();
+	m_sendEntries.clear();
+}
+
+#ifndef _WIN32
+void Server::sendBatch(SOCKET socket, std::size_t first, std::size_t end)
+{
+	std::size_t sent = first;
+	while (sent < end)
+	{
+		unsigned int count = static_cast<unsigned int>(std::min<std::size_t>(end - sent, SEND_BATCH_SIZE));
+		int result = sendmmsg(socket, &m_sendHeaders[sent], count, 0);
+		m_counters.sendCalls.add();
+
+		if (result > 0)
+		{
+			for (std::size_t end = sent + result; sent < end; sent++)
+				countSent(m_sendDatagrams[sent]);
+			continue;
+		}
+
+		// a pending ICMP error caused by an earlier datagram is reported by
+		// the next send. It is handled through the error queue, so try again.
+		if (result < 0 && ((errno == ECONNREFUSED && socket == m_socket) || errno == EINTR))
+			continue;
+
+		// the client of the Unix socket is gone, like an ICMP error on the UDP socket
+		if (result < 0 && (errno == ECONNREFUSED || errno == ENOENT) && socket == m_unixSocket)
+		{
+			const ClientInfo& client = m_clients[m_sendDatagrams[sent].recipient];
+			handleConnectionReset(client.address, client.port);
+			sent++;
+			continue;
+		}
+
+		// the receive queue of a client of the Unix socket is full: it is not
+		// reading fast enough, the datagram is lost like on a UDP socket
+		if (result < 0 && errno == EAGAIN && socket == m_unixSocket)
+		{
+			const SendDatagram& datagram = m_sendDatagrams[sent];
+			COMMS_LOG_LIMITED(cl::LogLevel::Warning, Server) << "Unix socket of client #" << datagram.recipient << " is full. Message not sent.";
+			countDropped(datagram.recipient);
+			sent++;
+			continue;
+		}
+
+		// the send buffer of the socket is full or the kernel is short of
+		// memory. The clients are fine: the rest of the batch is dropped.
+		if (result < 0 && ServerShard::transientSendError(errno))
+		{
+			COMMS_LOG_LIMITED(cl::LogLevel::Warning, Server) << "No room to send (" << errno << "). " << end - sent << " datagrams not sent.";
+			for (; sent < end; sent++)
+				countDropped(m_sendDatagrams[sent].recipient);
+			return;
+		}
+
+		// the first datagram of the batch could not be sent
+		COMMS_LOG_ERROR(Server) << "Error at sendmmsg() (" << errno << "). Message not sent.";
+		handleSendError(m_sendDatagrams[sent].recipient);
+		sent++;
+	}
+}
+
+void Server::sendRingBatch(std::size_t first, std::size_t end)
+{
+	m_ringRetries.clear();
+
+	std::size_t next = first;
+	while (next < end || m_ringSendsPending > 0)
+	{
+		// the chain ends with the submission, a full queue starts a new one
+		while (next < end && m_ring.send(m_socket, &m_sendHeaders[next].msg_hdr, RING_SEND + next, next + 1 < end))
+		{
+			m_ringSendsPending++;
+			next++;
+		}
+
+		// the datagrams point to m_sendData and m_sendPayloads, wait until all of them are sent
+		int result = m_ring.submit(next < end ? 0 : 1, -1);
+		m_counters.sendCalls.add();
+
+		if (result < 0 && errno != EINTR && errno != EBUSY && errno != EAGAIN)
+		{
+			COMMS_LOG_ERROR(Server) << "Error at io_uring_enter() (" << errno << "). Stopping server.";
+			m_continueExecution.store(false);
+			return;
+		}
+
+		reapCompletions();
+	}
+
+	// a pending ICMP error caused by an earlier datagram was reported
+	// instead of sending. It is handled through the error queue, so try again.
+	if (!m_ringRetries.empty())
+	{
+		handleErrorQueue();
+		for (std::size_t index : m_ringRetries)
+			sendBatch(m_socket, index, index + 1);
+	}
+}
+
+void Server::sendParallel(std::size_t end)
+{
+	std::size_t sliceCount = std::min<std::size_t>(m_shardCount + 1, end / SHARD_SEND_MIN);
+	std::size_t sliceEnds[MAX_SERVER_THREADS];
+
+	// the datagrams are grouped by client, a slice never splits a group
+	for (std::size_t i = 0; i < sliceCount; i++)
+	{
+		std::size_t sliceEnd = std::max((i + 1) * end / sliceCount, i > 0 ? sliceEnds[i - 1] : 1);
+		while (sliceEnd < end && m_sendDatagrams[sliceEnd].recipient == m_sendDatagrams[sliceEnd - 1].recipient)
+			sliceEnd++;
+		sliceEnds[i] = sliceEnd;
+	}
+
+	m_shardErrors.resize(end);
+
+	std::size_t shardsUsed = 0;
+	for (std::size_t i = 1; i < sliceCount; i++)
+	{
+		std::size_t first = sliceEnds[i - 1];
+		if (first < sliceEnds[i])
+			m_shards[shardsUsed++].send(&m_sendHeaders[first], sliceEnds[i] - first, &m_shardErrors[first]);
+	}
+
+	// the errors of the first slice are handled with the others, once no shard reads the client table
+	ServerShard::sendDatagrams(m_socket, m_sendHeaders.data(), sliceEnds[0], m_shardErrors.data(), m_counters.sendCalls);
+
+	for (std::size_t i = 0; i < shardsUsed; i++)
+		m_shards[i].waitSent();
+
+	for (std::size_t i = 0; i < end; i++)
+	{
+		if (m_shardErrors[i] == 0)
+		{
+			countSent(m_sendDatagrams[i]);
+			continue;
+		}
+
+		if (ServerShard::transientSendError(m_shardErrors[i]))
+		{
+			countDropped(m_sendDatagrams[i].recipient);
+			continue;
+		}
+
+		COMMS_LOG_ERROR(Server) << "Error at sendmmsg() (" << m_shardErrors[i] << "). Message not sent.";
+		handleSendError(m_sendDatagrams[i].recipient);
+	}
+}
+#endif // _WIN32
+
+void Server::countSent(const SendDatagram& datagram)
+{
+	ClientCounters& counters = m_clientCounters[m_clients[datagram.recipient].idAndTeam];
+	counters.datagramsSent.add();
+	counters.bytesSent.add(datagram.size);
+	counters.messagesSent.add(datagram.count);
+	m_counters.datagramsSent.add();
+	m_counters.bytesSent.add(datagram.size);
+	m_counters.messagesSent.add(datagram.count);
+}
+
+void Server::countDropped(unsigned int clientIndex)
+{
+	m_clientCounters[m_clients[clientIndex].idAndTeam].sendErrors.add();
+	m_counters.sendErrors.add();
+}
+
+std::size_t Server::copyDatagram(const SendDatagram& datagram, uint8_t* output) const
+{
+	std::size_t size = 0;
+
+	if (datagram.compact)
+		output[size++] = WIRE_VERSION;
+
+	for (std::size_t i = 0; i < datagram.count; i++)
+	{
+		const SendEntry& entry = m_sendEntries[m_sendOrder[datagram.first + i]];
+		memcpy(output + size, &m_sendData[entry.header], entry.headerSize);
+		if (entry.payloadSize > 0)
+			memcpy(output + size + entry.headerSize, &m_sendPayloads[entry.payload], entry.payloadSize);
+		memset(output + size + entry.headerSize + entry.payloadSize, 0, entry.size - entry.headerSize - entry.payloadSize);
+		size += entry.size;
+	}
+
+	if (datagram.padded)
+		output[size++] = 0x00;
+
+	return size;
+}
+
+void Server::handleSendError(unsigned int clientIndex)
+{
+	// the client may have several datagrams in the same batch
+	if (m_clients[clientIndex].address == INADDR_ANY)
+		return;
+
+	COMMS_LOG_ERROR(Server) << "Client #" << clientIndex << " with id: "
+	                        << (m_clients[clientIndex].idAndTeam >> 1) << " send error.";
+
+	m_counters.sendErrors.add();
+	m_clientCounters[m_clients[clientIndex].idAndTeam].sendErrors.add();
+
+	disconnectClient(clientIndex);
+
+	Message disconnectMessage;
+	disconnectMessage.parameters = MSG_ALL;
+	disconnectMessage.type       = MSG_DISCONNECT;
+	disconnectMessage.data[0]    = m_clients[clientIndex].idAndTeam >> 1;
+	m_messageBuffer.push(MessageView(disconnectMessage, 1));
+}
+
+void Server::handleReliableTimeout(unsigned int clientIndex)
+{
+	if (m_clients[clientIndex].address == INADDR_ANY)
+		return;
+
+	COMMS_LOG_INFO(Server) << "Client #" << clientIndex << " with id: "
+	                       << (m_clients[clientIndex].idAndTeam >> 1) << " stopped acknowledging reliable messages.";
+
+	sendDisconnectMessage(m_clients[clientIndex]);
+	disconnectClient(clientIndex);
+
+	Message disconnectMessage;
+	disconnectMessage.playerIDAndTeam = m_clients[clientIndex].idAndTeam;
+	disconnectMessage.parameters      = MSG_ALL;
+	disconnectMessage.type            = MSG_DISCONNECT;
+	disconnectMessage.data[0]         = MSG_DISCONNECT_SRC_SERVER;
+	m_messageBuffer.push(MessageView(disconnectMessage, 1));
+}
+
+void Server::handleClientTimeout(unsigned int clientIndex)
+{
+	COMMS_LOG_INFO(Server) << "Client #" << clientIndex << " with id: "
+	                       << (m_clients[clientIndex].idAndTeam >> 1) << " timed out.";
+
+	// the client may only have lost its way to the server, it connects again once told
+	sendDisconnectMessage(m_clients[clientIndex]);
+	disconnectClient(clientIndex);
+
+	Message disconnectMessage;
+	disconnectMessage.playerIDAndTeam = m_clients[clientIndex].idAndTeam;
+	disconnectMessage.parameters      = MSG_ALL;
+	disconnectMessage.type            = MSG_DISCONNECT;
+	disconnectMessage.data[0]         = MSG_DISCONNECT_SRC_SERVER;
+	m_messageBuffer.push(MessageView(disconnectMessage, 1));
+}
+
+void Server::resetClientCounters(const ClientInfo& client)
+{
+	ClientCounters& counters = m_clientCounters[client.idAndTeam];
+	counters.address.store(client.address, std::memory_order_relaxed);
+	counters.port.store(client.port, std::memory_order_relaxed);
+
+	counters.datagramsReceived.set(0);
+	counters.bytesReceived.set(0);
+	counters.messagesReceived.set(0);
+	counters.datagramsSent.set(0);
+	counters.bytesSent.set(0);
+	counters.messagesSent.set(0);
+	counters.malformedDatagrams.set(0);
+	counters.sendErrors.set(0);
+	counters.retransmissions.set(0);
+
+	counters.ping.store(-1.0f, std::memory_order_relaxed);
+	counters.jitter.store(0.0f, std::memory_order_relaxed);
+
+	// stats() only reads the counters of a client once they are reset
+	counters.connected.store(true, std::memory_order_release);
+}
+
+Server::ClientCounters* Server::senderCounters()
+{
+	int clientIndex = m_clients.find(m_datagramSender.sin_addr.s_addr, m_datagramSender.sin_port);
+	return clientIndex >= 0 ? &m_clientCounters[m_clients[clientIndex].idAndTeam] : nullptr;
+}
+
+void Server::countFanOut(std::size_t firstEntry)
+{
+	std::size_t copies = m_sendEntries.size() - firstEntry;
+	m_fanOut = MessageView();
+
+	m_counters.routedMessages.add();
+	m_counters.routedCopies.add(copies);
+	m_counters.maxFanOut.raise(copies);
+}
+
+bool Server::send(const void* data, std::size_t size, const ClientInfo& recipient) const
+{
+	int slot = shmSlot(recipient);
+	if (slot >= 0)
+	{
+		if (!m_shmChannels[slot].isOpen() || !m_shmChannels[slot].send(data, size))
+		{
+			COMMS_LOG_LIMITED(cl::LogLevel::Warning, Server) << "Shared memory of the recipient is full or closed. Message not sent.";
+			return false;
+		}
+
+		m_counters.datagramsSent.add();
+		m_counters.bytesSent.add(size);
+		return true;
+	}
+
+	SOCKET          socket           = m_socket;
+	const sockaddr* recipientAddress = reinterpret_cast<const sockaddr*>(&recipient.socketAddress);
+	socklen_t       addressSize      = sizeof(sockaddr_in);
+
+	int unixPeer = unixSlot(recipient);
+	if (unixPeer >= 0)
+	{
+		socket           = m_unixSocket;
+		recipientAddress = reinterpret_cast<const sockaddr*>(&m_unixPeers.address(unixPeer));
+		addressSize      = m_unixPeers.addressSize(unixPeer);
+	}
+
+	if (socket == INVALID_SOCKET)
+	{
+		COMMS_LOG_ERROR(Server) << "Invalid socket. Cannot send message.";
+		return false;
+	}
+
+	int sendResult = sendto(socket, static_cast<const char*>(data),
+		static_cast<int>(size), 0, recipientAddress, addressSize);
+	m_counters.sendCalls.add();
+
+#ifndef _WIN32
+
+	// a pending ICMP error caused by an earlier datagram is reported by
+	// the next send. It is handled through the error queue, so try again.
+	if (sendResult < 0 && errno == ECONNREFUSED && unixPeer < 0)
+	{
+		sendResult = sendto(socket, static_cast<const char*>(data),
+			static_cast<int>(size), 0, recipientAddress, addressSize);
+		m_counters.sendCalls.add();
+	}
+
+#endif // _WIN32
+
+	if (sendResult < 0)
+	{
+		COMMS_LOG_ERROR(Server) << "Error at sendto() (" << WSAGetLastError() << "). Message not sent.";
+		return false;
+	}
+
+	m_counters.datagramsSent.add();
+	m_counters.bytesSent.add(size);
+	return true;
+}
+
+ReceiveStatus Server::receive(MessageView& message, uint32_t& ipAddress, uint16_t& port)
+{
+	ipAddress = INADDR_ANY;
+	port      = 0;
+
+	while (!m_datagramReader.next(message))
+	{
+		if (m_datagramReader.malformed())
+		{
+			// skip the rest of the datagram
+			m_datagramReader.reset(nullptr, 0);
+			COMMS_LOG_LIMITED(cl::LogLevel::Warning, Server) << "Received undersized datagram.";
+
+			ClientCounters* counters = senderCounters();
+			if (counters != nullptr)
+				counters->malformedDatagrams.add();
+			m_counters.undersizedDatagrams.add();
+
+			return ReceiveStatus::Undersized;
+		}
+
+		ReceiveStatus datagramStatus = receiveDatagram();
+		if (datagramStatus != ReceiveStatus::Success)
+		{
+			if (datagramStatus == ReceiveStatus::Oversized || datagramStatus == ReceiveStatus::ConnReset)
+			{
+				ipAddress = m_datagramSender.sin_addr.s_addr;
+				port      = m_datagramSender.sin_port;
+			}
+			if (datagramStatus == ReceiveStatus::Oversized)
+			{
+				ClientCounters* counters = senderCounters();
+				if (counters != nullptr)
+					counters->malformedDatagrams.add();
+				m_counters.oversizedDatagrams.add();
+			}
+			return datagramStatus;
+		}
+	}
+
+	// SUCCESS, proceed to filling in information
+	ipAddress = m_datagramSender.sin_addr.s_addr; // we'll keep the windows formatting (no ntohl, etc.)
+	port      = m_datagramSender.sin_port;
+
+	return ReceiveStatus::Success;
+}
+
+ReceiveStatus Server::receiveDatagram()
+{
+	m_datagramReader.reset(nullptr, 0);
+
+	// the last datagram of a channel was read in place
+	if (m_shmReading >= 0)
+	{
+		m_shmChannels[m_shmReading].release();
+		m_shmReading = -1;
+	}
+
+	// so was the last datagram of a shard or of the host of the room
+	if (m_recordReading != nullptr)
+	{
+		m_recordReading->pop();
+		m_recordReading = nullptr;
+	}
+
+	if (m_socket == INVALID_SOCKET)
+	{
+		COMMS_LOG_ERROR(Server) << "Invalid socket. Cannot receive message.";
+		return ReceiveStatus::Error;
+	}
+
+	// the host of a room reads the socket for it
+	if (m_host != nullptr)
+		return receiveRecord(*m_inbox);
+
+#ifdef _WIN32
+
+	ZeroMemory(&m_datagramSender, sizeof(sockaddr_in));
+	m_datagramSender.sin_addr.s_addr = htonl(INADDR_ANY);
+	m_datagramSender.sin_family      = AF_INET;
+	m_datagramSender.sin_port        = 0;
+
+	socklen_t addressSize = static_cast<socklen_t>(sizeof(sockaddr_in));
+	int sizeReceived = recvfrom(m_socket, reinterpret_cast<char*>(m_receiveBuffers.get()),
+		MAX_DATAGRAM_SIZE, 0, reinterpret_cast<sockaddr*>(&m_datagramSender), &addressSize);
+	m_counters.receiveCalls.add();
 	
 	if (sizeReceived == 0)
 	{
 		return ReceiveStatus::NoData;
 	}
-	else if (sizeReceived < 0)
+	else if (sizeReceived < 0)
+	{
+		int errorCode = WSAGetLastError();
+		if (errorCode == WSAEWOULDBLOCK)
+		{
+			// no data to be read
+			return ReceiveStatus::NoData;
+		}
+		else if (errorCode == WSAEMSGSIZE)
+		{
+			COMMS_LOG_LIMITED(cl::LogLevel::Warning, Server) << "Oversized datagram received. Data truncated or ignored.";
+			// too much data. Datagram truncated
+			return ReceiveStatus::Oversized;
+		}
+		else if (errorCode == WSAECONNRESET)
+		{
+			// there was an error when sending a packet to a client.
+			//COMMS_LOG_WARNING(Server) << "Warning: WSACONNRESET. Disconnecting client.";
+			handleConnectionReset(m_datagramSender.sin_addr.s_addr, m_datagramSender.sin_port);
+			return ReceiveStatus::ConnReset;
+		}
+		COMMS_LOG_ERROR(Server) << "recvfrom() failed with error: " << errorCode << ".";
+		return ReceiveStatus::Error;
+	}
+
+	m_counters.datagramsReceived.add();
+	const uint8_t* datagram = m_receiveBuffers.get();
+
+#else
+
+	const mmsghdr* header;
+	const uint8_t* datagram;
+
+	while (true)
+	{
+		if (m_receiveIndex == m_receiveCount)
+		{
+			// the channels and the shards are read once the sockets are empty
+			ReceiveStatus batchStatus = receiveBatch();
+			if (batchStatus == ReceiveStatus::NoData)
+				return receiveShmDatagram() ? ReceiveStatus::Success : receiveShardDatagram();
+			if (batchStatus != ReceiveStatus::Success)
+				return batchStatus;
+		}
+
+		header   = m_receiveUnix ? &m_unixHeaders[m_receiveIndex] : &m_receiveHeaders[m_receiveIndex];
+		datagram = m_receiveBuffers.get() + m_receiveIndex * MAX_DATAGRAM_SIZE;
+		m_receiveIndex++;
+
+		if (!m_receiveUnix)
+		{
+			m_datagramSender = m_receiveAddresses[m_receiveIndex - 1];
+			break;
+		}
+
+		// the sender is told apart from UDP clients by an address no datagram comes from
+		int slot = unixSlot(m_unixAddresses[m_receiveIndex - 1], header->msg_hdr.msg_namelen);
+		if (slot >= 0)
+		{
+			ZeroMemory(&m_datagramSender, sizeof(sockaddr_in));
+			m_datagramSender.sin_family      = AF_INET;
+			m_datagramSender.sin_addr.s_addr = UNIX_CLIENT_ADDRESS;
+			m_datagramSender.sin_port        = htons(static_cast<uint16_t>(slot + 1));
+			break;
+		}
+
+		COMMS_LOG_LIMITED(cl::LogLevel::Warning, Server) << "Received datagram from an unbound Unix socket or with no slot left. Skipping.";
+	}
+
+	if (header->msg_hdr.msg_flags & MSG_TRUNC)
+	{
+		COMMS_LOG_LIMITED(cl::LogLevel::Warning, Server) << "Received oversized datagram.";
+		return ReceiveStatus::Oversized;
+	}
+
+	int sizeReceived = static_cast<int>(header->msg_len);
+
+
+#endif // _WIN32
+
+	m_counters.bytesReceived.add(sizeReceived);
+
+	ClientCounters* counters = senderCounters();
+	if (counters != nullptr)
+	{
+		counters->datagramsReceived.add();
+		counters->bytesReceived.add(sizeReceived);
+	}
+
+	// the size tells the format. Invalid compact datagrams are reported by receive()
+	m_datagramReader.reset(datagram, static_cast<std::size_t>(sizeReceived));
+	return ReceiveStatus::Success;
+}
+
+#ifndef _WIN32
+
+ReceiveStatus Server::receiveBatch()
+{
+	m_receiveCount = 0;
+	m_receiveIndex = 0;
+
+	// the datagrams of m_socket are already in the buffers of the ring
+	if (m_ring.isOpen())
+	{
+		m_receiveUnix = false;
+
+		ReceiveStatus ringStatus = receiveRingBatch();
+		if (ringStatus != ReceiveStatus::NoData)
+			return ringStatus;
+	}
+
+	// a partial batch means the socket was emptied. epoll reports it
+	// again for new data, so skip the system call that would fail.
+	while (m_socketReadable || m_unixSocketReadable)
+	{
+		m_receiveUnix = !m_socketReadable;
+
+		SOCKET   socket   = m_receiveUnix ? m_unixSocket : m_socket;
+		mmsghdr* headers  = m_receiveUnix ? m_unixHeaders : m_receiveHeaders;
+		bool&    readable = m_receiveUnix ? m_unixSocketReadable : m_socketReadable;
+
+		for (unsigned int i = 0; i < RECEIVE_BATCH_SIZE; i++)
+			headers[i].msg_hdr.msg_namelen = m_receiveUnix ? sizeof(sockaddr_un) : sizeof(sockaddr_in);
+
+		int count = recvmmsg(socket, headers, RECEIVE_BATCH_SIZE, MSG_DONTWAIT, nullptr);
+		m_counters.receiveCalls.add();
+
+		if (count < 0)
+		{
+			int errorCode = errno;
+			if (errorCode == EWOULDBLOCK || errorCode == EINTR)
+			{
+				// no data to be read
+				readable = false;
+				continue;
+			}
+			else if (errorCode == ECONNREFUSED)
+			{
+				// there was an error when sending a packet to a client.
+				// The address of the unreachable client is only available in the error queue
+				handleErrorQueue();
+				return ReceiveStatus::ConnReset;
+			}
+			COMMS_LOG_ERROR(Server) << "recvmmsg() failed with error: " << errorCode << ".";
+			return ReceiveStatus::Error;
+		}
+
+		m_counters.datagramsReceived.add(count);
+		m_receiveCount = static_cast<unsigned int>(count);
+		readable       = count == RECEIVE_BATCH_SIZE;
+
+		if (count > 0)
+			return ReceiveStatus::Success;
+	}
+
+	return ReceiveStatus::NoData;
+}
+
+bool Server::openRing()
+{
+	if (!m_ring.open(RING_ENTRIES, RING_BUFFER_COUNT, RING_BUFFER_SIZE))
+		return false;
+
+	// only the room for the sender matters, the data is received in the buffers of the ring
+	ZeroMemory(&m_ringHeader, sizeof(msghdr));
+	m_ringHeader.msg_namelen = sizeof(sockaddr_in);
+
+	m_ringReceived.reserve(RING_BUFFER_COUNT);
+	m_ring.receive(m_socket, &m_ringHeader, RING_RECEIVE);
+	m_ring.poll(m_epoll, RING_POLL);
+
+	if (m_ring.submit(0, 0) < 0 || epoll_ctl(m_epoll, EPOLL_CTL_DEL, m_socket, nullptr) == -1)
+	{
+		COMMS_LOG_ERROR(Server) << "Could not arm io_uring (" << errno << ").";
+		m_ring.close();
+		return false;
+	}
+
+	return true;
+}
+
+bool Server::waitForCompletions(int timeout)
+{
+	reapCompletions();
+
+	// the datagrams already received are handled first
+	if (!m_ringReceived.empty() || m_ringEpollReadable)
+		timeout = 0;
+
+	// nothing to submit and nothing to wait for
+	if (timeout == 0 && m_ring.queued() == 0)
+		return true;
+
+	int result = m_ring.submit(timeout == 0 ? 0 : 1, timeout);
+	m_counters.waitCalls.add();
+
+	if (result < 0 && errno != ETIME && errno != EINTR && errno != EBUSY && errno != EAGAIN)
+	{
+		COMMS_LOG_ERROR(Server) << "Error at io_uring_enter() (" << errno << "). Stopping server.";
+		return false;
+	}
+
+	reapCompletions();
+	return true;
+}
+
+void Server::reapCompletions()
+{
+	IoCompletion completion;
+	while (m_ring.complete(completion))
+	{
+		if (completion.tag == RING_RECEIVE)
+		{
+			m_ringReceived.push_back(completion);
+			continue;
+		}
+
+		if (completion.tag == RING_POLL)
+		{
+			if (completion.result > 0)
+				m_ringEpollReadable = true;
+			if (!completion.more)
+				m_ring.poll(m_epoll, RING_POLL);
+			continue;
+		}
+
+		std::size_t index = static_cast<std::size_t>(completion.tag - RING_SEND);
+		m_ringSendsPending--;
+
+		if (completion.result == -ECONNREFUSED)
+		{
+			m_ringRetries.push_back(index);
+			continue;
+		}
+
+		const SendDatagram& datagram = m_sendDatagrams[index];
+		if (completion.result < 0 && ServerShard::transientSendError(-completion.result))
+		{
+			countDropped(datagram.recipient);
+			continue;
+		}
+
+		if (completion.result < 0)
+		{
+			COMMS_LOG_ERROR(Server) << "Error at sendmsg() (" << -completion.result << "). Message not sent.";
+			handleSendError(datagram.recipient);
+			continue;
+		}
+
+		countSent(datagram);
+	}
+}
+
+ReceiveStatus Server::receiveRingBatch()
+{
+	reapCompletions();
+
+	ReceiveStatus status   = ReceiveStatus::NoData;
+	std::size_t   consumed = 0;
+
+	while (consumed < m_ringReceived.size() && m_receiveCount < RECEIVE_BATCH_SIZE && status == ReceiveStatus::NoData)
 	{
-		int errorCode = WSAGetLastError();
-		if (errorCode == WSAEWOULDBLOCK)
+		const IoCompletion& completion = m_ringReceived[consumed];
+		IoDatagram          datagram;
+
+		if (m_ring.datagram(completion, m_ringHeader, datagram))
 		{
-			// no data to be read
-			return ReceiveStatus::NoData;
+			unsigned int i = m_receiveCount++;
+			std::memcpy(&m_receiveAddresses[i], datagram.name, datagram.nameSize);
+			std::memcpy(m_receiveBuffers.get() + i * MAX_DATAGRAM_SIZE, datagram.data, datagram.size);
+			m_receiveHeaders[i].msg_len           = static_cast<unsigned int>(datagram.size);
+			m_receiveHeaders[i].msg_hdr.msg_flags = datagram.truncated ? MSG_TRUNC : 0;
 		}
-		else if (errorCode == WSAEMSGSIZE)
+		else if (completion.result < 0 && completion.result != -ENOBUFS && m_receiveCount > 0)
 		{
-			std::cout << "[COMMS SERVER] Warning: oversized datagram received. Data truncated or ignored." << std::endl;
-			// too much data. Datagram truncated
-			ipAddress = senderAddress.sin_addr.s_addr; // we'll keep the windows formatting (no ntohl, etc.)
-			port      = senderAddress.sin_port;
-			return ReceiveStatus::Oversized;
+			// the error is reported once the datagrams before it are handled
+			break;
 		}
-		else if (errorCode == WSAECONNRESET)
+		else if (completion.result == -ECONNREFUSED)
 		{
 			// there was an error when sending a packet to a client.
-			ipAddress = senderAddress.sin_addr.s_addr;
-			port      = senderAddress.sin_port;
-			//std::cout << "[COMMS SERVER] Warning: WSACONNRESET. Disconnecting client." << std::endl;
-			for (int i = 0; i < m_clients.size(); i++)
+			// The address of the unreachable client is only available in the error queue
+			handleErrorQueue();
+			status = ReceiveStatus::ConnReset;
+		}
+		else if (completion.result != -ENOBUFS)
+		{
+			COMMS_LOG_ERROR(Server) << "Multishot recvmsg() failed with error: " << -completion.result << ".";
+			status = ReceiveStatus::Error;
+		}
+
+		m_ring.recycle(completion.buffer);
+
+		// the kernel ends a multishot receive on errors, and once it runs out of buffers
+		if (!completion.more && !m_ring.receive(m_socket, &m_ringHeader, RING_RECEIVE))
+		{
+			COMMS_LOG_ERROR(Server) << "io_uring is full. Cannot receive message.";
+			status = ReceiveStatus::Error;
+		}
+
+		consumed++;
+	}
+
+	m_ringReceived.erase(m_ringReceived.begin(), m_ringReceived.begin() + consumed);
+
+	if (m_receiveCount == 0)
+		return status;
+
+	m_counters.datagramsReceived.add(m_receiveCount);
+	return ReceiveStatus::Success;
+}
+
+#endif // _WIN32
+
+bool Server::receiveShmDatagram()
+{
+	if (!m_shmListener.isOpen())
+		return false;
+
+	for (unsigned int i = 0; i < MAX_CLIENTS; i++)
+	{
+		unsigned int slot    = (m_shmNext + i) % MAX_CLIENTS;
+		ShmChannel&  channel = m_shmChannels[slot];
+		if (!channel.isOpen())
+			continue;
+
+		std::size_t    size;
+		const uint8_t* datagram = channel.receive(size);
+		if (datagram == nullptr)
+		{
+			if (channel.isCorrupted() && !m_shmHangups[slot])
 			{
-				if (m_clients[i].port == port)
-				{
-					disconnectClient(i);
-
-					Message disconnectMessage;
-					disconnectMessage.playerIDAndTeam = m_clients[i].idAndTeam;
-					disconnectMessage.key             = DEFAULT_KEY;
-					disconnectMessage.type            = MSG_DISCONNECT;
-					disconnectMessage.parameters      = MSG_ALL;
-					disconnectMessage.data[0]         = MSG_DISCONNECT_SRC_SERVER;
-
-					m_messageBuffer.push(disconnectMessage);
-
-					// We only disconnect the first client in the list because
-					// it is sorted by join time (from first to last) meaning
-					// that if a client were to incorectly disconnect and then
-					// reconnect later, we only delete the old invalid client.
-					break;
-				}
+				COMMS_LOG_WARNING(Server) << "Invalid data in shared memory channel " << slot << ". Closing it.";
+				m_shmHangups[slot] = true;
 			}
-			return ReceiveStatus::ConnReset;
+			continue;
 		}
-		std::cout << "[COMMS SERVER] recvfrom() failed with error: " << errorCode << "." << std::endl;
-		return ReceiveStatus::Error;
+
+		m_shmReading = static_cast<int>(slot);
+		m_shmNext    = slot + 1;
+
+		// the sender is told apart from UDP clients by an address no datagram comes from
+		ZeroMemory(&m_datagramSender, sizeof(sockaddr_in));
+		m_datagramSender.sin_family      = AF_INET;
+		m_datagramSender.sin_addr.s_addr = SHM_CLIENT_ADDRESS;
+		m_datagramSender.sin_port        = htons(static_cast<uint16_t>(slot + 1));
+
+		m_counters.datagramsReceived.add();
+		m_counters.bytesReceived.add(size);
+
+		ClientCounters* counters = senderCounters();
+		if (counters != nullptr)
+		{
+			counters->datagramsReceived.add();
+			counters->bytesReceived.add(size);
+		}
+
+		m_datagramReader.reset(datagram, size);
+		return true;
 	}
-	else if (sizeReceived > static_cast<int>(sizeof(Message)))
+
+	return false;
+}
+
+ReceiveStatus Server::receiveShardDatagram()
+{
+	for (std::size_t i = 0; i < m_shardCount; i++)
 	{
-		std::cout << "[COMMS SERVER] Received oversized datagram." << std::endl;
-		return ReceiveStatus::Oversized;
+		std::size_t   index  = (m_shardNext + i) % m_shardCount;
+		ReceiveStatus status = receiveRecord(m_shards[index].records());
+
+		if (status != ReceiveStatus::NoData)
+		{
+			m_shardNext = index + 1;
+			return status;
+		}
 	}
-	else if (sizeReceived < static_cast<int>(sizeof(Message)))
+
+	return ReceiveStatus::NoData;
+}
+
+ReceiveStatus Server::receiveRecord(RecordRing& records)
+{
+	ShardRecord    record;
+	std::size_t    size;
+	const uint8_t* datagram;
+
+	while ((datagram = records.front(record, size)) != nullptr)
 	{
-		std::cout << "[COMMS SERVER] Received undersized datagram." << std::endl;
-		return ReceiveStatus::Undersized;
+		// the client is unreachable, as reported by the error queue of the socket
+		if (record.flags & SHARD_UNREACHABLE)
+		{
+			handleConnectionReset(record.sender.sin_addr.s_addr, record.sender.sin_port);
+			records.pop();
+			continue;
+		}
+
+		m_recordReading  = &records;
+		m_datagramSender = record.sender;
+
+		m_counters.datagramsReceived.add();
+
+		if (record.flags & SHARD_TRUNCATED)
+		{
+			COMMS_LOG_LIMITED(cl::LogLevel::Warning, Server) << "Received oversized datagram.";
+			return ReceiveStatus::Oversized;
+		}
+
+		m_counters.bytesReceived.add(size);
+
+		ClientCounters* counters = senderCounters();
+		if (counters != nullptr)
+		{
+			counters->datagramsReceived.add();
+			counters->bytesReceived.add(size);
+		}
+
+		m_datagramReader.reset(datagram, size);
+		return ReceiveStatus::Success;
 	}
 
-	// SUCCESS, proceed to filling in information
-	// Message was already filled in recvfrom()
-	ipAddress = senderAddress.sin_addr.s_addr; // we'll keep the windows formatting (no ntohl, etc.)
-	port      = senderAddress.sin_port;
+	return ReceiveStatus::NoData;
+}
+
+void Server::acceptShmChannels()
+{
+#ifndef _WIN32
+
+	int connection;
+	while ((connection = m_shmListener.accept()) != -1)
+	{
+		unsigned int slot = 0;
+		while (slot < MAX_CLIENTS && m_shmChannels[slot].isOpen())
+			slot++;
+
+		// the client falls back to UDP
+		if (slot == MAX_CLIENTS)
+		{
+			COMMS_LOG_WARNING(Server) << "No shared memory channel left.";
+			::close(connection);
+			continue;
+		}
+
+		if (!m_shmChannels[slot].create(connection, m_shmListener.doorbell()))
+			continue;
+
+		epoll_event connectionEvent;
+		connectionEvent.events  = EPOLLIN | EPOLLRDHUP;
+		connectionEvent.data.fd = connection;
+		if (epoll_ctl(m_epoll, EPOLL_CTL_ADD, connection, &connectionEvent) == -1)
+		{
+			COMMS_LOG_ERROR(Server) << "Error at epoll_ctl() (" << errno << "). Shared memory channel closed.";
+			m_shmChannels[slot].close();
+			continue;
+		}
+
+		COMMS_LOG_DEBUG(Server) << "Opened shared memory channel " << slot << ".";
+	}
 
 #endif // _WIN32
-	
-	return ReceiveStatus::Success;
 }
 
-Message Server::handleMessage(const Message& receivedMessage, const uint32_t& senderAddress, const uint16_t& senderPort)
+void Server::closeShmChannel(unsigned int slot)
+{
+	m_shmHangups[slot] = false;
+
+	// a client that closed properly is already disconnected
+	handleConnectionReset(SHM_CLIENT_ADDRESS, htons(static_cast<uint16_t>(slot + 1)));
+
+	m_shmChannels[slot].close();
+	if (m_shmReading == static_cast<int>(slot))
+		m_shmReading = -1;
+
+	COMMS_LOG_DEBUG(Server) << "Closed shared memory channel " << slot << ".";
+}
+
+int Server::shmSlot(const ClientInfo& client) const
+{
+	unsigned int slot = ntohs(client.port) - 1u;
+	return client.address == SHM_CLIENT_ADDRESS && slot < MAX_CLIENTS ? static_cast<int>(slot) : -1;
+}
+
+int Server::unixSlot(const sockaddr_un& address, socklen_t size)
+{
+	// an unbound socket has no endpoint to answer to
+	if (size <= offsetof(sockaddr_un, sun_path) || size > sizeof(sockaddr_un))
+		return -1;
+
+	int slot = m_unixPeers.find(address, size);
+	if (slot >= 0)
+		return slot;
+
+	for (unsigned int i = 0; i < MAX_CLIENTS; i++)
+	{
+		if (m_clients.find(UNIX_CLIENT_ADDRESS, htons(static_cast<uint16_t>(i + 1))) < 0)
+			m_unixPeers.release(i);
+	}
+
+	return m_unixPeers.find(address, size);
+}
+
+int Server::unixSlot(const ClientInfo& client) const
+{
+	unsigned int slot = ntohs(client.port) - 1u;
+	if (client.address != UNIX_CLIENT_ADDRESS || slot >= MAX_CLIENTS || !m_unixPeers.used(slot))
+		return -1;
+
+	return static_cast<int>(slot);
+}
+
+void Server::handleMessage(const MessageView& receivedMessage, const uint32_t& senderAddress, const uint16_t& senderPort)
 {
-	Message t_message = receivedMessage;
+	MessageView t_message = receivedMessage;
+	Message     generatedMessage;
+
+	// only a connection request may come from an unknown sender. The others are
+	// not relayed, the answer tells a client dropped without knowing it to connect again.
+	if (receivedMessage.type != MSG_CONNECT && m_clients.find(senderAddress, senderPort) < 0)
+	{
+		COMMS_LOG_LIMITED(cl::LogLevel::Warning, Server) << "Message of type: " << (int)receivedMessage.type << " from a client that is not connected. Ignoring.";
+
+		ClientInfo sender;
+		sender.address   = senderAddress;
+		sender.port      = senderPort;
+		sender.idAndTeam = receivedMessage.playerIDAndTeam;
+		sender.key       = receivedMessage.key;
+
+		sender.socketAddress.sin_family      = AF_INET;
+		sender.socketAddress.sin_addr.s_addr = senderAddress;
+		sender.socketAddress.sin_port        = senderPort;
+
+		sendErrorMessage(sender, MSG_ERR_NOT_CON);
+		return;
+	}
 
 	if (receivedMessage.type == MSG_CONNECT)
 	{
-		t_message = handleConnectionMessage(receivedMessage, senderAddress, senderPort);
+		// the answer has no payload, except the recipient when it is only sent to the client again
+		generatedMessage = handleConnectionMessage(receivedMessage, senderAddress, senderPort);
+		t_message        = MessageView(generatedMessage, (generatedMessage.parameters & MSG_ALL) ? 0 : 1);
 	}
 	else if (receivedMessage.type == MSG_DISCONNECT)
 	{
-		for (int i = 0; i < m_clients.size(); i++)
+		int clientIndex = m_clients.find(receivedMessage.playerIDAndTeam);
+		if (clientIndex >= 0)
 		{
-			if (m_clients[i].idAndTeam == receivedMessage.playerIDAndTeam)
-			{
-				disconnectClient(i);
+			disconnectClient(clientIndex);
 
-				t_message.parameters |= MSG_ALL;
-				t_message.data[0]    =  MSG_DISCONNECT_SRC_CLIENT;
-			}
+			generatedMessage = receivedMessage.toMessage();
+			generatedMessage.parameters |= MSG_ALL;
+			generatedMessage.data[0]    =  MSG_DISCONNECT_SRC_CLIENT;
+			t_message = MessageView(generatedMessage, 1);
 		}
 	}
+	else if (receivedMessage.type == MSG_DELTA_ACK)
+	{
+		handleDeltaAck(receivedMessage, senderAddress, senderPort);
+		return;
+	}
+	else if (receivedMessage.type == MSG_ACK)
+	{
+		handleAck(receivedMessage, senderAddress, senderPort);
+		return;
+	}
+	else if (receivedMessage.type == MSG_PING)
+	{
+		handlePing(receivedMessage, senderAddress, senderPort);
+		return;
+	}
+	else if (receivedMessage.type == MSG_HEARTBEAT)
+	{
+		// receiving it was all that mattered
+		return;
+	}
+	else if (receivedMessage.parameters & MSG_RELIABLE)
+	{
+		handleReliableMessage(receivedMessage, senderAddress, senderPort);
+		return;
+	}
+	else if (receivedMessage.parameters & MSG_DELTA)
+	{
+		handleDeltaMessage(receivedMessage, senderAddress, senderPort);
+		return;
+	}
 	else
 	{
-		std::cout << "[COMMS SERVER] Message of type: " << (int)receivedMessage.type << "not handled." << std::endl;
+		COMMS_LOG_LIMITED(cl::LogLevel::Warning, Server) << "Message of type: " << (int)receivedMessage.type << " not handled.";
 	}
 
 	t_message.key = DEFAULT_KEY;
-	return t_message;
+	if (t_message.type != MSG_INVALID)
+		m_messageBuffer.push(t_message);
 }
 
-Message Server::handleConnectionMessage(const Message& connectionMessage, const uint32_t& senderAddress, const uint16_t& senderPort)
+Message Server::handleConnectionMessage(const MessageView& connectionMessage, const uint32_t& senderAddress, const uint16_t& senderPort)
 {
-	std::cout << "[COMMS SERVER] Received connection message!" << std::endl;
+	COMMS_LOG_INFO(Server) << "Received connection message!";
 
 	Message outputMessage;
 	outputMessage.type = MSG_INVALID;
@@ -443,9 +2672,18 @@ Message Server::handleConnectionMessage(const Message& connectionMessage, const
 	newClient.port      = senderPort;
 	newClient.idAndTeam = connectionMessage.playerIDAndTeam;
 
-	if (m_clients.size() >= 128)
+	// the server supports every capability, the answer tells the client
+	newClient.capabilities = connectionMessage.parameters & MSG_CAP_ALL;
+	if (!(newClient.capabilities & MSG_CAP_COMPACT))
+		newClient.capabilities &= ~(MSG_CAP_DELTA | MSG_CAP_RELIABLE);
+
+	newClient.socketAddress.sin_family      = AF_INET;
+	newClient.socketAddress.sin_addr.s_addr = senderAddress;
+	newClient.socketAddress.sin_port        = senderPort;
+
+	if (m_clients.full())
 	{
-		std::cout << "[COMMS SERVER] Too many clients already connected. Ignoring connection request." << std::endl;
+		COMMS_LOG_LIMITED(cl::LogLevel::Warning, Server) << "Too many clients already connected. Ignoring connection request.";
 
 		sendErrorMessage(newClient, MSG_ERR_TOO_MANY);
 
@@ -453,58 +2691,282 @@ Message Server::handleConnectionMessage(const Message& connectionMessage, const
 	}
 	if (connectionMessage.key != DEFAULT_KEY)
 	{
-		std::cout << "[COMMS SERVER] Received invalid connection message. Ignoring connection request." << std::endl;
+		COMMS_LOG_LIMITED(cl::LogLevel::Warning, Server) << "Received invalid connection message. Ignoring connection request.";
 
 		sendErrorMessage(newClient, MSG_ERR_INVALID_CON);
 
 		return outputMessage;
 	}
 
-	for (int i = 0; i < m_clients.size(); i++)
+	int clientIndex = m_clients.find(newClient.idAndTeam);
+	if (clientIndex >= 0 && m_clients[clientIndex].address == senderAddress && m_clients[clientIndex].port == senderPort)
 	{
-		// no need to check for port/address, as we can't bind two UDP sockets to the same port on the same machine
-
-		if (m_clients[i].idAndTeam == newClient.idAndTeam)
-		{
-			std::cout << "[COMMS SERVER] Received connection packet form already connect client with id: " << (m_clients[i].idAndTeam >> 1) << "." << std::endl;
-
-			sendErrorMessage(newClient, MSG_ERR_ALREADY_CON);
+		// the answer was lost or is late, answer again to this client only
+		COMMS_LOG_LIMITED(cl::LogLevel::Warning, Server) << "Received connection packet again from client with id: " << (newClient.idAndTeam >> 1) << ".";
 
-			return outputMessage;
-		}
+		outputMessage.playerIDAndTeam = newClient.idAndTeam;
+		outputMessage.type            = MSG_CONNECT;
+		outputMessage.parameters      = MSG_PRIVATE | m_clients[clientIndex].capabilities;
+		outputMessage.data[0]         = newClient.idAndTeam;
 
-		if (m_clients[i].address == newClient.address && m_clients[i].port == newClient.port)
-		{
-			// the client was not disconnected properly and reconnected later
-			// we remove the old one because it is invalid (we can only bind
-			// one UDP socket to the same port on the same machine)
-			disconnectClient(i);
+		return outputMessage;
+	}
+	if (clientIndex >= 0)
+	{
+		COMMS_LOG_LIMITED(cl::LogLevel::Warning, Server) << "Received connection packet form already connect client with id: " << (m_clients[clientIndex].idAndTeam >> 1) << ".";
 
-			Message disconnectMessage;
-			disconnectMessage.playerIDAndTeam = m_clients[i].idAndTeam;
-			disconnectMessage.key             = DEFAULT_KEY;
-			disconnectMessage.type            = MSG_DISCONNECT;
-			disconnectMessage.parameters      = MSG_ALL;
-			disconnectMessage.data[0]         = MSG_DISCONNECT_SRC_SERVER;
+		sendErrorMessage(newClient, MSG_ERR_ALREADY_CON);
 
-			m_messageBuffer.push(disconnectMessage);
-		}
+		return outputMessage;
 	}
 
+	// the client was not disconnected properly and reconnected later
+	// we remove the old one because it is invalid (we can only bind
+	// one UDP socket to the same port on the same machine)
+	handleConnectionReset(newClient.address, newClient.port);
+
 	// SETUP CLIENT
 
 	// generate new key
-	newClient.key = generateKey(reinterpret_cast<uint8_t const*>(&connectionMessage));
+	// a connection message is always a fixed Message, but make sure all 64 bytes are there
+	Message fixedMessage = connectionMessage.toMessage();
+	newClient.key = generateKey(reinterpret_cast<uint8_t const*>(&fixedMessage));
+
+	newClient.lastMessageTime = std::chrono::steady_clock::now();
+
+	resetDeltaStreams(newClient.idAndTeam);
+	m_reliableEndpoints.erase(newClient.idAndTeam);
 
-	m_clients.push_back(newClient);
+	// the pings stopped with the last client
+	if (m_clients.empty() && m_pingInterval.load() > std::chrono::milliseconds::zero())
+		m_timers.schedule(PING_TIMER, std::max(m_lastPingTime + m_pingInterval.load(), newClient.lastMessageTime));
+
+	m_clients.add(newClient);
+	resetClientCounters(newClient);
+
+	if (m_host != nullptr)
+		m_host->route(newClient.address, newClient.port, m_roomSlot);
+
+	// legacy clients announce no capability and never answer pings nor send heartbeats
+	if (m_clientTimeout.load() > std::chrono::milliseconds::zero() && newClient.capabilities != 0x00)
+		m_timers.schedule(TIMEOUT_TIMER(newClient.idAndTeam), newClient.lastMessageTime + m_clientTimeout.load());
 
 	outputMessage.playerIDAndTeam = newClient.idAndTeam;
 	outputMessage.type            = MSG_CONNECT;
-	outputMessage.parameters      |= MSG_ALL;
+	outputMessage.parameters      |= MSG_ALL | newClient.capabilities;
 	
 	return outputMessage;
 }
 
+void Server::handleConnectionReset(uint32_t address, uint16_t port)
+{
+	// only one client can be bound to an address and port, released
+	// clients that used it before can't be found anymore
+	int clientIndex = m_clients.find(address, port);
+	if (clientIndex < 0)
+		return;
+
+	disconnectClient(clientIndex);
+
+	Message disconnectMessage;
+	disconnectMessage.playerIDAndTeam = m_clients[clientIndex].idAndTeam;
+	disconnectMessage.key             = DEFAULT_KEY;
+	disconnectMessage.type            = MSG_DISCONNECT;
+	disconnectMessage.parameters      = MSG_ALL;
+	disconnectMessage.data[0]         = MSG_DISCONNECT_SRC_SERVER;
+
+	m_messageBuffer.push(MessageView(disconnectMessage, 1));
+}
+
+void Server::handleDeltaMessage(const MessageView& message, const uint32_t& senderAddress, const uint16_t& senderPort)
+{
+	int clientIndex = m_clients.find(senderAddress, senderPort);
+	if (clientIndex < 0 || !(m_clients[clientIndex].capabilities & MSG_CAP_DELTA))
+	{
+		// older clients may set the bit by accident, relay the message as is
+		MessageView plainMessage = message;
+		plainMessage.key         =  DEFAULT_KEY;
+		plainMessage.parameters  &= ~MSG_DELTA;
+		m_messageBuffer.push(plainMessage);
+		return;
+	}
+
+	uint8_t      source = m_clients[clientIndex].idAndTeam;
+	DeltaStream& stream = m_deltaStreams[deltaStreamKey(source, message.type)];
+
+	// keep room for the sequence number before the snapshot
+	uint16_t size;
+	uint16_t sequence;
+	if (!decodeDelta(message.data, message.size, stream.history, m_deltaSnapshot + 2, size, sequence))
+	{
+		// the baseline may have been dropped, the next acknowledgement will fix it
+		COMMS_LOG_LIMITED(cl::LogLevel::Warning, Server) << "Could not decode delta-encoded message of type: " << (int)message.type << ".";
+		return;
+	}
+
+	stream.history.store(sequence, m_deltaSnapshot + 2, size);
+	stream.latestSequence = sequence;
+	stream.ackPending     = true;
+
+	m_deltaSnapshot[0] = static_cast<uint8_t>(sequence >> 8);
+	m_deltaSnapshot[1] = static_cast<uint8_t>(sequence & 0xFF);
+
+	MessageView snapshot     = message;
+	snapshot.playerIDAndTeam = source;
+	snapshot.key             = DEFAULT_KEY;
+	snapshot.data            = m_deltaSnapshot;
+	snapshot.size            = size + 2;
+	m_messageBuffer.push(snapshot);
+}
+
+void Server::handleDeltaAck(const MessageView& message, const uint32_t& senderAddress, const uint16_t& senderPort)
+{
+	int clientIndex = m_clients.find(senderAddress, senderPort);
+	if (clientIndex < 0)
+		return;
+
+	uint8_t recipient = m_clients[clientIndex].idAndTeam;
+
+	for (std::size_t offset = 0; offset + DELTA_ACK_SIZE <= message.size; offset += DELTA_ACK_SIZE)
+	{
+		uint8_t  source;
+		uint8_t  type;
+		uint16_t sequence;
+		decodeDeltaAck(message.data + offset, source, type, sequence);
+
+		auto stream = m_deltaStreams.find(deltaStreamKey(source, type));
+		if (stream == m_deltaStreams.end())
+			continue;
+
+		// acknowledgements may arrive out of order
+		DeltaStream& deltaStream = stream->second;
+		if (!deltaStream.acked[recipient] || static_cast<int16_t>(sequence - deltaStream.ackedSequence[recipient]) > 0)
+		{
+			deltaStream.acked[recipient]         = true;
+			deltaStream.ackedSequence[recipient] = sequence;
+		}
+	}
+}
+
+void Server::handleReliableMessage(const MessageView& message, const uint32_t& senderAddress, const uint16_t& senderPort)
+{
+	int clientIndex = m_clients.find(senderAddress, senderPort);
+	if (clientIndex < 0 || !(m_clients[clientIndex].capabilities & MSG_CAP_RELIABLE))
+	{
+		// older clients may set the bit by accident, relay the message as is
+		MessageView plainMessage = message;
+		plainMessage.key         =  DEFAULT_KEY;
+		plainMessage.parameters  &= ~MSG_RELIABLE;
+		m_messageBuffer.push(plainMessage);
+		return;
+	}
+
+	ReliableEndpoint& endpoint = m_reliableEndpoints[m_clients[clientIndex].idAndTeam];
+	ReliableStatus    status   = endpoint.receive(message);
+
+	if (status == ReliableStatus::Malformed)
+	{
+		COMMS_LOG_LIMITED(cl::LogLevel::Warning, Server) << "Received reliable message without a valid header. Ignoring.";
+		return;
+	}
+
+	// the header is kept so the message is sent on the same channel
+	MessageView reliableMessage = message;
+	if (status == ReliableStatus::Deliver)
+	{
+		reliableMessage.key = DEFAULT_KEY;
+		m_messageBuffer.push(reliableMessage);
+	}
+
+	while (endpoint.nextOrdered(reliableMessage))
+	{
+		reliableMessage.key = DEFAULT_KEY;
+		m_messageBuffer.push(reliableMessage);
+	}
+}
+
+void Server::handleAck(const MessageView& message, const uint32_t& senderAddress, const uint16_t& senderPort)
+{
+	int clientIndex = m_clients.find(senderAddress, senderPort);
+	if (clientIndex < 0)
+		return;
+
+	auto endpoint = m_reliableEndpoints.find(m_clients[clientIndex].idAndTeam);
+	if (endpoint == m_reliableEndpoints.end())
+		return;
+
+	std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+	endpoint->second.receiveAcks(message.data, message.size, now);
+
+	// the acknowledged messages made room for the queued ones
+	if (endpoint->second.queuedCount() > 0)
+		m_timers.schedule(RETRANSMIT_TIMER(m_clients[clientIndex].idAndTeam), now);
+}
+
+void Server::handlePing(const MessageView& message, const uint32_t& senderAddress, const uint16_t& senderPort)
+{
+	std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+
+	int clientIndex = m_clients.find(senderAddress, senderPort);
+	if (clientIndex < 0 || message.size < PING_PAYLOAD_SIZE)
+		return;
+
+	// ignore timestamps the server can't have sent
+	std::chrono::steady_clock::time_point sentTime = readTimestamp(message.data);
+	if (sentTime > m_lastPingTime)
+		return;
+
+	std::chrono::steady_clock::duration rtt = now - sentTime;
+
+	ClientInfo& client = m_clients[clientIndex];
+	float sample = std::chrono::duration<float, std::milli>(rtt).count();
+
+	// exponentially weighted moving averages, as in RFC 6298 and RFC 3550
+	if (client.ping < 0.0f)
+	{
+		client.ping   = sample;
+		client.jitter = 0.0f;
+	}
+	else
+	{
+		client.ping   += (sample - client.ping) / 8.0f;
+		client.jitter += (std::abs(sample - client.lastRtt) - client.jitter) / 16.0f;
+	}
+
+	client.lastRtt   = sample;
+	client.isPinging = false;
+
+	m_clientCounters[client.idAndTeam].ping.store(client.ping, std::memory_order_relaxed);
+	m_clientCounters[client.idAndTeam].jitter.store(client.jitter, std::memory_order_relaxed);
+}
+
+void Server::resetDeltaStreams(uint8_t idAndTeam)
+{
+	for (auto stream = m_deltaStreams.begin(); stream != m_deltaStreams.end();)
+	{
+		if ((stream->first >> 8) == idAndTeam)
+		{
+			stream = m_deltaStreams.erase(stream);
+			continue;
+		}
+
+		stream->second.acked[idAndTeam] = false;
+		++stream;
+	}
+}
+
+#ifndef _WIN32
+
+void Server::handleErrorQueue()
+{
+	ServerShard::forEachUnreachable(m_socket, [this](const sockaddr_in& destination)
+	{
+		handleConnectionReset(destination.sin_addr.s_addr, destination.sin_port);
+	});
+}
+
+#endif // _WIN32
+
 bool Server::sendErrorMessage(const ClientInfo& recipient, uint8_t errorCode) const
 {
 	Message errMessage;
@@ -514,13 +2976,33 @@ bool Server::sendErrorMessage(const ClientInfo& recipient, uint8_t errorCode) co
 	errMessage.type            = MSG_ERROR;
 	errMessage.data[0]         = errorCode;
 
-	return send(&errMessage, recipient);
+	return send(&errMessage, sizeof(Message), recipient);
+}
+
+bool Server::sendDisconnectMessage(const ClientInfo& recipient) const
+{
+	Message disconnectMessage;
+	disconnectMessage.playerIDAndTeam = recipient.idAndTeam;
+	disconnectMessage.key             = recipient.key;
+	disconnectMessage.parameters      = MSG_PRIVATE;
+	disconnectMessage.type            = MSG_DISCONNECT;
+	disconnectMessage.data[0]         = MSG_DISCONNECT_SRC_SERVER;
+
+	return send(&disconnectMessage, sizeof(Message), recipient);
 }
 
 void Server::disconnectClient(const int& clientIndex)
 {
-	m_clients[clientIndex].address = INADDR_ANY;
-	m_clients[clientIndex].port    = 0;
+	resetDeltaStreams(m_clients[clientIndex].idAndTeam);
+	m_reliableEndpoints.erase(m_clients[clientIndex].idAndTeam);
+	m_timers.cancel(TIMEOUT_TIMER(m_clients[clientIndex].idAndTeam));
+	m_timers.cancel(RETRANSMIT_TIMER(m_clients[clientIndex].idAndTeam));
+	m_clientCounters[m_clients[clientIndex].idAndTeam].connected.store(false, std::memory_order_relaxed);
+
+	if (m_host != nullptr)
+		m_host->unroute(m_clients[clientIndex].address, m_clients[clientIndex].port, m_roomSlot);
+
+	m_clients.release(clientIndex);
 }
 
 uint8_t Server::generateKey(uint8_t const* messageData) const
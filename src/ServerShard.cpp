@@ -0,0 +1,481 @@
+#include <ServerShard.hpp>
+#include <Log.hpp>
+
+#include <algorithm>
+#include <cstring>
+
+// most datagrams a sendmmsg() call accepts (UIO_MAXIOV)
+#define SEND_BATCH_SIZE 1024
+
+#ifndef _WIN32
+
+	#include <linux/errqueue.h>
+	#include <poll.h>
+	#include <sys/eventfd.h>
+
+#endif // _WIN32
+
+namespace cl
+{
+
+RecordRing::RecordRing()
+: m_control(new ShmRingControl())
+, m_data(new uint8_t[SHM_RING_SIZE])
+{
+	m_control->head.store(0);
+	m_control->tail.store(0);
+	m_control->waiting.store(0);
+	m_writer.attach(m_control.get(), m_data.get());
+	m_reader.attach(m_control.get(), m_data.get());
+}
+
+bool RecordRing::push(const sockaddr_in& sender, uint32_t flags, const uint8_t* datagram, std::size_t size)
+{
+	uint8_t* output = m_writer.reserve(sizeof(ShardRecord) + size);
+	if (output == nullptr)
+		return false;
+
+	ShardRecord record;
+	record.sender = sender;
+	record.flags  = flags;
+
+	std::memcpy(output, &record, sizeof(ShardRecord));
+	if (size > 0)
+		std::memcpy(output + sizeof(ShardRecord), datagram, size);
+	m_writer.commit();
+	return true;
+}
+
+bool RecordRing::wakeNeeded()
+{
+	return m_writer.wakeNeeded();
+}
+
+const uint8_t* RecordRing::front(ShardRecord& record, std::size_t& size) const
+{
+	std::size_t    recordSize;
+	const uint8_t* data = m_reader.front(recordSize);
+	if (data == nullptr || recordSize < sizeof(ShardRecord))
+		return nullptr;
+
+	std::memcpy(&record, data, sizeof(ShardRecord));
+	size = recordSize - sizeof(ShardRecord);
+	return data + sizeof(ShardRecord);
+}
+
+void RecordRing::pop()
+{
+	m_reader.pop();
+}
+
+bool RecordRing::prepareWait()
+{
+	return m_reader.prepareWait();
+}
+
+void RecordRing::endWait()
+{
+	m_reader.endWait();
+}
+
+ServerShard::ServerShard()
+: m_socket(INVALID_SOCKET)
+, m_doorbell(-1)
+, m_wakeup(-1)
+, m_sent(-1)
+, m_records()
+, m_buffers(new uint8_t[SHARD_BATCH_SIZE * MAX_DATAGRAM_SIZE])
+, m_batchCount(0)
+, m_batchIndex(0)
+, m_sendHeaders(nullptr)
+, m_sendCount(0)
+, m_sendErrors(nullptr)
+, m_sendPending(false)
+, m_continueExecution(false)
+{
+}
+
+ServerShard::~ServerShard()
+{
+	stop();
+}
+
+bool ServerShard::start(uint16_t port, int doorbell)
+{
+#ifdef _WIN32
+
+	(void)port;
+	(void)doorbell;
+	COMMS_LOG_ERROR(Server) << "Server shards are not supported on this platform.";
+	return false;
+
+#else
+
+	m_doorbell = doorbell;
+	m_socket   = ::socket(AF_INET, SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC, IPPROTO_UDP);
+	m_wakeup   = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+	m_sent     = eventfd(0, EFD_CLOEXEC); // waitSent() blocks on it
+
+	sockaddr_in bindAddress;
+	ZeroMemory(&bindAddress, sizeof(bindAddress));
+	bindAddress.sin_family      = AF_INET;
+	bindAddress.sin_addr.s_addr = INADDR_ANY;
+	bindAddress.sin_port        = htons(port);
+
+	int enable = 1;
+	if (m_socket == INVALID_SOCKET || m_wakeup == -1 || m_sent == -1
+	 || setsockopt(m_socket, SOL_SOCKET, SO_REUSEPORT, &enable, sizeof(enable)) == SOCKET_ERROR
+	 || setsockopt(m_socket, IPPROTO_IP, IP_RECVERR, &enable, sizeof(enable)) == SOCKET_ERROR
+	 || bind(m_socket, reinterpret_cast<sockaddr*>(&bindAddress), sizeof(bindAddress)) == SOCKET_ERROR)
+	{
+		COMMS_LOG_ERROR(Server) << "Could not bind shard socket to port " << port << " (" << errno << ").";
+		stop();
+		return false;
+	}
+
+	setupReceiveHeaders(m_headers, m_vectors, m_addresses, m_buffers.get(), SHARD_BATCH_SIZE);
+
+	m_continueExecution.store(true);
+	m_thread = std::thread(&ServerShard::run, this);
+	return true;
+
+#endif // _WIN32
+}
+
+void ServerShard::stop()
+{
+	m_continueExecution.store(false);
+
+#ifndef _WIN32
+
+	uint64_t wakeupCount = 1;
+	if (m_thread.joinable() && write(m_wakeup, &wakeupCount, sizeof(wakeupCount)) < 0)
+		COMMS_LOG_ERROR(Server) << "Error while waking up shard thread (" << errno << ").";
+
+	if (m_thread.joinable()) m_thread.join();
+
+	for (int* fd : { &m_wakeup, &m_sent })
+	{
+		if (*fd != -1)
+			::close(*fd);
+		*fd = -1;
+	}
+
+#endif // _WIN32
+
+	if (m_socket != INVALID_SOCKET)
+	{
+		closesocket(m_socket);
+		m_socket = INVALID_SOCKET;
+	}
+}
+
+RecordRing& ServerShard::records()
+{
+	return m_records;
+}
+
+void ServerShard::send(mmsghdr* headers, std::size_t count, int* errors)
+{
+#ifdef _WIN32
+
+	(void)headers;
+	(void)count;
+	(void)errors;
+
+#else
+
+	// the thread stopped on an error, send from this one
+	if (!m_continueExecution.load())
+	{
+		sendDatagrams(m_socket, headers, count, errors, m_sendCalls);
+		return;
+	}
+
+	m_sendHeaders = headers;
+	m_sendCount   = count;
+	m_sendErrors  = errors;
+	m_sendPending.store(true, std::memory_order_release);
+
+	uint64_t wakeupCount = 1;
+	if (write(m_wakeup, &wakeupCount, sizeof(wakeupCount)) < 0)
+		COMMS_LOG_ERROR(Server) << "Error while waking up shard thread (" << errno << ").";
+
+#endif // _WIN32
+}
+
+void ServerShard::waitSent()
+{
+#ifndef _WIN32
+
+	uint64_t sentCount;
+	while (m_sendPending.load(std::memory_order_acquire) && m_thread.joinable())
+	{
+		if (read(m_sent, &sentCount, sizeof(sentCount)) < 0 && errno != EINTR)
+		{
+			COMMS_LOG_ERROR(Server) << "Error while waiting for shard thread (" << errno << ").";
+			return;
+		}
+	}
+
+#endif // _WIN32
+}
+
+void ServerShard::sendDatagrams(SOCKET socket, mmsghdr* headers, std::size_t count, int* errors, StatCounter& sendCalls)
+{
+#ifdef _WIN32
+
+	(void)socket;
+	(void)headers;
+	(void)count;
+	(void)errors;
+	(void)sendCalls;
+
+#else
+
+	std::size_t sent = 0;
+	while (sent < count)
+	{
+		unsigned int batchSize = static_cast<unsigned int>(std::min<std::size_t>(count - sent, SEND_BATCH_SIZE));
+		int result = sendmmsg(socket, &headers[sent], batchSize, 0);
+		sendCalls.add();
+
+		if (result > 0)
+		{
+			std::fill(errors + sent, errors + sent + result, 0);
+			sent += result;
+			continue;
+		}
+
+		// a pending ICMP error caused by an earlier datagram is reported by
+		// the next send. It is handled through the error queue, so try again.
+		if (result < 0 && (errno == ECONNREFUSED || errno == EINTR))
+			continue;
+
+		// the socket has no room, sending the rest would fail the same way
+		if (result < 0 && transientSendError(errno))
+		{
+			std::fill(errors + sent, errors + count, errno);
+			break;
+		}
+
+		// the first datagram of the batch could not be sent
+		errors[sent++] = result < 0 ? errno : EIO;
+	}
+
+#endif // _WIN32
+}
+
+bool ServerShard::transientSendError(int error)
+{
+	// EAGAIN is EWOULDBLOCK on Linux
+	return error == WSAEWOULDBLOCK || error == WSAENOBUFS;
+}
+
+void ServerShard::forEachUnreachable(SOCKET socket, const std::function<void(const sockaddr_in&)>& unreachable)
+{
+#ifdef _WIN32
+
+	(void)socket;
+	(void)unreachable;
+
+#else
+
+	sockaddr_in destination; // destination of the datagram that caused the error
+	uint8_t     data[sizeof(Message)];
+	uint8_t     control[512];
+
+	iovec  dataVector;
+	msghdr header;
+
+	while (true)
+	{
+		ZeroMemory(&header, sizeof(header));
+		dataVector.iov_base    = data;
+		dataVector.iov_len     = sizeof(data);
+		header.msg_name        = &destination;
+		header.msg_namelen     = sizeof(destination);
+		header.msg_iov         = &dataVector;
+		header.msg_iovlen      = 1;
+		header.msg_control     = control;
+		header.msg_controllen  = sizeof(control);
+
+		// reading the error queue never blocks; stop once it is empty
+		if (recvmsg(socket, &header, MSG_ERRQUEUE) < 0)
+			break;
+
+		for (cmsghdr* cmsg = CMSG_FIRSTHDR(&header); cmsg != nullptr; cmsg = CMSG_NXTHDR(&header, cmsg))
+		{
+			if (cmsg->cmsg_level != IPPROTO_IP || cmsg->cmsg_type != IP_RECVERR)
+				continue;
+
+			sock_extended_err const* error = reinterpret_cast<sock_extended_err const*>(CMSG_DATA(cmsg));
+			if (error->ee_origin == SO_EE_ORIGIN_ICMP && error->ee_errno == ECONNREFUSED)
+				unreachable(destination);
+		}
+	}
+
+#endif // _WIN32
+}
+
+#ifndef _WIN32
+
+void ServerShard::setupReceiveHeaders(mmsghdr* headers, iovec* vectors, sockaddr_in* senders, uint8_t* buffers, std::size_t count)
+{
+	for (std::size_t i = 0; i < count; i++)
+	{
+		vectors[i].iov_base = buffers + i * MAX_DATAGRAM_SIZE;
+		vectors[i].iov_len  = MAX_DATAGRAM_SIZE;
+
+		ZeroMemory(&headers[i], sizeof(mmsghdr));
+		headers[i].msg_hdr.msg_name   = &senders[i];
+		headers[i].msg_hdr.msg_iov    = &vectors[i];
+		headers[i].msg_hdr.msg_iovlen = 1;
+	}
+}
+
+#endif // _WIN32
+
+uint64_t ServerShard::waitCalls() const
+{
+	return m_waitCalls.load();
+}
+
+uint64_t ServerShard::receiveCalls() const
+{
+	return m_receiveCalls.load();
+}
+
+uint64_t ServerShard::sendCalls() const
+{
+	return m_sendCalls.load();
+}
+
+void ServerShard::run()
+{
+#ifndef _WIN32
+
+	while (m_continueExecution.load())
+	{
+		// while the ring is full, the datagrams wait in the socket and only sends are handled
+		bool   backlog = m_batchIndex < m_batchCount;
+		pollfd fds[2]  = { { m_wakeup, POLLIN, 0 }, { m_socket, POLLIN, 0 } };
+
+		int result = ::poll(fds, backlog ? 1 : 2, backlog ? SHARD_RETRY_MS : -1);
+		m_waitCalls.add();
+
+		if (result < 0 && errno != EINTR)
+		{
+			COMMS_LOG_ERROR(Server) << "Error at poll() (" << errno << "). Stopping shard.";
+			break;
+		}
+
+		uint64_t wakeupCount;
+		if ((fds[0].revents & POLLIN) && read(m_wakeup, &wakeupCount, sizeof(wakeupCount)) < 0 && errno != EAGAIN)
+			COMMS_LOG_ERROR(Server) << "Error while reading wakeup event (" << errno << ").";
+
+		if (m_sendPending.load(std::memory_order_acquire))
+		{
+			sendDatagrams(m_socket, m_sendHeaders, m_sendCount, m_sendErrors, m_sendCalls);
+			m_sendPending.store(false, std::memory_order_release);
+
+			uint64_t sentCount = 1;
+			if (write(m_sent, &sentCount, sizeof(sentCount)) < 0)
+				COMMS_LOG_ERROR(Server) << "Error while waking up server thread (" << errno << ").";
+		}
+
+		if (!backlog && (fds[1].revents & POLLERR))
+			readErrorQueue();
+
+		if (backlog || (fds[1].revents & POLLIN))
+			receiveDatagrams();
+	}
+
+	// the server thread may be waiting for sends that will never happen
+	m_continueExecution.store(false);
+	m_sendPending.store(false, std::memory_order_release);
+	uint64_t sentCount = 1;
+	if (write(m_sent, &sentCount, sizeof(sentCount)) < 0)
+		COMMS_LOG_ERROR(Server) << "Error while waking up server thread (" << errno << ").";
+
+#endif // _WIN32
+}
+
+void ServerShard::receiveDatagrams()
+{
+#ifndef _WIN32
+
+	while (true)
+	{
+		// the rest of the last batch goes first
+		bool copied = false;
+		for (; m_batchIndex < m_batchCount; m_batchIndex++)
+		{
+			const mmsghdr& header = m_headers[m_batchIndex];
+			uint32_t       flags  = (header.msg_hdr.msg_flags & MSG_TRUNC) ? SHARD_TRUNCATED : 0;
+
+			if (!m_records.push(m_addresses[m_batchIndex], flags, static_cast<uint8_t*>(m_vectors[m_batchIndex].iov_base), header.msg_len))
+				break;
+			copied = true;
+		}
+
+		uint64_t doorbellCount = 1;
+		if (copied && m_records.wakeNeeded() && write(m_doorbell, &doorbellCount, sizeof(doorbellCount)) < 0)
+			COMMS_LOG_ERROR(Server) << "Error while waking up server thread (" << errno << ").";
+
+		// a partial batch means the socket was emptied
+		if (m_batchIndex < m_batchCount || (m_batchCount > 0 && m_batchCount < SHARD_BATCH_SIZE))
+		{
+			if (m_batchIndex == m_batchCount)
+				m_batchCount = m_batchIndex = 0;
+			return;
+		}
+
+		for (unsigned int i = 0; i < SHARD_BATCH_SIZE; i++)
+			m_headers[i].msg_hdr.msg_namelen = sizeof(sockaddr_in);
+
+		int count = recvmmsg(m_socket, m_headers, SHARD_BATCH_SIZE, MSG_DONTWAIT, nullptr);
+		m_receiveCalls.add();
+
+		m_batchIndex = 0;
+		m_batchCount = 0;
+
+		if (count > 0)
+		{
+			m_batchCount = static_cast<unsigned int>(count);
+			continue;
+		}
+
+		// the address of the unreachable client is only available in the error queue
+		if (count < 0 && errno == ECONNREFUSED)
+		{
+			readErrorQueue();
+			continue;
+		}
+
+		if (count < 0 && errno != EWOULDBLOCK && errno != EINTR)
+			COMMS_LOG_ERROR(Server) << "recvmmsg() failed with error: " << errno << ".";
+		return;
+	}
+
+#endif // _WIN32
+}
+
+void ServerShard::readErrorQueue()
+{
+#ifndef _WIN32
+
+	// if the ring is full, the client times out instead
+	forEachUnreachable(m_socket, [this](const sockaddr_in& destination)
+	{
+		m_records.push(destination, SHARD_UNREACHABLE, nullptr, 0);
+	});
+
+	uint64_t doorbellCount = 1;
+	if (m_records.wakeNeeded() && write(m_doorbell, &doorbellCount, sizeof(doorbellCount)) < 0)
+		COMMS_LOG_ERROR(Server) << "Error while waking up server thread (" << errno << ").";
+
+#endif // _WIN32
+}
+
+} // cl
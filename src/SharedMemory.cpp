@@ -0,0 +1,605 @@
+#include <SharedMemory.hpp>
+#include <Log.hpp>
+#include <Platform.hpp>
+
+#include <cstddef>
+#include <cstring>
+#include <string>
+
+#ifndef _WIN32
+
+	#include <sys/eventfd.h>
+	#include <sys/mman.h>
+	#include <sys/stat.h>
+	#include <sys/un.h>
+
+#endif // _WIN32
+
+// datagram size (4 bytes), records are 4-byte aligned
+#define RECORD_HEADER_SIZE 4
+
+// datagram size marking the unused end of the ring before a wrap
+#define WRAP_MARKER 0xFFFFFFFF
+
+#define SHM_RING_MASK (SHM_RING_SIZE - 1)
+
+// written last by the server, "CLSM"
+#define SHM_MAGIC 0x434C534D
+
+// descriptors passed to the client: segment, doorbell of the server and of the client
+#define SHM_DESCRIPTOR_COUNT 3
+
+static_assert((SHM_RING_SIZE & SHM_RING_MASK) == 0, "SHM_RING_SIZE must be a power of two");
+static_assert(std::atomic<uint32_t>::is_always_lock_free, "shared indices must be lock-free");
+
+namespace cl
+{
+
+ShmRing::ShmRing()
+: m_control(nullptr)
+, m_data(nullptr)
+, m_cachedTail(0)
+, m_cachedHead(0)
+, m_reserved(0)
+{
+}
+
+void ShmRing::attach(ShmRingControl* control, uint8_t* data)
+{
+	m_control    = control;
+	m_data       = data;
+	m_cachedTail = control->tail.load(std::memory_order_acquire);
+	m_cachedHead = control->head.load(std::memory_order_acquire);
+	m_reserved   = m_cachedTail;
+}
+
+uint8_t* ShmRing::reserve(std::size_t size)
+{
+	if (size > SHM_RING_SIZE / 2)
+		return nullptr;
+
+	uint32_t recordSize = static_cast<uint32_t>(RECORD_HEADER_SIZE + size + 3) & ~3u;
+	uint32_t tail       = m_control->tail.load(std::memory_order_relaxed);
+	uint32_t offset     = tail & SHM_RING_MASK;
+	uint32_t contiguous = SHM_RING_SIZE - offset;
+
+	// records are never split: skip the end of the ring if it is too short
+	uint32_t skip = contiguous < recordSize ? contiguous : 0;
+	uint32_t end  = tail + skip + recordSize;
+
+	// only read the consumer's index when the ring looks full
+	if (end - m_cachedHead > SHM_RING_SIZE)
+	{
+		m_cachedHead = m_control->head.load(std::memory_order_acquire);
+		if (end - m_cachedHead > SHM_RING_SIZE)
+			return nullptr;
+	}
+
+	// records are aligned, so there is always room for the marker
+	if (skip > 0)
+	{
+		uint32_t marker = WRAP_MARKER;
+		std::memcpy(m_data + offset, &marker, RECORD_HEADER_SIZE);
+	}
+
+	uint8_t* record     = m_data + ((tail + skip) & SHM_RING_MASK);
+	uint32_t recordData = static_cast<uint32_t>(size);
+	std::memcpy(record, &recordData, RECORD_HEADER_SIZE);
+
+	m_reserved = end;
+	return record + RECORD_HEADER_SIZE;
+}
+
+void ShmRing::commit()
+{
+	m_control->tail.store(m_reserved, std::memory_order_release);
+}
+
+bool ShmRing::wakeNeeded()
+{
+	// pairs with the fence of prepareWait(): either we see the flag or the consumer sees the datagram
+	std::atomic_thread_fence(std::memory_order_seq_cst);
+	return m_control->waiting.load(std::memory_order_relaxed) != 0 && m_control->waiting.exchange(0) != 0;
+}
+
+bool ShmRing::empty() const
+{
+	uint32_t head = m_control->head.load(std::memory_order_relaxed);
+
+	// only read the producer's index when the ring looks empty
+	if (head == m_cachedTail)
+		m_cachedTail = m_control->tail.load(std::memory_order_acquire);
+
+	return head == m_cachedTail;
+}
+
+const uint8_t* ShmRing::front(std::size_t& size) const
+{
+	if (empty())
+		return nullptr;
+
+	uint32_t position  = frontPosition();
+	uint32_t offset    = position & SHM_RING_MASK;
+	uint32_t available = m_cachedTail - position;
+	if (available < RECORD_HEADER_SIZE || available > SHM_RING_SIZE)
+		return nullptr;
+
+	uint32_t recordSize;
+	std::memcpy(&recordSize, m_data + offset, RECORD_HEADER_SIZE);
+
+	// the other process may write anything, never read past its tail or the end of the ring
+	if (recordSize > available - RECORD_HEADER_SIZE || recordSize > SHM_RING_SIZE - offset - RECORD_HEADER_SIZE)
+		return nullptr;
+
+	size = recordSize;
+	return m_data + offset + RECORD_HEADER_SIZE;
+}
+
+void ShmRing::pop()
+{
+	uint32_t position = frontPosition();
+	uint32_t recordSize;
+	std::memcpy(&recordSize, m_data + (position & SHM_RING_MASK), RECORD_HEADER_SIZE);
+
+	m_control->head.store(position + ((RECORD_HEADER_SIZE + recordSize + 3) & ~3u), std::memory_order_release);
+}
+
+bool ShmRing::prepareWait()
+{
+	m_control->waiting.store(1, std::memory_order_relaxed);
+	std::atomic_thread_fence(std::memory_order_seq_cst);
+	if (!empty())
+	{
+		m_control->waiting.store(0, std::memory_order_relaxed);
+		return false;
+	}
+
+	return true;
+}
+
+void ShmRing::endWait()
+{
+	// the producer clears the flag itself when it rings the doorbell
+	if (m_control->waiting.load(std::memory_order_relaxed) != 0)
+		m_control->waiting.store(0, std::memory_order_relaxed);
+}
+
+uint32_t ShmRing::frontPosition() const
+{
+	uint32_t head   = m_control->head.load(std::memory_order_relaxed);
+	uint32_t offset = head & SHM_RING_MASK;
+	uint32_t recordSize;
+	std::memcpy(&recordSize, m_data + offset, RECORD_HEADER_SIZE);
+
+	return recordSize == WRAP_MARKER ? head + (SHM_RING_SIZE - offset) : head;
+}
+
+ShmChannel::ShmChannel()
+: m_segment(nullptr)
+, m_connection(-1)
+, m_doorbell(-1)
+, m_peerDoorbell(-1)
+, m_notifyPending(false)
+, m_corrupted(false)
+{
+}
+
+ShmChannel::~ShmChannel()
+{
+	close();
+}
+
+bool ShmChannel::create(int connection, int serverDoorbell)
+{
+#ifdef _WIN32
+
+	(void)connection;
+	(void)serverDoorbell;
+	return false;
+
+#else
+
+	m_connection = connection;
+
+	int segment = memfd_create("commslib", MFD_CLOEXEC);
+	if (segment == -1 || ftruncate(segment, sizeof(ShmSegment)) == -1)
+	{
+		COMMS_LOG_ERROR(Server) << "Could not create shared memory (" << errno << ").";
+		if (segment != -1) ::close(segment);
+		close();
+		return false;
+	}
+
+	void* memory = mmap(nullptr, sizeof(ShmSegment), PROT_READ | PROT_WRITE, MAP_SHARED, segment, 0);
+	m_peerDoorbell = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+	if (memory == MAP_FAILED || m_peerDoorbell == -1)
+	{
+		COMMS_LOG_ERROR(Server) << "Could not map shared memory (" << errno << ").";
+		if (memory != MAP_FAILED) munmap(memory, sizeof(ShmSegment));
+		::close(segment);
+		close();
+		return false;
+	}
+
+	// a new memfd is zeroed, which is a valid state for every index and flag
+	m_segment = static_cast<ShmSegment*>(memory);
+	m_segment->magic    = SHM_MAGIC;
+	m_segment->ringSize = SHM_RING_SIZE;
+	m_inbound.attach(&m_segment->toServer, m_segment->toServerData);
+	m_outbound.attach(&m_segment->toClient, m_segment->toClientData);
+	m_notifyPending = false;
+	m_corrupted     = false;
+
+	int descriptors[SHM_DESCRIPTOR_COUNT] = { segment, serverDoorbell, m_peerDoorbell };
+
+	uint32_t ringSize = SHM_RING_SIZE;
+	iovec    dataVector;
+	dataVector.iov_base = &ringSize;
+	dataVector.iov_len  = sizeof(ringSize);
+
+	alignas(cmsghdr) uint8_t control[CMSG_SPACE(sizeof(descriptors))];
+	msghdr header;
+	ZeroMemory(&header, sizeof(header));
+	header.msg_iov        = &dataVector;
+	header.msg_iovlen     = 1;
+	header.msg_control    = control;
+	header.msg_controllen = sizeof(control);
+
+	cmsghdr* cmsg    = CMSG_FIRSTHDR(&header);
+	cmsg->cmsg_level = SOL_SOCKET;
+	cmsg->cmsg_type  = SCM_RIGHTS;
+	cmsg->cmsg_len   = CMSG_LEN(sizeof(descriptors));
+	std::memcpy(CMSG_DATA(cmsg), descriptors, sizeof(descriptors));
+
+	bool sent = sendmsg(m_connection, &header, MSG_NOSIGNAL) == static_cast<ssize_t>(sizeof(ringSize));
+
+	// the client holds its own references
+	::close(segment);
+
+	if (!sent)
+	{
+		COMMS_LOG_ERROR(Server) << "Could not hand out shared memory (" << errno << ").";
+		close();
+		return false;
+	}
+
+	return true;
+
+#endif // _WIN32
+}
+
+bool ShmChannel::connect(uint16_t serverPort)
+{
+#ifdef _WIN32
+
+	(void)serverPort;
+	COMMS_LOG_ERROR(Client) << "Shared memory is not supported on this platform.";
+	return false;
+
+#else
+
+	std::string name = SHM_SOCKET_PREFIX + std::to_string(serverPort);
+
+	// abstract socket: the name starts with a null character and leaves no file behind
+	sockaddr_un address;
+	ZeroMemory(&address, sizeof(address));
+	address.sun_family = AF_UNIX;
+	std::memcpy(address.sun_path + 1, name.c_str(), name.size());
+	socklen_t addressSize = static_cast<socklen_t>(offsetof(sockaddr_un, sun_path) + 1 + name.size());
+
+	m_connection = ::socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0);
+	if (m_connection == -1)
+	{
+		COMMS_LOG_ERROR(Client) << "Error at socket() (" << errno << ").";
+		return false;
+	}
+
+	timeval timeout;
+	timeout.tv_sec  = SHM_CONNECT_TIMEOUT_MS / 1000;
+	timeout.tv_usec = (SHM_CONNECT_TIMEOUT_MS % 1000) * 1000;
+	setsockopt(m_connection, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+
+	if (::connect(m_connection, reinterpret_cast<sockaddr*>(&address), addressSize) == -1)
+	{
+		close();
+		return false;
+	}
+
+	uint32_t ringSize = 0;
+	iovec    dataVector;
+	dataVector.iov_base = &ringSize;
+	dataVector.iov_len  = sizeof(ringSize);
+
+	int descriptors[SHM_DESCRIPTOR_COUNT] = { -1, -1, -1 };
+
+	alignas(cmsghdr) uint8_t control[CMSG_SPACE(sizeof(descriptors))];
+	msghdr header;
+	ZeroMemory(&header, sizeof(header));
+	header.msg_iov        = &dataVector;
+	header.msg_iovlen     = 1;
+	header.msg_control    = control;
+	header.msg_controllen = sizeof(control);
+
+	ssize_t received = recvmsg(m_connection, &header, MSG_CMSG_CLOEXEC);
+
+	cmsghdr* cmsg = CMSG_FIRSTHDR(&header);
+	if (cmsg != nullptr && cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_RIGHTS
+	 && cmsg->cmsg_len == CMSG_LEN(sizeof(descriptors)))
+		std::memcpy(descriptors, CMSG_DATA(cmsg), sizeof(descriptors));
+
+	// the server drops the connection when it has no channel left
+	int segment    = descriptors[0];
+	m_peerDoorbell = descriptors[1];
+	m_doorbell     = descriptors[2];
+
+	struct stat status;
+	bool valid = received == static_cast<ssize_t>(sizeof(ringSize)) && ringSize == SHM_RING_SIZE
+	          && segment != -1 && m_peerDoorbell != -1 && m_doorbell != -1
+	          && fstat(segment, &status) == 0 && static_cast<std::size_t>(status.st_size) >= sizeof(ShmSegment);
+
+	void* memory = valid ? mmap(nullptr, sizeof(ShmSegment), PROT_READ | PROT_WRITE, MAP_SHARED, segment, 0) : MAP_FAILED;
+	if (segment != -1) ::close(segment);
+
+	if (memory == MAP_FAILED)
+	{
+		close();
+		return false;
+	}
+
+	m_segment = static_cast<ShmSegment*>(memory);
+	if (m_segment->magic != SHM_MAGIC)
+	{
+		close();
+		return false;
+	}
+
+	m_inbound.attach(&m_segment->toClient, m_segment->toClientData);
+	m_outbound.attach(&m_segment->toServer, m_segment->toServerData);
+	m_notifyPending = false;
+	m_corrupted     = false;
+
+	int flags = fcntl(m_connection, F_GETFL, 0);
+	fcntl(m_connection, F_SETFL, flags | O_NONBLOCK);
+
+	return true;
+
+#endif // _WIN32
+}
+
+void ShmChannel::close()
+{
+#ifndef _WIN32
+
+	if (m_segment != nullptr)
+	{
+		munmap(m_segment, sizeof(ShmSegment));
+		m_segment = nullptr;
+	}
+
+	for (int* descriptor : { &m_connection, &m_doorbell, &m_peerDoorbell })
+	{
+		if (*descriptor != -1)
+		{
+			::close(*descriptor);
+			*descriptor = -1;
+		}
+	}
+
+#endif // _WIN32
+}
+
+bool ShmChannel::isOpen() const
+{
+	return m_segment != nullptr;
+}
+
+bool ShmChannel::send(const void* data, std::size_t size)
+{
+	uint8_t* record = m_outbound.reserve(size);
+	if (record == nullptr)
+		return false;
+
+	std::memcpy(record, data, size);
+	commit();
+	notify();
+
+	return true;
+}
+
+uint8_t* ShmChannel::reserve(std::size_t size)
+{
+	return m_outbound.reserve(size);
+}
+
+void ShmChannel::commit()
+{
+	m_outbound.commit();
+	m_notifyPending = true;
+}
+
+void ShmChannel::notify()
+{
+	if (!m_notifyPending)
+		return;
+	m_notifyPending = false;
+
+#ifndef _WIN32
+
+	uint64_t wakeupCount = 1;
+	if (m_outbound.wakeNeeded() && write(m_peerDoorbell, &wakeupCount, sizeof(wakeupCount)) < 0)
+		COMMS_LOG_ERROR(None) << "Error while ringing shared memory doorbell (" << errno << ").";
+
+#endif // _WIN32
+}
+
+const uint8_t* ShmChannel::receive(std::size_t& size)
+{
+	if (m_corrupted)
+		return nullptr;
+
+	const uint8_t* datagram = m_inbound.front(size);
+	if (datagram == nullptr && !m_inbound.empty())
+		m_corrupted = true;
+
+	return datagram;
+}
+
+void ShmChannel::release()
+{
+	m_inbound.pop();
+}
+
+bool ShmChannel::isCorrupted() const
+{
+	return m_corrupted;
+}
+
+bool ShmChannel::prepareWait()
+{
+	return m_corrupted || m_inbound.prepareWait();
+}
+
+void ShmChannel::endWait()
+{
+	m_inbound.endWait();
+}
+
+void ShmChannel::markClosed()
+{
+	if (m_segment == nullptr)
+		return;
+
+	m_segment->closed.store(1, std::memory_order_release);
+
+	// wake the client up even if it does not wait, it checks the flag on every wakeup
+#ifndef _WIN32
+
+	uint64_t wakeupCount = 1;
+	if (write(m_peerDoorbell, &wakeupCount, sizeof(wakeupCount)) < 0)
+		COMMS_LOG_ERROR(Server) << "Error while ringing shared memory doorbell (" << errno << ").";
+
+#endif // _WIN32
+}
+
+bool ShmChannel::isClosedByServer() const
+{
+	return m_segment != nullptr && m_segment->closed.load(std::memory_order_acquire) != 0;
+}
+
+int ShmChannel::connection() const
+{
+	return m_connection;
+}
+
+int ShmChannel::doorbell() const
+{
+	return m_doorbell;
+}
+
+ShmListener::ShmListener()
+: m_socket(-1)
+, m_doorbell(-1)
+{
+}
+
+ShmListener::~ShmListener()
+{
+	close();
+}
+
+bool ShmListener::open(uint16_t port)
+{
+#ifdef _WIN32
+
+	(void)port;
+	COMMS_LOG_ERROR(Server) << "Shared memory is not supported on this platform.";
+	return false;
+
+#else
+
+	std::string name = SHM_SOCKET_PREFIX + std::to_string(port);
+
+	sockaddr_un address;
+	ZeroMemory(&address, sizeof(address));
+	address.sun_family = AF_UNIX;
+	std::memcpy(address.sun_path + 1, name.c_str(), name.size());
+	socklen_t addressSize = static_cast<socklen_t>(offsetof(sockaddr_un, sun_path) + 1 + name.size());
+
+	m_socket   = ::socket(AF_UNIX, SOCK_SEQPACKET | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+	m_doorbell = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+	if (m_socket == -1 || m_doorbell == -1)
+	{
+		COMMS_LOG_ERROR(Server) << "Could not setup shared memory listener (" << errno << ").";
+		close();
+		return false;
+	}
+
+	if (bind(m_socket, reinterpret_cast<sockaddr*>(&address), addressSize) == -1
+	 || listen(m_socket, SOMAXCONN) == -1)
+	{
+		COMMS_LOG_ERROR(Server) << "Could not bind shared memory listener to " << name << " (" << errno << ").";
+		close();
+		return false;
+	}
+
+	return true;
+
+#endif // _WIN32
+}
+
+void ShmListener::close()
+{
+#ifndef _WIN32
+
+	for (int* descriptor : { &m_socket, &m_doorbell })
+	{
+		if (*descriptor != -1)
+		{
+			::close(*descriptor);
+			*descriptor = -1;
+		}
+	}
+
+#endif // _WIN32
+}
+
+bool ShmListener::isOpen() const
+{
+	return m_socket != -1;
+}
+
+int ShmListener::accept()
+{
+#ifdef _WIN32
+
+	return -1;
+
+#else
+
+	return accept4(m_socket, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+
+#endif // _WIN32
+}
+
+void ShmListener::clearDoorbell()
+{
+#ifndef _WIN32
+
+	uint64_t wakeupCount;
+	if (read(m_doorbell, &wakeupCount, sizeof(wakeupCount)) < 0 && errno != EAGAIN)
+		COMMS_LOG_ERROR(Server) << "Error while reading shared memory doorbell (" << errno << ").";
+
+#endif // _WIN32
+}
+
+int ShmListener::socket() const
+{
+	return m_socket;
+}
+
+int ShmListener::doorbell() const
+{
+	return m_doorbell;
+}
+
+} // cl
@@ -0,0 +1,110 @@
+#include <Stats.hpp>
+
+#include <sstream>
+
+namespace cl
+{
+
+// a metric of the server, without labels
+static void writeMetric(std::ostringstream& output, const char* name, const char* type, const char* help, uint64_t value)
+{
+	output << "# HELP commslib_" << name << ' ' << help << '\n';
+	output << "# TYPE commslib_" << name << ' ' << type << '\n';
+	output << "commslib_" << name << ' ' << value << '\n';
+}
+
+// the first line of a metric with one sample per label value
+static void writeFamily(std::ostringstream& output, const char* name, const char* type, const char* help)
+{
+	output << "# HELP commslib_" << name << ' ' << help << '\n';
+	output << "# TYPE commslib_" << name << ' ' << type << '\n';
+}
+
+template <typename T>
+static void writeSample(std::ostringstream& output, const char* name, const char* label, const char* labelValue, T value)
+{
+	output << "commslib_" << name << '{' << label << "=\"" << labelValue << "\"} " << value << '\n';
+}
+
+// a metric of every client, labelled with its id and team
+template <typename Getter>
+static void writeClientMetric(std::ostringstream& output, const ServerStats& stats, const char* name, const char* type,
+	const char* help, Getter getter)
+{
+	writeFamily(output, name, type, help);
+
+	for (const ClientStats& client : stats.clients)
+	{
+		output << "commslib_" << name << "{id=\"" << (client.idAndTeam >> 1)
+		       << "\",team=\"" << ((client.idAndTeam & 0x01) ? "blue" : "orange") << "\"} " << getter(client) << '\n';
+	}
+}
+
+std::string formatPrometheus(const ServerStats& stats)
+{
+	std::ostringstream output;
+
+	writeMetric(output, "wait_calls_total",         "counter", "System calls waiting for data.",         stats.waitCalls);
+	writeMetric(output, "receive_calls_total",      "counter", "Receive system calls.",                  stats.receiveCalls);
+	writeMetric(output, "datagrams_received_total", "counter", "Datagrams received.",                    stats.datagramsReceived);
+	writeMetric(output, "bytes_received_total",     "counter", "Bytes of the datagrams received.",       stats.bytesReceived);
+	writeMetric(output, "messages_received_total",  "counter", "Messages read from the datagrams.",      stats.messagesReceived);
+	writeMetric(output, "send_calls_total",         "counter", "Send system calls.",                     stats.sendCalls);
+	writeMetric(output, "datagrams_sent_total",     "counter", "Datagrams sent.",                        stats.datagramsSent);
+	writeMetric(output, "bytes_sent_total",         "counter", "Bytes of the datagrams sent.",           stats.bytesSent);
+	writeMetric(output, "messages_sent_total",      "counter", "Messages packed in the datagrams sent.",  stats.messagesSent);
+	writeMetric(output, "send_errors_total",        "counter", "Datagrams that could not be sent.",      stats.sendErrors);
+	writeMetric(output, "retransmissions_total",    "counter", "Reliable messages sent again.",          stats.retransmissions);
+
+	writeFamily(output, "dropped_datagrams_total", "counter", "Datagrams received and dropped.");
+	writeSample(output, "dropped_datagrams_total", "reason", "undersized", stats.undersizedDatagrams);
+	writeSample(output, "dropped_datagrams_total", "reason", "oversized",  stats.oversizedDatagrams);
+
+	writeFamily(output, "dropped_messages_total", "counter", "Messages dropped because a queue was full.");
+	writeSample(output, "dropped_messages_total", "queue", "buffer", stats.bufferDrops);
+	writeSample(output, "dropped_messages_total", "queue", "inbox",  stats.inboxDrops);
+	writeSample(output, "dropped_messages_total", "queue", "outbox", stats.outboxDrops);
+
+	writeMetric(output, "routed_messages_total", "counter", "Messages routed to the clients.",          stats.routedMessages);
+	writeMetric(output, "routed_copies_total",   "counter", "Copies queued for the routed messages.",  stats.routedCopies);
+	writeMetric(output, "max_fan_out",           "gauge",   "Most recipients of a single message.",    stats.maxFanOut);
+
+	writeMetric(output, "message_buffer_high_water_bytes", "gauge", "Most bytes waiting for a dispatch.",                     stats.messageBufferHighWater);
+	writeMetric(output, "inbox_high_water_bytes",          "gauge", "Most bytes waiting for the application.",                stats.inboxHighWater);
+	writeMetric(output, "outbox_high_water_messages",      "gauge", "Most application messages sent during a dispatch.",      stats.outboxHighWater);
+	writeMetric(output, "send_queue_high_water_messages",  "gauge", "Most messages queued for the clients during a dispatch.", stats.sendQueueHighWater);
+
+	writeMetric(output, "clients", "gauge", "Connected clients.", stats.clients.size());
+
+	if (stats.clients.empty())
+		return output.str();
+
+	writeClientMetric(output, stats, "client_datagrams_received_total", "counter", "Datagrams received from the client.",
+		[](const ClientStats& client) { return client.datagramsReceived; });
+	writeClientMetric(output, stats, "client_bytes_received_total", "counter", "Bytes received from the client.",
+		[](const ClientStats& client) { return client.bytesReceived; });
+	writeClientMetric(output, stats, "client_messages_received_total", "counter", "Messages received from the client.",
+		[](const ClientStats& client) { return client.messagesReceived; });
+	writeClientMetric(output, stats, "client_datagrams_sent_total", "counter", "Datagrams sent to the client.",
+		[](const ClientStats& client) { return client.datagramsSent; });
+	writeClientMetric(output, stats, "client_bytes_sent_total", "counter", "Bytes sent to the client.",
+		[](const ClientStats& client) { return client.bytesSent; });
+	writeClientMetric(output, stats, "client_messages_sent_total", "counter", "Messages sent to the client.",
+		[](const ClientStats& client) { return client.messagesSent; });
+	writeClientMetric(output, stats, "client_malformed_datagrams_total", "counter", "Datagrams of the client dropped.",
+		[](const ClientStats& client) { return client.malformedDatagrams; });
+	writeClientMetric(output, stats, "client_send_errors_total", "counter", "Datagrams that could not be sent to the client.",
+		[](const ClientStats& client) { return client.sendErrors; });
+	writeClientMetric(output, stats, "client_retransmissions_total", "counter", "Reliable messages sent again to the client.",
+		[](const ClientStats& client) { return client.retransmissions; });
+
+	// Prometheus expects seconds, NaN until the first answer to a ping
+	writeClientMetric(output, stats, "client_rtt_seconds", "gauge", "Smoothed round-trip time.",
+		[](const ClientStats& client) { return client.ping < 0.0f ? std::string("NaN") : std::to_string(client.ping / 1000.0); });
+	writeClientMetric(output, stats, "client_jitter_seconds", "gauge", "Smoothed round-trip time variation.",
+		[](const ClientStats& client) { return client.ping < 0.0f ? std::string("NaN") : std::to_string(client.jitter / 1000.0); });
+
+	return output.str();
+}
+
+} // cl
@@ -0,0 +1,220 @@
+#include <StatsExporter.hpp>
+#include <Log.hpp>
+
+
+#ifndef _WIN32
+
+	#include <poll.h>
+	#include <sys/eventfd.h>
+	#include <sys/stat.h>
+	#include <sys/un.h>
+
+#endif // _WIN32
+
+#define HTTP_REQUEST_SIZE 1024 // the end of longer requests is not read
+
+namespace cl
+{
+
+StatsExporter::StatsExporter(const Server& server, const std::string& path)
+: m_server(server)
+, m_path(path)
+, m_socket(-1)
+#ifndef _WIN32
+, m_wakeup(eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC))
+#else
+, m_wakeup(-1)
+#endif // _WIN32
+, m_continueExecution(true)
+, m_thread(&StatsExporter::init, this)
+{
+}
+
+StatsExporter::~StatsExporter()
+{
+	stop();
+}
+
+void StatsExporter::stop()
+{
+	m_continueExecution.store(false);
+
+#ifndef _WIN32
+
+	uint64_t wakeupCount = 1;
+	if (m_wakeup != -1 && write(m_wakeup, &wakeupCount, sizeof(wakeupCount)) < 0)
+		COMMS_LOG_ERROR(Stats) << "Error while waking up exporter thread (" << errno << ").";
+
+#endif // _WIN32
+
+	if (m_thread.joinable()) m_thread.join();
+
+#ifndef _WIN32
+
+	if (m_wakeup != -1)
+	{
+		::close(m_wakeup);
+		m_wakeup = -1;
+	}
+
+#endif // _WIN32
+}
+
+bool StatsExporter::isRunning() const
+{
+	return m_continueExecution.load();
+}
+
+bool StatsExporter::init()
+{
+#ifdef _WIN32
+
+	COMMS_LOG_ERROR(Stats) << "Unix sockets are not supported on this platform. Could not start stats exporter.";
+	m_continueExecution.store(false);
+	return false;
+
+#else
+
+	sockaddr_un address;
+	ZeroMemory(&address, sizeof(address));
+	address.sun_family = AF_UNIX;
+
+	if (m_path.empty() || m_path.size() >= sizeof(address.sun_path))
+	{
+		COMMS_LOG_ERROR(Stats) << "Invalid socket path: " << m_path << ". Could not start stats exporter.";
+		m_continueExecution.store(false);
+		return false;
+	}
+	std::memcpy(address.sun_path, m_path.c_str(), m_path.size());
+
+	if (m_wakeup == -1)
+	{
+		COMMS_LOG_ERROR(Stats) << "Could not setup wakeup event (" << errno << "). Could not start stats exporter.";
+		m_continueExecution.store(false);
+		return false;
+	}
+
+	m_socket = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+	if (m_socket == -1)
+	{
+		COMMS_LOG_ERROR(Stats) << "Error at socket() (" << errno << "). Could not start stats exporter.";
+		m_continueExecution.store(false);
+		return false;
+	}
+
+	// a previous exporter that did not stop properly leaves its socket behind, but never remove anything else
+	struct stat status;
+	if (lstat(m_path.c_str(), &status) == 0 && S_ISSOCK(status.st_mode))
+		unlink(m_path.c_str());
+
+	if (bind(m_socket, reinterpret_cast<sockaddr*>(&address), sizeof(address)) == -1
+	 || listen(m_socket, STATS_EXPORTER_BACKLOG) == -1)
+	{
+		COMMS_LOG_ERROR(Stats) << "Could not bind socket to " << m_path << " (" << errno << "). Could not start stats exporter.";
+		::close(m_socket);
+		m_socket = -1;
+		m_continueExecution.store(false);
+		return false;
+	}
+
+	COMMS_LOG_INFO(Stats) << "Serving stats on " << m_path << ".";
+
+	run();
+
+	::close(m_socket);
+	m_socket = -1;
+	unlink(m_path.c_str());
+
+	return true;
+
+#endif // _WIN32
+}
+
+void StatsExporter::run()
+{
+#ifndef _WIN32
+
+	while (m_continueExecution.load())
+	{
+		pollfd events[2];
+		events[0].fd     = m_socket;
+		events[0].events = POLLIN;
+		events[1].fd     = m_wakeup;
+		events[1].events = POLLIN;
+
+		if (::poll(events, 2, -1) < 0)
+		{
+			if (errno == EINTR)
+				continue;
+
+			COMMS_LOG_ERROR(Stats) << "Error at poll() (" << errno << "). Stopping stats exporter.";
+			m_continueExecution.store(false);
+			break;
+		}
+
+		if (!(events[0].revents & POLLIN))
+			continue;
+
+		int connection = accept4(m_socket, nullptr, nullptr, SOCK_CLOEXEC);
+		if (connection == -1)
+			continue;
+
+		serve(connection);
+	}
+
+#endif // _WIN32
+}
+
+void StatsExporter::serve(int connection)
+{
+#ifndef _WIN32
+
+	// a client that does not send anything or stops reading must not block the exporter
+	timeval timeout;
+	timeout.tv_sec  = 0;
+	timeout.tv_usec = STATS_REQUEST_TIMEOUT_MS * 1000;
+	setsockopt(connection, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+	setsockopt(connection, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+
+	// read the request until its empty line, if there is one
+	std::string request;
+	char        buffer[HTTP_REQUEST_SIZE];
+	while (request.size() < HTTP_REQUEST_SIZE && request.find("\r\n\r\n") == std::string::npos)
+	{
+		ssize_t size = recv(connection, buffer, sizeof(buffer), 0);
+		if (size <= 0)
+			break;
+		request.append(buffer, static_cast<std::size_t>(size));
+	}
+
+	std::string body = formatPrometheus(m_server.stats());
+
+	std::string answer;
+	if (request.compare(0, 4, "GET ") == 0)
+	{
+		answer = "HTTP/1.0 200 OK\r\n"
+		         "Content-Type: text/plain; version=0.0.4\r\n"
+		         "Content-Length: " + std::to_string(body.size()) + "\r\n"
+		         "Connection: close\r\n\r\n";
+	}
+	answer += body;
+
+	std::size_t written = 0;
+	while (written < answer.size())
+	{
+		ssize_t size = ::send(connection, answer.data() + written, answer.size() - written, MSG_NOSIGNAL);
+		if (size <= 0)
+			break;
+		written += static_cast<std::size_t>(size);
+	}
+
+	::close(connection);
+
+#else
+
+	(void)connection;
+
+#endif // _WIN32
+}
+
+} // cl
@@ -0,0 +1,239 @@
+#include <TimerWheel.hpp>
+
+#include <algorithm>
+
+#ifdef _MSC_VER
+	#include <intrin.h>
+#endif // _MSC_VER
+
+#define TIMER_WHEEL_SLOTS (1u << TIMER_WHEEL_SLOT_BITS)
+#define TIMER_WHEEL_MASK  (TIMER_WHEEL_SLOTS - 1)
+
+// end of a slot and slot of an unscheduled timer
+#define NO_TIMER 0xFFFFFFFF
+#define NO_SLOT  0xFFFF
+
+namespace cl
+{
+
+// index of the lowest bit set, bits must not be 0
+static unsigned int lowestBit(uint64_t bits)
+{
+#ifdef _MSC_VER
+	unsigned long index;
+	_BitScanForward64(&index, bits);
+	return static_cast<unsigned int>(index);
+#else
+	return static_cast<unsigned int>(__builtin_ctzll(bits));
+#endif // _MSC_VER
+}
+
+TimerWheel::TimerWheel(std::size_t capacity, Clock::duration resolution, Clock::time_point start)
+: m_timers(capacity)
+, m_slots(TIMER_WHEEL_LEVELS * TIMER_WHEEL_SLOTS, NO_TIMER)
+, m_occupied()
+, m_count(0)
+, m_resolution(resolution)
+, m_start(start)
+, m_currentTick(0)
+{
+}
+
+std::size_t TimerWheel::capacity() const
+{
+	return m_timers.size();
+}
+
+void TimerWheel::schedule(std::size_t timer, Clock::time_point deadline)
+{
+	if (m_timers[timer].slot != NO_SLOT)
+		remove(static_cast<uint32_t>(timer));
+	else
+		m_count++;
+
+	m_timers[timer].deadline = deadline;
+	m_timers[timer].tick     = tickOf(deadline, true);
+	insert(static_cast<uint32_t>(timer));
+}
+
+void TimerWheel::cancel(std::size_t timer)
+{
+	if (m_timers[timer].slot == NO_SLOT)
+		return;
+
+	remove(static_cast<uint32_t>(timer));
+	m_count--;
+}
+
+bool TimerWheel::scheduled(std::size_t timer) const
+{
+	return m_timers[timer].slot != NO_SLOT;
+}
+
+TimerWheel::Clock::time_point TimerWheel::deadline(std::size_t timer) const
+{
+	return m_timers[timer].deadline;
+}
+
+TimerWheel::Clock::time_point TimerWheel::nextExpiry() const
+{
+	if (m_count == 0)
+		return Clock::time_point::max();
+
+	return m_start + m_resolution * static_cast<Clock::rep>(nextTick(true));
+}
+
+std::size_t TimerWheel::advance(Clock::time_point now, std::size_t* timers, std::size_t maxCount)
+{
+	uint64_t    target = tickOf(now, false);
+	std::size_t count  = 0;
+
+	while (true)
+	{
+		// every timer of the slot of the current tick is due
+		uint32_t& first = m_slots[m_currentTick & TIMER_WHEEL_MASK];
+		while (first != NO_TIMER)
+		{
+			if (count == maxCount)
+				return count;
+
+			timers[count++] = first;
+			remove(first);
+			m_count--;
+		}
+
+		if (m_currentTick >= target)
+			break;
+
+		// skip the ticks where nothing happens
+		if (m_count == 0)
+		{
+			m_currentTick = target;
+			break;
+		}
+
+		m_currentTick = std::min(nextTick(false), target);
+		cascade();
+	}
+
+	return count;
+}
+
+uint64_t TimerWheel::tickOf(Clock::time_point time, bool roundUp) const
+{
+	if (time <= m_start)
+		return 0;
+
+	Clock::duration elapsed = time - m_start;
+	uint64_t        tick    = static_cast<uint64_t>(elapsed / m_resolution);
+	if (roundUp && elapsed % m_resolution != Clock::duration::zero())
+		tick++;
+
+	return tick;
+}
+
+void TimerWheel::insert(uint32_t timer)
+{
+	// late timers expire with the current tick
+	uint64_t tick  = std::max(m_timers[timer].tick, m_currentTick);
+	uint64_t delta = tick - m_currentTick;
+
+	unsigned int level = 0;
+	while (level < TIMER_WHEEL_LEVELS - 1 && delta >> (TIMER_WHEEL_SLOT_BITS * (level + 1)) != 0)
+		level++;
+
+	// timers beyond the last wheel wait in its farthest slot and are spread again from there
+	uint64_t range = uint64_t(1) << (TIMER_WHEEL_SLOT_BITS * TIMER_WHEEL_LEVELS);
+	if (delta >= range)
+		tick = m_currentTick + range - 1;
+
+	unsigned int index = static_cast<unsigned int>(tick >> (TIMER_WHEEL_SLOT_BITS * level)) & TIMER_WHEEL_MASK;
+	uint16_t     slot  = static_cast<uint16_t>(level * TIMER_WHEEL_SLOTS + index);
+
+	Timer& scheduledTimer = m_timers[timer];
+	scheduledTimer.slot     = slot;
+	scheduledTimer.previous = NO_TIMER;
+	scheduledTimer.next     = m_slots[slot];
+
+	if (m_slots[slot] != NO_TIMER)
+		m_timers[m_slots[slot]].previous = timer;
+
+	m_slots[slot] = timer;
+	m_occupied[level] |= uint64_t(1) << index;
+}
+
+void TimerWheel::remove(uint32_t timer)
+{
+	Timer& removedTimer = m_timers[timer];
+
+	if (removedTimer.previous != NO_TIMER)
+	{
+		m_timers[removedTimer.previous].next = removedTimer.next;
+	}
+	else
+	{
+		m_slots[removedTimer.slot] = removedTimer.next;
+		if (removedTimer.next == NO_TIMER)
+			m_occupied[removedTimer.slot / TIMER_WHEEL_SLOTS] &= ~(uint64_t(1) << (removedTimer.slot & TIMER_WHEEL_MASK));
+	}
+
+	if (removedTimer.next != NO_TIMER)
+		m_timers[removedTimer.next].previous = removedTimer.previous;
+
+	removedTimer.slot = NO_SLOT;
+}
+
+void TimerWheel::cascade()
+{
+	for (unsigned int level = 1; level < TIMER_WHEEL_LEVELS; level++)
+	{
+		unsigned int shift = TIMER_WHEEL_SLOT_BITS * level;
+
+		// a coarser wheel only turns when the finer one starts a new turn
+		if ((m_currentTick & ((uint64_t(1) << shift) - 1)) != 0)
+			break;
+
+		unsigned int index = static_cast<unsigned int>(m_currentTick >> shift) & TIMER_WHEEL_MASK;
+		uint16_t     slot  = static_cast<uint16_t>(level * TIMER_WHEEL_SLOTS + index);
+
+		uint32_t timer = m_slots[slot];
+		m_slots[slot] = NO_TIMER;
+		m_occupied[level] &= ~(uint64_t(1) << index);
+
+		while (timer != NO_TIMER)
+		{
+			uint32_t next = m_timers[timer].next;
+			insert(timer);
+			timer = next;
+		}
+	}
+}
+
+uint64_t TimerWheel::nextTick(bool includeCurrent) const
+{
+	uint64_t next = UINT64_MAX;
+
+	for (unsigned int level = 0; level < TIMER_WHEEL_LEVELS; level++)
+	{
+		uint64_t occupied = m_occupied[level];
+		if (occupied == 0)
+			continue;
+
+		unsigned int shift    = TIMER_WHEEL_SLOT_BITS * level;
+		uint64_t     block    = m_currentTick >> shift;
+		unsigned int position = static_cast<unsigned int>(block & TIMER_WHEEL_MASK);
+
+		// the current slot of a coarser wheel was already spread, its timers are one turn away
+		unsigned int from  = (level == 0 && includeCurrent) ? position : position + 1;
+		uint64_t     later = from < TIMER_WHEEL_SLOTS ? occupied & (~uint64_t(0) << from) : 0;
+
+		uint64_t slotBlock = later != 0 ? block - position + lowestBit(later)
+		                                : block - position + TIMER_WHEEL_SLOTS + lowestBit(occupied);
+
+		next = std::min(next, slotBlock << shift);
+	}
+
+	return next;
+}
+
+} // cl
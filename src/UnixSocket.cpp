@@ -0,0 +1,154 @@
+#include <UnixSocket.hpp>
+#include <Log.hpp>
+
+#include <cstddef>
+#include <cstring>
+
+#ifndef _WIN32
+
+	#include <sys/stat.h>
+
+#endif // _WIN32
+
+namespace cl
+{
+
+std::string unixServerPath(const std::string& path, uint16_t port)
+{
+	return path.empty() ? UNIX_SOCKET_PREFIX + std::to_string(port) + ".dgram" : path;
+}
+
+std::string unixClientPath(const std::string& serverPath, unsigned int id)
+{
+	return serverPath + "." + std::to_string(id);
+}
+
+socklen_t unixAddress(const std::string& path, sockaddr_un& address)
+{
+	ZeroMemory(&address, sizeof(address));
+	address.sun_family = AF_UNIX;
+
+	// filesystem paths are null-terminated, abstract names are not
+	if (path.empty() || path.size() >= sizeof(address.sun_path))
+		return 0;
+
+	std::memcpy(address.sun_path, path.data(), path.size());
+	if (path[0] == '@')
+	{
+		address.sun_path[0] = '\0';
+		return static_cast<socklen_t>(offsetof(sockaddr_un, sun_path) + path.size());
+	}
+
+	return static_cast<socklen_t>(offsetof(sockaddr_un, sun_path) + path.size() + 1);
+}
+
+SOCKET openUnixSocket(const std::string& path)
+{
+#ifdef _WIN32
+
+	COMMS_LOG_ERROR(None) << "Unix datagram sockets are not supported on this platform.";
+	return INVALID_SOCKET;
+
+#else
+
+	sockaddr_un address;
+	socklen_t   addressSize = unixAddress(path, address);
+	if (addressSize == 0)
+	{
+		COMMS_LOG_ERROR(None) << "Invalid Unix socket path: " << path << ".";
+		return INVALID_SOCKET;
+	}
+
+	SOCKET unixSocket = ::socket(AF_UNIX, SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+	if (unixSocket == INVALID_SOCKET)
+	{
+		COMMS_LOG_ERROR(None) << "Error at socket() (" << errno << ").";
+		return INVALID_SOCKET;
+	}
+
+	// a previous process that did not stop properly leaves its socket behind, but never remove anything else
+	struct stat status;
+	if (path[0] != '@' && lstat(path.c_str(), &status) == 0 && S_ISSOCK(status.st_mode))
+		unlink(path.c_str());
+
+	if (bind(unixSocket, reinterpret_cast<sockaddr*>(&address), addressSize) == SOCKET_ERROR)
+	{
+		COMMS_LOG_ERROR(None) << "Could not bind socket to " << path << " (" << errno << ").";
+		closesocket(unixSocket);
+		return INVALID_SOCKET;
+	}
+
+	return unixSocket;
+
+#endif // _WIN32
+}
+
+void closeUnixSocket(SOCKET& socket, const std::string& path)
+{
+	if (socket == INVALID_SOCKET)
+		return;
+
+	closesocket(socket);
+	socket = INVALID_SOCKET;
+
+#ifndef _WIN32
+
+	if (!path.empty() && path[0] != '@')
+		unlink(path.c_str());
+
+#endif // _WIN32
+}
+
+UnixPeerTable::UnixPeerTable()
+{
+	m_slots.reserve(MAX_CLIENTS);
+}
+
+int UnixPeerTable::find(const sockaddr_un& address, socklen_t size)
+{
+	m_key.assign(reinterpret_cast<const char*>(&address), size);
+
+	auto slot = m_slots.find(m_key);
+	if (slot != m_slots.end())
+		return static_cast<int>(slot->second);
+
+	for (unsigned int i = 0; i < MAX_CLIENTS; i++)
+	{
+		if (m_peers[i].size != 0)
+			continue;
+
+		std::memcpy(&m_peers[i].address, &address, size);
+		m_peers[i].size = size;
+		m_slots.emplace(m_key, i);
+		return static_cast<int>(i);
+	}
+
+	return -1;
+}
+
+void UnixPeerTable::release(unsigned int slot)
+{
+	if (m_peers[slot].size == 0)
+		return;
+
+	m_key.assign(reinterpret_cast<const char*>(&m_peers[slot].address), m_peers[slot].size);
+	m_slots.erase(m_key);
+	m_peers[slot].size = 0;
+}
+
+bool UnixPeerTable::used(unsigned int slot) const
+{
+	return m_peers[slot].size != 0;
+}
+
+const sockaddr_un& UnixPeerTable::address(unsigned int slot) const
+{
+	return m_peers[slot].address;
+}
+
+socklen_t UnixPeerTable::addressSize(unsigned int slot) const
+{
+	return m_peers[slot].size;
+}
+
+} // cl
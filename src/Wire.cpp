@@ -0,0 +1,177 @@
+#include <Wire.hpp>
+
+#include <cstring>
+
+namespace cl
+{
+
+std::size_t encodedSize(const MessageView& message, bool compact)
+{
+	return compact ? FRAME_HEADER_SIZE + message.size : sizeof(Message);
+}
+
+std::size_t encodeHeader(uint8_t* buffer, const MessageView& message, bool compact)
+{
+	buffer[0] = message.playerIDAndTeam;
+	buffer[1] = message.key;
+	buffer[2] = message.parameters;
+	buffer[3] = message.type;
+
+	if (!compact)
+		return sizeof(Message) - LEGACY_PAYLOAD_SIZE;
+
+	buffer[4] = static_cast<uint8_t>(message.size >> 8);
+	buffer[5] = static_cast<uint8_t>(message.size & 0xFF);
+
+	return FRAME_HEADER_SIZE;
+}
+
+std::size_t encodeMessage(uint8_t* buffer, const MessageView& message, bool compact)
+{
+	if (!compact)
+	{
+		Message fixedMessage = message.toMessage();
+		std::memcpy(buffer, &fixedMessage, sizeof(Message));
+		return sizeof(Message);
+	}
+
+	encodeHeader(buffer, message, compact);
+
+	if (message.size > 0)
+		std::memcpy(buffer + FRAME_HEADER_SIZE, message.data, message.size);
+
+	return FRAME_HEADER_SIZE + message.size;
+}
+
+// DatagramWriter
+
+DatagramWriter::DatagramWriter(uint8_t* buffer, std::size_t maxSize)
+: m_buffer(buffer)
+, m_maxSize(maxSize)
+, m_size(0)
+, m_count(0)
+, m_compact(false)
+{
+}
+
+void DatagramWriter::reset(bool compact)
+{
+	m_compact = compact;
+	m_count   = 0;
+	m_size    = 0;
+
+	if (compact)
+		m_buffer[m_size++] = WIRE_VERSION;
+}
+
+bool DatagramWriter::empty() const
+{
+	return m_count == 0;
+}
+
+bool DatagramWriter::compact() const
+{
+	return m_compact;
+}
+
+bool DatagramWriter::fits(const MessageView& message) const
+{
+	if (empty())
+		return true;
+
+	// keep room for the padding byte
+	std::size_t reserved = m_compact ? 1 : 0;
+	return m_size + encodedSize(message, m_compact) + reserved <= m_maxSize;
+}
+
+void DatagramWriter::append(const MessageView& message)
+{
+	m_size += encodeMessage(m_buffer + m_size, message, m_compact);
+	m_count++;
+}
+
+std::size_t DatagramWriter::finish()
+{
+	if (m_compact && paddingSize(m_size) > 0)
+		m_buffer[m_size++] = 0x00;
+
+	return m_size;
+}
+
+const uint8_t* DatagramWriter::data() const
+{
+	return m_buffer;
+}
+
+// DatagramReader
+
+DatagramReader::DatagramReader()
+: m_data(nullptr)
+, m_size(0)
+, m_offset(0)
+, m_compact(false)
+, m_malformed(false)
+{
+}
+
+void DatagramReader::reset(const uint8_t* data, std::size_t size)
+{
+	m_data      = data;
+	m_size      = size;
+	m_compact   = isCompactDatagram(size);
+	m_offset    = m_compact ? 1 : 0;
+	m_malformed = m_compact && (size < 1 + FRAME_HEADER_SIZE || data[0] != WIRE_VERSION);
+}
+
+bool DatagramReader::next(MessageView& message)
+{
+	if (m_malformed)
+		return false;
+
+	const uint8_t* frame = m_data + m_offset;
+
+	if (!m_compact)
+	{
+		if (m_size - m_offset < sizeof(Message))
+			return false;
+
+		message.playerIDAndTeam = frame[0];
+		message.key             = frame[1];
+		message.parameters      = frame[2];
+		message.type            = frame[3];
+		message.size            = LEGACY_PAYLOAD_SIZE;
+		message.data            = frame + 4;
+
+		m_offset += sizeof(Message);
+		return true;
+	}
+
+	// what is left after the last frame is padding
+	std::size_t remaining = m_size - m_offset;
+	if (remaining < FRAME_HEADER_SIZE)
+		return false;
+
+	uint16_t payloadSize = static_cast<uint16_t>(frame[4] << 8 | frame[5]);
+	if (payloadSize > remaining - FRAME_HEADER_SIZE)
+	{
+		m_malformed = true;
+		return false;
+	}
+
+	message.playerIDAndTeam = frame[0];
+	message.key             = frame[1];
+	message.parameters      = frame[2];
+	message.type            = frame[3];
+	message.size            = payloadSize;
+	message.data            = frame + FRAME_HEADER_SIZE;
+
+	m_offset += FRAME_HEADER_SIZE + payloadSize;
+	return true;
+}
+
+bool DatagramReader::malformed() const
+{
+	return m_malformed;
+}
+
+} // cl
@@ -0,0 +1,24 @@
+#ifndef COMMSLIB_TESTS_CHECK_HPP
+#define COMMSLIB_TESTS_CHECK_HPP
+
+#include <cstdio>
+
+// Checks of the unit tests. A failed check is reported with its line and
+// the test goes on, TEST_RESULT() is the exit code of the test.
+
+static int checkFailures = 0;
+
+#define CHECK(condition)                                                   \
+	do                                                                     \
+	{                                                                      \
+		if (!(condition))                                                  \
+		{                                                                  \
+			std::fprintf(stderr, "%s:%d: check failed: %s\n",              \
+			             __FILE__, __LINE__, #condition);                  \
+			checkFailures++;                                               \
+		}                                                                  \
+	} while (false)
+
+#define TEST_RESULT() (checkFailures == 0 ? 0 : 1)
+
+#endif // COMMSLIB_TESTS_CHECK_HPP
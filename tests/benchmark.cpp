@@ -0,0 +1,607 @@
+#include <Client.hpp>
+#include <Log.hpp>
+#include <Server.hpp>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Loopback benchmark of a server and clients running in this process.
+//
+// For every scenario, client count and rate, a server is started and the
+// clients send messages stamped with the time they were sent. Each
+// client has a thread waiting for its messages, which measures the time
+// between the send and the moment getMessage() returns them. The results
+// are written as JSON so runs of different versions can be compared.
+//
+// Scenarios:
+// * unicast:   every client sends private messages to the next client
+// * broadcast: every client sends messages to all clients, itself included
+
+#define BENCH_MESSAGE_TYPE 0x42 //!< User-defined type of the messages measured
+#define BENCH_PAYLOAD_SIZE 16   //!< Recipient, padding, send time and sequence number
+
+#define BENCH_DEFAULT_PORT        43215
+#define BENCH_DEFAULT_DURATION_MS 1000
+#define BENCH_DRAIN_MS            250 //!< Time to receive the messages in flight after the last send
+#define BENCH_CONNECT_TIMEOUT_MS  5000
+#define BENCH_UPDATE_INTERVAL_MS  10  //!< Time between two updates of each client while sending
+#define BENCH_MAX_LAG_MS          100 //!< The sender skips sends that are later than this
+
+using Clock = std::chrono::steady_clock;
+
+enum class Scenario
+{
+	Unicast,
+	Broadcast
+};
+
+struct Options
+{
+	std::vector<Scenario>     scenarios    = { Scenario::Unicast, Scenario::Broadcast };
+	std::vector<unsigned int> clientCounts = { 1, 2, 4, 8, 16, 32, 64, 128 };
+	std::vector<unsigned int> rates        = { 60, 1000 }; // messages per second of each client
+	std::vector<unsigned int> threadCounts = { 1 };        // threads of the server
+	unsigned int              durationMs   = BENCH_DEFAULT_DURATION_MS;
+	unsigned int              tickRate     = 0;
+	uint16_t                  datagramSize = sizeof(Message);
+	uint16_t                  port         = BENCH_DEFAULT_PORT;
+	cl::Transport             transport    = cl::Transport::Udp;
+	cl::IoEngine              engine       = cl::IoEngine::Epoll;
+	std::string               label;
+	std::string               output;
+};
+
+struct Result
+{
+	Scenario     scenario;
+	unsigned int clients;
+	unsigned int rate;
+	unsigned int threads;
+
+	double   duration;              // seconds messages were sent for
+	uint64_t sent;                  // messages sent by the clients
+	uint64_t expected;              // copies the clients should receive
+	uint64_t delivered;             // copies received
+	double   latencyMean;           // microseconds
+	double   latencyPercentiles[3]; // p50, p99 and p99.9, in microseconds
+	double   latencyMax;            // microseconds
+
+	cl::ServerStats server; // difference between the end and the start of the measure
+};
+
+// a client and the thread reading its messages
+struct BenchClient
+{
+	std::unique_ptr<cl::Client> client;
+	std::thread                 receiver;
+	uint64_t                    received = 0;
+	std::vector<uint32_t>       latencies; // nanoseconds, of the messages sent during the measure
+};
+
+static const char* scenarioName(Scenario scenario)
+{
+	return scenario == Scenario::Unicast ? "unicast" : "broadcast";
+}
+
+static const char* transportName(cl::Transport transport)
+{
+	switch (transport)
+	{
+	case cl::Transport::SharedMemory: return "shm";
+	case cl::Transport::UnixDatagram: return "unix";
+	default:                          return "udp";
+	}
+}
+
+static const char* engineName(cl::IoEngine engine)
+{
+	return engine == cl::IoEngine::IoUring ? "io_uring" : "epoll";
+}
+
+// system calls of the server thread per message it received
+static double syscallsPerMessage(const cl::ServerStats& stats)
+{
+	uint64_t calls = stats.waitCalls + stats.receiveCalls + stats.sendCalls;
+	return stats.messagesReceived ? static_cast<double>(calls) / stats.messagesReceived : 0.0;
+}
+
+static int64_t nanoseconds(Clock::time_point time)
+{
+	return std::chrono::duration_cast<std::chrono::nanoseconds>(time.time_since_epoch()).count();
+}
+
+static void writeUint64(uint8_t* data, uint64_t value)
+{
+	for (int i = 7; i >= 0; i--, value >>= 8)
+		data[i] = static_cast<uint8_t>(value);
+}
+
+static void writeUint32(uint8_t* data, uint32_t value)
+{
+	for (int i = 3; i >= 0; i--, value >>= 8)
+		data[i] = static_cast<uint8_t>(value);
+}
+
+static uint64_t readUint64(const uint8_t* data)
+{
+	uint64_t value = 0;
+	for (int i = 0; i < 8; i++)
+		value = value << 8 | data[i];
+	return value;
+}
+
+static uint8_t idAndTeam(unsigned int index)
+{
+	return static_cast<uint8_t>(index << 1 | (index & 0x01));
+}
+
+// read the messages of a client until the end of the run
+static void receive(BenchClient& benchClient, const std::atomic<bool>& running, int64_t measureStart, int64_t measureEnd)
+{
+	cl::Client& client = *benchClient.client;
+
+	while (running.load(std::memory_order_relaxed))
+	{
+		if (!client.waitForMessage(std::chrono::milliseconds(10)))
+			continue;
+
+		MessageView message;
+		while (client.getMessage(message))
+		{
+			if (message.type != BENCH_MESSAGE_TYPE || message.size < BENCH_PAYLOAD_SIZE)
+				continue;
+
+			int64_t now  = nanoseconds(Clock::now());
+			int64_t sent = static_cast<int64_t>(readUint64(message.data + 4));
+			benchClient.received++;
+
+			if (sent >= measureStart && sent < measureEnd)
+				benchClient.latencies.push_back(static_cast<uint32_t>(std::min<int64_t>(now - sent, UINT32_MAX)));
+		}
+	}
+}
+
+static cl::ServerStats difference(const cl::ServerStats& end, const cl::ServerStats& start)
+{
+	cl::ServerStats stats = end;
+	stats.waitCalls         -= start.waitCalls;
+	stats.receiveCalls      -= start.receiveCalls;
+	stats.datagramsReceived -= start.datagramsReceived;
+	stats.bytesReceived     -= start.bytesReceived;
+	stats.messagesReceived  -= start.messagesReceived;
+	stats.sendCalls         -= start.sendCalls;
+	stats.datagramsSent     -= start.datagramsSent;
+	stats.bytesSent         -= start.bytesSent;
+	stats.messagesSent      -= start.messagesSent;
+	stats.sendErrors        -= start.sendErrors;
+	stats.bufferDrops       -= start.bufferDrops;
+	stats.outboxDrops       -= start.outboxDrops;
+	stats.routedMessages    -= start.routedMessages;
+	stats.routedCopies      -= start.routedCopies;
+	return stats;
+}
+
+static bool waitForClients(cl::Server& server, std::vector<BenchClient>& clients)
+{
+	Clock::time_point deadline = Clock::now() + std::chrono::milliseconds(BENCH_CONNECT_TIMEOUT_MS);
+
+	while (Clock::now() < deadline)
+	{
+		for (BenchClient& benchClient : clients)
+			benchClient.client->update(BENCH_UPDATE_INTERVAL_MS / 1000.0f);
+
+		if (server.stats().clients.size() == clients.size())
+			return true;
+
+		std::this_thread::sleep_for(std::chrono::milliseconds(BENCH_UPDATE_INTERVAL_MS));
+	}
+
+	return false;
+}
+
+static bool runBenchmark(const Options& options, Scenario scenario, unsigned int clientCount, unsigned int rate,
+                         unsigned int threads, Result& result)
+{
+	cl::Server server(options.port, options.tickRate, DEFAULT_MAX_DATAGRAM_SIZE, options.transport, std::string(),
+	                  options.engine, threads);
+
+	std::vector<BenchClient> clients(clientCount);
+	for (unsigned int i = 0; i < clientCount; i++)
+		clients[i].client.reset(new cl::Client(options.port, i, i & 0x01, true, options.datagramSize, options.transport));
+
+	if (!waitForClients(server, clients))
+	{
+		std::cerr << "Only " << server.stats().clients.size() << " of " << clientCount << " clients connected." << std::endl;
+		return false;
+	}
+
+	// leave time for the connection messages to be received before measuring
+	std::this_thread::sleep_for(std::chrono::milliseconds(BENCH_DRAIN_MS));
+
+	Clock::time_point start = Clock::now();
+	Clock::time_point end   = start + std::chrono::milliseconds(options.durationMs);
+
+	std::atomic<bool> running(true);
+	for (BenchClient& benchClient : clients)
+	{
+		benchClient.latencies.reserve(static_cast<std::size_t>(rate) * options.durationMs / 1000
+			* (scenario == Scenario::Broadcast ? clientCount : 1));
+		benchClient.receiver = std::thread(receive, std::ref(benchClient), std::cref(running), nanoseconds(start), nanoseconds(end));
+	}
+
+	cl::ServerStats startStats = server.stats();
+
+	// the sends of all clients are interleaved in a single schedule
+	Clock::duration   interval   = std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(1.0 / (static_cast<double>(rate) * clientCount)));
+	Clock::time_point nextSend   = start;
+	Clock::time_point nextUpdate = start;
+	uint64_t          sent       = 0;
+
+	uint8_t payload[BENCH_PAYLOAD_SIZE] = {};
+
+	MessageView message;
+	message.type = BENCH_MESSAGE_TYPE;
+	message.size = BENCH_PAYLOAD_SIZE;
+	message.data = payload;
+
+	for (Clock::time_point now = Clock::now(); now < end; now = Clock::now())
+	{
+		if (now >= nextUpdate)
+		{
+			for (BenchClient& benchClient : clients)
+				benchClient.client->update(BENCH_UPDATE_INTERVAL_MS / 1000.0f);
+			nextUpdate = now + std::chrono::milliseconds(BENCH_UPDATE_INTERVAL_MS);
+		}
+
+		if (now < nextSend)
+		{
+			std::this_thread::sleep_until(std::min(nextSend, nextUpdate));
+			continue;
+		}
+
+		// a sender that can't keep up measures the rate it achieves
+		if (now - nextSend > std::chrono::milliseconds(BENCH_MAX_LAG_MS))
+			nextSend = now;
+
+		unsigned int sender = static_cast<unsigned int>(sent % clientCount);
+
+		message.playerIDAndTeam = idAndTeam(sender);
+		message.parameters      = scenario == Scenario::Unicast ? MSG_PRIVATE : MSG_ALL;
+		payload[0]              = idAndTeam((sender + 1) % clientCount);
+		writeUint64(payload + 4, static_cast<uint64_t>(nanoseconds(Clock::now())));
+		writeUint32(payload + 12, static_cast<uint32_t>(sent));
+
+		if (clients[sender].client->sendMessage(message))
+			sent++;
+		else
+			break;
+
+		nextSend += interval;
+	}
+
+	Clock::time_point sendEnd = Clock::now();
+
+	// receive the messages still in flight
+	Clock::time_point drainEnd = sendEnd + std::chrono::milliseconds(BENCH_DRAIN_MS);
+	while (Clock::now() < drainEnd)
+	{
+		for (BenchClient& benchClient : clients)
+			benchClient.client->update(BENCH_UPDATE_INTERVAL_MS / 1000.0f);
+		std::this_thread::sleep_for(std::chrono::milliseconds(BENCH_UPDATE_INTERVAL_MS));
+	}
+
+	running.store(false);
+	for (BenchClient& benchClient : clients)
+		benchClient.receiver.join();
+
+	result.server = difference(server.stats(), startStats);
+
+	std::vector<uint32_t> latencies;
+	result.delivered = 0;
+	for (BenchClient& benchClient : clients)
+	{
+		result.delivered += benchClient.received;
+		latencies.insert(latencies.end(), benchClient.latencies.begin(), benchClient.latencies.end());
+	}
+
+	result.scenario = scenario;
+	result.clients  = clientCount;
+	result.rate     = rate;
+	result.threads  = threads;
+	result.duration = std::chrono::duration<double>(sendEnd - start).count();
+	result.sent     = sent;
+	result.expected = scenario == Scenario::Unicast ? sent : sent * clientCount;
+
+	std::sort(latencies.begin(), latencies.end());
+
+	const double percentiles[3] = { 0.5, 0.99, 0.999 };
+	for (int i = 0; i < 3; i++)
+	{
+		std::size_t rank = static_cast<std::size_t>(percentiles[i] * static_cast<double>(latencies.size()) + 0.999999);
+		result.latencyPercentiles[i] = latencies.empty() ? 0.0 : latencies[std::max<std::size_t>(rank, 1) - 1] / 1000.0;
+	}
+
+	double total = 0.0;
+	for (uint32_t latency : latencies)
+		total += latency;
+	result.latencyMean = latencies.empty() ? 0.0 : total / static_cast<double>(latencies.size()) / 1000.0;
+	result.latencyMax  = latencies.empty() ? 0.0 : latencies.back() / 1000.0;
+
+	// the clients disconnect before the server stops
+	clients.clear();
+	server.stop();
+
+	return true;
+}
+
+static std::string escape(const std::string& text)
+{
+	std::string escaped;
+	for (char character : text)
+	{
+		if (character == '"' || character == '\\')
+			escaped += '\\';
+		if (static_cast<unsigned char>(character) >= 0x20)
+			escaped += character;
+	}
+	return escaped;
+}
+
+static std::string toJson(const Options& options, const std::vector<Result>& results)
+{
+	std::ostringstream json;
+
+	char date[32];
+	std::time_t now = std::time(nullptr);
+	std::strftime(date, sizeof(date), "%Y-%m-%dT%H:%M:%SZ", std::gmtime(&now));
+
+	json << "{\n";
+	json << "  \"benchmark\": \"CommsLibBench\",\n";
+	json << "  \"label\": \"" << escape(options.label) << "\",\n";
+	json << "  \"date\": \"" << date << "\",\n";
+	json << "  \"config\": {\n";
+	json << "    \"duration_ms\": " << options.durationMs << ",\n";
+	json << "    \"tick_rate\": " << options.tickRate << ",\n";
+	json << "    \"datagram_size\": " << options.datagramSize << ",\n";
+	json << "    \"transport\": \"" << transportName(options.transport) << "\",\n";
+	json << "    \"engine\": \"" << engineName(options.engine) << "\",\n";
+	json << "    \"payload_size\": " << BENCH_PAYLOAD_SIZE << ",\n";
+	json << "    \"hardware_threads\": " << std::thread::hardware_concurrency() << "\n";
+	json << "  },\n";
+	json << "  \"results\": [";
+
+	for (std::size_t i = 0; i < results.size(); i++)
+	{
+		const Result& result = results[i];
+
+		json << (i == 0 ? "\n" : ",\n");
+		json << "    {\n";
+		json << "      \"scenario\": \"" << scenarioName(result.scenario) << "\",\n";
+		json << "      \"clients\": " << result.clients << ",\n";
+		json << "      \"rate_per_client\": " << result.rate << ",\n";
+		json << "      \"threads\": " << result.threads << ",\n";
+		json << "      \"duration_s\": " << result.duration << ",\n";
+		json << "      \"sent\": " << result.sent << ",\n";
+		json << "      \"expected\": " << result.expected << ",\n";
+		json << "      \"delivered\": " << result.delivered << ",\n";
+		json << "      \"delivery_ratio\": " << (result.expected ? static_cast<double>(result.delivered) / result.expected : 0.0) << ",\n";
+		json << "      \"messages_per_s\": " << result.sent / result.duration << ",\n";
+		json << "      \"deliveries_per_s\": " << result.delivered / result.duration << ",\n";
+		json << "      \"latency_us\": { "
+		     << "\"mean\": " << result.latencyMean
+		     << ", \"p50\": " << result.latencyPercentiles[0]
+		     << ", \"p99\": " << result.latencyPercentiles[1]
+		     << ", \"p999\": " << result.latencyPercentiles[2]
+		     << ", \"max\": " << result.latencyMax << " },\n";
+		json << "      \"server\": { "
+		     << "\"wait_calls\": " << result.server.waitCalls
+		     << ", \"receive_calls\": " << result.server.receiveCalls
+		     << ", \"datagrams_received\": " << result.server.datagramsReceived
+		     << ", \"send_calls\": " << result.server.sendCalls
+		     << ", \"datagrams_sent\": " << result.server.datagramsSent
+		     << ", \"routed_copies\": " << result.server.routedCopies
+		     << ", \"send_errors\": " << result.server.sendErrors
+		     << ", \"buffer_drops\": " << result.server.bufferDrops
+		     << ", \"syscalls_per_message\": " << syscallsPerMessage(result.server) << " }\n";
+		json << "    }";
+	}
+
+	json << "\n  ]\n}\n";
+	return json.str();
+}
+
+template <typename T>
+static bool parseList(const char* text, std::vector<T>& values, T (*parse)(const std::string&, bool&))
+{
+	values.clear();
+
+	std::stringstream list(text);
+	std::string       item;
+	while (std::getline(list, item, ','))
+	{
+		bool valid = true;
+		values.push_back(parse(item, valid));
+		if (!valid)
+			return false;
+	}
+
+	return !values.empty();
+}
+
+static unsigned int parseNumber(const std::string& text, bool& valid)
+{
+	char*         end   = nullptr;
+	unsigned long value = std::strtoul(text.c_str(), &end, 10);
+	valid = !text.empty() && *end == '\0' && value > 0 && value <= 1000000;
+	return static_cast<unsigned int>(value);
+}
+
+static Scenario parseScenario(const std::string& text, bool& valid)
+{
+	valid = text == "unicast" || text == "broadcast";
+	return text == "unicast" ? Scenario::Unicast : Scenario::Broadcast;
+}
+
+static void printUsage(const char* program)
+{
+	std::cerr << "Usage: " << program << " [options]\n"
+	          << "  --scenarios LIST    unicast,broadcast (default: both)\n"
+	          << "  --clients LIST      client counts, at most " << MAX_CLIENTS << " (default: 1,2,4,8,16,32,64,128)\n"
+	          << "  --rates LIST        messages per second of each client (default: 60,1000)\n"
+	          << "  --duration MS       time messages are sent for in each run (default: " << BENCH_DEFAULT_DURATION_MS << ")\n"
+	          << "  --tick-rate N       tick rate of the server, 0 dispatches immediately (default: 0)\n"
+	          << "  --datagram-size N   largest datagram of the clients (default: " << sizeof(Message) << ", no coalescing)\n"
+	          << "  --port N            port of the server (default: " << BENCH_DEFAULT_PORT << ")\n"
+	          << "  --transport NAME    udp, shm (shared memory) or unix (default: udp)\n"
+	          << "  --engine NAME       epoll or io_uring, how the server uses its UDP socket (default: epoll)\n"
+	          << "  --threads LIST      threads of the server receiving and sending UDP datagrams, at most "
+	          << MAX_SERVER_THREADS << " (default: 1)\n"
+	          << "  --label TEXT        written in the results, e.g. the version benchmarked\n"
+	          << "  --output FILE       write the JSON results to FILE instead of the standard output\n";
+}
+
+static bool parseOptions(int argc, char** argv, Options& options)
+{
+	for (int i = 1; i < argc; i++)
+	{
+		std::string option = argv[i];
+		if (option == "--help" || option == "-h" || i + 1 == argc)
+			return false;
+
+		const char* value = argv[++i];
+		bool        valid = true;
+
+		if (option == "--scenarios")
+			valid = parseList(value, options.scenarios, parseScenario);
+		else if (option == "--clients")
+			valid = parseList(value, options.clientCounts, parseNumber)
+			     && *std::max_element(options.clientCounts.begin(), options.clientCounts.end()) <= MAX_CLIENTS;
+		else if (option == "--rates")
+			valid = parseList(value, options.rates, parseNumber);
+		else if (option == "--threads")
+			valid = parseList(value, options.threadCounts, parseNumber)
+			     && *std::max_element(options.threadCounts.begin(), options.threadCounts.end()) <= MAX_SERVER_THREADS;
+		else if (option == "--duration")
+			options.durationMs = parseNumber(value, valid);
+		else if (option == "--tick-rate")
+			options.tickRate = std::strcmp(value, "0") == 0 ? 0 : parseNumber(value, valid);
+		else if (option == "--datagram-size")
+		{
+			options.datagramSize = static_cast<uint16_t>(parseNumber(value, valid));
+			valid = valid && options.datagramSize >= sizeof(Message) && options.datagramSize <= MAX_DATAGRAM_SIZE;
+		}
+		else if (option == "--port")
+		{
+			unsigned int port = parseNumber(value, valid);
+			options.port = static_cast<uint16_t>(port);
+			valid = valid && port + MAX_CLIENTS < 65536;
+		}
+		else if (option == "--transport")
+		{
+			valid = false;
+			for (cl::Transport transport : { cl::Transport::Udp, cl::Transport::SharedMemory, cl::Transport::UnixDatagram })
+			{
+				if (std::strcmp(value, transportName(transport)) == 0)
+				{
+					options.transport = transport;
+					valid             = true;
+				}
+			}
+		}
+		else if (option == "--engine")
+		{
+			valid = false;
+			for (cl::IoEngine engine : { cl::IoEngine::Epoll, cl::IoEngine::IoUring })
+			{
+				if (std::strcmp(value, engineName(engine)) == 0)
+				{
+					options.engine = engine;
+					valid          = true;
+				}
+			}
+		}
+		else if (option == "--label")
+			options.label = value;
+		else if (option == "--output")
+			options.output = value;
+		else
+			valid = false;
+
+		if (!valid)
+		{
+			std::cerr << "Invalid option: " << option << ' ' << value << std::endl;
+			return false;
+		}
+	}
+
+	return true;
+}
+
+int main(int argc, char** argv)
+{
+	Options options;
+	if (!parseOptions(argc, argv, options))
+	{
+		printUsage(argv[0]);
+		return 1;
+	}
+
+	// the results are written to the standard output, like the logs
+	cl::Logger::setLevel(cl::LogLevel::Error);
+
+	std::vector<Result> results;
+	for (Scenario scenario : options.scenarios)
+	{
+		for (unsigned int clientCount : options.clientCounts)
+		{
+			for (unsigned int rate : options.rates)
+			{
+				for (unsigned int threads : options.threadCounts)
+				{
+					Result result;
+					if (!runBenchmark(options, scenario, clientCount, rate, threads, result))
+						return 1;
+
+					std::fprintf(stderr, "%-9s %3u clients %6u msg/s %2u threads: %9.0f msg/s sent, %10.0f delivered/s (%5.1f%%), p50 %8.1f us, p99 %8.1f us, p99.9 %8.1f us, %5.2f syscalls/msg\n",
+						scenarioName(scenario), clientCount, rate, threads, result.sent / result.duration, result.delivered / result.duration,
+						result.expected ? 100.0 * result.delivered / result.expected : 0.0,
+						result.latencyPercentiles[0], result.latencyPercentiles[1], result.latencyPercentiles[2],
+						syscallsPerMessage(result.server));
+
+					results.push_back(result);
+				}
+			}
+		}
+	}
+
+	cl::Logger::flush();
+
+	std::string json = toJson(options, results);
+	if (options.output.empty())
+	{
+		std::cout << json;
+		return 0;
+	}
+
+	std::ofstream file(options.output);
+	file << json;
+	if (!file)
+	{
+		std::cerr << "Could not write " << options.output << '.' << std::endl;
+		return 1;
+	}
+
+	return 0;
+}
@@ -0,0 +1,249 @@
+#include "Check.hpp"
+
+#include <ClientTable.hpp>
+
+#include <cstdint>
+#include <map>
+#include <random>
+#include <utility>
+#include <vector>
+
+// ClientTable against a reference map: lookups by id and by address,
+// team lists, release() and compact(), and the backward shift deletion
+// of its open-addressed address table.
+
+#define ADDRESS_TABLE_SIZE (2 * MAX_CLIENTS) // as in ClientTable.cpp
+
+using Endpoint = std::pair<uint32_t, uint16_t>;
+
+// same hash as ClientTable.cpp, to build probe sequences on purpose
+static std::size_t addressHash(uint32_t address, uint16_t port)
+{
+	uint32_t hash = (address ^ (static_cast<uint32_t>(port) << 16 | port)) * 2654435761u;
+	return (hash >> 16) & (ADDRESS_TABLE_SIZE - 1);
+}
+
+static cl::ClientInfo makeClient(uint8_t idAndTeam, uint32_t address, uint16_t port)
+{
+	cl::ClientInfo client;
+	client.idAndTeam = idAndTeam;
+	client.address   = address;
+	client.port      = port;
+	return client;
+}
+
+// endpoints whose ideal slot is the given one
+static std::vector<Endpoint> collidingEndpoints(std::size_t slot, std::size_t count)
+{
+	std::vector<Endpoint> endpoints;
+	for (uint16_t port = 1; endpoints.size() < count; port++)
+	{
+		if (addressHash(0x7F000001, port) == slot)
+			endpoints.emplace_back(0x7F000001, port);
+	}
+	return endpoints;
+}
+
+// every client of the model can be found and nothing else. The team
+// lists only drop the released clients once compacted.
+static void checkTable(const cl::ClientTable& table, const std::map<uint8_t, Endpoint>& model)
+{
+	std::size_t teamCounts[2] = {};
+
+	for (const auto& entry : model)
+	{
+		int index = table.find(entry.first);
+		CHECK(index >= 0);
+		if (index < 0)
+			continue;
+
+		CHECK(table.find(entry.second.first, entry.second.second) == index);
+		CHECK(table[index].idAndTeam == entry.first);
+		CHECK(table[index].address == entry.second.first);
+		CHECK(table[index].port == entry.second.second);
+		teamCounts[entry.first & 0x01]++;
+	}
+
+	for (unsigned int idAndTeam = 0; idAndTeam < 256; idAndTeam++)
+	{
+		if (model.count(static_cast<uint8_t>(idAndTeam)) == 0)
+			CHECK(table.find(static_cast<uint8_t>(idAndTeam)) == -1);
+	}
+
+	if (table.size() != model.size())
+		return;
+
+	for (uint8_t team = 0; team < 2; team++)
+	{
+		CHECK(table.teamSize(team) == teamCounts[team]);
+		for (std::size_t position = 0; position < table.teamSize(team); position++)
+		{
+			std::size_t index = table.teamMember(team, position);
+			CHECK(index < table.size());
+			CHECK((table[index].idAndTeam & 0x01) == team);
+			CHECK(table[index].address != INADDR_ANY);
+		}
+	}
+}
+
+static void testAddAndFind()
+{
+	cl::ClientTable table;
+	CHECK(table.empty());
+	CHECK(table.find(0x02) == -1);
+	CHECK(table.find(0x7F000001, 1234) == -1);
+
+	int index = table.add(makeClient(0x02, 0x7F000001, 1234));
+	CHECK(index == 0);
+	CHECK(!table.empty());
+	CHECK(table.find(0x02) == 0);
+	CHECK(table.find(0x7F000001, 1234) == 0);
+	CHECK(table.find(0x7F000001, 1235) == -1);
+	CHECK(table.find(0x7F000002, 1234) == -1);
+	CHECK(table.teamSize(0) == 1);
+	CHECK(table.teamSize(1) == 0);
+}
+
+static void testFull()
+{
+	cl::ClientTable table;
+	for (unsigned int i = 0; i < MAX_CLIENTS; i++)
+		CHECK(table.add(makeClient(static_cast<uint8_t>(i), 0x7F000001, static_cast<uint16_t>(1000 + i))) == static_cast<int>(i));
+
+	CHECK(table.full());
+	CHECK(table.add(makeClient(0xF0, 0x7F000001, 999)) == -1);
+	CHECK(table.find(0xF0) == -1);
+
+	// every slot of the address table is reachable even at full load
+	for (unsigned int i = 0; i < MAX_CLIENTS; i++)
+		CHECK(table.find(0x7F000001, static_cast<uint16_t>(1000 + i)) == static_cast<int>(i));
+
+	// a released client only frees its slot once compacted
+	table.release(5);
+	CHECK(table.full());
+	CHECK(table.compact());
+	CHECK(!table.full());
+	CHECK(table.add(makeClient(0xF0, 0x7F000001, 999)) == MAX_CLIENTS - 1);
+}
+
+static void testRelease()
+{
+	cl::ClientTable table;
+	table.add(makeClient(0x02, 0x7F000001, 1));
+	table.add(makeClient(0x05, 0x7F000001, 2));
+	table.add(makeClient(0x08, 0x7F000001, 3));
+
+	// released clients keep their index until compact()
+	table.release(0);
+	table.release(0);
+	CHECK(table.size() == 3);
+	CHECK(table[0].address == INADDR_ANY);
+	CHECK(table.find(0x02) == -1);
+	CHECK(table.find(0x7F000001, 1) == -1);
+	CHECK(table.find(0x05) == 1);
+
+	CHECK(table.compact());
+	CHECK(!table.compact());
+	CHECK(table.size() == 2);
+	checkTable(table, { { 0x05, { 0x7F000001, 2 } }, { 0x08, { 0x7F000001, 3 } } });
+
+	table.release(0);
+	table.release(1);
+	CHECK(table.empty());
+	CHECK(table.compact());
+	CHECK(table.size() == 0);
+	checkTable(table, {});
+}
+
+// deleting from a probe sequence must move the next entries up, across the end of the table too
+static void testBackwardShift()
+{
+	const std::size_t slots[] = { 17, ADDRESS_TABLE_SIZE - 2 };
+
+	for (std::size_t slot : slots)
+	{
+		std::vector<Endpoint> cluster = collidingEndpoints(slot, 4);
+		std::vector<Endpoint> next    = collidingEndpoints((slot + 2) % ADDRESS_TABLE_SIZE, 1);
+
+		// the cluster takes slot to slot + 2, pushing the entry of slot + 2 to slot + 3
+		cl::ClientTable             table;
+		std::map<uint8_t, Endpoint> model;
+		uint8_t                     idAndTeam = 0;
+		for (const Endpoint& endpoint : { cluster[0], cluster[1], cluster[2], next[0], cluster[3] })
+		{
+			table.add(makeClient(idAndTeam, endpoint.first, endpoint.second));
+			model[idAndTeam++] = endpoint;
+		}
+		checkTable(table, model);
+
+		// remove from the head, the middle and the tail of the sequence
+		const uint8_t removed[] = { 0, 3, 4, 2, 1 };
+		for (uint8_t id : removed)
+		{
+			table.release(static_cast<std::size_t>(table.find(id)));
+			model.erase(id);
+			checkTable(table, model);
+
+			table.compact();
+			checkTable(table, model);
+		}
+	}
+}
+
+// random operations against the reference map, with a table kept nearly full
+static void testRandomOperations()
+{
+	std::mt19937 random(1234);
+
+	cl::ClientTable             table;
+	std::map<uint8_t, Endpoint> model;
+
+	for (int step = 0; step < 20000; step++)
+	{
+		unsigned int operation = random() % 8;
+
+		if (operation < 5 && !table.full())
+		{
+			uint8_t  idAndTeam = static_cast<uint8_t>(random());
+			Endpoint endpoint(0x7F000000 | (random() % 4), static_cast<uint16_t>(1 + random() % 512));
+
+			bool used = model.count(idAndTeam) > 0;
+			for (const auto& entry : model)
+				used = used || entry.second == endpoint;
+			if (used || table.find(idAndTeam) >= 0)
+				continue;
+
+			CHECK(table.add(makeClient(idAndTeam, endpoint.first, endpoint.second)) >= 0);
+			model[idAndTeam] = endpoint;
+		}
+		else if (operation < 7 && !model.empty())
+		{
+			auto entry = model.begin();
+			std::advance(entry, random() % model.size());
+
+			table.release(static_cast<std::size_t>(table.find(entry->first)));
+			model.erase(entry);
+		}
+		else
+		{
+			table.compact();
+			CHECK(table.size() == model.size());
+		}
+
+		if (step % 97 == 0)
+			checkTable(table, model);
+	}
+
+	checkTable(table, model);
+}
+
+int main()
+{
+	testAddAndFind();
+	testFull();
+	testRelease();
+	testBackwardShift();
+	testRandomOperations();
+
+	return TEST_RESULT();
+}
@@ -0,0 +1,166 @@
+#include "Check.hpp"
+
+#include <Client.hpp>
+#include <Log.hpp>
+#include <Server.hpp>
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <chrono>
+#include <cstring>
+#include <thread>
+
+// A client that goes silent is disconnected after the client timeout:
+// the others are told, the client itself is told and connects again
+// once it updates. A legacy client, which never pings nor sends
+// heartbeats, stays connected.
+
+#define TIMEOUT_TEST_PORT       43340
+#define TIMEOUT_TEST_TIMEOUT_MS 300
+#define TIMEOUT_TEST_PING_MS    50
+
+#define TIMEOUT_TEST_SILENT 1 // ids of the clients
+#define TIMEOUT_TEST_ALIVE  2
+#define TIMEOUT_TEST_LEGACY 3
+
+using Clock = std::chrono::steady_clock;
+
+static bool hasClient(const cl::Server& server, uint8_t idAndTeam)
+{
+	for (const cl::ClientStats& client : server.stats().clients)
+	{
+		if (client.idAndTeam == idAndTeam)
+			return true;
+	}
+
+	return false;
+}
+
+// a client of the fixed format, announcing no capability
+static bool connectLegacy(int& legacy)
+{
+	legacy = ::socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+
+	timeval timeout = { 0, 100000 };
+	setsockopt(legacy, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+
+	sockaddr_in address;
+	std::memset(&address, 0, sizeof(address));
+	address.sin_family      = AF_INET;
+	address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	address.sin_port        = htons(TIMEOUT_TEST_PORT);
+	if (::connect(legacy, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0)
+		return false;
+
+	Message request;
+	request.playerIDAndTeam = TIMEOUT_TEST_LEGACY << 1;
+	request.parameters      = MSG_ALL;
+	request.type            = MSG_CONNECT;
+
+	// the server binds its socket once its thread started, until then the requests are refused
+	Clock::time_point deadline = Clock::now() + std::chrono::seconds(5);
+	while (Clock::now() < deadline)
+	{
+		send(legacy, &request, sizeof(request), 0);
+
+		Message answer;
+		while (recv(legacy, &answer, sizeof(answer), 0) == sizeof(answer))
+		{
+			if (answer.type == MSG_CONNECT && answer.playerIDAndTeam == request.playerIDAndTeam)
+				return true;
+		}
+	}
+
+	return false;
+}
+
+// the legacy client reads the disconnection broadcast by the server
+static bool receiveDisconnect(int legacy, uint8_t idAndTeam)
+{
+	Clock::time_point deadline = Clock::now() + std::chrono::seconds(2);
+	while (Clock::now() < deadline)
+	{
+		Message message;
+		if (recv(legacy, &message, sizeof(message), 0) != sizeof(message))
+			continue;
+
+		if (message.type == MSG_DISCONNECT && message.playerIDAndTeam == idAndTeam
+		 && message.data[0] == MSG_DISCONNECT_SRC_SERVER)
+			return true;
+	}
+
+	return false;
+}
+
+// only the clients given are updated, the others stay silent
+static void update(cl::Client& client, cl::Client* other, unsigned int milliseconds)
+{
+	Clock::time_point end = Clock::now() + std::chrono::milliseconds(milliseconds);
+	while (Clock::now() < end)
+	{
+		client.update(0.01f);
+		if (other != nullptr)
+			other->update(0.01f);
+
+		std::this_thread::sleep_for(std::chrono::milliseconds(10));
+	}
+}
+
+// until both clients are connected
+static bool connect(const cl::Server& server, cl::Client& silent, cl::Client& alive)
+{
+	Clock::time_point deadline = Clock::now() + std::chrono::seconds(5);
+	while (Clock::now() < deadline)
+	{
+		update(silent, &alive, 10);
+		if (silent.isConnected() && hasClient(server, TIMEOUT_TEST_SILENT << 1)
+		 && alive.isConnected()  && hasClient(server, TIMEOUT_TEST_ALIVE << 1))
+			return true;
+	}
+
+	return false;
+}
+
+int main()
+{
+	cl::Logger::setLevel(cl::LogLevel::Error);
+
+	cl::Server server(TIMEOUT_TEST_PORT, 0);
+	CHECK(server.isRunning());
+	server.setPingInterval(std::chrono::milliseconds(TIMEOUT_TEST_PING_MS));
+	server.setClientTimeout(std::chrono::milliseconds(TIMEOUT_TEST_TIMEOUT_MS));
+
+	int legacy = -1;
+	CHECK(connectLegacy(legacy));
+
+	cl::Client silent(TIMEOUT_TEST_PORT, TIMEOUT_TEST_SILENT, false);
+	cl::Client alive(TIMEOUT_TEST_PORT, TIMEOUT_TEST_ALIVE, false);
+	CHECK(connect(server, silent, alive));
+
+	// only the silent client is disconnected, the legacy one never sent anything either
+	update(alive, nullptr, TIMEOUT_TEST_TIMEOUT_MS * 3);
+	CHECK(!hasClient(server, TIMEOUT_TEST_SILENT << 1));
+	CHECK(hasClient(server, TIMEOUT_TEST_ALIVE << 1));
+	CHECK(hasClient(server, TIMEOUT_TEST_LEGACY << 1));
+	CHECK(alive.isConnected());
+
+	// the others are told
+	CHECK(receiveDisconnect(legacy, TIMEOUT_TEST_SILENT << 1));
+
+	// the silent client reads that it was disconnected as soon as it updates again...
+	silent.update(0.01f);
+	CHECK(!silent.isConnected());
+
+	// ...and connects again
+	CHECK(connect(server, silent, alive));
+	CHECK(hasClient(server, TIMEOUT_TEST_LEGACY << 1));
+
+	close(legacy);
+	server.stop();
+	cl::Logger::flush();
+
+	return TEST_RESULT();
+}
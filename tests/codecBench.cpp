@@ -0,0 +1,352 @@
+#include <Codec.hpp>
+#include <Tmcp.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <string>
+#include <vector>
+
+// Microbenchmark of the message codecs (Codec.hpp).
+//
+// For every message type, a pass encodes an array of structs into the
+// data of as many messages, then decodes them back. The same pass with
+// a raw memcpy of the structs, which is what the bots did before and
+// gets neither the byte order nor the layout right across platforms, is
+// the reference. The fastest of all passes is kept, so the scheduler
+// does not skew the results. The program fails if a codec is more than
+// --max-ratio times slower than memcpy. A layout listing the members in
+// another order than they are declared is copied field by field instead
+// of at once, and has its own limit, --max-reordered-ratio.
+
+#define CODEC_BENCH_MESSAGES  4096 //!< Messages of a pass, their data fits in L2
+#define CODEC_BENCH_PASSES    200
+#define CODEC_BENCH_MAX_RATIO 1.10 //!< Allowed codec / memcpy time, for the noise of the measure
+
+#define CODEC_BENCH_MAX_REORDERED_RATIO 4.0 //!< Allowed codec / memcpy time of a layout copied field by field
+
+using Clock = std::chrono::steady_clock;
+
+// a user-defined type larger than the TMCP messages
+struct BenchState
+{
+	double  time;
+	float   position[3];
+	float   velocity[3];
+	float   rotation[4];
+	int32_t frame;
+	int32_t boost;
+};
+
+// the same members, sent in another order than they are declared: copied field by field
+struct BenchReordered
+{
+	double  time;
+	float   position[3];
+	float   velocity[3];
+	float   rotation[4];
+	int32_t frame;
+	int32_t boost;
+};
+
+// declared in the order BenchReordered is sent, its wire format is the same
+struct BenchReorderedWire
+{
+	int32_t frame;
+	int32_t boost;
+	float   rotation[4];
+	float   velocity[3];
+	float   position[3];
+	double  time;
+};
+
+namespace cl
+{
+template <> struct WireLayout<BenchState> : WireFields<0x42, &BenchState::time, &BenchState::position, &BenchState::velocity,
+                                                      &BenchState::rotation, &BenchState::frame, &BenchState::boost> {};
+template <> struct WireLayout<BenchReordered> : WireFields<0x43, &BenchReordered::frame, &BenchReordered::boost, &BenchReordered::rotation,
+                                                          &BenchReordered::velocity, &BenchReordered::position, &BenchReordered::time> {};
+template <> struct WireLayout<BenchReorderedWire> : WireFields<0x43, &BenchReorderedWire::frame, &BenchReorderedWire::boost, &BenchReorderedWire::rotation,
+                                                              &BenchReorderedWire::velocity, &BenchReorderedWire::position, &BenchReorderedWire::time> {};
+} // cl
+
+struct Options
+{
+	unsigned int passes            = CODEC_BENCH_PASSES;
+	double       maxRatio          = CODEC_BENCH_MAX_RATIO;
+	double       maxReorderedRatio = CODEC_BENCH_MAX_REORDERED_RATIO;
+};
+
+static volatile uint8_t sink; // keeps the results of the passes alive
+
+static float randomFloat(std::mt19937& random)
+{
+	return std::uniform_real_distribution<float>(-4096.0f, 4096.0f)(random);
+}
+
+static void randomize(std::mt19937& random, cl::TmcpBall& value)
+{
+	value.time = randomFloat(random);
+	for (float& component : value.direction)
+		component = randomFloat(random);
+}
+
+static void randomize(std::mt19937& random, cl::TmcpBoost& value)
+{
+	value.target = static_cast<int32_t>(random() % 34);
+}
+
+static void randomize(std::mt19937& random, cl::TmcpDemo& value)
+{
+	value.target = static_cast<int32_t>(random() % 8);
+	value.time   = randomFloat(random);
+}
+
+static void randomize(std::mt19937& random, BenchState& value)
+{
+	value.time = randomFloat(random);
+	for (float& component : value.position)
+		component = randomFloat(random);
+	for (float& component : value.velocity)
+		component = randomFloat(random);
+	for (float& component : value.rotation)
+		component = randomFloat(random);
+	value.frame = static_cast<int32_t>(random());
+	value.boost = static_cast<int32_t>(random() % 101);
+}
+
+static void randomize(std::mt19937& random, BenchReordered& value)
+{
+	value.time = randomFloat(random);
+	for (float& component : value.position)
+		component = randomFloat(random);
+	for (float& component : value.velocity)
+		component = randomFloat(random);
+	for (float& component : value.rotation)
+		component = randomFloat(random);
+	value.frame = static_cast<int32_t>(random());
+	value.boost = static_cast<int32_t>(random() % 101);
+}
+
+template <typename T, bool Codec>
+static double encodePass(const std::vector<T>& values, std::vector<Message>& messages)
+{
+	Clock::time_point start = Clock::now();
+
+	for (std::size_t i = 0; i < values.size(); i++)
+	{
+		if (Codec)
+			cl::encode(messages[i].data, values[i]);
+		else
+			std::memcpy(messages[i].data, &values[i], sizeof(T));
+	}
+
+	Clock::time_point end = Clock::now();
+	sink = messages[values.size() / 2].data[0];
+
+	return std::chrono::duration<double, std::nano>(end - start).count();
+}
+
+template <typename T, bool Codec>
+static double decodePass(const std::vector<Message>& messages, std::vector<T>& values)
+{
+	Clock::time_point start = Clock::now();
+
+	for (std::size_t i = 0; i < values.size(); i++)
+	{
+		if (Codec)
+			cl::decode(messages[i].data, values[i]);
+		else
+			std::memcpy(&values[i], messages[i].data, sizeof(T));
+	}
+
+	Clock::time_point end = Clock::now();
+	sink = reinterpret_cast<const uint8_t*>(&values[values.size() / 2])[0];
+
+	return std::chrono::duration<double, std::nano>(end - start).count();
+}
+
+// fastest pass of each kind, in nanoseconds per message
+struct Timings
+{
+	double encodeCodec  = 1e300;
+	double encodeMemcpy = 1e300;
+	double decodeCodec  = 1e300;
+	double decodeMemcpy = 1e300;
+};
+
+template <typename T>
+static Timings runBenchmark(const Options& options)
+{
+	std::mt19937 random(42);
+
+	std::vector<T> values(CODEC_BENCH_MESSAGES);
+	for (T& value : values)
+		randomize(random, value);
+
+	std::vector<T>       decoded(CODEC_BENCH_MESSAGES);
+	std::vector<Message> messages(CODEC_BENCH_MESSAGES);
+
+	// the kinds of passes alternate, so they all see the same conditions
+	Timings timings;
+	for (unsigned int pass = 0; pass < options.passes; pass++)
+	{
+		timings.encodeCodec  = std::min(timings.encodeCodec,  encodePass<T, true>(values, messages));
+		timings.decodeCodec  = std::min(timings.decodeCodec,  decodePass<T, true>(messages, decoded));
+		timings.encodeMemcpy = std::min(timings.encodeMemcpy, encodePass<T, false>(values, messages));
+		timings.decodeMemcpy = std::min(timings.decodeMemcpy, decodePass<T, false>(messages, decoded));
+	}
+
+	timings.encodeCodec  /= CODEC_BENCH_MESSAGES;
+	timings.encodeMemcpy /= CODEC_BENCH_MESSAGES;
+	timings.decodeCodec  /= CODEC_BENCH_MESSAGES;
+	timings.decodeMemcpy /= CODEC_BENCH_MESSAGES;
+
+	return timings;
+}
+
+// codecs must be exact, or their speed means nothing
+template <typename T>
+static bool checkRoundTrip()
+{
+	std::mt19937 random(7);
+
+	T value;
+	randomize(random, value);
+
+	Message message = cl::makeMessage(value);
+
+	T decoded;
+	std::memset(&decoded, 0, sizeof(T));
+	if (!cl::readMessage(MessageView(message, cl::wireSize<T>()), decoded))
+		return false;
+
+	return std::memcmp(&value, &decoded, sizeof(T)) == 0;
+}
+
+// field by field, the members are written in the order of the layout
+static bool checkReorderedWire()
+{
+	std::mt19937 random(11);
+
+	BenchReordered value;
+	randomize(random, value);
+
+	BenchReorderedWire wire;
+	wire.frame = value.frame;
+	wire.boost = value.boost;
+	std::memcpy(wire.rotation, value.rotation, sizeof(wire.rotation));
+	std::memcpy(wire.velocity, value.velocity, sizeof(wire.velocity));
+	std::memcpy(wire.position, value.position, sizeof(wire.position));
+	wire.time = value.time;
+
+	uint8_t encoded[sizeof(BenchReordered)];
+	uint8_t expected[sizeof(BenchReorderedWire)];
+	cl::encode(encoded, value);
+	cl::encode(expected, wire);
+
+	return std::memcmp(encoded, expected, sizeof(encoded)) == 0;
+}
+
+template <typename T>
+static bool report(const char* name, const Options& options, double maxRatio)
+{
+	if (!checkRoundTrip<T>())
+	{
+		std::fprintf(stderr, "%-6s the decoded struct differs from the encoded one.\n", name);
+		return false;
+	}
+
+	Timings timings = runBenchmark<T>(options);
+
+	double encodeRatio = timings.encodeCodec / timings.encodeMemcpy;
+	double decodeRatio = timings.decodeCodec / timings.decodeMemcpy;
+
+	std::printf("%-6s %2u bytes: encode %6.2f ns/msg (memcpy %6.2f, ratio %4.2f), decode %6.2f ns/msg (memcpy %6.2f, ratio %4.2f)\n",
+		name, static_cast<unsigned int>(cl::wireSize<T>()),
+		timings.encodeCodec, timings.encodeMemcpy, encodeRatio,
+		timings.decodeCodec, timings.decodeMemcpy, decodeRatio);
+
+	if (encodeRatio > maxRatio || decodeRatio > maxRatio)
+	{
+		std::fprintf(stderr, "%-6s the codec is slower than memcpy (more than %.2f times).\n", name, maxRatio);
+		return false;
+	}
+
+	return true;
+}
+
+static void printUsage(const char* program)
+{
+	std::fprintf(stderr,
+		"Usage: %s [options]\n"
+		"  --passes N       passes of each kind, the fastest is kept (default: %u)\n"
+		"  --max-ratio R    fail if a codec takes more than R times the time of memcpy (default: %.2f)\n"
+		"  --max-reordered-ratio R\n"
+		"                   the same for the layout sent field by field (default: %.2f)\n",
+		program, CODEC_BENCH_PASSES, CODEC_BENCH_MAX_RATIO, CODEC_BENCH_MAX_REORDERED_RATIO);
+}
+
+static bool parseOptions(int argc, char** argv, Options& options)
+{
+	for (int i = 1; i < argc; i++)
+	{
+		std::string option = argv[i];
+		if (i + 1 >= argc)
+			return false;
+
+		char* end = nullptr;
+		if (option == "--passes")
+		{
+			options.passes = static_cast<unsigned int>(std::strtoul(argv[++i], &end, 10));
+			if (*end != '\0' || options.passes == 0)
+				return false;
+		}
+		else if (option == "--max-ratio")
+		{
+			options.maxRatio = std::strtod(argv[++i], &end);
+			if (*end != '\0' || options.maxRatio <= 0.0)
+				return false;
+		}
+		else if (option == "--max-reordered-ratio")
+		{
+			options.maxReorderedRatio = std::strtod(argv[++i], &end);
+			if (*end != '\0' || options.maxReorderedRatio <= 0.0)
+				return false;
+		}
+		else
+		{
+			return false;
+		}
+	}
+
+	return true;
+}
+
+int main(int argc, char** argv)
+{
+	Options options;
+	if (!parseOptions(argc, argv, options))
+	{
+		printUsage(argv[0]);
+		return 1;
+	}
+
+	bool success = true;
+	success &= report<cl::TmcpBoost>("boost", options, options.maxRatio);
+	success &= report<cl::TmcpDemo>("demo", options, options.maxRatio);
+	success &= report<cl::TmcpBall>("ball", options, options.maxRatio);
+	success &= report<BenchState>("state", options, options.maxRatio);
+	success &= report<BenchReordered>("order", options, options.maxReorderedRatio);
+
+	if (!checkReorderedWire())
+	{
+		std::fprintf(stderr, "order  the fields are not sent in the order of the layout.\n");
+		success = false;
+	}
+
+	return success ? 0 : 1;
+}
@@ -0,0 +1,231 @@
+#include "Check.hpp"
+
+#include <Delta.hpp>
+
+#include <cstdint>
+#include <cstring>
+#include <random>
+#include <vector>
+
+// Delta encoding: round trips against a baseline, the history replacing
+// old snapshots, and the fallback to a keyframe when the baseline is
+// unknown or a delta would not be smaller.
+
+#define DELTA_KEYFRAME 0x00 // as in Delta.cpp
+#define DELTA_XOR      0x01
+
+#define DELTA_XOR_HEADER_SIZE 5
+
+using Snapshot = std::vector<uint8_t>;
+
+// encode and decode with the same history, as the sender and the receiver both keep it
+static bool roundTrip(const Snapshot& snapshot, uint16_t sequence, const cl::SnapshotHistory& history,
+                      bool hasBaseline, uint16_t baselineSequence, uint8_t& kind, std::size_t& encodedSize)
+{
+	uint8_t payload[MAX_PAYLOAD_SIZE];
+	encodedSize = cl::encodeDelta(payload, sequence, snapshot.data(), static_cast<uint16_t>(snapshot.size()),
+	                              history, hasBaseline, baselineSequence);
+	kind = payload[0];
+
+	uint8_t  decoded[MAX_SNAPSHOT_SIZE];
+	uint16_t size;
+	uint16_t decodedSequence;
+	if (!cl::decodeDelta(payload, encodedSize, history, decoded, size, decodedSequence))
+		return false;
+
+	return decodedSequence == sequence && size == snapshot.size() && std::memcmp(decoded, snapshot.data(), size) == 0;
+}
+
+static Snapshot randomSnapshot(std::mt19937& random, std::size_t size)
+{
+	Snapshot snapshot(size);
+	for (uint8_t& byte : snapshot)
+		byte = static_cast<uint8_t>(random());
+	return snapshot;
+}
+
+static void testHistory()
+{
+	cl::SnapshotHistory history;
+	const uint8_t*      data;
+	uint16_t            size;
+	CHECK(!history.find(0, data, size));
+
+	uint8_t snapshot[4] = { 1, 2, 3, 4 };
+	history.store(7, snapshot, 4);
+	CHECK(history.find(7, data, size));
+	CHECK(size == 4 && std::memcmp(data, snapshot, 4) == 0);
+	CHECK(!history.find(7 + DELTA_HISTORY_SIZE, data, size));
+
+	// snapshot n is replaced by snapshot n + DELTA_HISTORY_SIZE, across the wrap of the sequence numbers too
+	history.store(7 + DELTA_HISTORY_SIZE, snapshot, 2);
+	CHECK(!history.find(7, data, size));
+	CHECK(history.find(7 + DELTA_HISTORY_SIZE, data, size) && size == 2);
+
+	history.store(0xFFFF, snapshot, 3);
+	history.store(0, snapshot, 1);
+	CHECK(history.find(0xFFFF, data, size) && size == 3);
+	CHECK(history.find(0, data, size) && size == 1);
+
+	history.clear();
+	CHECK(!history.find(0xFFFF, data, size));
+	CHECK(!history.find(7 + DELTA_HISTORY_SIZE, data, size));
+}
+
+// small changes to a known baseline are sent as a delta, whatever the sizes
+static void testDelta()
+{
+	std::mt19937        random(1234);
+	cl::SnapshotHistory history;
+	Snapshot            baseline = randomSnapshot(random, 200);
+	history.store(10, baseline.data(), static_cast<uint16_t>(baseline.size()));
+
+	uint8_t     kind;
+	std::size_t encodedSize;
+
+	// unchanged: only the header and the size
+	CHECK(roundTrip(baseline, 11, history, true, 10, kind, encodedSize));
+	CHECK(kind == DELTA_XOR);
+	CHECK(encodedSize < 10);
+
+	// a few bytes changed, at the start, in the middle and at the end
+	Snapshot changed = baseline;
+	changed[0]   ^= 0x01;
+	changed[100] ^= 0x80;
+	changed[199] ^= 0xFF;
+	CHECK(roundTrip(changed, 12, history, true, 10, kind, encodedSize));
+	CHECK(kind == DELTA_XOR);
+	CHECK(encodedSize < 20);
+
+	// shorter and longer than the baseline: truncated or padded with zeros
+	Snapshot shorter(baseline.begin(), baseline.begin() + 150);
+	CHECK(roundTrip(shorter, 13, history, true, 10, kind, encodedSize));
+	CHECK(kind == DELTA_XOR);
+
+	Snapshot longer = baseline;
+	longer.resize(260, 0);
+	longer[230] = 0x42;
+	CHECK(roundTrip(longer, 14, history, true, 10, kind, encodedSize));
+	CHECK(kind == DELTA_XOR);
+
+	Snapshot zeroPadded = baseline;
+	zeroPadded.resize(260, 0);
+	CHECK(roundTrip(zeroPadded, 15, history, true, 10, kind, encodedSize));
+	CHECK(kind == DELTA_XOR);
+	CHECK(encodedSize < 10);
+}
+
+// without a usable baseline, or when a delta is not smaller, the snapshot is sent as is
+static void testKeyframeFallback()
+{
+	std::mt19937        random(5678);
+	cl::SnapshotHistory history;
+	Snapshot            baseline = randomSnapshot(random, 100);
+	history.store(20, baseline.data(), static_cast<uint16_t>(baseline.size()));
+
+	uint8_t     kind;
+	std::size_t encodedSize;
+
+	// no acknowledgement yet
+	CHECK(roundTrip(baseline, 21, history, false, 20, kind, encodedSize));
+	CHECK(kind == DELTA_KEYFRAME);
+	CHECK(encodedSize == DELTA_KEYFRAME_HEADER_SIZE + baseline.size());
+
+	// acknowledged snapshot no longer in the history
+	history.store(20 + DELTA_HISTORY_SIZE, baseline.data(), static_cast<uint16_t>(baseline.size()));
+	CHECK(roundTrip(baseline, 22, history, true, 20, kind, encodedSize));
+	CHECK(kind == DELTA_KEYFRAME);
+	CHECK(encodedSize == DELTA_KEYFRAME_HEADER_SIZE + baseline.size());
+
+	// every other byte changed: the runs cost more than the snapshot
+	Snapshot changed = baseline;
+	for (std::size_t i = 0; i < changed.size(); i += 2)
+		changed[i] ^= 0x55;
+	CHECK(roundTrip(changed, 23, history, true, 20 + DELTA_HISTORY_SIZE, kind, encodedSize));
+	CHECK(kind == DELTA_KEYFRAME);
+	CHECK(encodedSize == DELTA_KEYFRAME_HEADER_SIZE + changed.size());
+
+	// too small for a delta to pay off
+	Snapshot tiny(4, 0);
+	history.store(24, tiny.data(), 4);
+	CHECK(roundTrip(tiny, 25, history, true, 24, kind, encodedSize));
+	CHECK(kind == DELTA_KEYFRAME);
+
+	// empty snapshot
+	CHECK(roundTrip(Snapshot(), 26, history, true, 24, kind, encodedSize));
+	CHECK(encodedSize == DELTA_KEYFRAME_HEADER_SIZE);
+}
+
+// a delta whose baseline the receiver lost, or malformed payloads, are rejected
+static void testDecodeErrors()
+{
+	std::mt19937        random(91011);
+	cl::SnapshotHistory sender;
+	Snapshot            baseline = randomSnapshot(random, 100);
+	sender.store(30, baseline.data(), static_cast<uint16_t>(baseline.size()));
+
+	Snapshot changed = baseline;
+	changed[50] ^= 0x10;
+
+	uint8_t     payload[MAX_PAYLOAD_SIZE];
+	std::size_t encodedSize = cl::encodeDelta(payload, 31, changed.data(), static_cast<uint16_t>(changed.size()), sender, true, 30);
+	CHECK(payload[0] == DELTA_XOR);
+
+	uint8_t             decoded[MAX_SNAPSHOT_SIZE];
+	uint16_t            size;
+	uint16_t            sequence;
+	cl::SnapshotHistory receiver;
+	CHECK(!cl::decodeDelta(payload, encodedSize, receiver, decoded, size, sequence));
+	CHECK(cl::decodeDelta(payload, encodedSize, sender, decoded, size, sequence));
+
+	// truncated header or run
+	for (std::size_t truncated = 0; truncated <= DELTA_XOR_HEADER_SIZE; truncated++)
+		CHECK(!cl::decodeDelta(payload, truncated, sender, decoded, size, sequence));
+	CHECK(!cl::decodeDelta(payload, encodedSize - 1, sender, decoded, size, sequence));
+
+	// unknown kind
+	payload[0] = 0x7F;
+	CHECK(!cl::decodeDelta(payload, encodedSize, sender, decoded, size, sequence));
+}
+
+// random snapshots changing a little each time, with acknowledgements lost on the way
+static void testRandomStream()
+{
+	std::mt19937        random(4321);
+	cl::SnapshotHistory history;
+	Snapshot            snapshot     = randomSnapshot(random, 300);
+	bool                hasBaseline  = false;
+	uint16_t            acknowledged = 0;
+
+	for (uint16_t sequence = 0xFF00; sequence != 0x0100; sequence++)
+	{
+		std::size_t changes = random() % 8;
+		for (std::size_t i = 0; i < changes; i++)
+			snapshot[random() % snapshot.size()] = static_cast<uint8_t>(random());
+		if (random() % 16 == 0)
+			snapshot.resize(1 + random() % MAX_SNAPSHOT_SIZE, 0);
+
+		uint8_t     kind;
+		std::size_t encodedSize;
+		CHECK(roundTrip(snapshot, sequence, history, hasBaseline, acknowledged, kind, encodedSize));
+		CHECK(encodedSize <= DELTA_KEYFRAME_HEADER_SIZE + snapshot.size());
+
+		history.store(sequence, snapshot.data(), static_cast<uint16_t>(snapshot.size()));
+		if (random() % 4 != 0)
+		{
+			hasBaseline  = true;
+			acknowledged = sequence;
+		}
+	}
+}
+
+int main()
+{
+	testHistory();
+	testDelta();
+	testKeyframeFallback();
+	testDecodeErrors();
+	testRandomStream();
+
+	return TEST_RESULT();
+}
@@ -0,0 +1,405 @@
+#include "Check.hpp"
+
+#include <Log.hpp>
+#include <Reliable.hpp>
+#include <Server.hpp>
+#include <Wire.hpp>
+
+#include <arpa/inet.h>
+#include <dlfcn.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <deque>
+#include <map>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// The server sends the payload of a fan-out once, each datagram pointing
+// to it between the header of its recipient and the padding. sendmmsg()
+// is replaced by one recording what it gathers, which must be byte for
+// byte what each recipient gets when its messages are encoded for it
+// alone, whatever its format: legacy, compact, coalesced or not. The
+// messages come from the application and from the clients, to the teams
+// and to a single client.
+
+#define FAN_OUT_TEST_PORT          43320
+#define FAN_OUT_TEST_DATAGRAM_SIZE 300 // a few messages per coalesced datagram
+#define FAN_OUT_TEST_TYPE          0x23
+
+using Clock    = std::chrono::steady_clock;
+using Datagram = std::vector<uint8_t>;
+
+static std::mutex                                sentMutex;
+static std::map<uint16_t, std::vector<Datagram>> sent; // datagrams gathered by sendmmsg(), by port of the recipient
+
+extern "C" int sendmmsg(int socket, mmsghdr* headers, unsigned int count, int flags)
+{
+	using SendFunction = int (*)(int, mmsghdr*, unsigned int, int);
+	static SendFunction realSend = reinterpret_cast<SendFunction>(dlsym(RTLD_NEXT, "sendmmsg"));
+
+	{
+		std::lock_guard<std::mutex> lock(sentMutex);
+		for (unsigned int i = 0; i < count; i++)
+		{
+			const msghdr& header = headers[i].msg_hdr;
+			if (header.msg_namelen != sizeof(sockaddr_in))
+				continue;
+
+			Datagram datagram;
+			for (std::size_t j = 0; j < header.msg_iovlen; j++)
+			{
+				const uint8_t* data = static_cast<const uint8_t*>(header.msg_iov[j].iov_base);
+				datagram.insert(datagram.end(), data, data + header.msg_iov[j].iov_len);
+			}
+
+			sent[ntohs(static_cast<const sockaddr_in*>(header.msg_name)->sin_port)].push_back(datagram);
+		}
+	}
+
+	return realSend(socket, headers, count, flags);
+}
+
+// a client announcing only some capabilities, which cl::Client cannot do
+struct FakeClient
+{
+	uint8_t                  idAndTeam    = 0;
+	uint8_t                  capabilities = 0;
+	uint8_t                  key          = DEFAULT_KEY;
+	int                      socket       = -1;
+	uint16_t                 port         = 0;
+	std::vector<MessageView> expected; // messages of the test it should receive, in order
+};
+
+static bool connect(FakeClient& client)
+{
+	client.socket = ::socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+
+	sockaddr_in address;
+	std::memset(&address, 0, sizeof(address));
+	address.sin_family      = AF_INET;
+	address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	address.sin_port        = 0;
+	socklen_t size          = sizeof(address);
+	if (bind(client.socket, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0
+	 || getsockname(client.socket, reinterpret_cast<sockaddr*>(&address), &size) != 0)
+		return false;
+	client.port = ntohs(address.sin_port);
+
+	timeval timeout = { 0, 100000 };
+	setsockopt(client.socket, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+
+	address.sin_port = htons(FAN_OUT_TEST_PORT);
+	if (::connect(client.socket, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0)
+		return false;
+
+	Message request;
+	request.playerIDAndTeam = client.idAndTeam;
+	request.parameters      = MSG_ALL | client.capabilities;
+	request.type            = MSG_CONNECT;
+
+	// the server binds its socket once its thread started, until then the requests are refused
+	Clock::time_point deadline = Clock::now() + std::chrono::seconds(5);
+	while (Clock::now() < deadline)
+	{
+		send(client.socket, &request, sizeof(request), 0);
+
+		uint8_t buffer[MAX_DATAGRAM_SIZE];
+		ssize_t received;
+		while ((received = recv(client.socket, buffer, sizeof(buffer), 0)) > 0)
+		{
+			cl::DatagramReader reader;
+			reader.reset(buffer, static_cast<std::size_t>(received));
+
+			MessageView answer;
+			while (reader.next(answer))
+			{
+				if (answer.type == MSG_CONNECT && answer.playerIDAndTeam == client.idAndTeam)
+				{
+					client.key = answer.key;
+					return (answer.parameters & MSG_CAP_ALL) == client.capabilities;
+				}
+			}
+		}
+
+		std::this_thread::sleep_for(std::chrono::milliseconds(10));
+	}
+
+	return false;
+}
+
+// a message from a client, in a datagram of its own
+static void relay(const FakeClient& client, MessageView message)
+{
+	message.playerIDAndTeam = client.idAndTeam;
+	message.key             = client.key;
+
+	uint8_t            buffer[MAX_DATAGRAM_SIZE];
+	cl::DatagramWriter writer(buffer, MAX_DATAGRAM_SIZE);
+	writer.reset((client.capabilities & MSG_CAP_COMPACT) != 0);
+	writer.append(message);
+	send(client.socket, writer.data(), writer.finish(), 0);
+}
+
+// the messages of the test in the datagrams gathered for the client
+static std::size_t countReceived(const std::vector<Datagram>& datagrams)
+{
+	std::size_t count = 0;
+	for (const Datagram& datagram : datagrams)
+	{
+		cl::DatagramReader reader;
+		reader.reset(datagram.data(), datagram.size());
+
+		MessageView message;
+		while (reader.next(message))
+			count += message.type == FAN_OUT_TEST_TYPE;
+	}
+	return count;
+}
+
+static bool waitForMessages(const std::vector<FakeClient>& clients)
+{
+	Clock::time_point deadline = Clock::now() + std::chrono::seconds(2);
+	while (Clock::now() < deadline)
+	{
+		bool done = true;
+		{
+			std::lock_guard<std::mutex> lock(sentMutex);
+			for (const FakeClient& client : clients)
+				done = done && countReceived(sent[client.port]) >= client.expected.size();
+		}
+		if (done)
+			return true;
+
+		std::this_thread::sleep_for(std::chrono::milliseconds(10));
+	}
+
+	return false;
+}
+
+// each datagram is the one encoding its messages for this client alone would give
+static void checkDatagrams(const FakeClient& client, const std::vector<Datagram>& datagrams, bool packed)
+{
+	bool        compact  = (client.capabilities & MSG_CAP_COMPACT) != 0;
+	bool        coalesce = (client.capabilities & MSG_CAP_COALESCE) != 0;
+	std::size_t next     = 0;
+
+	for (const Datagram& datagram : datagrams)
+	{
+		CHECK(cl::isCompactDatagram(datagram.size()) == compact);
+
+		cl::DatagramReader reader;
+		reader.reset(datagram.data(), datagram.size());
+
+		std::size_t count = 0;
+		MessageView message;
+		while (reader.next(message))
+		{
+			CHECK(message.type == FAN_OUT_TEST_TYPE);
+			count++;
+		}
+		CHECK(!reader.malformed());
+		CHECK(coalesce ? count >= 1 : count == 1);
+		CHECK(next + count <= client.expected.size());
+		if (next + count > client.expected.size())
+			return;
+
+		uint8_t            buffer[MAX_DATAGRAM_SIZE];
+		cl::DatagramWriter writer(buffer, FAN_OUT_TEST_DATAGRAM_SIZE);
+		writer.reset(compact);
+		for (std::size_t i = 0; i < count; i++)
+		{
+			MessageView expected = client.expected[next + i];
+			expected.key         = client.key;
+			CHECK(writer.fits(expected) || i == 0);
+			writer.append(expected);
+		}
+
+		std::size_t size = writer.finish();
+		CHECK(size == datagram.size());
+		CHECK(size == datagram.size() && std::memcmp(buffer, datagram.data(), size) == 0);
+
+		next += count;
+	}
+
+	CHECK(next == client.expected.size());
+
+	// the messages queued at once were packed, not sent one per datagram
+	if (packed && coalesce)
+		CHECK(datagrams.size() < client.expected.size());
+}
+
+static void checkPhase(std::vector<FakeClient>& clients, bool packed)
+{
+	CHECK(waitForMessages(clients));
+
+	// nothing else is sent in the meantime
+	std::this_thread::sleep_for(std::chrono::milliseconds(50));
+
+	std::lock_guard<std::mutex> lock(sentMutex);
+	for (FakeClient& client : clients)
+	{
+		checkDatagrams(client, sent[client.port], packed);
+		client.expected.clear();
+	}
+	sent.clear();
+}
+
+static MessageView makeMessage(uint8_t parameters, const std::vector<uint8_t>& payload)
+{
+	MessageView message;
+	message.parameters = parameters;
+	message.type       = FAN_OUT_TEST_TYPE;
+	message.size       = static_cast<uint16_t>(payload.size());
+	message.data       = payload.data();
+	return message;
+}
+
+// the recipients of a message sent to the teams in its parameters, or to data[0]
+static void expect(std::vector<FakeClient>& clients, const MessageView& message)
+{
+	for (FakeClient& client : clients)
+	{
+		bool recipient = (message.parameters & MSG_ALL) == MSG_PRIVATE
+		               ? message.size > 0 && message.data[0] == client.idAndTeam
+		               : (message.parameters & ((client.idAndTeam & 1) ? MSG_BLUE : MSG_ORANGE)) != 0;
+		if (recipient)
+			client.expected.push_back(message);
+	}
+}
+
+// messages of a client relayed by the server to every team, to one team and to a single client
+static void relayAll(std::vector<FakeClient>& clients, const FakeClient& sender,
+                     const std::vector<std::vector<uint8_t>>& payloads, cl::ReliableEndpoint* endpoint)
+{
+	bool                             legacySender = (sender.capabilities & MSG_CAP_COMPACT) == 0;
+	std::deque<std::vector<uint8_t>> relayed;
+	uint8_t                          reliablePayload[MAX_PAYLOAD_SIZE];
+
+	for (const std::vector<uint8_t>& payload : payloads)
+	{
+		for (uint8_t teams : { MSG_ALL, MSG_BLUE, MSG_PRIVATE })
+		{
+			// from a legacy client, a message is a full fixed Message
+			relayed.push_back(payload);
+			std::vector<uint8_t>& relayedPayload = relayed.back();
+			if (legacySender)
+				relayedPayload.resize(LEGACY_PAYLOAD_SIZE, 0);
+			if (teams == MSG_PRIVATE)
+			{
+				relayedPayload.resize(std::max<std::size_t>(relayedPayload.size(), 1));
+				relayedPayload[0] = clients[relayed.size() % clients.size()].idAndTeam;
+			}
+
+			// the server strips the reliable header, the payload is shared from after it
+			MessageView message     = makeMessage(teams, relayedPayload);
+			MessageView sentMessage = message;
+			if (endpoint != nullptr)
+				CHECK(endpoint->send(message, cl::Delivery::Reliable, Clock::now(), reliablePayload, sentMessage));
+			relay(sender, sentMessage);
+
+			message.playerIDAndTeam = sender.idAndTeam;
+			expect(clients, message);
+		}
+	}
+
+	checkPhase(clients, false);
+}
+
+int main()
+{
+	cl::Logger::setLevel(cl::LogLevel::Error);
+
+	cl::Server server(FAN_OUT_TEST_PORT, DEFAULT_TICK_RATE, FAN_OUT_TEST_DATAGRAM_SIZE);
+	server.setPingInterval(std::chrono::milliseconds(0));
+	server.setClientTimeout(std::chrono::milliseconds(0));
+
+	// each format on each team, the last bit of the id and team is the team
+	const uint8_t formats[] = { 0, MSG_CAP_COALESCE, MSG_CAP_COMPACT, MSG_CAP_COMPACT | MSG_CAP_COALESCE };
+
+	std::vector<FakeClient> clients;
+	for (uint8_t i = 0; i < 8; i++)
+	{
+		FakeClient client;
+		client.idAndTeam    = static_cast<uint8_t>((i + 1) << 1 | (i & 1));
+		client.capabilities = formats[i / 2];
+		clients.push_back(client);
+	}
+
+	for (FakeClient& client : clients)
+		CHECK(connect(client));
+	CHECK(server.stats().clients.size() == clients.size());
+
+	// the notifications of the connections are not part of the test
+	std::this_thread::sleep_for(std::chrono::milliseconds(100));
+	{
+		std::lock_guard<std::mutex> lock(sentMutex);
+		sent.clear();
+	}
+
+	// payloads around the size of a fixed Message, truncated or padded for the legacy clients,
+	// and padded in a compact datagram of a single message (57 bytes)
+	std::vector<std::vector<uint8_t>> payloads;
+	for (std::size_t size : { 0, 1, 57, 59, 60, 61, 200 })
+	{
+		std::vector<uint8_t> payload(size);
+		for (std::size_t i = 0; i < size; i++)
+			payload[i] = static_cast<uint8_t>(size + i * 7);
+		payloads.push_back(payload);
+	}
+
+	// messages of the application, to every team, to one team and to a single client
+	for (const std::vector<uint8_t>& payload : payloads)
+	{
+		for (uint8_t teams : { MSG_ALL, MSG_ORANGE, MSG_BLUE })
+		{
+			MessageView message = makeMessage(teams, payload);
+			CHECK(server.broadcast(message));
+			expect(clients, message);
+		}
+	}
+
+	std::vector<uint8_t> privatePayloads[8];
+	for (std::size_t i = 0; i < clients.size(); i++)
+	{
+		privatePayloads[i] = payloads[(i + 2) % payloads.size()];
+		privatePayloads[i].resize(std::max<std::size_t>(privatePayloads[i].size(), 1));
+		privatePayloads[i][0] = clients[i].idAndTeam;
+
+		MessageView message = makeMessage(MSG_PRIVATE, privatePayloads[i]);
+		CHECK(server.sendTo(clients[i].idAndTeam, message));
+		expect(clients, message);
+	}
+
+	checkPhase(clients, true);
+
+	relayAll(clients, clients[0], payloads, nullptr);
+	relayAll(clients, clients[5], payloads, nullptr);
+
+	// a client of the reliable channels, whose acknowledgements are not part of the test
+	FakeClient           reliableSender;
+	cl::ReliableEndpoint endpoint;
+	reliableSender.idAndTeam    = static_cast<uint8_t>((clients.size() + 1) << 1);
+	reliableSender.capabilities = MSG_CAP_COMPACT | MSG_CAP_RELIABLE;
+	CHECK(connect(reliableSender));
+	std::this_thread::sleep_for(std::chrono::milliseconds(100));
+	{
+		std::lock_guard<std::mutex> lock(sentMutex);
+		sent.clear();
+	}
+
+	relayAll(clients, reliableSender, payloads, &endpoint);
+
+	server.stop();
+	for (FakeClient& client : clients)
+		close(client.socket);
+	close(reliableSender.socket);
+	cl::Logger::flush();
+
+	return TEST_RESULT();
+}
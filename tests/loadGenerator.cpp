@@ -0,0 +1,865 @@
+#include <Message.hpp>
+#include <Platform.hpp>
+#include <Wire.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <poll.h>
+
+// Load generator emulating many bots from a single process.
+//
+// The server identifies a client by its address and port, so every bot
+// needs its own pair. Instead of one socket per bot, the bots share a
+// few sockets bound to all addresses: each bot sends from its own
+// loopback address (127.0.0.x) with IP_PKTINFO, and the address the
+// server answers to tells which bot a datagram is for.
+//
+// Every bot connects with MSG_CONNECT like a real client, checks the key
+// of the messages it receives, answers pings, sends heartbeats and then
+// sends a mix of messages to all bots at the rates requested. The
+// messages are stamped with the time they were sent, so each bot
+// measures the loss and latency of what it receives.
+
+#define LOADGEN_DEFAULT_PORT        43215
+#define LOADGEN_DEFAULT_BOTS        128
+#define LOADGEN_DEFAULT_SOCKETS     4
+#define LOADGEN_DEFAULT_DURATION_MS 10000
+#define LOADGEN_DEFAULT_MIX         "ball:60:32,boost:10:8,demo:1:8,ready:1:8"
+
+#define LOADGEN_CONNECT_TIMEOUT_MS  5000
+#define LOADGEN_CONNECT_INTERVAL_MS 100  //!< Time between two connection attempts of a bot
+#define LOADGEN_HEARTBEAT_MS        1000 //!< Time between two heartbeats of a bot
+#define LOADGEN_SETTLE_MS           250  //!< Time before measuring, and to receive the messages in flight after it
+#define LOADGEN_RECEIVE_BATCH       64   //!< Datagrams read by a single system call
+#define LOADGEN_STAMP_SIZE          8    //!< Send time at the start of every payload
+
+#define LOCALHOST_ADDRESS 0x7F000001 //!< 127.0.0.1, in host order
+
+using Clock = std::chrono::steady_clock;
+
+// a type of message sent by every bot
+struct MixEntry
+{
+	uint8_t         type;
+	double          rate;     // per second, for each bot
+	uint16_t        size;     // payload size, at least the stamp
+	Clock::duration interval; // between two messages of a bot
+};
+
+struct Options
+{
+	uint16_t              port         = LOADGEN_DEFAULT_PORT;
+	unsigned int          bots         = LOADGEN_DEFAULT_BOTS;
+	unsigned int          firstId      = 0;
+	unsigned int          sockets      = LOADGEN_DEFAULT_SOCKETS;
+	unsigned int          durationMs   = LOADGEN_DEFAULT_DURATION_MS;
+	uint16_t              datagramSize = sizeof(Message);
+	uint8_t               capabilities = MSG_CAP_COALESCE | MSG_CAP_COMPACT;
+	std::vector<MixEntry> mix;
+	std::string           output;
+};
+
+enum class Phase
+{
+	Connecting, // until every bot is connected
+	Settling,   // before the measure
+	Measuring,
+	Draining    // receive the messages in flight, nothing is sent
+};
+
+struct Bot
+{
+	uint8_t      idAndTeam;
+	uint32_t     address; // network order
+	unsigned int socket;  // index in the sockets of the generator
+
+	bool    connected    = false;
+	uint8_t key          = DEFAULT_KEY;
+	uint8_t capabilities = 0x00; // accepted by the server
+
+	Clock::time_point              nextConnect;
+	Clock::time_point              nextHeartbeat;
+	std::vector<Clock::time_point> nextSends; // one per entry of the mix
+
+	uint64_t connections = 0;
+	uint64_t sent        = 0; // measured messages sent
+	uint64_t received    = 0; // measured messages received
+	uint64_t invalidKeys = 0;
+	uint64_t errors      = 0; // MSG_ERROR and forced disconnections
+	uint64_t malformed   = 0;
+
+	std::vector<uint32_t> latencies; // nanoseconds
+};
+
+struct Generator
+{
+	Options             options;
+	std::vector<SOCKET> sockets;
+	std::vector<Bot>    bots;
+	sockaddr_in         server;
+	Phase               phase        = Phase::Connecting;
+	int64_t             measureStart = 0; // nanoseconds
+	int64_t             measureEnd   = 0;
+	uint64_t            foreign      = 0; // datagrams from another address than the server
+	std::mt19937        random;
+};
+
+static int64_t nanoseconds(Clock::time_point time)
+{
+	return std::chrono::duration_cast<std::chrono::nanoseconds>(time.time_since_epoch()).count();
+}
+
+static void writeUint64(uint8_t* data, uint64_t value)
+{
+	for (int i = 7; i >= 0; i--, value >>= 8)
+		data[i] = static_cast<uint8_t>(value);
+}
+
+static uint64_t readUint64(const uint8_t* data)
+{
+	uint64_t value = 0;
+	for (int i = 0; i < 8; i++)
+		value = value << 8 | data[i];
+	return value;
+}
+
+static std::string addressText(uint32_t address)
+{
+	char text[INET_ADDRSTRLEN];
+	in_addr value;
+	value.s_addr = address;
+	inet_ntop(AF_INET, &value, text, sizeof(text));
+	return text;
+}
+
+static uint16_t socketPort(SOCKET socket)
+{
+	sockaddr_in address;
+	socklen_t   size = sizeof(address);
+	if (getsockname(socket, reinterpret_cast<sockaddr*>(&address), &size) != 0)
+		return 0;
+	return ntohs(address.sin_port);
+}
+
+static bool createSockets(Generator& generator)
+{
+	for (unsigned int i = 0; i < generator.options.sockets; i++)
+	{
+		SOCKET udpSocket = socket(AF_INET, SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC, IPPROTO_UDP);
+		if (udpSocket == INVALID_SOCKET)
+		{
+			std::cerr << "Error at socket() (" << errno << ")." << std::endl;
+			return false;
+		}
+		generator.sockets.push_back(udpSocket);
+
+		// the destination of each datagram received tells the bot
+		int enabled = 1;
+		if (setsockopt(udpSocket, IPPROTO_IP, IP_PKTINFO, &enabled, sizeof(enabled)) != 0)
+		{
+			std::cerr << "Error at setsockopt(IP_PKTINFO) (" << errno << ")." << std::endl;
+			return false;
+		}
+
+		sockaddr_in bindAddress;
+		ZeroMemory(&bindAddress, sizeof(bindAddress));
+		bindAddress.sin_family      = AF_INET;
+		bindAddress.sin_addr.s_addr = htonl(INADDR_ANY);
+		bindAddress.sin_port        = 0;
+		if (bind(udpSocket, reinterpret_cast<sockaddr*>(&bindAddress), sizeof(bindAddress)) != 0)
+		{
+			std::cerr << "Error at bind() (" << errno << ")." << std::endl;
+			return false;
+		}
+	}
+
+	return true;
+}
+
+static void createBots(Generator& generator)
+{
+	const Options& options = generator.options;
+
+	Clock::time_point now = Clock::now();
+	for (unsigned int i = 0; i < options.bots; i++)
+	{
+		unsigned int id = options.firstId + i;
+
+		Bot bot;
+		bot.idAndTeam   = static_cast<uint8_t>(id << 1 | (id & 0x01));
+		bot.socket      = i % options.sockets;
+		bot.address     = htonl(LOCALHOST_ADDRESS + i / options.sockets);
+		bot.nextConnect = now;
+		bot.nextSends.resize(options.mix.size());
+		generator.bots.push_back(bot);
+	}
+}
+
+static int findBot(const Generator& generator, unsigned int socketIndex, uint32_t address)
+{
+	uint32_t offset = ntohl(address) - LOCALHOST_ADDRESS;
+	if (offset >= generator.bots.size())
+		return -1;
+
+	std::size_t index = static_cast<std::size_t>(offset) * generator.options.sockets + socketIndex;
+	return index < generator.bots.size() ? static_cast<int>(index) : -1;
+}
+
+// send a datagram to the server from the address of a bot
+static bool sendFrom(Generator& generator, const Bot& bot, const uint8_t* data, std::size_t size)
+{
+	iovec vector;
+	vector.iov_base = const_cast<uint8_t*>(data);
+	vector.iov_len  = size;
+
+	alignas(cmsghdr) char control[CMSG_SPACE(sizeof(in_pktinfo))];
+	std::memset(control, 0, sizeof(control));
+
+	msghdr header;
+	std::memset(&header, 0, sizeof(header));
+	header.msg_name       = &generator.server;
+	header.msg_namelen    = sizeof(generator.server);
+	header.msg_iov        = &vector;
+	header.msg_iovlen     = 1;
+	header.msg_control    = control;
+	header.msg_controllen = sizeof(control);
+
+	cmsghdr* message    = CMSG_FIRSTHDR(&header);
+	message->cmsg_level = IPPROTO_IP;
+	message->cmsg_type  = IP_PKTINFO;
+	message->cmsg_len   = CMSG_LEN(sizeof(in_pktinfo));
+
+	in_pktinfo* info = reinterpret_cast<in_pktinfo*>(CMSG_DATA(message));
+	info->ipi_spec_dst.s_addr = bot.address;
+
+	return sendmsg(generator.sockets[bot.socket], &header, 0) == static_cast<ssize_t>(size);
+}
+
+// send a single message, in the format the server accepted
+static bool sendMessage(Generator& generator, const Bot& bot, const MessageView& message, bool compact)
+{
+	uint8_t            buffer[MAX_DATAGRAM_SIZE];
+	cl::DatagramWriter writer(buffer, sizeof(buffer));
+	writer.reset(compact);
+	writer.append(message);
+	return sendFrom(generator, bot, writer.data(), writer.finish());
+}
+
+static void sendConnection(Generator& generator, Bot& bot)
+{
+	// a connection message is always a fixed Message, the key is derived from its random data
+	Message connectionMessage;
+	connectionMessage.playerIDAndTeam = bot.idAndTeam;
+	connectionMessage.type            = MSG_CONNECT;
+	connectionMessage.parameters      = MSG_ALL | generator.options.capabilities;
+	for (uint8_t& byte : connectionMessage.data)
+		byte = static_cast<uint8_t>(generator.random());
+
+	if (!sendMessage(generator, bot, MessageView(connectionMessage), false))
+		bot.errors++;
+}
+
+static void sendDisconnection(Generator& generator, Bot& bot)
+{
+	Message disconnectMessage;
+	disconnectMessage.playerIDAndTeam = bot.idAndTeam;
+	disconnectMessage.type            = MSG_DISCONNECT;
+	disconnectMessage.parameters      = MSG_ALL;
+	sendMessage(generator, bot, MessageView(disconnectMessage), false);
+
+	bot.connected = false;
+}
+
+static void handleMessage(Generator& generator, Bot& bot, const MessageView& message, int64_t receiveTime)
+{
+	if (!bot.connected)
+	{
+		// the answer to this bot carries its key and the capabilities accepted
+		if (message.type == MSG_CONNECT && message.playerIDAndTeam == bot.idAndTeam)
+		{
+			bot.connected     = true;
+			bot.key           = message.key;
+			bot.capabilities  = message.parameters & MSG_CAP_ALL;
+			bot.nextHeartbeat = Clock::now() + std::chrono::milliseconds(LOADGEN_HEARTBEAT_MS);
+			bot.connections++;
+		}
+		return;
+	}
+
+	if (message.key != bot.key)
+	{
+		bot.invalidKeys++;
+		return;
+	}
+
+	if (message.type == MSG_PING)
+	{
+		MessageView pongMessage = message;
+		pongMessage.playerIDAndTeam = bot.idAndTeam;
+		pongMessage.parameters      = MSG_PRIVATE;
+		pongMessage.size            = std::min<uint16_t>(message.size, LEGACY_PAYLOAD_SIZE);
+		sendMessage(generator, bot, pongMessage, (bot.capabilities & MSG_CAP_COMPACT) != 0);
+	}
+	else if (message.type == MSG_ERROR)
+	{
+		bot.errors++;
+	}
+	else if (message.type == MSG_SERVER_STOP
+	     || (message.type == MSG_DISCONNECT && message.playerIDAndTeam == bot.idAndTeam && message.size > 0 && message.data[0] == MSG_DISCONNECT_SRC_SERVER))
+	{
+		// connect again
+		bot.errors++;
+		bot.connected   = false;
+		bot.key         = DEFAULT_KEY;
+		bot.nextConnect = Clock::now();
+	}
+	else if (message.size >= LOADGEN_STAMP_SIZE && !(message.parameters & (MSG_DELTA | MSG_RELIABLE)))
+	{
+		bool measured = false;
+		for (const MixEntry& entry : generator.options.mix)
+			measured = measured || entry.type == message.type;
+
+		int64_t sent = static_cast<int64_t>(readUint64(message.data));
+		if (!measured || sent < generator.measureStart || sent >= generator.measureEnd)
+			return;
+
+		bot.received++;
+		bot.latencies.push_back(static_cast<uint32_t>(std::min<int64_t>(std::max<int64_t>(receiveTime - sent, 0), UINT32_MAX)));
+	}
+}
+
+static void receive(Generator& generator, unsigned int socketIndex)
+{
+	static uint8_t buffers[LOADGEN_RECEIVE_BATCH][MAX_DATAGRAM_SIZE];
+	alignas(cmsghdr) static char controls[LOADGEN_RECEIVE_BATCH][CMSG_SPACE(sizeof(in_pktinfo))];
+
+	mmsghdr     headers[LOADGEN_RECEIVE_BATCH];
+	iovec       vectors[LOADGEN_RECEIVE_BATCH];
+	sockaddr_in senders[LOADGEN_RECEIVE_BATCH];
+
+	while (true)
+	{
+		for (int i = 0; i < LOADGEN_RECEIVE_BATCH; i++)
+		{
+			vectors[i].iov_base = buffers[i];
+			vectors[i].iov_len  = MAX_DATAGRAM_SIZE;
+
+			std::memset(&headers[i], 0, sizeof(headers[i]));
+			headers[i].msg_hdr.msg_name       = &senders[i];
+			headers[i].msg_hdr.msg_namelen    = sizeof(senders[i]);
+			headers[i].msg_hdr.msg_iov        = &vectors[i];
+			headers[i].msg_hdr.msg_iovlen     = 1;
+			headers[i].msg_hdr.msg_control    = controls[i];
+			headers[i].msg_hdr.msg_controllen = sizeof(controls[i]);
+		}
+
+		int count = recvmmsg(generator.sockets[socketIndex], headers, LOADGEN_RECEIVE_BATCH, 0, nullptr);
+		if (count <= 0)
+			return;
+
+		int64_t receiveTime = nanoseconds(Clock::now());
+
+		for (int i = 0; i < count; i++)
+		{
+			if (senders[i].sin_addr.s_addr != generator.server.sin_addr.s_addr || senders[i].sin_port != generator.server.sin_port)
+			{
+				generator.foreign++;
+				continue;
+			}
+
+			uint32_t destination = 0;
+			for (cmsghdr* control = CMSG_FIRSTHDR(&headers[i].msg_hdr); control != nullptr; control = CMSG_NXTHDR(&headers[i].msg_hdr, control))
+			{
+				if (control->cmsg_level == IPPROTO_IP && control->cmsg_type == IP_PKTINFO)
+					destination = reinterpret_cast<in_pktinfo*>(CMSG_DATA(control))->ipi_addr.s_addr;
+			}
+
+			int botIndex = findBot(generator, socketIndex, destination);
+			if (botIndex < 0)
+			{
+				generator.foreign++;
+				continue;
+			}
+
+			Bot&               bot = generator.bots[botIndex];
+			cl::DatagramReader reader;
+			MessageView        message;
+			reader.reset(buffers[i], std::min<std::size_t>(headers[i].msg_len, MAX_DATAGRAM_SIZE));
+			while (reader.next(message))
+				handleMessage(generator, bot, message, receiveTime);
+			if (reader.malformed())
+				bot.malformed++;
+		}
+
+		if (count < LOADGEN_RECEIVE_BATCH)
+			return;
+	}
+}
+
+// send what is due for a bot, several messages per datagram if the server accepts it
+static void sendDue(Generator& generator, Bot& bot, Clock::time_point now)
+{
+	if (!bot.connected)
+	{
+		if (now >= bot.nextConnect)
+		{
+			sendConnection(generator, bot);
+			bot.nextConnect = now + std::chrono::milliseconds(LOADGEN_CONNECT_INTERVAL_MS);
+		}
+		return;
+	}
+
+	bool        compact = (bot.capabilities & MSG_CAP_COMPACT) != 0;
+	std::size_t maxSize = (bot.capabilities & MSG_CAP_COALESCE) ? generator.options.datagramSize : sizeof(Message);
+
+	uint8_t            buffer[MAX_DATAGRAM_SIZE];
+	cl::DatagramWriter writer(buffer, maxSize);
+	writer.reset(compact);
+
+	auto append = [&](const MessageView& message)
+	{
+		if (!writer.empty() && !writer.fits(message))
+		{
+			if (!sendFrom(generator, bot, writer.data(), writer.finish()))
+				bot.errors++;
+			writer.reset(compact);
+		}
+		writer.append(message);
+	};
+
+	if (now >= bot.nextHeartbeat)
+	{
+		MessageView heartbeatMessage;
+		heartbeatMessage.playerIDAndTeam = bot.idAndTeam;
+		heartbeatMessage.key             = bot.key;
+		heartbeatMessage.parameters      = MSG_PRIVATE;
+		heartbeatMessage.type            = MSG_HEARTBEAT;
+		append(heartbeatMessage);
+		bot.nextHeartbeat = now + std::chrono::milliseconds(LOADGEN_HEARTBEAT_MS);
+	}
+
+	if (generator.phase == Phase::Measuring)
+	{
+		uint8_t payload[MAX_PAYLOAD_SIZE] = {};
+		writeUint64(payload, static_cast<uint64_t>(nanoseconds(now)));
+
+		for (std::size_t i = 0; i < generator.options.mix.size(); i++)
+		{
+			const MixEntry& entry = generator.options.mix[i];
+
+			// a late bot catches up, but never by more than a second
+			if (now - bot.nextSends[i] > std::chrono::seconds(1))
+				bot.nextSends[i] = now;
+
+			while (now >= bot.nextSends[i])
+			{
+				MessageView message;
+				message.playerIDAndTeam = bot.idAndTeam;
+				message.key             = bot.key;
+				message.parameters      = MSG_ALL;
+				message.type            = entry.type;
+				message.size            = entry.size;
+				message.data            = payload;
+				append(message);
+
+				bot.sent++;
+				bot.nextSends[i] += entry.interval;
+			}
+		}
+	}
+
+	if (!writer.empty() && !sendFrom(generator, bot, writer.data(), writer.finish()))
+		bot.errors++;
+}
+
+static Clock::time_point nextDue(const Generator& generator, Clock::time_point limit)
+{
+	Clock::time_point next = limit;
+	for (const Bot& bot : generator.bots)
+	{
+		if (!bot.connected)
+		{
+			next = std::min(next, bot.nextConnect);
+			continue;
+		}
+
+		next = std::min(next, bot.nextHeartbeat);
+		if (generator.phase == Phase::Measuring)
+		{
+			for (const Clock::time_point& nextSend : bot.nextSends)
+				next = std::min(next, nextSend);
+		}
+	}
+	return next;
+}
+
+// send and receive until the deadline
+static void run(Generator& generator, Clock::time_point deadline)
+{
+	std::vector<pollfd> descriptors(generator.sockets.size());
+	for (std::size_t i = 0; i < generator.sockets.size(); i++)
+	{
+		descriptors[i].fd     = generator.sockets[i];
+		descriptors[i].events = POLLIN;
+	}
+
+	for (Clock::time_point now = Clock::now(); now < deadline; now = Clock::now())
+	{
+		for (Bot& bot : generator.bots)
+			sendDue(generator, bot, now);
+
+		if (generator.phase == Phase::Connecting
+		 && std::all_of(generator.bots.begin(), generator.bots.end(), [](const Bot& bot) { return bot.connected; }))
+			return;
+
+		std::chrono::nanoseconds wait = nextDue(generator, deadline) - Clock::now();
+		timespec timeout;
+		timeout.tv_sec  = wait.count() > 0 ? static_cast<time_t>(wait.count() / 1000000000) : 0;
+		timeout.tv_nsec = wait.count() > 0 ? static_cast<long>(wait.count() % 1000000000) : 0;
+
+		if (ppoll(descriptors.data(), descriptors.size(), &timeout, nullptr) <= 0)
+			continue;
+
+		for (std::size_t i = 0; i < descriptors.size(); i++)
+		{
+			if (descriptors[i].revents & POLLIN)
+				receive(generator, static_cast<unsigned int>(i));
+		}
+	}
+}
+
+static double percentile(const std::vector<uint32_t>& sorted, double rank)
+{
+	if (sorted.empty())
+		return 0.0;
+
+	std::size_t index = static_cast<std::size_t>(rank * static_cast<double>(sorted.size()) + 0.999999);
+	return sorted[std::max<std::size_t>(index, 1) - 1] / 1000.0;
+}
+
+static std::string report(Generator& generator, uint64_t expected)
+{
+	std::ostringstream json;
+	json << "{\n";
+	json << "  \"tool\": \"CommsLibLoadGen\",\n";
+	json << "  \"config\": { \"bots\": " << generator.bots.size()
+	     << ", \"sockets\": " << generator.sockets.size()
+	     << ", \"duration_ms\": " << generator.options.durationMs
+	     << ", \"datagram_size\": " << generator.options.datagramSize
+	     << ", \"capabilities\": " << static_cast<unsigned int>(generator.options.capabilities)
+	     << ", \"mix\": [";
+	for (std::size_t i = 0; i < generator.options.mix.size(); i++)
+	{
+		const MixEntry& entry = generator.options.mix[i];
+		json << (i == 0 ? "" : ", ") << "{ \"type\": " << static_cast<unsigned int>(entry.type)
+		     << ", \"rate\": " << entry.rate << ", \"size\": " << entry.size << " }";
+	}
+	json << "] },\n";
+	json << "  \"bots\": [";
+
+	std::printf("%4s %4s %-16s %8s %10s %10s %7s %10s %10s %10s %10s %6s %6s\n",
+		"id", "team", "address", "sent", "received", "expected", "loss%", "p50 us", "p99 us", "p99.9 us", "max us", "keys", "errors");
+
+	uint64_t              totalSent     = 0;
+	uint64_t              totalReceived = 0;
+	std::vector<uint32_t> allLatencies;
+
+	for (std::size_t i = 0; i < generator.bots.size(); i++)
+	{
+		Bot& bot = generator.bots[i];
+		std::sort(bot.latencies.begin(), bot.latencies.end());
+
+		double loss = expected ? 100.0 * (1.0 - static_cast<double>(bot.received) / static_cast<double>(expected)) : 0.0;
+		std::string address = addressText(bot.address) + ':' + std::to_string(socketPort(generator.sockets[bot.socket]));
+
+		std::printf("%4u %4s %-16s %8llu %10llu %10llu %7.2f %10.1f %10.1f %10.1f %10.1f %6llu %6llu\n",
+			bot.idAndTeam >> 1, (bot.idAndTeam & 0x01) ? "blue" : "orng", address.c_str(),
+			static_cast<unsigned long long>(bot.sent), static_cast<unsigned long long>(bot.received),
+			static_cast<unsigned long long>(expected), loss,
+			percentile(bot.latencies, 0.5), percentile(bot.latencies, 0.99), percentile(bot.latencies, 0.999),
+			bot.latencies.empty() ? 0.0 : bot.latencies.back() / 1000.0,
+			static_cast<unsigned long long>(bot.invalidKeys), static_cast<unsigned long long>(bot.errors + bot.malformed));
+
+		json << (i == 0 ? "\n" : ",\n");
+		json << "    { \"id\": " << (bot.idAndTeam >> 1)
+		     << ", \"team\": \"" << ((bot.idAndTeam & 0x01) ? "blue" : "orange") << '"'
+		     << ", \"address\": \"" << address << '"'
+		     << ", \"connections\": " << bot.connections
+		     << ", \"sent\": " << bot.sent
+		     << ", \"received\": " << bot.received
+		     << ", \"expected\": " << expected
+		     << ", \"loss\": " << loss / 100.0
+		     << ", \"latency_us\": { \"p50\": " << percentile(bot.latencies, 0.5)
+		     << ", \"p99\": " << percentile(bot.latencies, 0.99)
+		     << ", \"p999\": " << percentile(bot.latencies, 0.999)
+		     << ", \"max\": " << (bot.latencies.empty() ? 0.0 : bot.latencies.back() / 1000.0) << " }"
+		     << ", \"invalid_keys\": " << bot.invalidKeys
+		     << ", \"errors\": " << bot.errors
+		     << ", \"malformed\": " << bot.malformed << " }";
+
+		totalSent     += bot.sent;
+		totalReceived += bot.received;
+		allLatencies.insert(allLatencies.end(), bot.latencies.begin(), bot.latencies.end());
+	}
+
+	std::sort(allLatencies.begin(), allLatencies.end());
+
+	uint64_t totalExpected = expected * generator.bots.size();
+	double   totalLoss     = totalExpected ? 1.0 - static_cast<double>(totalReceived) / static_cast<double>(totalExpected) : 0.0;
+
+	std::printf("total: %llu sent, %llu received of %llu (%.2f%% loss), p50 %.1f us, p99 %.1f us, p99.9 %.1f us, %llu datagrams from elsewhere\n",
+		static_cast<unsigned long long>(totalSent), static_cast<unsigned long long>(totalReceived),
+		static_cast<unsigned long long>(totalExpected), 100.0 * totalLoss,
+		percentile(allLatencies, 0.5), percentile(allLatencies, 0.99), percentile(allLatencies, 0.999),
+		static_cast<unsigned long long>(generator.foreign));
+
+	json << "\n  ],\n";
+	json << "  \"total\": { \"sent\": " << totalSent
+	     << ", \"received\": " << totalReceived
+	     << ", \"expected\": " << totalExpected
+	     << ", \"loss\": " << totalLoss
+	     << ", \"latency_us\": { \"p50\": " << percentile(allLatencies, 0.5)
+	     << ", \"p99\": " << percentile(allLatencies, 0.99)
+	     << ", \"p999\": " << percentile(allLatencies, 0.999) << " }"
+	     << ", \"foreign_datagrams\": " << generator.foreign << " }\n";
+	json << "}\n";
+
+	return json.str();
+}
+
+static bool parseNumber(const std::string& text, double minimum, double maximum, double& value)
+{
+	char* end = nullptr;
+	value = std::strtod(text.c_str(), &end);
+	return !text.empty() && *end == '\0' && value >= minimum && value <= maximum;
+}
+
+// TYPE:RATE[:SIZE], TYPE being a TMCP 1.0 message name or a user-defined type
+static bool parseMix(const std::string& text, std::vector<MixEntry>& mix)
+{
+	static const struct { const char* name; uint8_t type; } names[] = {
+		{ "ball",   MSG_TMCP1_BALL },
+		{ "boost",  MSG_TMCP1_BOOST },
+		{ "demo",   MSG_TMCP1_DEMO },
+		{ "ready",  MSG_TMCP1_READY },
+		{ "defend", MSG_TMCP1_DEFEND },
+	};
+
+	mix.clear();
+
+	std::stringstream list(text);
+	std::string       item;
+	while (std::getline(list, item, ','))
+	{
+		std::vector<std::string> fields;
+		std::stringstream        itemStream(item);
+		std::string              field;
+		while (std::getline(itemStream, field, ':'))
+			fields.push_back(field);
+
+		if (fields.size() < 2 || fields.size() > 3)
+			return false;
+
+		MixEntry entry;
+		double   value;
+
+		entry.type = MSG_INVALID;
+		for (const auto& name : names)
+		{
+			if (fields[0] == name.name)
+				entry.type = name.type;
+		}
+		if (entry.type == MSG_INVALID)
+		{
+			if (!parseNumber(fields[0], 0, 127, value))
+				return false;
+			entry.type = static_cast<uint8_t>(value);
+		}
+
+		if (!parseNumber(fields[1], 0.001, 100000, entry.rate))
+			return false;
+
+		entry.size = LOADGEN_STAMP_SIZE;
+		if (fields.size() == 3)
+		{
+			if (!parseNumber(fields[2], LOADGEN_STAMP_SIZE, MAX_PAYLOAD_SIZE, value))
+				return false;
+			entry.size = static_cast<uint16_t>(value);
+		}
+
+		entry.interval = std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(1.0 / entry.rate));
+		mix.push_back(entry);
+	}
+
+	return !mix.empty();
+}
+
+static void printUsage(const char* program)
+{
+	std::cerr << "Usage: " << program << " [options]\n"
+	          << "  --port N           port of the server on localhost (default: " << LOADGEN_DEFAULT_PORT << ")\n"
+	          << "  --bots N           bots to emulate, at most 128 (default: " << LOADGEN_DEFAULT_BOTS << ")\n"
+	          << "  --first-id N       RLBot id of the first bot, the next ones follow (default: 0)\n"
+	          << "  --sockets N        sockets shared by the bots (default: " << LOADGEN_DEFAULT_SOCKETS << ")\n"
+	          << "  --duration MS      time the mix is sent for (default: " << LOADGEN_DEFAULT_DURATION_MS << ")\n"
+	          << "  --mix LIST         TYPE:RATE[:SIZE] sent to all bots by each bot, TYPE being ball, boost,\n"
+	          << "                     demo, ready, defend or 0-127 (default: " << LOADGEN_DEFAULT_MIX << ")\n"
+	          << "  --datagram-size N  largest datagram if the server accepts several messages per datagram\n"
+	          << "                     (default: " << sizeof(Message) << ", one message per datagram)\n"
+	          << "  --legacy           only send fixed 64-byte messages\n"
+	          << "  --output FILE      also write the results as JSON to FILE\n";
+}
+
+static bool parseOptions(int argc, char** argv, Options& options)
+{
+	std::string mix = LOADGEN_DEFAULT_MIX;
+
+	for (int i = 1; i < argc; i++)
+	{
+		std::string option = argv[i];
+		if (option == "--legacy")
+		{
+			options.capabilities = 0x00;
+			continue;
+		}
+		if (option == "--help" || option == "-h" || i + 1 == argc)
+			return false;
+
+		std::string value = argv[++i];
+		double      number;
+		bool        valid = true;
+
+		if (option == "--mix")
+			mix = value;
+		else if (option == "--output")
+			options.output = value;
+		else if (option == "--port" && (valid = parseNumber(value, 1, 65535, number)))
+			options.port = static_cast<uint16_t>(number);
+		else if (option == "--bots" && (valid = parseNumber(value, 1, 128, number)))
+			options.bots = static_cast<unsigned int>(number);
+		else if (option == "--first-id" && (valid = parseNumber(value, 0, 127, number)))
+			options.firstId = static_cast<unsigned int>(number);
+		else if (option == "--sockets" && (valid = parseNumber(value, 1, 128, number)))
+			options.sockets = static_cast<unsigned int>(number);
+		else if (option == "--duration" && (valid = parseNumber(value, 1, 86400000, number)))
+			options.durationMs = static_cast<unsigned int>(number);
+		else if (option == "--datagram-size" && (valid = parseNumber(value, sizeof(Message), MAX_DATAGRAM_SIZE, number)))
+			options.datagramSize = static_cast<uint16_t>(number);
+		else
+			valid = false;
+
+		if (!valid)
+		{
+			std::cerr << "Invalid option: " << option << ' ' << value << std::endl;
+			return false;
+		}
+	}
+
+	if (options.firstId + options.bots > 128)
+	{
+		std::cerr << "The ids of the bots must be lower than 128." << std::endl;
+		return false;
+	}
+
+	if (!parseMix(mix, options.mix))
+	{
+		std::cerr << "Invalid message mix: " << mix << std::endl;
+		return false;
+	}
+
+	return true;
+}
+
+int main(int argc, char** argv)
+{
+	Generator generator;
+	if (!parseOptions(argc, argv, generator.options))
+	{
+		printUsage(argv[0]);
+		return 1;
+	}
+
+	generator.options.sockets = std::min(generator.options.sockets, generator.options.bots);
+	generator.random.seed(std::random_device()());
+
+	ZeroMemory(&generator.server, sizeof(generator.server));
+	generator.server.sin_family      = AF_INET;
+	generator.server.sin_addr.s_addr = htonl(LOCALHOST_ADDRESS);
+	generator.server.sin_port        = htons(generator.options.port);
+
+	if (!createSockets(generator))
+		return 1;
+	createBots(generator);
+
+	std::cerr << "Connecting " << generator.bots.size() << " bots over " << generator.sockets.size() << " sockets..." << std::endl;
+	run(generator, Clock::now() + std::chrono::milliseconds(LOADGEN_CONNECT_TIMEOUT_MS));
+
+	std::size_t connected = std::count_if(generator.bots.begin(), generator.bots.end(), [](const Bot& bot) { return bot.connected; });
+	if (connected == 0)
+	{
+		std::cerr << "No bot could connect to the server on port " << generator.options.port << '.' << std::endl;
+		return 1;
+	}
+	if (connected < generator.bots.size())
+		std::cerr << "Only " << connected << " bots connected, the others keep trying." << std::endl;
+
+	generator.phase = Phase::Settling;
+	run(generator, Clock::now() + std::chrono::milliseconds(LOADGEN_SETTLE_MS));
+
+	// the bots start sending at different times so their messages are spread
+	Clock::time_point start = Clock::now();
+	Clock::time_point end   = start + std::chrono::milliseconds(generator.options.durationMs);
+	for (std::size_t i = 0; i < generator.bots.size(); i++)
+	{
+		for (std::size_t j = 0; j < generator.options.mix.size(); j++)
+			generator.bots[i].nextSends[j] = start + generator.options.mix[j].interval * i / generator.bots.size();
+	}
+
+	generator.measureStart = nanoseconds(start);
+	generator.measureEnd   = nanoseconds(end);
+	generator.phase        = Phase::Measuring;
+
+	std::cerr << "Sending for " << generator.options.durationMs << " ms..." << std::endl;
+	run(generator, end);
+
+	generator.phase = Phase::Draining;
+	run(generator, Clock::now() + std::chrono::milliseconds(LOADGEN_SETTLE_MS));
+
+	// every bot sends its messages to all bots, itself included
+	uint64_t expected = 0;
+	for (const Bot& bot : generator.bots)
+		expected += bot.sent;
+
+	std::string json = report(generator, expected);
+
+	for (Bot& bot : generator.bots)
+	{
+		if (bot.connected)
+			sendDisconnection(generator, bot);
+	}
+	for (SOCKET udpSocket : generator.sockets)
+		closesocket(udpSocket);
+
+	if (!generator.options.output.empty())
+	{
+		std::ofstream file(generator.options.output);
+		file << json;
+		if (!file)
+		{
+			std::cerr << "Could not write " << generator.options.output << '.' << std::endl;
+			return 1;
+		}
+	}
+
+	return 0;
+}
@@ -0,0 +1,168 @@
+#include "Check.hpp"
+
+#include <MessageRing.hpp>
+
+#include <algorithm>
+#include <cstdint>
+#include <deque>
+#include <random>
+#include <vector>
+
+// MessageRing: records of every payload size, the end of the buffer
+// skipped with WRAP_MARKER or by the consumer itself when it is shorter
+// than a record header, and a full ring.
+
+#define RECORD_HEADER_SIZE 6 // as in MessageRing.cpp
+
+struct Record
+{
+	uint8_t              type;
+	std::vector<uint8_t> payload;
+};
+
+static Record makeRecord(uint8_t type, std::size_t size)
+{
+	Record record;
+	record.type = type;
+	for (std::size_t i = 0; i < size; i++)
+		record.payload.push_back(static_cast<uint8_t>(type + i));
+	return record;
+}
+
+static bool push(cl::MessageRing& ring, const Record& record)
+{
+	MessageView message;
+	message.playerIDAndTeam = static_cast<uint8_t>(record.type ^ 0x5A);
+	message.key             = 0x42;
+	message.parameters      = MSG_ALL;
+	message.type            = record.type;
+	message.size            = static_cast<uint16_t>(record.payload.size());
+	message.data            = record.payload.data();
+	return ring.push(message);
+}
+
+// the first message is the record, header and payload
+static void checkFront(cl::MessageRing& ring, const Record& record)
+{
+	CHECK(!ring.empty());
+	if (ring.empty())
+		return;
+
+	MessageView message = ring.front();
+	CHECK(message.playerIDAndTeam == static_cast<uint8_t>(record.type ^ 0x5A));
+	CHECK(message.key == 0x42);
+	CHECK(message.parameters == MSG_ALL);
+	CHECK(message.type == record.type);
+	CHECK(message.size == record.payload.size());
+	if (message.size == record.payload.size())
+		CHECK(std::equal(record.payload.begin(), record.payload.end(), message.data));
+}
+
+static void checkPop(cl::MessageRing& ring, const Record& record)
+{
+	checkFront(ring, record);
+	ring.pop();
+}
+
+// a record that does not fit before the end of the buffer starts over at its beginning
+static void testWrap()
+{
+	cl::MessageRing ring(64);
+
+	// 18 bytes left: WRAP_MARKER tells the consumer to skip them
+	CHECK(push(ring, makeRecord(1, 40)));
+	checkPop(ring, makeRecord(1, 40));
+	CHECK(push(ring, makeRecord(2, 20)));
+	CHECK(ring.size() == 18 + RECORD_HEADER_SIZE + 20);
+	checkPop(ring, makeRecord(2, 20));
+	CHECK(ring.empty());
+
+	// the head is at 26, 38 bytes to the end: fill to 4 bytes from it
+	CHECK(push(ring, makeRecord(3, 28)));
+	checkPop(ring, makeRecord(3, 28));
+
+	// 4 bytes left, too short for WRAP_MARKER: the consumer skips them by itself
+	CHECK(push(ring, makeRecord(4, 10)));
+	CHECK(ring.size() == 4 + RECORD_HEADER_SIZE + 10);
+	checkPop(ring, makeRecord(4, 10));
+
+	// exactly to the end of the buffer, nothing skipped
+	CHECK(push(ring, makeRecord(5, 64 - 16 - RECORD_HEADER_SIZE)));
+	CHECK(push(ring, makeRecord(6, 0)));
+	checkPop(ring, makeRecord(5, 64 - 16 - RECORD_HEADER_SIZE));
+	checkPop(ring, makeRecord(6, 0));
+	CHECK(ring.empty());
+	CHECK(ring.overflowCount() == 0);
+}
+
+// the skipped end of the buffer counts against the free space
+static void testFull()
+{
+	cl::MessageRing ring(64);
+
+	CHECK(push(ring, makeRecord(1, 40)));
+	CHECK(!push(ring, makeRecord(2, 20)));
+	CHECK(push(ring, makeRecord(3, 12)));
+	CHECK(ring.size() == 64);
+	CHECK(!push(ring, makeRecord(4, 0)));
+	CHECK(ring.overflowCount() == 2);
+
+	checkPop(ring, makeRecord(1, 40));
+	CHECK(push(ring, makeRecord(5, 20)));
+	checkPop(ring, makeRecord(3, 12));
+	checkPop(ring, makeRecord(5, 20));
+	CHECK(ring.empty());
+
+	// larger than a payload can be, it could be mistaken for WRAP_MARKER
+	cl::MessageRing large(4 * MAX_PAYLOAD_SIZE);
+	CHECK(!push(large, makeRecord(7, MAX_PAYLOAD_SIZE + 1)));
+	CHECK(push(large, makeRecord(8, MAX_PAYLOAD_SIZE)));
+	checkPop(large, makeRecord(8, MAX_PAYLOAD_SIZE));
+}
+
+// random sizes against a reference queue, wrapping many times
+static void testRandomSizes()
+{
+	std::mt19937       random(1234);
+	cl::MessageRing    ring(1024);
+	std::deque<Record> model;
+	uint8_t            type = 0;
+
+	for (int step = 0; step < 100000; step++)
+	{
+		if (random() % 2 == 0)
+		{
+			Record      record     = makeRecord(type++, random() % 200);
+			std::size_t recordSize = RECORD_HEADER_SIZE + record.payload.size();
+			if (push(ring, record))
+				model.push_back(record);
+			else // at most recordSize - 1 bytes are skipped at the end of the buffer
+				CHECK(ring.size() + 2 * recordSize - 1 > ring.capacity());
+		}
+		else if (!model.empty())
+		{
+			checkPop(ring, model.front());
+			model.pop_front();
+		}
+		else
+		{
+			CHECK(ring.empty());
+		}
+	}
+
+	while (!model.empty())
+	{
+		checkPop(ring, model.front());
+		model.pop_front();
+	}
+	CHECK(ring.empty());
+}
+
+int main()
+{
+	testWrap();
+	testFull();
+	testRandomSizes();
+
+	return TEST_RESULT();
+}
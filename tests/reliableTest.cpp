@@ -0,0 +1,344 @@
+#include "Check.hpp"
+
+#include <Reliable.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <random>
+#include <vector>
+
+// ReliableEndpoint: the acknowledgement history (a SACK of the 32
+// sequence numbers before the latest), duplicates, ordered delivery,
+// retransmissions with backoff, the window, and a lossy link across the
+// wrap of the sequence numbers.
+
+#define LOSS_RATE        20 //!< One datagram in LOSS_RATE is lost on the simulated link
+#define SEND_INTERVAL_MS 4  //!< Time between two messages of a channel on the simulated link
+
+using Clock = cl::ReliableEndpoint::Clock;
+
+static Clock::time_point at(long long milliseconds)
+{
+	return Clock::time_point() + std::chrono::milliseconds(milliseconds);
+}
+
+// a message whose payload is a counter, with its reliable header
+struct Datagram
+{
+	uint8_t     payload[RELIABLE_HEADER_SIZE + 4];
+	MessageView message;
+};
+
+static MessageView makeMessage(uint32_t counter, uint8_t* data)
+{
+	std::memcpy(data, &counter, sizeof(counter));
+
+	MessageView message;
+	message.playerIDAndTeam = 0x02;
+	message.parameters      = MSG_PRIVATE;
+	message.type            = MSG_TMCP1_READY;
+	message.size            = sizeof(counter);
+	message.data            = data;
+	return message;
+}
+
+static bool send(cl::ReliableEndpoint& endpoint, uint32_t counter, cl::Delivery delivery, Clock::time_point now, Datagram& datagram)
+{
+	uint8_t data[4];
+	return endpoint.send(makeMessage(counter, data), delivery, now, datagram.payload, datagram.message);
+}
+
+static uint32_t counterOf(const MessageView& message)
+{
+	MessageView stripped = cl::stripReliableHeader(message);
+	uint32_t    counter  = 0;
+	if (stripped.size == sizeof(counter))
+		std::memcpy(&counter, stripped.data, sizeof(counter));
+	return counter;
+}
+
+static uint32_t ackHistory(const uint8_t* ack)
+{
+	return static_cast<uint32_t>(ack[3]) << 24 | static_cast<uint32_t>(ack[4]) << 16 |
+	       static_cast<uint32_t>(ack[5]) << 8  | static_cast<uint32_t>(ack[6]);
+}
+
+// bit n of the history is latest - n - 1, and only the missing messages stay pending
+static void testAckHistory()
+{
+	cl::ReliableEndpoint sender;
+	cl::ReliableEndpoint receiver;
+	Datagram             datagrams[6];
+
+	for (uint32_t i = 0; i < 6; i++)
+		CHECK(send(sender, i, cl::Delivery::Reliable, at(0), datagrams[i]));
+	CHECK(sender.pendingCount() == 6);
+
+	for (uint32_t i : { 0u, 1u, 3u, 5u })
+		CHECK(receiver.receive(datagrams[i].message) == cl::ReliableStatus::Deliver);
+	CHECK(receiver.ackPending());
+
+	uint8_t     acks[RELIABLE_CHANNEL_COUNT * RELIABLE_ACK_SIZE];
+	std::size_t size = receiver.writeAcks(acks);
+	CHECK(size == RELIABLE_ACK_SIZE);
+	CHECK(!receiver.ackPending());
+	CHECK(acks[0] == 0);
+	CHECK((acks[1] << 8 | acks[2]) == 5);
+	CHECK(ackHistory(acks) == 0x1A); // 3, 1 and 0 received, 4 and 2 missing
+
+	sender.receiveAcks(acks, size, at(10));
+	CHECK(sender.pendingCount() == 2);
+	CHECK(sender.rtt().hasSample());
+
+	// the missing messages are sent again, then acknowledged by a later history
+	MessageView messages[8];
+	CHECK(sender.retransmit(at(10), messages, 8) == 0);
+	std::size_t count = sender.retransmit(sender.nextRetransmit(), messages, 8);
+	CHECK(count == 2);
+	CHECK(sender.retransmissionCount() == 2);
+	for (std::size_t i = 0; i < count; i++)
+	{
+		uint32_t counter = counterOf(messages[i]);
+		CHECK(counter == 2 || counter == 4);
+		CHECK(receiver.receive(messages[i]) == cl::ReliableStatus::Deliver);
+	}
+
+	size = receiver.writeAcks(acks);
+	CHECK(ackHistory(acks) == 0x1F);
+	sender.receiveAcks(acks, size, at(20));
+	CHECK(sender.pendingCount() == 0);
+	CHECK(sender.nextRetransmit() == Clock::time_point::max());
+}
+
+// a message received twice is acknowledged again but not delivered again
+static void testDuplicates()
+{
+	cl::ReliableEndpoint sender;
+	cl::ReliableEndpoint receiver;
+	Datagram             datagrams[RELIABLE_WINDOW_SIZE];
+
+	for (uint32_t i = 0; i < RELIABLE_WINDOW_SIZE; i++)
+		CHECK(send(sender, i, cl::Delivery::Reliable, at(0), datagrams[i]));
+
+	CHECK(receiver.receive(datagrams[0].message) == cl::ReliableStatus::Deliver);
+	uint8_t acks[RELIABLE_CHANNEL_COUNT * RELIABLE_ACK_SIZE];
+	receiver.writeAcks(acks);
+
+	CHECK(receiver.receive(datagrams[0].message) == cl::ReliableStatus::Duplicate);
+	CHECK(receiver.ackPending());
+
+	// newer first, then older ones still in the history
+	CHECK(receiver.receive(datagrams[31].message) == cl::ReliableStatus::Deliver);
+	CHECK(receiver.receive(datagrams[5].message) == cl::ReliableStatus::Deliver);
+	CHECK(receiver.receive(datagrams[5].message) == cl::ReliableStatus::Duplicate);
+	CHECK(receiver.receive(datagrams[31].message) == cl::ReliableStatus::Duplicate);
+
+	// 0 is now bit 30 of the history
+	CHECK(receiver.receive(datagrams[0].message) == cl::ReliableStatus::Duplicate);
+
+	// too short for a header, or on a channel that does not exist
+	MessageView malformed = datagrams[1].message;
+	malformed.size = RELIABLE_HEADER_SIZE - 1;
+	CHECK(receiver.receive(malformed) == cl::ReliableStatus::Malformed);
+	datagrams[1].payload[0] = RELIABLE_CHANNEL_COUNT;
+	CHECK(receiver.receive(datagrams[1].message) == cl::ReliableStatus::Malformed);
+}
+
+// messages arriving out of order are buffered until the ones before them arrive
+static void testOrdered()
+{
+	cl::ReliableEndpoint sender;
+	cl::ReliableEndpoint receiver;
+	Datagram             datagrams[5];
+
+	for (uint32_t i = 0; i < 5; i++)
+		CHECK(send(sender, i, cl::Delivery::ReliableOrdered, at(0), datagrams[i]));
+	CHECK(cl::reliableDelivery(datagrams[0].message) == cl::Delivery::ReliableOrdered);
+
+	MessageView message;
+	CHECK(receiver.receive(datagrams[2].message) == cl::ReliableStatus::Buffered);
+	CHECK(receiver.receive(datagrams[1].message) == cl::ReliableStatus::Buffered);
+	CHECK(receiver.receive(datagrams[1].message) == cl::ReliableStatus::Duplicate);
+	CHECK(receiver.receive(datagrams[4].message) == cl::ReliableStatus::Buffered);
+	CHECK(!receiver.nextOrdered(message));
+
+	CHECK(receiver.receive(datagrams[0].message) == cl::ReliableStatus::Deliver);
+	CHECK(receiver.nextOrdered(message) && counterOf(message) == 1);
+	CHECK(receiver.nextOrdered(message) && counterOf(message) == 2);
+	CHECK(!receiver.nextOrdered(message));
+
+	CHECK(receiver.receive(datagrams[0].message) == cl::ReliableStatus::Duplicate);
+	CHECK(receiver.receive(datagrams[3].message) == cl::ReliableStatus::Deliver);
+	CHECK(receiver.nextOrdered(message) && counterOf(message) == 4);
+	CHECK(!receiver.nextOrdered(message));
+}
+
+// the timeout doubles after each retry, and the peer is lost after RELIABLE_MAX_RETRIES
+static void testRetransmit()
+{
+	cl::ReliableEndpoint sender;
+	Datagram             datagram;
+	CHECK(send(sender, 7, cl::Delivery::Reliable, at(0), datagram));
+	CHECK(sender.nextRetransmit() == at(RELIABLE_INITIAL_TIMEOUT_MS));
+
+	MessageView       messages[2];
+	Clock::time_point previous = at(0);
+	for (unsigned int retry = 1; retry <= RELIABLE_MAX_RETRIES + 1; retry++)
+	{
+		Clock::time_point now = sender.nextRetransmit();
+		CHECK(now > previous);
+		CHECK(sender.retransmit(now - std::chrono::milliseconds(1), messages, 2) == 0);
+		CHECK(sender.retransmit(now, messages, 2) == 1);
+		CHECK(counterOf(messages[0]) == 7);
+		CHECK(sender.lost() == (retry > RELIABLE_MAX_RETRIES));
+
+		// doubled, up to RELIABLE_MAX_TIMEOUT_MS
+		std::chrono::milliseconds timeout = std::chrono::duration_cast<std::chrono::milliseconds>(sender.nextRetransmit() - now);
+		CHECK(timeout.count() == std::min<long long>(RELIABLE_INITIAL_TIMEOUT_MS << std::min(retry, 7u), RELIABLE_MAX_TIMEOUT_MS));
+		previous = now;
+	}
+
+	CHECK(sender.retransmissionCount() == RELIABLE_MAX_RETRIES + 1);
+
+	sender.reset();
+	CHECK(!sender.lost());
+	CHECK(sender.pendingCount() == 0);
+}
+
+// past RELIABLE_WINDOW_SIZE messages waiting for an acknowledgement, the next ones are queued
+static void testWindow()
+{
+	cl::ReliableEndpoint  sender;
+	cl::ReliableEndpoint  receiver;
+	std::vector<Datagram> datagrams(RELIABLE_WINDOW_SIZE + 8);
+
+	for (uint32_t i = 0; i < datagrams.size(); i++)
+		CHECK(send(sender, i, cl::Delivery::ReliableOrdered, at(0), datagrams[i]) == (i < RELIABLE_WINDOW_SIZE));
+	CHECK(sender.pendingCount() == datagrams.size());
+	CHECK(sender.queuedCount() == 8);
+
+	// nothing to retransmit yet and no room in the window
+	MessageView messages[RELIABLE_WINDOW_SIZE];
+	CHECK(sender.retransmit(at(1), messages, RELIABLE_WINDOW_SIZE) == 0);
+
+	for (uint32_t i = 0; i < RELIABLE_WINDOW_SIZE; i++)
+		CHECK(receiver.receive(datagrams[i].message) == cl::ReliableStatus::Deliver);
+
+	uint8_t acks[RELIABLE_CHANNEL_COUNT * RELIABLE_ACK_SIZE];
+	sender.receiveAcks(acks, receiver.writeAcks(acks), at(2));
+	CHECK(sender.pendingCount() == 8);
+
+	// the queued messages are numbered in order once there is room
+	std::size_t count = sender.retransmit(at(2), messages, RELIABLE_WINDOW_SIZE);
+	CHECK(count == 8);
+	CHECK(sender.queuedCount() == 0);
+	for (std::size_t i = 0; i < count; i++)
+	{
+		CHECK(counterOf(messages[i]) == RELIABLE_WINDOW_SIZE + i);
+		CHECK(receiver.receive(messages[i]) == cl::ReliableStatus::Deliver);
+	}
+}
+
+// both channels over a link losing messages and acknowledgements, past the wrap of the sequence numbers
+static void testLossyLink()
+{
+	std::mt19937         random(1234);
+	cl::ReliableEndpoint sender;
+	cl::ReliableEndpoint receiver;
+
+	const uint32_t    messageCount = 70000; // per channel, more than 65536 sequence numbers
+	uint32_t          sent[RELIABLE_CHANNEL_COUNT] = {};
+	uint32_t          nextOrdered  = 0;
+	std::vector<bool> delivered[RELIABLE_CHANNEL_COUNT];
+	uint64_t          duplicates   = 0;
+	for (std::vector<bool>& channel : delivered)
+		channel.assign(messageCount, false);
+
+	auto transmit = [&](const MessageView& message)
+	{
+		if (random() % LOSS_RATE == 0)
+			return;
+
+		uint32_t counter = counterOf(message);
+		uint8_t  channel = message.data[0];
+		switch (receiver.receive(message))
+		{
+		case cl::ReliableStatus::Deliver:
+			CHECK(!delivered[channel][counter]);
+			delivered[channel][counter] = true;
+			if (channel == 1)
+			{
+				CHECK(counter == nextOrdered);
+				nextOrdered++;
+
+				MessageView buffered;
+				while (receiver.nextOrdered(buffered))
+				{
+					CHECK(counterOf(buffered) == nextOrdered);
+					delivered[1][nextOrdered++] = true;
+				}
+			}
+			break;
+		case cl::ReliableStatus::Duplicate:
+			duplicates++;
+			break;
+		case cl::ReliableStatus::Buffered:
+			break;
+		default:
+			CHECK(false);
+		}
+	};
+
+	MessageView messages[2 * RELIABLE_WINDOW_SIZE];
+	long long   step = 0;
+	for (; step < 10000000 && (sent[0] < messageCount || sent[1] < messageCount || sender.pendingCount() > 0); step++)
+	{
+		Clock::time_point now = at(step);
+
+		for (uint8_t channel = 0; channel < RELIABLE_CHANNEL_COUNT; channel++)
+		{
+			if (step % SEND_INTERVAL_MS != 0 || sent[channel] >= messageCount)
+				continue;
+
+			Datagram     datagram;
+			cl::Delivery delivery = channel == 1 ? cl::Delivery::ReliableOrdered : cl::Delivery::Reliable;
+			if (send(sender, sent[channel]++, delivery, now, datagram))
+				transmit(datagram.message);
+		}
+
+		std::size_t count = sender.retransmit(now, messages, 2 * RELIABLE_WINDOW_SIZE);
+		for (std::size_t i = 0; i < count; i++)
+			transmit(messages[i]);
+
+		uint8_t     acks[RELIABLE_CHANNEL_COUNT * RELIABLE_ACK_SIZE];
+		std::size_t size = receiver.writeAcks(acks);
+		if (size > 0 && random() % LOSS_RATE != 0)
+			sender.receiveAcks(acks, size, now);
+
+		CHECK(!sender.lost());
+		if (sender.lost())
+			break;
+	}
+
+	CHECK(sender.pendingCount() == 0);
+	CHECK(nextOrdered == messageCount);
+	CHECK(duplicates > 0);
+	CHECK(sender.retransmissionCount() > 0);
+	for (const std::vector<bool>& channel : delivered)
+		for (uint32_t counter = 0; counter < messageCount; counter++)
+			CHECK(channel[counter]);
+}
+
+int main()
+{
+	testAckHistory();
+	testDuplicates();
+	testOrdered();
+	testRetransmit();
+	testWindow();
+	testLossyLink();
+
+	return TEST_RESULT();
+}
@@ -0,0 +1,186 @@
+#include "Check.hpp"
+
+#include <RingBuffer.hpp>
+
+#include <cstdint>
+#include <thread>
+#include <vector>
+
+// SpscRing and MpscRing: capacity rounding, wrap-around of the indices,
+// a full ring dropping and counting elements, and MpscRing with
+// concurrent producers.
+
+#define PRODUCERS           4
+#define VALUES_PER_PRODUCER 100000
+
+static void testCapacity()
+{
+	CHECK(cl::ringCapacity(0) == 2);
+	CHECK(cl::ringCapacity(2) == 2);
+	CHECK(cl::ringCapacity(3) == 4);
+	CHECK(cl::ringCapacity(64) == 64);
+	CHECK(cl::ringCapacity(65) == 128);
+
+	cl::SpscRing<int> spsc(5);
+	cl::MpscRing<int> mpsc(5);
+	CHECK(spsc.capacity() == 8);
+	CHECK(mpsc.capacity() == 8);
+}
+
+// push and pop past the end of the buffer many times, in bursts of every size
+template <typename Ring>
+static void testWrap()
+{
+	Ring ring(8);
+	int  next     = 0;
+	int  expected = 0;
+
+	for (int lap = 0; lap < 100; lap++)
+	{
+		std::size_t burst = 1 + lap % ring.capacity();
+		for (std::size_t i = 0; i < burst; i++)
+			CHECK(ring.push(next++));
+		CHECK(ring.size() == burst);
+
+		for (std::size_t i = 0; i < burst; i++)
+		{
+			CHECK(!ring.empty());
+			CHECK(ring.front() == expected++);
+			ring.pop();
+		}
+		CHECK(ring.empty());
+	}
+
+	int value = -1;
+	CHECK(!ring.tryPop(value));
+	CHECK(value == -1);
+	CHECK(ring.overflowCount() == 0);
+}
+
+// a full ring drops the new elements, keeps the old ones and takes more once read
+template <typename Ring>
+static void testFull()
+{
+	Ring ring(4);
+
+	// start past the end of the buffer so the full ring straddles it
+	int value;
+	for (int i = 0; i < 3; i++)
+	{
+		ring.push(-1);
+		ring.tryPop(value);
+	}
+
+	for (int i = 0; i < 4; i++)
+		CHECK(ring.push(i));
+	CHECK(ring.size() == 4);
+
+	CHECK(!ring.push(100));
+	CHECK(!ring.push(101));
+	CHECK(ring.overflowCount() == 2);
+	CHECK(ring.size() == 4);
+
+	CHECK(ring.tryPop(value) && value == 0);
+	CHECK(ring.push(4));
+	CHECK(!ring.push(102));
+	CHECK(ring.overflowCount() == 3);
+
+	for (int i = 1; i <= 4; i++)
+		CHECK(ring.tryPop(value) && value == i);
+	CHECK(ring.empty());
+	CHECK(ring.size() == 0);
+}
+
+// every producer's values arrive once and in the order it pushed them
+static void testConcurrentProducers()
+{
+	cl::MpscRing<uint32_t> ring(64);
+
+	std::vector<std::thread> producers;
+	for (uint32_t producer = 0; producer < PRODUCERS; producer++)
+	{
+		producers.emplace_back([&ring, producer]()
+		{
+			for (uint32_t i = 0; i < VALUES_PER_PRODUCER; i++)
+			{
+				// a full ring is not an error here, retry until the consumer catches up
+				while (!ring.push(producer << 24 | i))
+					std::this_thread::yield();
+			}
+		});
+	}
+
+	std::vector<uint32_t> nextValues(PRODUCERS, 0);
+	uint32_t              received = 0;
+	while (received < PRODUCERS * VALUES_PER_PRODUCER)
+	{
+		uint32_t value;
+		if (!ring.tryPop(value))
+		{
+			std::this_thread::yield();
+			continue;
+		}
+
+		received++;
+
+		uint32_t producer = value >> 24;
+		CHECK(producer < PRODUCERS);
+		if (producer >= PRODUCERS)
+			continue;
+
+		CHECK((value & 0xFFFFFF) == nextValues[producer]);
+		nextValues[producer] = (value & 0xFFFFFF) + 1;
+	}
+
+	for (std::thread& producer : producers)
+		producer.join();
+
+	CHECK(ring.empty());
+	for (uint32_t producer = 0; producer < PRODUCERS; producer++)
+		CHECK(nextValues[producer] == VALUES_PER_PRODUCER);
+}
+
+// same with one producer and one consumer thread
+static void testConcurrentSpsc()
+{
+	cl::SpscRing<uint32_t> ring(64);
+
+	std::thread producer([&ring]()
+	{
+		for (uint32_t i = 0; i < PRODUCERS * VALUES_PER_PRODUCER; i++)
+		{
+			while (!ring.push(i))
+				std::this_thread::yield();
+		}
+	});
+
+	uint32_t expected = 0;
+	while (expected < PRODUCERS * VALUES_PER_PRODUCER)
+	{
+		uint32_t value;
+		if (!ring.tryPop(value))
+		{
+			std::this_thread::yield();
+			continue;
+		}
+
+		CHECK(value == expected);
+		expected = value + 1;
+	}
+
+	producer.join();
+	CHECK(expected == PRODUCERS * VALUES_PER_PRODUCER);
+}
+
+int main()
+{
+	testCapacity();
+	testWrap<cl::SpscRing<int>>();
+	testWrap<cl::MpscRing<int>>();
+	testFull<cl::SpscRing<int>>();
+	testFull<cl::MpscRing<int>>();
+	testConcurrentProducers();
+	testConcurrentSpsc();
+
+	return TEST_RESULT();
+}
@@ -0,0 +1,301 @@
+#include "Check.hpp"
+
+#include <Client.hpp>
+#include <Log.hpp>
+#include <RoomHost.hpp>
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <thread>
+#include <vector>
+
+// Rooms of a RoomHost are isolated servers: clients with the same ids
+// in two rooms only see the traffic of their own room, with their own
+// key. A room can be closed while its clients are sending, and a
+// request for a room that does not exist is answered.
+
+#define ROOM_TEST_PORT    43350
+#define ROOM_TEST_WORKERS 2
+#define ROOM_TEST_TYPE    0x25
+
+#define ROOM_TEST_FIRST   1  // ids of the rooms
+#define ROOM_TEST_SECOND  2
+#define ROOM_TEST_UNKNOWN 99
+
+using Clock = std::chrono::steady_clock;
+
+// a client of the fixed format, announcing no capability so it needs no update
+struct FakeClient
+{
+	uint8_t  idAndTeam = 0;
+	uint32_t room      = 0;
+	uint8_t  key       = DEFAULT_KEY;
+	int      socket    = -1;
+};
+
+static bool connect(FakeClient& client)
+{
+	client.socket = ::socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+
+	timeval timeout = { 0, 50000 };
+	setsockopt(client.socket, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+
+	sockaddr_in address;
+	std::memset(&address, 0, sizeof(address));
+	address.sin_family      = AF_INET;
+	address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	address.sin_port        = htons(ROOM_TEST_PORT);
+	if (::connect(client.socket, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0)
+		return false;
+
+	Message request;
+	request.playerIDAndTeam = client.idAndTeam;
+	request.parameters      = MSG_ALL | MSG_CONNECT_ROOM;
+	request.type            = MSG_CONNECT;
+	request.data[0]         = static_cast<uint8_t>(client.room >> 24);
+	request.data[1]         = static_cast<uint8_t>(client.room >> 16);
+	request.data[2]         = static_cast<uint8_t>(client.room >> 8);
+	request.data[3]         = static_cast<uint8_t>(client.room);
+
+	// the host binds its socket once its thread started, until then the requests are refused
+	Clock::time_point deadline = Clock::now() + std::chrono::seconds(5);
+	while (Clock::now() < deadline)
+	{
+		send(client.socket, &request, sizeof(request), 0);
+
+		Message answer;
+		while (recv(client.socket, &answer, sizeof(answer), 0) == sizeof(answer))
+		{
+			if (answer.type == MSG_CONNECT && answer.playerIDAndTeam == client.idAndTeam)
+			{
+				client.key = answer.key;
+				return true;
+			}
+		}
+	}
+
+	return false;
+}
+
+static bool sendTagged(const FakeClient& client, uint8_t tag, uint32_t sequence)
+{
+	Message message;
+	message.playerIDAndTeam = client.idAndTeam;
+	message.key             = client.key;
+	message.parameters      = MSG_ALL;
+	message.type            = ROOM_TEST_TYPE;
+	message.data[0]         = tag;
+	std::memcpy(message.data + 1, &sequence, sizeof(sequence));
+
+	return send(client.socket, &message, sizeof(message), 0) == sizeof(message);
+}
+
+static bool sendTagged(cl::Client& client, uint8_t tag)
+{
+	Message message;
+	message.parameters = MSG_ALL;
+	message.type       = ROOM_TEST_TYPE;
+	message.data[0]    = tag;
+
+	return client.sendMessage(&message);
+}
+
+// tags of the messages of the test read by a fake client, all carrying its key
+static std::vector<uint8_t> receiveTags(const FakeClient& client, bool& keyed)
+{
+	std::vector<uint8_t> tags;
+
+	Message message;
+	while (recv(client.socket, &message, sizeof(message), 0) == sizeof(message))
+	{
+		if (message.type != ROOM_TEST_TYPE)
+			continue;
+
+		keyed = keyed && message.key == client.key;
+		tags.push_back(message.data[0]);
+	}
+
+	return tags;
+}
+
+// updates the clients for a while, the tags read by the first one are returned
+static std::vector<uint8_t> receiveTags(cl::Client& client, cl::Client& other, unsigned int milliseconds)
+{
+	std::vector<uint8_t> tags;
+
+	Clock::time_point end = Clock::now() + std::chrono::milliseconds(milliseconds);
+	while (Clock::now() < end)
+	{
+		client.update(0.01f);
+		other.update(0.01f);
+
+		MessageView message;
+		while (client.getMessage(message))
+		{
+			if (message.type == ROOM_TEST_TYPE && message.size > 0)
+				tags.push_back(message.data[0]);
+		}
+
+		std::this_thread::sleep_for(std::chrono::milliseconds(10));
+	}
+
+	return tags;
+}
+
+// the messages are sent to their sender too: both tags of a room and no other
+static bool only(const std::vector<uint8_t>& tags, uint8_t tag, uint8_t otherTag)
+{
+	bool found      = false;
+	bool otherFound = false;
+	for (uint8_t received : tags)
+	{
+		if (received != tag && received != otherTag)
+			return false;
+
+		found      = found      || received == tag;
+		otherFound = otherFound || received == otherTag;
+	}
+
+	return found && otherFound;
+}
+
+static bool connect(cl::Client& first, cl::Client& second)
+{
+	Clock::time_point deadline = Clock::now() + std::chrono::seconds(5);
+	while (Clock::now() < deadline)
+	{
+		first.update(0.01f);
+		second.update(0.01f);
+		if (first.isConnected() && second.isConnected())
+			return true;
+
+		std::this_thread::sleep_for(std::chrono::milliseconds(10));
+	}
+
+	return false;
+}
+
+int main()
+{
+	cl::Logger::setLevel(cl::LogLevel::Error);
+
+	cl::RoomHost host(ROOM_TEST_PORT, ROOM_TEST_WORKERS);
+	CHECK(host.isRunning());
+	CHECK(host.openRoom(ROOM_TEST_FIRST)  != nullptr);
+	CHECK(host.openRoom(ROOM_TEST_SECOND) != nullptr);
+
+	// a room that does not exist is refused once, the client stops asking
+	cl::Client lost(ROOM_TEST_PORT, 1, false, false, sizeof(Message), cl::Transport::Udp, "", ROOM_TEST_UNKNOWN);
+	Clock::time_point deadline = Clock::now() + std::chrono::seconds(5);
+	while (lost.lastError() != MSG_ERR_NO_ROOM && Clock::now() < deadline)
+	{
+		lost.update(0.01f);
+		std::this_thread::sleep_for(std::chrono::milliseconds(10));
+	}
+	CHECK(lost.lastError() == MSG_ERR_NO_ROOM);
+	CHECK(!lost.isConnected());
+
+	uint64_t received = host.stats().datagramsReceived;
+	for (int i = 0; i < CONNECT_RETRY_INTERVAL_MS / 10 * 3; i++)
+	{
+		lost.update(0.01f);
+		std::this_thread::sleep_for(std::chrono::milliseconds(10));
+	}
+	CHECK(host.stats().datagramsReceived == received);
+
+	// the same ids in both rooms
+	cl::Client first(ROOM_TEST_PORT, 1, false, false, sizeof(Message), cl::Transport::Udp, "", ROOM_TEST_FIRST);
+	cl::Client second(ROOM_TEST_PORT, 1, false, false, sizeof(Message), cl::Transport::Udp, "", ROOM_TEST_SECOND);
+	CHECK(connect(first, second));
+
+	FakeClient firstFake;
+	firstFake.idAndTeam = 2 << 1;
+	firstFake.room      = ROOM_TEST_FIRST;
+	CHECK(connect(firstFake));
+
+	FakeClient secondFake;
+	secondFake.idAndTeam = 2 << 1;
+	secondFake.room      = ROOM_TEST_SECOND;
+	CHECK(connect(secondFake));
+
+	CHECK(host.room(ROOM_TEST_FIRST)->stats().clients.size()  == 2);
+	CHECK(host.room(ROOM_TEST_SECOND)->stats().clients.size() == 2);
+
+	// each room relays the messages of its own clients only, with the key of the recipient
+	CHECK(sendTagged(first, 'A'));
+	CHECK(sendTagged(second, 'B'));
+	CHECK(sendTagged(firstFake, 'a', 0));
+	CHECK(sendTagged(secondFake, 'b', 0));
+
+	CHECK(only(receiveTags(first, second, 300), 'A', 'a'));
+	CHECK(only(receiveTags(second, first, 300), 'B', 'b'));
+
+	bool keyed = true;
+	CHECK(only(receiveTags(firstFake, keyed), 'A', 'a'));
+	CHECK(only(receiveTags(secondFake, keyed), 'B', 'b'));
+	CHECK(keyed);
+
+	// the second room is closed while its fake client is sending
+	std::atomic<bool>     sending(true);
+	std::atomic<uint32_t> sent(0);
+	std::thread sender([&]()
+	{
+		while (sending.load())
+		{
+			uint32_t sequence = sent.load();
+			sendTagged(secondFake, 'b', sequence);
+			sent.store(sequence + 1);
+			std::this_thread::sleep_for(std::chrono::microseconds(200));
+		}
+	});
+
+	std::vector<uint8_t> tags = receiveTags(second, first, 100);
+	CHECK(!tags.empty());
+
+	CHECK(host.closeRoom(ROOM_TEST_SECOND));
+	uint32_t closed = sent.load() + 1; // the sequence of a datagram being sent may not be stored yet
+	CHECK(host.room(ROOM_TEST_SECOND) == nullptr);
+	CHECK(!host.closeRoom(ROOM_TEST_SECOND));
+
+	std::this_thread::sleep_for(std::chrono::milliseconds(100));
+	sending.store(false);
+	sender.join();
+	CHECK(sent.load() > closed);
+
+	// nothing is relayed once the room is closed
+	bool late = false;
+	Clock::time_point end = Clock::now() + std::chrono::milliseconds(200);
+	while (Clock::now() < end)
+	{
+		second.update(0.01f);
+
+		MessageView message;
+		while (second.getMessage(message))
+		{
+			uint32_t sequence;
+			std::memcpy(&sequence, message.data + 1, sizeof(sequence));
+			late = late || (message.type == ROOM_TEST_TYPE && sequence >= closed);
+		}
+
+		std::this_thread::sleep_for(std::chrono::milliseconds(10));
+	}
+	CHECK(!late);
+
+	// the other room is still running
+	CHECK(host.isRunning());
+	CHECK(sendTagged(firstFake, 'a', 0));
+	CHECK(only(receiveTags(first, second, 200), 'a', 'a'));
+
+	close(firstFake.socket);
+	close(secondFake.socket);
+	host.stop();
+	cl::Logger::flush();
+
+	return TEST_RESULT();
+}
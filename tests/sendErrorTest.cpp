@@ -0,0 +1,79 @@
+#include "Check.hpp"
+
+#include <Client.hpp>
+#include <Log.hpp>
+#include <Server.hpp>
+
+#include <dlfcn.h>
+
+#include <atomic>
+#include <chrono>
+#include <thread>
+
+// A socket with no room for a datagram (EAGAIN, ENOBUFS) loses it, but
+// the clients are fine and must stay connected. sendmmsg() is replaced
+// by one failing every SEND_ERROR_TEST_PERIOD calls.
+
+#define SEND_ERROR_TEST_PORT     43310
+#define SEND_ERROR_TEST_PERIOD   3
+#define SEND_ERROR_TEST_MESSAGES 100
+#define SEND_ERROR_TEST_TYPE     0x22
+
+static std::atomic<unsigned int> sendCalls(0);
+static std::atomic<unsigned int> failedCalls(0);
+
+extern "C" int sendmmsg(int socket, mmsghdr* headers, unsigned int count, int flags)
+{
+	using SendFunction = int (*)(int, mmsghdr*, unsigned int, int);
+	static SendFunction realSend = reinterpret_cast<SendFunction>(dlsym(RTLD_NEXT, "sendmmsg"));
+
+	unsigned int call = ++sendCalls;
+	if (call % SEND_ERROR_TEST_PERIOD == 0)
+	{
+		failedCalls++;
+		errno = call % 2 ? EAGAIN : ENOBUFS;
+		return -1;
+	}
+
+	return realSend(socket, headers, count, flags);
+}
+
+static void update(cl::Client& orange, cl::Client& blue)
+{
+	orange.update(0.01f);
+	blue.update(0.01f);
+	std::this_thread::sleep_for(std::chrono::milliseconds(5));
+}
+
+int main()
+{
+	cl::Logger::setLevel(cl::LogLevel::Error);
+
+	cl::Server server(SEND_ERROR_TEST_PORT, 0);
+	cl::Client orange(SEND_ERROR_TEST_PORT, 1, false);
+	cl::Client blue(SEND_ERROR_TEST_PORT, 2, true);
+
+	for (int i = 0; i < 1000 && server.stats().clients.size() < 2; i++)
+		update(orange, blue);
+	CHECK(server.stats().clients.size() == 2);
+
+	for (int i = 0; i < SEND_ERROR_TEST_MESSAGES; i++)
+	{
+		Message message;
+		message.parameters = MSG_ALL;
+		message.type       = SEND_ERROR_TEST_TYPE;
+		server.broadcast(message);
+
+		update(orange, blue);
+	}
+
+	cl::ServerStats stats = server.stats();
+	CHECK(failedCalls.load() > 0);
+	CHECK(stats.sendErrors > 0);
+	CHECK(stats.clients.size() == 2);
+
+	server.stop();
+	cl::Logger::flush();
+
+	return TEST_RESULT();
+}
@@ -0,0 +1,94 @@
+#include "Check.hpp"
+
+#include <Client.hpp>
+#include <Log.hpp>
+#include <Server.hpp>
+
+#include <chrono>
+#include <thread>
+
+// The server loop sleeps until it has something to do: with no tick
+// rate, an idle server must not wake up, and a message of the
+// application must still be sent at once.
+
+#define LOOP_TEST_PORT    43300
+#define LOOP_TEST_IDLE_MS 500
+#define LOOP_TEST_TYPE    0x21
+
+using Clock = std::chrono::steady_clock;
+
+static uint64_t waitCalls(const cl::Server& server)
+{
+	return server.stats().waitCalls;
+}
+
+static bool connect(cl::Server& server, cl::Client& client)
+{
+	Clock::time_point deadline = Clock::now() + std::chrono::seconds(5);
+	while (Clock::now() < deadline)
+	{
+		client.update(0.01f);
+		if (server.stats().clients.size() == 1)
+			return true;
+
+		std::this_thread::sleep_for(std::chrono::milliseconds(10));
+	}
+
+	return false;
+}
+
+// keeps the client alive without sending anything else
+static void idle(cl::Client& client, unsigned int milliseconds)
+{
+	Clock::time_point end = Clock::now() + std::chrono::milliseconds(milliseconds);
+	while (Clock::now() < end)
+	{
+		client.update(0.05f);
+		std::this_thread::sleep_for(std::chrono::milliseconds(50));
+	}
+}
+
+int main()
+{
+	cl::Logger::setLevel(cl::LogLevel::Error);
+
+	cl::Server server(LOOP_TEST_PORT, 0);
+	CHECK(server.isRunning());
+
+	// no client, no timer: the thread only waits once
+	std::this_thread::sleep_for(std::chrono::milliseconds(100));
+	uint64_t before = waitCalls(server);
+	std::this_thread::sleep_for(std::chrono::milliseconds(LOOP_TEST_IDLE_MS));
+	CHECK(waitCalls(server) - before <= 2);
+
+	cl::Client client(LOOP_TEST_PORT, 1, false);
+	CHECK(connect(server, client));
+
+	// a connected client only wakes the server up with its heartbeats and pongs
+	before = waitCalls(server);
+	idle(client, LOOP_TEST_IDLE_MS);
+	CHECK(waitCalls(server) - before <= 20);
+
+	// a message of the application is sent without waiting for a tick
+	Message message;
+	message.parameters = MSG_ALL;
+	message.type       = LOOP_TEST_TYPE;
+	CHECK(server.broadcast(message));
+
+	bool received = false;
+	Clock::time_point deadline = Clock::now() + std::chrono::seconds(1);
+	while (!received && Clock::now() < deadline)
+	{
+		client.update(0.01f);
+
+		Message incoming;
+		while (client.getMessage(incoming))
+			received = received || incoming.type == LOOP_TEST_TYPE;
+	}
+	CHECK(received);
+
+	server.stop();
+	cl::Logger::flush();
+
+	return TEST_RESULT();
+}
@@ -24,6 +24,10 @@ int main()
 			{
 				commsServer.pingClients();
 			}
+			else if (input == "stats")
+			{
+				std::cout << cl::formatPrometheus(commsServer.stats()) << std::endl;
+			}
 			else if (input == "dcall")
 			{
 				
@@ -34,6 +38,7 @@ int main()
 					      << "\tstop       stops the server.\n"
 					      << "\tclients    shows a list of connected clients.\n"
 						  << "\tping       pings all clients\n"
+						  << "\tstats      shows the traffic counters\n"
 						  << "\tdcall      disconnects all clients\n"
 						  << "\thelp       shows this help message\n"
 						  << std::endl;
@@ -45,6 +50,7 @@ int main()
 					      << "\tstop       stops the server.\n"
 					      << "\tclients    shows a list of connected clients.\n"
 						  << "\tping       pings all clients\n"
+						  << "\tstats      shows the traffic counters\n"
 						  << "\tdcall      disconnects all clients\n"
 						  << "\thelp       shows this help message\n"
 						  << std::endl;
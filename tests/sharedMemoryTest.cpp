@@ -0,0 +1,249 @@
+#include "Check.hpp"
+
+#include <Client.hpp>
+#include <Log.hpp>
+#include <Server.hpp>
+#include <SharedMemory.hpp>
+
+#include <chrono>
+#include <cstring>
+#include <thread>
+#include <vector>
+
+// Clients of the shared-memory transport connect and have their
+// messages relayed like over UDP, drop the messages that don't carry
+// their key, and see the end of the connection once the server stops.
+
+#define SHM_TEST_PORT      43360
+#define SHM_TEST_FAKE_PORT 43361 // listened to by the test itself
+#define SHM_TEST_TYPE      0x27
+#define SHM_TEST_KEY       0x5A
+
+using Clock = std::chrono::steady_clock;
+
+// the clients fall back to UDP if the server does not listen yet
+static bool waitForListener(uint16_t port)
+{
+	Clock::time_point deadline = Clock::now() + std::chrono::seconds(5);
+	while (Clock::now() < deadline)
+	{
+		cl::ShmChannel probe;
+		if (probe.connect(port))
+			return true;
+
+		std::this_thread::sleep_for(std::chrono::milliseconds(10));
+	}
+
+	return false;
+}
+
+static bool usesSharedMemory(const cl::Server& server, uint8_t idAndTeam)
+{
+	for (const cl::ClientStats& client : server.stats().clients)
+	{
+		if (client.idAndTeam == idAndTeam)
+			return client.address == SHM_CLIENT_ADDRESS;
+	}
+
+	return false;
+}
+
+static bool connect(cl::Client& first, cl::Client& second)
+{
+	Clock::time_point deadline = Clock::now() + std::chrono::seconds(5);
+	while (Clock::now() < deadline)
+	{
+		first.update(0.01f);
+		second.update(0.01f);
+		if (first.isConnected() && second.isConnected())
+			return true;
+
+		std::this_thread::sleep_for(std::chrono::milliseconds(10));
+	}
+
+	return false;
+}
+
+static bool sendTagged(cl::Client& client, uint8_t tag)
+{
+	Message message;
+	message.parameters = MSG_ALL;
+	message.type       = SHM_TEST_TYPE;
+	message.data[0]    = tag;
+
+	return client.sendMessage(&message);
+}
+
+// updates the clients for a while, the tags read by the first one are returned
+static std::vector<uint8_t> receiveTags(cl::Client& client, cl::Client* other, unsigned int milliseconds)
+{
+	std::vector<uint8_t> tags;
+
+	Clock::time_point end = Clock::now() + std::chrono::milliseconds(milliseconds);
+	while (Clock::now() < end)
+	{
+		client.update(0.01f);
+		if (other != nullptr)
+			other->update(0.01f);
+
+		MessageView message;
+		while (client.getMessage(message))
+		{
+			if (message.type == SHM_TEST_TYPE && message.size > 0)
+				tags.push_back(message.data[0]);
+		}
+
+		std::this_thread::sleep_for(std::chrono::milliseconds(10));
+	}
+
+	return tags;
+}
+
+static bool contains(const std::vector<uint8_t>& tags, uint8_t tag)
+{
+	for (uint8_t received : tags)
+	{
+		if (received == tag)
+			return true;
+	}
+
+	return false;
+}
+
+static void testRelay()
+{
+	cl::Server server(SHM_TEST_PORT, 0, DEFAULT_MAX_DATAGRAM_SIZE, cl::Transport::SharedMemory);
+	CHECK(server.isRunning());
+	CHECK(waitForListener(SHM_TEST_PORT));
+
+	cl::Client first(SHM_TEST_PORT, 1, false, false, sizeof(Message), cl::Transport::SharedMemory);
+	cl::Client second(SHM_TEST_PORT, 2, true, false, sizeof(Message), cl::Transport::SharedMemory);
+	CHECK(connect(first, second));
+	CHECK(usesSharedMemory(server, 1 << 1));
+	CHECK(usesSharedMemory(server, 2 << 1 | 1));
+
+	// in both directions, and to the application of the server
+	CHECK(sendTagged(first, 'f'));
+	CHECK(contains(receiveTags(second, &first, 200), 'f'));
+	CHECK(sendTagged(second, 's'));
+	CHECK(contains(receiveTags(first, &second, 200), 's'));
+
+	bool polled = false;
+	Message messages[16];
+	std::size_t count;
+	while ((count = server.poll(messages, 16)) > 0)
+	{
+		for (std::size_t i = 0; i < count; i++)
+			polled = polled || (messages[i].type == SHM_TEST_TYPE && messages[i].data[0] == 'f');
+	}
+	CHECK(polled);
+
+	Message message;
+	message.parameters = MSG_ALL;
+	message.type       = SHM_TEST_TYPE;
+	message.data[0]    = 'S';
+	CHECK(server.broadcast(message));
+	CHECK(contains(receiveTags(first, &second, 200), 'S'));
+
+	// the channel is closed by the server, the clients are told at once
+	server.stop();
+	first.update(0.01f);
+	second.update(0.01f);
+	CHECK(!first.isConnected());
+	CHECK(!second.isConnected());
+}
+
+// the test plays the server, to send a message with the wrong key
+static void testKeys()
+{
+	cl::ShmListener listener;
+	CHECK(listener.open(SHM_TEST_FAKE_PORT));
+
+	cl::ShmChannel channel;
+	std::thread accepter([&]()
+	{
+		Clock::time_point deadline = Clock::now() + std::chrono::seconds(5);
+		while (Clock::now() < deadline)
+		{
+			int connection = listener.accept();
+			if (connection >= 0)
+			{
+				channel.create(connection, listener.doorbell());
+				return;
+			}
+
+			std::this_thread::sleep_for(std::chrono::milliseconds(1));
+		}
+	});
+
+	cl::Client client(SHM_TEST_FAKE_PORT, 3, false, false, sizeof(Message), cl::Transport::SharedMemory);
+	accepter.join();
+	CHECK(channel.isOpen());
+
+	// the connection request was sent by the constructor
+	Message request;
+	bool    requested = false;
+	Clock::time_point deadline = Clock::now() + std::chrono::seconds(1);
+	while (!requested && Clock::now() < deadline)
+	{
+		std::size_t    size;
+		const uint8_t* datagram = channel.receive(size);
+		if (datagram == nullptr)
+			continue;
+
+		if (size == sizeof(Message))
+		{
+			std::memcpy(&request, datagram, sizeof(Message));
+			requested = request.type == MSG_CONNECT;
+		}
+		channel.release();
+	}
+	CHECK(requested);
+
+	Message answer;
+	answer.playerIDAndTeam = request.playerIDAndTeam;
+	answer.key             = SHM_TEST_KEY;
+	answer.parameters      = MSG_PRIVATE;
+	answer.type            = MSG_CONNECT;
+	answer.data[0]         = request.playerIDAndTeam;
+	CHECK(channel.send(&answer, sizeof(answer)));
+
+	Clock::time_point end = Clock::now() + std::chrono::seconds(1);
+	while (!client.isConnected() && Clock::now() < end)
+	{
+		client.update(0.01f);
+		std::this_thread::sleep_for(std::chrono::milliseconds(1));
+	}
+	CHECK(client.isConnected());
+
+	Message message;
+	message.playerIDAndTeam = 4 << 1;
+	message.key             = SHM_TEST_KEY ^ 0x01;
+	message.parameters      = MSG_ALL;
+	message.type            = SHM_TEST_TYPE;
+	message.data[0]         = 'x';
+	CHECK(channel.send(&message, sizeof(message)));
+
+	message.key     = SHM_TEST_KEY;
+	message.data[0] = 'k';
+	CHECK(channel.send(&message, sizeof(message)));
+
+	std::vector<uint8_t> tags = receiveTags(client, nullptr, 100);
+	CHECK(tags.size() == 1 && tags[0] == 'k');
+
+	channel.markClosed();
+	channel.close();
+	listener.close();
+}
+
+int main()
+{
+	cl::Logger::setLevel(cl::LogLevel::Error);
+
+	testRelay();
+	testKeys();
+
+	cl::Logger::flush();
+
+	return TEST_RESULT();
+}
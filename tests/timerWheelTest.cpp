@@ -0,0 +1,187 @@
+#include "Check.hpp"
+
+#include <TimerWheel.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <map>
+#include <random>
+#include <vector>
+
+// TimerWheel: timers expiring on time from every wheel, cascading from
+// the coarser wheels to the first one, rescheduling and cancelling, and
+// nextExpiry() never later than the next deadline.
+
+#define TIMER_WHEEL_RANGE (uint64_t(1) << (TIMER_WHEEL_SLOT_BITS * TIMER_WHEEL_LEVELS)) //!< Ticks covered by the wheels
+
+using Clock = cl::TimerWheel::Clock;
+
+static const Clock::time_point start = Clock::time_point() + std::chrono::hours(1);
+
+static Clock::time_point at(uint64_t milliseconds)
+{
+	return start + std::chrono::milliseconds(milliseconds);
+}
+
+static std::vector<std::size_t> advance(cl::TimerWheel& wheel, Clock::time_point now)
+{
+	std::vector<std::size_t> expired(wheel.capacity());
+	expired.resize(wheel.advance(now, expired.data(), expired.size()));
+	std::sort(expired.begin(), expired.end());
+	return expired;
+}
+
+// a timer in each wheel, at the edges of its slots and beyond the last wheel
+static void testCascade()
+{
+	const uint64_t deadlines[] = {
+		0, 1, 63, 64, 65, 127, 4095, 4096, 4097, 4160, 262143, 262144, 262145, 300000,
+		TIMER_WHEEL_RANGE - 1, TIMER_WHEEL_RANGE, TIMER_WHEEL_RANGE + 4097, 3 * TIMER_WHEEL_RANGE + 5
+	};
+	const std::size_t count = sizeof(deadlines) / sizeof(deadlines[0]);
+
+	cl::TimerWheel wheel(count, std::chrono::milliseconds(1), start);
+	for (std::size_t timer = 0; timer < count; timer++)
+	{
+		wheel.schedule(timer, at(deadlines[timer]));
+		CHECK(wheel.scheduled(timer));
+		CHECK(wheel.deadline(timer) == at(deadlines[timer]));
+	}
+
+	// each timer expires at its deadline, not one tick before
+	for (std::size_t timer = 0; timer < count; timer++)
+	{
+		if (deadlines[timer] > 0)
+			CHECK(advance(wheel, at(deadlines[timer] - 1)).empty());
+
+		CHECK(wheel.nextExpiry() <= at(deadlines[timer]));
+		CHECK(advance(wheel, at(deadlines[timer])) == std::vector<std::size_t>{ timer });
+		CHECK(!wheel.scheduled(timer));
+	}
+
+	CHECK(wheel.nextExpiry() == Clock::time_point::max());
+}
+
+// many timers in the same slot of a coarse wheel are spread over the finer ones
+static void testCascadeSlot()
+{
+	cl::TimerWheel wheel(64, std::chrono::milliseconds(1), start);
+	for (std::size_t timer = 0; timer < 64; timer++)
+		wheel.schedule(timer, at(262144 + timer * 64 + timer % 3));
+
+	for (std::size_t timer = 0; timer < 64; timer++)
+	{
+		uint64_t deadline = 262144 + timer * 64 + timer % 3;
+		CHECK(advance(wheel, at(deadline - 1)).empty());
+		CHECK(advance(wheel, at(deadline)) == std::vector<std::size_t>{ timer });
+	}
+}
+
+static void testRescheduleAndCancel()
+{
+	cl::TimerWheel wheel(4, std::chrono::milliseconds(10), start);
+	CHECK(wheel.nextExpiry() == Clock::time_point::max());
+
+	// rounded up to the resolution, never early
+	wheel.schedule(0, at(15));
+	CHECK(wheel.nextExpiry() == at(20));
+	CHECK(advance(wheel, at(19)).empty());
+
+	// moved later from the first wheel to the second one, then back
+	wheel.schedule(0, at(5000));
+	CHECK(advance(wheel, at(100)).empty());
+	wheel.schedule(0, at(150));
+	CHECK(wheel.nextExpiry() == at(150));
+	wheel.schedule(1, at(120));
+	wheel.cancel(1);
+	wheel.cancel(1);
+	wheel.cancel(2);
+	CHECK(!wheel.scheduled(1));
+	CHECK(advance(wheel, at(150)) == std::vector<std::size_t>{ 0 });
+
+	// in the past: expires with the next call to advance()
+	wheel.schedule(3, at(0));
+	CHECK(wheel.nextExpiry() <= at(150));
+	CHECK(advance(wheel, at(151)) == std::vector<std::size_t>{ 3 });
+
+	// no more than asked for at once
+	for (std::size_t timer = 0; timer < 4; timer++)
+		wheel.schedule(timer, at(200));
+	std::size_t expired[2];
+	CHECK(wheel.advance(at(200), expired, 2) == 2);
+	CHECK(wheel.advance(at(200), expired, 2) == 2);
+	CHECK(wheel.advance(at(200), expired, 2) == 0);
+}
+
+// random operations against a reference map, with deadlines in every wheel
+static void testRandomOperations()
+{
+	std::mt19937   random(1234);
+	cl::TimerWheel wheel(256, std::chrono::milliseconds(1), start);
+
+	std::map<std::size_t, uint64_t> model; // timer and deadline
+	uint64_t                        now = 0;
+
+	for (int step = 0; step < 200000; step++)
+	{
+		std::size_t  timer     = random() % wheel.capacity();
+		unsigned int operation = random() % 8;
+
+		if (operation < 4)
+		{
+			static const uint64_t ranges[] = { 64, 4096, 262144, 2 * TIMER_WHEEL_RANGE };
+			uint64_t deadline = now + random() % ranges[random() % 4];
+			wheel.schedule(timer, at(deadline));
+			model[timer] = deadline;
+		}
+		else if (operation < 5)
+		{
+			wheel.cancel(timer);
+			model.erase(timer);
+		}
+		else
+		{
+			// the next expiry is never after the next deadline
+			Clock::time_point next = wheel.nextExpiry();
+			uint64_t          first = UINT64_MAX;
+			for (const auto& entry : model)
+				first = std::min(first, entry.second);
+			CHECK(model.empty() ? next == Clock::time_point::max() : next <= at(std::max(first, now)));
+
+			// jump to the next expiry or a bit further
+			if (next != Clock::time_point::max() && random() % 2 == 0)
+				now = std::max<uint64_t>(now, std::chrono::duration_cast<std::chrono::milliseconds>(next - start).count());
+			else
+				now += random() % 5000;
+
+			std::vector<std::size_t> expected;
+			for (auto entry = model.begin(); entry != model.end();)
+			{
+				if (entry->second <= now)
+				{
+					expected.push_back(entry->first);
+					entry = model.erase(entry);
+				}
+				else
+				{
+					entry++;
+				}
+			}
+
+			CHECK(advance(wheel, at(now)) == expected);
+		}
+
+		CHECK(wheel.scheduled(timer) == (model.count(timer) > 0));
+	}
+}
+
+int main()
+{
+	testCascade();
+	testCascadeSlot();
+	testRescheduleAndCancel();
+	testRandomOperations();
+
+	return TEST_RESULT();
+}
@@ -0,0 +1,169 @@
+#include "Check.hpp"
+
+#include <Client.hpp>
+#include <Log.hpp>
+#include <Server.hpp>
+#include <UnixSocket.hpp>
+
+#include <unistd.h>
+
+#include <chrono>
+#include <memory>
+#include <string>
+#include <thread>
+
+// Clients of the Unix datagram transport connect to an abstract
+// endpoint like over UDP, the slots of the endpoints that went away are
+// given to new ones, and a client connects again to a restarted server.
+
+#define UNIX_TEST_PORT 43370
+#define UNIX_TEST_TYPE 0x29
+
+using Clock = std::chrono::steady_clock;
+
+// the clients fall back to UDP if the server is not bound yet
+static bool waitForEndpoint(const std::string& path)
+{
+	sockaddr_un address;
+	socklen_t   addressSize = cl::unixAddress(path, address);
+
+	Clock::time_point deadline = Clock::now() + std::chrono::seconds(5);
+	while (Clock::now() < deadline)
+	{
+		SOCKET probe  = ::socket(AF_UNIX, SOCK_DGRAM, 0);
+		int    result = ::connect(probe, reinterpret_cast<sockaddr*>(&address), addressSize);
+		closesocket(probe);
+		if (result == 0)
+			return true;
+
+		std::this_thread::sleep_for(std::chrono::milliseconds(10));
+	}
+
+	return false;
+}
+
+static bool usesUnixSocket(const cl::Server& server, uint8_t idAndTeam)
+{
+	for (const cl::ClientStats& client : server.stats().clients)
+	{
+		if (client.idAndTeam == idAndTeam)
+			return client.address == UNIX_CLIENT_ADDRESS;
+	}
+
+	return false;
+}
+
+static bool waitConnected(const cl::Server& server, cl::Client& client, uint8_t idAndTeam)
+{
+	Clock::time_point deadline = Clock::now() + std::chrono::seconds(5);
+	while (Clock::now() < deadline)
+	{
+		client.update(0.001f);
+		if (client.isConnected() && usesUnixSocket(server, idAndTeam))
+			return true;
+
+		std::this_thread::sleep_for(std::chrono::milliseconds(1));
+	}
+
+	return false;
+}
+
+static void testHandshake(const std::string& path)
+{
+	cl::Server server(UNIX_TEST_PORT, 0, DEFAULT_MAX_DATAGRAM_SIZE, cl::Transport::UnixDatagram, path);
+	CHECK(server.isRunning());
+	CHECK(waitForEndpoint(path));
+
+	cl::Client client(UNIX_TEST_PORT, 1, false, false, sizeof(Message), cl::Transport::UnixDatagram, path);
+	CHECK(waitConnected(server, client, 1 << 1));
+
+	// the client is answered on its own endpoint
+	Message message;
+	message.parameters = MSG_ALL;
+	message.type       = UNIX_TEST_TYPE;
+	message.data[0]    = 'u';
+	CHECK(client.sendMessage(&message));
+
+	bool received = false;
+	Clock::time_point deadline = Clock::now() + std::chrono::seconds(1);
+	while (!received && Clock::now() < deadline)
+	{
+		client.update(0.001f);
+
+		Message incoming;
+		while (client.getMessage(incoming))
+			received = received || (incoming.type == UNIX_TEST_TYPE && incoming.data[0] == 'u');
+	}
+	CHECK(received);
+
+	server.stop();
+}
+
+// every slot is used once, the next endpoint needs the slot of one that closed
+static void testSlotReuse(const std::string& path)
+{
+	cl::Server server(UNIX_TEST_PORT, 0, DEFAULT_MAX_DATAGRAM_SIZE, cl::Transport::UnixDatagram, path);
+	CHECK(waitForEndpoint(path));
+
+	unsigned int connected = 0;
+	for (unsigned int id = 0; id <= MAX_CLIENTS; id++)
+	{
+		uint8_t idAndTeam = static_cast<uint8_t>(id << 1);
+
+		{
+			cl::Client client(UNIX_TEST_PORT, id, false, false, sizeof(Message), cl::Transport::UnixDatagram, path);
+			if (waitConnected(server, client, idAndTeam))
+				connected++;
+		}
+
+		// the client tells the server it closes
+		Clock::time_point deadline = Clock::now() + std::chrono::seconds(1);
+		while (!server.stats().clients.empty() && Clock::now() < deadline)
+			std::this_thread::sleep_for(std::chrono::milliseconds(1));
+	}
+	CHECK(connected == MAX_CLIENTS + 1);
+	CHECK(server.stats().clients.empty());
+
+	server.stop();
+}
+
+static void testRestart(const std::string& path)
+{
+	std::unique_ptr<cl::Server> server(new cl::Server(UNIX_TEST_PORT, 0, DEFAULT_MAX_DATAGRAM_SIZE, cl::Transport::UnixDatagram, path));
+	CHECK(waitForEndpoint(path));
+
+	cl::Client client(UNIX_TEST_PORT, 2, true, false, sizeof(Message), cl::Transport::UnixDatagram, path);
+	CHECK(waitConnected(*server, client, 2 << 1 | 1));
+
+	// the client notices the server is gone when it sends its next heartbeat
+	server.reset();
+	Clock::time_point deadline = Clock::now() + std::chrono::milliseconds(HEARTBEAT_INTERVAL_MS * 3);
+	while (client.isConnected() && Clock::now() < deadline)
+	{
+		client.update(0.001f);
+		std::this_thread::sleep_for(std::chrono::milliseconds(1));
+	}
+	CHECK(!client.isConnected());
+
+	server.reset(new cl::Server(UNIX_TEST_PORT, 0, DEFAULT_MAX_DATAGRAM_SIZE, cl::Transport::UnixDatagram, path));
+	CHECK(waitForEndpoint(path));
+	CHECK(waitConnected(*server, client, 2 << 1 | 1));
+
+	server->stop();
+}
+
+int main()
+{
+	cl::Logger::setLevel(cl::LogLevel::Error);
+
+	// abstract endpoints leave no file behind, the pid keeps parallel runs apart
+	std::string path = "@commslib.test." + std::to_string(getpid());
+
+	testHandshake(path);
+	testSlotReuse(path);
+	testRestart(path);
+
+	cl::Logger::flush();
+
+	return TEST_RESULT();
+}